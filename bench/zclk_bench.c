@@ -0,0 +1,2556 @@
+/**
+ * Copyright (c) 2020 Abhishek Mishra
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Benchmarks for the zclk parser.
+ *
+ * argv scaling: parses command lines of 1K to 1M tokens made of long,
+ * short, --opt=value and flag options and reports the time per token.
+ * The time per token should stay flat as the command line grows.
+ *
+ * option lookup: looks up every option of commands with 10 to 1000
+ * options by name, using zclk_command_get_option (hashed) and a linear
+ * strcmp scan of the options list (the previous implementation).
+ *
+ * frozen dispatch: parses the same command lines against a 600 command
+ * tree (40 groups of 15 commands), before and after zclk_command_freeze,
+ * and reports the time and the allocations per parse. The frozen tree
+ * copies the initial values and binds the options from the block, without
+ * going through the option lists of the commands.
+ *
+ * tree allocations: builds and frees a tree of 1000 commands with 3
+ * options and an argument each, on the heap and in a zclk_arena, and
+ * reports the number of malloc/calloc/realloc calls (counted when built
+ * against glibc) and the time taken. The allocations left in the arena
+ * tree are those of the option, argument and sub-command lists.
+ *
+ * threaded parse: N threads parse valid and invalid command lines of one
+ * shared (frozen) tree at the same time, each with its own zclk_parse_ctx,
+ * and check that every parsed value and error message is the one expected
+ * for the thread's own command line.
+ *
+ * number parsing: parses a million ints and doubles with zclk_parse_int
+ * and zclk_parse_double and with sscanf, and checks the doubles are the
+ * same as those returned by strtod.
+ *
+ * table output: writes a 200k row table to /dev/null with one printf call
+ * per cell (the previous renderer) and with write_table_result through a
+ * FILE and an fd zclk_writer, and reports the time taken.
+ *
+ * table storage: builds a 1M row, 5 column table in the previous row-major
+ * layout (a string allocated per cell), in zclk_table with string columns,
+ * and with int columns for the numbers, and reports the allocations, the
+ * heap in use (glibc) and the time taken.
+ *
+ * table streaming: writes a 1M row table into a pipe, materialized in a
+ * zclk_table and pushed through a zclk_table_stream, and reports the
+ * time until the reader gets the first byte, the total time, the
+ * allocations and how much the peak RSS grew. Each path runs in a child
+ * process, whose peak RSS is reset first where the OS allows it (Linux).
+ *
+ * parallel table output: writes a 1M row, 5 column table (5M cells) to
+ * /dev/null with write_table_result and with write_table_result_parallel
+ * on 1 to 16 threads, after checking the outputs are the same, and
+ * reports the time taken and the number of online CPUs. Thread counts
+ * above it are marked, as they cannot scale.
+ *
+ * structured output: writes a 200k row table to /dev/null in each
+ * --output format, and escapes 64 MB of JSON strings with
+ * zclk_json_write_string and one byte at a time, reporting the MB/s.
+ *
+ * dict: puts, gets, replaces, iterates and removes 10, 1k and 1M keys in
+ * a zclk_dict (1M operations in all for each size), and reports the ns
+ * per operation, along with a strcmp scan of the entries for the smaller
+ * sizes.
+ *
+ * progress redraw: makes 200k updates to 64 progress lines, drawn by
+ * reprinting every line on each update (the previous renderer), by
+ * redrawing the changed lines, and by redrawing them at most 30 times a
+ * second, and reports the frames and bytes written and the time taken.
+ *
+ * progress threads: 16 threads make 500k updates each to their own
+ * progress line, bumping the counter and drawing under a shared lock (as
+ * handlers had to), and bumping the atomic counter while a render thread
+ * draws, and reports the time taken and checks no update is lost.
+ *
+ * progress bar: draws a 40 cell bar on stdout (sent to /dev/null) 200k
+ * times, with a printf per cell (the previous show_progress), with the
+ * line composed in one buffer, and with the rate and ETA added, and
+ * reports the ns per draw.
+ *
+ * help: renders the help of a command with 20 options and 10, 120 and
+ * 1000 sub-commands with strcat into a fixed buffer (the previous
+ * renderer, given a buffer big enough), into a growable buffer, and from
+ * the cached help of the command, and reports the us per help.
+ *
+ * completion: completes partial command lines on a tree with 1000
+ * sub-commands (live and frozen), as the hidden __complete mode does on
+ * each Tab press, and reports the us per completion and the number of
+ * candidates.
+ *
+ * lazy tree: starts a CLI with 100, 1k and 10k sub-commands (3 options
+ * and an argument each) and runs one of them, building every command up
+ * front or registering them as lazy sub-commands which are filled in when
+ * reached, and reports the us and allocations per start.
+ *
+ * tree cache: cold starts of a CLI with 100, 1k and 10k sub-commands
+ * defined by a script, building the tree on every start, or hashing the
+ * script and mapping the tree from a cache file written by an earlier
+ * run, then running one command (dispatched on the mapped block). Reports
+ * the us per start and the size of the cache file.
+ *
+ * argument file: runs a command with 10k to 1M file names given in argv,
+ * in an @file with one name per line, and in a NUL delimited file given
+ * with --args-from, and reports the ns and the allocations per name. The
+ * files are mapped and split in place, so the allocations should not
+ * grow with the number of names.
+ *
+ * parser suite (zclk_bench suite): builds a synthetic tree of the given
+ * depth and fan-out with the given number of options per command, and
+ * parses command lines of increasing length which invoke the deepest,
+ * last command. Reports ns/parse and allocs/parse for make_zclk_argv,
+ * get_command_to_exec, parse_options (including the value table) and
+ * parse_args, each measured on its own, and for a full exec_command,
+ * along with the peak RSS of the process. The output can be text, csv
+ * or json, to track regressions across builds.
+ *
+ * usage: zclk_bench [max_tokens] [threads]
+ *        zclk_bench suite [--depth N] [--fanout N] [--options N]
+ *                         [--max-tokens N] [--iterations N]
+ *                         [--format text|csv|json]
+ */
+
+#include <zclk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#ifdef __GLIBC__
+/* count allocations by interposing the glibc allocator entry points */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static size_t alloc_count = 0;
+
+void *malloc(size_t size)
+{
+    alloc_count++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    alloc_count++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    alloc_count++;
+    return __libc_realloc(ptr, size);
+}
+#define ALLOC_COUNT() (alloc_count)
+#else
+#define ALLOC_COUNT() ((size_t)0)
+#endif
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#define HEAP_IN_USE() ((size_t)(mallinfo2().uordblks + mallinfo2().hblkhd))
+#else
+#define HEAP_IN_USE() ((size_t)0)
+#endif
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static zclk_res noop_handler(zclk_command* cmd, void* handler_args)
+{
+    return ZCLK_RES_SUCCESS;
+}
+
+static void bench_argv_scaling(int max_tokens)
+{
+    zclk_command *cmd = new_zclk_command("bench", "b",
+                            "Parser benchmark", &noop_handler);
+    zclk_command_int_option(cmd, "count", "c", 0, "An int option");
+    zclk_command_string_option(cmd, "name", "n", "", "A string option");
+    zclk_command_flag_option(cmd, "verbose", "v", "A flag option");
+
+    arraylist *commands;
+    arraylist_new(&commands, NULL);
+    arraylist_add(commands, cmd);
+
+    char **argv = (char **)calloc((size_t)max_tokens + 1, sizeof(char *));
+    if (argv == NULL)
+    {
+        fprintf(stderr, "allocation failed\n");
+        exit(1);
+    }
+
+    /* token pattern: --count 7 -n x --name=y -v */
+    static char *pattern[] = { "--count", "7", "-n", "x", "--name=y", "-v" };
+    argv[0] = "bench";
+    for (int i = 1; i < max_tokens; i++)
+    {
+        argv[i] = pattern[(i - 1) % 6];
+    }
+
+    printf("%-12s %14s %12s\n", "tokens", "total_ms", "ns/token");
+    for (int n = 1000; n <= max_tokens; n *= 10)
+    {
+        /* end on a complete option/value pair */
+        int argc = n - ((n - 1) % 6);
+
+        double start = now_ns();
+        zclk_res res = exec_command(commands, NULL, argc, argv);
+        double elapsed = now_ns() - start;
+
+        if (res != ZCLK_RES_SUCCESS)
+        {
+            fprintf(stderr, "parse failed with error %d\n", res);
+            exit(1);
+        }
+        printf("%-12d %14.3f %12.1f\n", argc, elapsed / 1e6,
+            elapsed / argc);
+    }
+
+    free(argv);
+    arraylist_free(commands);
+    free_command(cmd);
+}
+
+/* the lookup used before commands had an option index */
+static zclk_option *linear_get_option(zclk_command *cmd, const char *name)
+{
+    size_t opt_len = arraylist_length(cmd->options);
+    for (size_t i = 0; i < opt_len; i++)
+    {
+        zclk_option *x = arraylist_get(cmd->options, i);
+        if ((x->name != NULL && strcmp(x->name, name) == 0)
+            || (x->short_name != NULL && strcmp(x->short_name, name) == 0))
+        {
+            return x;
+        }
+    }
+    return NULL;
+}
+
+static void bench_option_lookup(void)
+{
+    static const int option_counts[] = { 10, 150, 1000 };
+    const int lookups = 1000000;
+
+    printf("%-12s %16s %16s %10s\n", "options", "hashed_ns/op",
+        "linear_ns/op", "speedup");
+    for (size_t c = 0; c < sizeof(option_counts) / sizeof(int); c++)
+    {
+        int num_options = option_counts[c];
+        zclk_command *cmd = new_zclk_command("bench", "b",
+                                "Option lookup benchmark", &noop_handler);
+        char **names = (char **)calloc((size_t)num_options, sizeof(char *));
+        for (int i = 0; i < num_options; i++)
+        {
+            char name[32], short_name[32];
+            snprintf(name, sizeof(name), "option-number-%d", i);
+            snprintf(short_name, sizeof(short_name), "o%d", i);
+            zclk_command_int_option(cmd, name, short_name, i, "An option");
+            names[i] = zclk_str_clone(name);
+        }
+
+        size_t found = 0;
+        double start = now_ns();
+        for (int i = 0; i < lookups; i++)
+        {
+            found += (zclk_command_get_option(cmd,
+                        names[i % num_options]) != NULL);
+        }
+        double hashed = (now_ns() - start) / lookups;
+
+        start = now_ns();
+        for (int i = 0; i < lookups; i++)
+        {
+            found += (linear_get_option(cmd, names[i % num_options]) != NULL);
+        }
+        double linear = (now_ns() - start) / lookups;
+
+        if (found != 2 * (size_t)lookups)
+        {
+            fprintf(stderr, "lookup failed\n");
+            exit(1);
+        }
+        printf("%-12d %16.1f %16.1f %9.1fx\n", num_options, hashed, linear,
+            linear / hashed);
+
+        for (int i = 0; i < num_options; i++)
+        {
+            free(names[i]);
+        }
+        free(names);
+        free_command(cmd);
+    }
+}
+
+static zclk_command *make_admin_tree(void)
+{
+    zclk_command *root = new_zclk_command("admin", "a",
+                            "Admin CLI", &noop_handler);
+    for (int g = 0; g < 40; g++)
+    {
+        char name[32], short_name[32];
+        snprintf(name, sizeof(name), "group-%d", g);
+        snprintf(short_name, sizeof(short_name), "g%d", g);
+        zclk_command *group = new_zclk_command(name, short_name,
+                                "A group", &noop_handler);
+        for (int c = 0; c < 15; c++)
+        {
+            snprintf(name, sizeof(name), "command-%d", c);
+            snprintf(short_name, sizeof(short_name), "c%d", c);
+            zclk_command *leaf = new_zclk_command(name, short_name,
+                                    "A command", &noop_handler);
+            for (int o = 0; o < 10; o++)
+            {
+                snprintf(name, sizeof(name), "option-%d", o);
+                snprintf(short_name, sizeof(short_name), "o%d", o);
+                zclk_command_string_option(leaf, name, short_name, "",
+                    "An option");
+            }
+            zclk_command_subcommand_add(group, leaf);
+        }
+        zclk_command_subcommand_add(root, group);
+    }
+    return root;
+}
+
+static double time_dispatch(zclk_command *root, int iterations,
+    double *allocs_per_parse)
+{
+    arraylist *commands;
+    arraylist_new(&commands, NULL);
+    arraylist_add(commands, root);
+
+    char *argv[] = { "admin", "group-37", "command-12", "--option-3", "x",
+                     "-o7", "y", "--option-9=z" };
+    int argc = sizeof(argv) / sizeof(char *);
+
+    size_t allocs = ALLOC_COUNT();
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        if (exec_command(commands, NULL, argc, argv) != ZCLK_RES_SUCCESS)
+        {
+            fprintf(stderr, "dispatch failed\n");
+            exit(1);
+        }
+    }
+    double elapsed = (now_ns() - start) / iterations;
+    *allocs_per_parse = (double)(ALLOC_COUNT() - allocs) / iterations;
+    arraylist_free(commands);
+    return elapsed;
+}
+
+static void bench_frozen_dispatch(void)
+{
+    const int iterations = 200000;
+    zclk_command *live = make_admin_tree();
+    zclk_command *frozen = make_admin_tree();
+    zclk_command_freeze(frozen);
+
+    double live_ns, frozen_ns, live_allocs, frozen_allocs;
+    live_ns = time_dispatch(live, iterations, &live_allocs);
+    frozen_ns = time_dispatch(frozen, iterations, &frozen_allocs);
+
+    printf("%-12s %12s %14s\n", "tree", "ns/parse", "allocs/parse");
+    printf("%-12s %12.1f %14.1f\n", "live", live_ns, live_allocs);
+    printf("%-12s %12.1f %14.1f\n", "frozen", frozen_ns, frozen_allocs);
+    printf("%-12s %12zu\n", "frozen_bytes", frozen->frozen->size);
+    free_command(live);
+    free_command(frozen);
+}
+
+static zclk_command *make_wide_tree(zclk_arena *arena, int num_commands)
+{
+    zclk_command *root = new_zclk_command_in(arena, "wide", "w",
+                            "Wide CLI", &noop_handler);
+    for (int c = 0; c < num_commands; c++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "command-%d", c);
+        zclk_command *cmd = new_zclk_command_in(arena, name, NULL,
+                                "A command", &noop_handler);
+        zclk_command_int_option(cmd, "count", "c", 1, "An int option");
+        zclk_command_string_option(cmd, "name", "n", "x", "A string option");
+        zclk_command_flag_option(cmd, "verbose", "v", "A flag option");
+        zclk_command_string_argument(cmd, "file", "", "An argument", 1);
+        zclk_command_subcommand_add(root, cmd);
+    }
+    return root;
+}
+
+static void bench_tree_allocations(void)
+{
+    const int num_commands = 1000;
+
+    printf("%-12s %12s %12s %12s %12s\n", "tree", "build_allocs",
+        "build_us", "free_us", "arena_kb");
+
+    size_t allocs = ALLOC_COUNT();
+    double start = now_ns();
+    zclk_command *root = make_wide_tree(NULL, num_commands);
+    double built = now_ns();
+    allocs = ALLOC_COUNT() - allocs;
+    free_command(root);
+    double freed = now_ns();
+    printf("%-12s %12zu %12.1f %12.1f %12s\n", "heap", allocs,
+        (built - start) / 1e3, (freed - built) / 1e3, "-");
+
+    zclk_arena *arena;
+    allocs = ALLOC_COUNT();
+    start = now_ns();
+    create_zclk_arena(&arena, 0);
+    root = make_wide_tree(arena, num_commands);
+    built = now_ns();
+    allocs = ALLOC_COUNT() - allocs;
+    size_t arena_kb = arena->bytes_used / 1024;
+    free_zclk_arena(arena);
+    freed = now_ns();
+    printf("%-12s %12zu %12.1f %12.1f %12zu\n", "arena", allocs,
+        (built - start) / 1e3, (freed - built) / 1e3, arena_kb);
+}
+
+typedef struct parse_thread_t
+{
+    zclk_command *root;
+    int id;
+    int iterations;
+    int failures;
+} parse_thread;
+
+static void *parse_thread_fn(void *data)
+{
+    parse_thread *t = (parse_thread *)data;
+
+    /* the tree is shared, values go to each parse's own result */
+    zclk_parse_ctx *ctx;
+    make_zclk_parse_ctx(&ctx);
+
+    arraylist *commands;
+    arraylist_new(&commands, NULL);
+    arraylist_add(commands, t->root);
+
+    char count[16], bogus[32], expected[64];
+    snprintf(count, sizeof(count), "%d", t->id);
+    snprintf(bogus, sizeof(bogus), "--bogus-%d", t->id);
+    snprintf(expected, sizeof(expected), "Unknown option %s.", bogus);
+    char *valid[] = { "wide", "command-3", "--count", count, "-v", "f" };
+    char *invalid[] = { "wide", "command-5", bogus, "f" };
+
+    for (int i = 0; i < t->iterations; i++)
+    {
+        zclk_parse_result *result;
+        if (zclk_command_parse_ctx(ctx, t->root, 6, valid, &result)
+                != ZCLK_RES_SUCCESS
+            || zclk_val_get_int(zclk_parse_result_get_option_by_name(
+                    result, "count")) != t->id)
+        {
+            t->failures++;
+        }
+        free_zclk_parse_result(result);
+        if (exec_command_ctx(ctx, commands, NULL, 4, invalid)
+                != ZCLK_RES_ERR_OPTION_NOT_FOUND
+            || zclk_parse_ctx_get_error(ctx) != ZCLK_RES_ERR_OPTION_NOT_FOUND
+            || strcmp(zclk_parse_ctx_get_error_message(ctx), expected) != 0)
+        {
+            t->failures++;
+        }
+    }
+
+    arraylist_free(commands);
+    free_zclk_parse_ctx(ctx);
+    return NULL;
+}
+
+static void bench_threaded_parse(int num_threads)
+{
+    const int iterations = 20000;
+    pthread_t *threads = (pthread_t *)calloc((size_t)num_threads,
+                                sizeof(pthread_t));
+    parse_thread *data = (parse_thread *)calloc((size_t)num_threads,
+                                sizeof(parse_thread));
+    zclk_arena *arena;
+    create_zclk_arena(&arena, 0);
+    zclk_command *root = make_wide_tree(arena, 20);
+    zclk_command_freeze(root);
+
+    double start = now_ns();
+    for (int i = 0; i < num_threads; i++)
+    {
+        data[i].root = root;
+        data[i].id = i;
+        data[i].iterations = iterations;
+        pthread_create(&threads[i], NULL, &parse_thread_fn, &data[i]);
+    }
+    int failures = 0;
+    for (int i = 0; i < num_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+        failures += data[i].failures;
+    }
+    double elapsed = now_ns() - start;
+    free_zclk_arena(arena);
+
+    printf("%-12s %12s %12s\n", "threads", "parses/s", "failures");
+    printf("%-12d %12.0f %12d\n", num_threads,
+        2.0 * iterations * num_threads / (elapsed / 1e9), failures);
+    free(threads);
+    free(data);
+    if (failures > 0)
+    {
+        exit(1);
+    }
+}
+
+static uint64_t bench_rand(void)
+{
+    static uint64_t state = 88172645463325252ULL;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static void bench_number_parsing(void)
+{
+    const int count = 1000000;
+    char (*ints)[24] = calloc((size_t)count, sizeof(*ints));
+    char (*dbls)[32] = calloc((size_t)count, sizeof(*dbls));
+    for (int i = 0; i < count; i++)
+    {
+        int v = (int)(bench_rand() % 2000001) - 1000000;
+        snprintf(ints[i], sizeof(ints[i]), "%d", v);
+        double d = (double)(bench_rand() % 100000000) / 1000.0;
+        switch (i % 3)
+        {
+        case 0:
+            snprintf(dbls[i], sizeof(dbls[i]), "%.17g", d * 1e-3);
+            break;
+        case 1:
+            snprintf(dbls[i], sizeof(dbls[i]), "%.3f", d);
+            break;
+        default:
+            snprintf(dbls[i], sizeof(dbls[i]), "%.6e", d * 1e20);
+            break;
+        }
+    }
+
+    long long isum = 0;
+    double start = now_ns();
+    for (int i = 0; i < count; i++)
+    {
+        int v = 0;
+        zclk_parse_int(ints[i], &v);
+        isum += v;
+    }
+    double zclk_int = (now_ns() - start) / count;
+
+    start = now_ns();
+    for (int i = 0; i < count; i++)
+    {
+        int v = 0;
+        sscanf(ints[i], "%d", &v);
+        isum -= v;
+    }
+    double sscanf_int = (now_ns() - start) / count;
+
+    double dsum = 0;
+    start = now_ns();
+    for (int i = 0; i < count; i++)
+    {
+        double d = 0;
+        zclk_parse_double(dbls[i], &d);
+        dsum += d;
+    }
+    double zclk_dbl = (now_ns() - start) / count;
+
+    start = now_ns();
+    for (int i = 0; i < count; i++)
+    {
+        double d = 0;
+        sscanf(dbls[i], "%lf", &d);
+        dsum -= d;
+    }
+    double sscanf_dbl = (now_ns() - start) / count;
+
+    int mismatches = (isum != 0);
+    for (int i = 0; i < count; i++)
+    {
+        double d = 0;
+        zclk_parse_double(dbls[i], &d);
+        mismatches += (d != strtod(dbls[i], NULL));
+    }
+
+    printf("%-12s %12s %12s %10s\n", "type", "zclk_ns/op", "sscanf_ns/op",
+        "speedup");
+    printf("%-12s %12.1f %12.1f %9.1fx\n", "int", zclk_int, sscanf_int,
+        sscanf_int / zclk_int);
+    printf("%-12s %12.1f %12.1f %9.1fx\n", "double", zclk_dbl, sscanf_dbl,
+        sscanf_dbl / zclk_dbl);
+    printf("%-12s %12d\n", "mismatches", mismatches);
+
+    free(ints);
+    free(dbls);
+    if (mismatches > 0)
+    {
+        exit(1);
+    }
+}
+
+/* the renderer used before zclk_writer, one printf call per cell */
+static void printf_table(FILE *out, zclk_table *tbl)
+{
+    size_t *col_widths = (size_t *)calloc(tbl->num_cols, sizeof(size_t));
+    char (*col_fmtspec)[16] = calloc(tbl->num_cols, sizeof(*col_fmtspec));
+    for (size_t i = 0; i < tbl->num_cols; i++)
+    {
+        size_t col_width = strlen(tbl->header[i]);
+        for (size_t j = 0; j < tbl->num_rows; j++)
+        {
+            char *value;
+            zclk_table_get_row_val(&value, tbl, j, i);
+            if (value != NULL && strlen(value) > col_width)
+            {
+                col_width = strlen(value);
+            }
+        }
+        col_width = col_width < 4 ? 4 : (col_width > 25 ? 25 : col_width);
+        snprintf(col_fmtspec[i], sizeof(col_fmtspec[i]), "%%-%zu.%zus",
+            col_width + 1, col_width);
+        col_widths[i] = col_width;
+    }
+    fprintf(out, "\n");
+    for (size_t i = 0; i < tbl->num_cols; i++)
+    {
+        fprintf(out, col_fmtspec[i], tbl->header[i]);
+    }
+    fprintf(out, "\n");
+    for (size_t i = 0; i < tbl->num_cols; i++)
+    {
+        for (size_t j = 0; j < col_widths[i] + 1; j++)
+        {
+            fprintf(out, "-");
+        }
+    }
+    fprintf(out, "\n");
+    for (size_t i = 0; i < tbl->num_rows; i++)
+    {
+        for (size_t j = 0; j < tbl->num_cols; j++)
+        {
+            char *value;
+            zclk_table_get_row_val(&value, tbl, i, j);
+            fprintf(out, col_fmtspec[j], value == NULL ? "" : value);
+        }
+        fprintf(out, "\n");
+    }
+    fprintf(out, "\n");
+    free(col_widths);
+    free(col_fmtspec);
+}
+
+static zclk_table *make_bench_table(size_t num_rows)
+{
+    static char *headers[] = { "id", "name", "status", "size", "updated" };
+    zclk_table *tbl;
+    create_zclk_table(&tbl, num_rows, 5);
+    for (size_t c = 0; c < 5; c++)
+    {
+        zclk_table_set_header(tbl, c, headers[c]);
+    }
+    for (size_t r = 0; r < num_rows; r++)
+    {
+        char cell[64];
+        snprintf(cell, sizeof(cell), "%zu", r);
+        zclk_table_set_row_val(tbl, r, 0, cell);
+        snprintf(cell, sizeof(cell), "object-%zu.tar.gz", r * 7919);
+        zclk_table_set_row_val(tbl, r, 1, cell);
+        zclk_table_set_row_val(tbl, r, 2, r % 3 ? "ok" : "pending");
+        snprintf(cell, sizeof(cell), "%zu", (r * 2654435761u) % 100000);
+        zclk_table_set_row_val(tbl, r, 3, cell);
+        zclk_table_set_row_val(tbl, r, 4, "2020-01-01T00:00:00Z");
+    }
+    return tbl;
+}
+
+static void bench_table_output(void)
+{
+#ifndef _WIN32
+    const size_t num_rows = 200000;
+    zclk_table *tbl = make_bench_table(num_rows);
+    FILE *null_file = fopen("/dev/null", "w");
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_file == NULL || null_fd < 0)
+    {
+        fprintf(stderr, "cannot open /dev/null\n");
+        exit(1);
+    }
+
+    double start = now_ns();
+    printf_table(null_file, tbl);
+    fflush(null_file);
+    double printf_ms = (now_ns() - start) / 1e6;
+
+    zclk_writer *file_writer;
+    create_zclk_writer_file(&file_writer, null_file);
+    start = now_ns();
+    write_table_result(file_writer, tbl);
+    zclk_writer_flush(file_writer);
+    double file_ms = (now_ns() - start) / 1e6;
+
+    zclk_writer *fd_writer;
+    create_zclk_writer_fd(&fd_writer, null_fd);
+    start = now_ns();
+    write_table_result(fd_writer, tbl);
+    zclk_writer_flush(fd_writer);
+    double fd_ms = (now_ns() - start) / 1e6;
+
+    printf("%-12s %12s %10s\n", "renderer", "total_ms", "speedup");
+    printf("%-12s %12.1f %9.1fx\n", "printf", printf_ms, 1.0);
+    printf("%-12s %12.1f %9.1fx\n", "writer_file", file_ms,
+        printf_ms / file_ms);
+    printf("%-12s %12.1f %9.1fx\n", "writer_fd", fd_ms, printf_ms / fd_ms);
+
+    free_zclk_writer(file_writer);
+    free_zclk_writer(fd_writer);
+    fclose(null_file);
+    close(null_fd);
+    free_zclk_table(tbl);
+#endif
+}
+
+static void bench_table_parallel(void)
+{
+#ifndef _WIN32
+    /* 1M rows of 5 columns */
+    const size_t num_rows = 1000000;
+    static const int thread_counts[] = { 1, 2, 4, 8, 16 };
+    zclk_table *tbl = make_bench_table(num_rows);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0)
+    {
+        fprintf(stderr, "cannot open /dev/null\n");
+        exit(1);
+    }
+
+    /* the parallel output must be the same as the serial one */
+    zclk_writer *serial_out, *parallel_out;
+    create_zclk_writer_memory(&serial_out);
+    create_zclk_writer_memory(&parallel_out);
+    write_table_result(serial_out, tbl);
+    write_table_result_parallel(parallel_out, tbl, 16);
+    size_t serial_len, parallel_len;
+    const char *serial_data = zclk_writer_get_data(serial_out, &serial_len);
+    const char *parallel_data = zclk_writer_get_data(parallel_out,
+                                    &parallel_len);
+    if (serial_len != parallel_len
+        || memcmp(serial_data, parallel_data, serial_len) != 0)
+    {
+        fprintf(stderr, "parallel table output differs from serial\n");
+        exit(1);
+    }
+    free_zclk_writer(serial_out);
+    free_zclk_writer(parallel_out);
+
+    zclk_writer *fd_writer;
+    create_zclk_writer_fd(&fd_writer, null_fd);
+    double start = now_ns();
+    write_table_result(fd_writer, tbl);
+    zclk_writer_flush(fd_writer);
+    double serial_ms = (now_ns() - start) / 1e6;
+
+    /* threads beyond the online CPUs cannot speed it up */
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("online cpus: %ld\n", num_cpus);
+    printf("%-12s %12s %12s %10s\n", "threads", "cells", "total_ms",
+        "speedup");
+    printf("%-12s %12zu %12.1f %9.1fx\n", "serial", num_rows * 5, serial_ms,
+        1.0);
+    int oversubscribed = 0;
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(int); i++)
+    {
+        start = now_ns();
+        write_table_result_parallel(fd_writer, tbl, thread_counts[i]);
+        zclk_writer_flush(fd_writer);
+        double ms = (now_ns() - start) / 1e6;
+        char label[16];
+        snprintf(label, sizeof(label), "%d%s", thread_counts[i],
+            thread_counts[i] > num_cpus ? "*" : "");
+        oversubscribed = oversubscribed || thread_counts[i] > num_cpus;
+        printf("%-12s %12zu %12.1f %9.1fx\n", label, num_rows * 5, ms,
+            serial_ms / ms);
+    }
+    if (oversubscribed)
+    {
+        printf("* more threads than online cpus\n");
+    }
+
+    free_zclk_writer(fd_writer);
+    close(null_fd);
+    free_zclk_table(tbl);
+#endif
+}
+
+/* JSON string escaping one byte at a time, for comparison */
+static void json_write_string_bytewise(zclk_writer *w, const char *str,
+    size_t len)
+{
+    zclk_writer_putc(w, '"');
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)str[i];
+        if (c == '"' || c == '\\')
+        {
+            zclk_writer_putc(w, '\\');
+            zclk_writer_putc(w, (char)c);
+        }
+        else if (c < 0x20)
+        {
+            zclk_writer_printf(w, "\\u%04x", c);
+        }
+        else
+        {
+            zclk_writer_putc(w, (char)c);
+        }
+    }
+    zclk_writer_putc(w, '"');
+}
+
+static void bench_structured_output(void)
+{
+#ifndef _WIN32
+    const size_t num_rows = 200000;
+    zclk_table *tbl = make_bench_table(num_rows);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0)
+    {
+        fprintf(stderr, "cannot open /dev/null\n");
+        exit(1);
+    }
+    zclk_writer *fd_writer;
+    create_zclk_writer_fd(&fd_writer, null_fd);
+
+    printf("%-12s %12s\n", "format", "total_ms");
+    for (int f = ZCLK_OUTPUT_TABLE; f <= ZCLK_OUTPUT_NDJSON; f++)
+    {
+        double start = now_ns();
+        write_result_as(fd_writer, (zclk_output_format)f, ZCLK_RES_SUCCESS,
+            ZCLK_RESULT_TABLE, tbl);
+        double ms = (now_ns() - start) / 1e6;
+        printf("%-12s %12.1f\n", zclk_output_format_name((zclk_output_format)f),
+            ms);
+    }
+
+    /* 1 MB strings of 100 byte words, with a quote in every 10th word */
+    const size_t str_len = 1 << 20;
+    const int reps = 64;
+    char *str = (char *)malloc(str_len);
+    for (size_t i = 0; i < str_len; i++)
+    {
+        str[i] = (i % 100 == 99) ? ' ' : (char)('a' + i % 26);
+        if (i % 1000 == 500)
+        {
+            str[i] = '"';
+        }
+    }
+    printf("\n%-12s %12s %10s\n", "escaping", "MB_per_s", "speedup");
+    double rates[2];
+    for (int v = 0; v < 2; v++)
+    {
+        double start = now_ns();
+        for (int r = 0; r < reps; r++)
+        {
+            if (v == 0)
+            {
+                json_write_string_bytewise(fd_writer, str, str_len);
+            }
+            else
+            {
+                zclk_json_write_string(fd_writer, str, str_len);
+            }
+        }
+        zclk_writer_flush(fd_writer);
+        rates[v] = (double)str_len * reps / ((now_ns() - start) / 1e9)
+            / (1 << 20);
+        printf("%-12s %12.1f %9.1fx\n", v == 0 ? "bytewise" : "zclk_json",
+            rates[v], rates[v] / rates[0]);
+    }
+
+    free(str);
+    free_zclk_writer(fd_writer);
+    close(null_fd);
+    free_zclk_table(tbl);
+#endif
+}
+
+static void bench_dict(void)
+{
+    static const size_t sizes[] = { 10, 1000, 1000000 };
+    printf("%-10s %10s %10s %10s %10s %10s %12s\n", "keys", "put_ns",
+        "get_ns", "replace_ns", "remove_ns", "iter_ns", "linear_get_ns");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(size_t); s++)
+    {
+        size_t n = sizes[s];
+        /* repeat the small sizes to get a measurable time */
+        size_t reps = 1000000 / n;
+        char **keys = (char **)malloc(n * sizeof(char *));
+        for (size_t k = 0; k < n; k++)
+        {
+            char key[32];
+            snprintf(key, sizeof(key), "key-%zu-%llu", k,
+                (unsigned long long)(bench_rand() % 1000000));
+            keys[k] = zclk_str_clone(key);
+        }
+
+        double put_ns = 0, get_ns = 0, replace_ns = 0, remove_ns = 0;
+        double iter_ns = 0, linear_ns = 0;
+        size_t found = 0;
+        for (size_t r = 0; r < reps; r++)
+        {
+            zclk_dict *dict;
+            create_zclk_dict(&dict);
+            double start = now_ns();
+            for (size_t k = 0; k < n; k++)
+            {
+                zclk_dict_put(dict, keys[k], "value");
+            }
+            put_ns += now_ns() - start;
+
+            start = now_ns();
+            for (size_t k = 0; k < n; k++)
+            {
+                char *value;
+                found += zclk_dict_get(dict, keys[n - 1 - k], &value) == 0;
+            }
+            get_ns += now_ns() - start;
+
+            start = now_ns();
+            for (size_t k = 0; k < n; k++)
+            {
+                zclk_dict_put(dict, keys[k], "other");
+            }
+            replace_ns += now_ns() - start;
+
+            start = now_ns();
+            zclk_dict_foreach(dict, key, value)
+            {
+                found += key[0] != '\0' && value[0] == 'o';
+            }
+            iter_ns += now_ns() - start;
+
+            /* a strcmp scan of the entries, as handlers did without get */
+            if (n <= 1000)
+            {
+                start = now_ns();
+                for (size_t k = 0; k < n; k++)
+                {
+                    for (size_t e = 0; e < dict->num_entries; e++)
+                    {
+                        if (strcmp(dict->entries[e].key, keys[k]) == 0)
+                        {
+                            found++;
+                            break;
+                        }
+                    }
+                }
+                linear_ns += now_ns() - start;
+            }
+
+            start = now_ns();
+            for (size_t k = 0; k < n; k++)
+            {
+                zclk_dict_remove(dict, keys[k]);
+            }
+            remove_ns += now_ns() - start;
+            free_zclk_dict(dict);
+        }
+
+        double ops = (double)n * reps;
+        char linear[32] = "-";
+        if (n <= 1000)
+        {
+            snprintf(linear, sizeof(linear), "%.1f", linear_ns / ops);
+        }
+        printf("%-10zu %10.1f %10.1f %10.1f %10.1f %10.1f %12s\n", n,
+            put_ns / ops, get_ns / ops, replace_ns / ops, remove_ns / ops,
+            iter_ns / ops, linear);
+        if (found == 0)
+        {
+            printf("no keys found\n");
+        }
+        for (size_t k = 0; k < n; k++)
+        {
+            free(keys[k]);
+        }
+        free(keys);
+    }
+}
+
+/* the previous progress renderer: reprints every line on every update */
+static void reprint_progress(zclk_writer *w, zclk_multi_progress *mp)
+{
+    if (mp->old_count > 0)
+    {
+        zclk_writer_printf(w, "\033[%dA", mp->old_count);
+    }
+    size_t n = arraylist_length(mp->progress_ls);
+    for (size_t i = 0; i < n; i++)
+    {
+        zclk_progress *p = (zclk_progress *)arraylist_get(mp->progress_ls, i);
+        zclk_writer_printf(w, "\033[K%s: %s", p->name, p->message);
+        if (p->extra != NULL)
+        {
+            zclk_writer_putc(w, ' ');
+            zclk_writer_puts(w, p->extra);
+        }
+        zclk_writer_putc(w, '\n');
+    }
+    mp->old_count = (int)n;
+}
+
+static void bench_progress_redraw(void)
+{
+    enum { NUM_BARS = 64 };
+    const int num_updates = 200000;
+    static const char *renderers[] = { "reprint", "diff", "diff_30fps" };
+    char names[NUM_BARS][16];
+    char extras[NUM_BARS][32];
+    printf("%-12s %10s %10s %12s %10s\n", "renderer", "updates", "frames",
+        "bytes", "total_ms");
+    for (int r = 0; r < 3; r++)
+    {
+        zclk_multi_progress *mp;
+        create_zclk_multi_progress(&mp);
+        zclk_multi_progress_set_fps(mp, r == 2 ? 30 : 0);
+        zclk_progress *bars[NUM_BARS];
+        for (int b = 0; b < NUM_BARS; b++)
+        {
+            snprintf(names[b], sizeof(names[b]), "transfer-%02d", b);
+            snprintf(extras[b], sizeof(extras[b]), "0 KB");
+            create_zclk_progress(&bars[b], names[b], 20, num_updates);
+            bars[b]->message = "downloading";
+            bars[b]->extra = extras[b];
+            arraylist_add(mp->progress_ls, bars[b]);
+        }
+        zclk_writer *out;
+        create_zclk_writer_memory(&out);
+        size_t frames = 0, bytes = 0;
+        double start = now_ns();
+        for (int u = 0; u < num_updates; u++)
+        {
+            int b = (int)(bench_rand() % NUM_BARS);
+            zclk_progress_add(bars[b], 1);
+            snprintf(extras[b], sizeof(extras[b]), "%.0f KB",
+                zclk_progress_get(bars[b]) * 64);
+            if (r == 0)
+            {
+                reprint_progress(out, mp);
+            }
+            else
+            {
+                zclk_multi_progress_render(mp, out, u == num_updates - 1);
+            }
+            size_t len;
+            zclk_writer_get_data(out, &len);
+            frames += len > 0;
+            bytes += len;
+            zclk_writer_clear(out);
+        }
+        double ms = (now_ns() - start) / 1e6;
+        printf("%-12s %10d %10zu %12zu %10.1f\n", renderers[r], num_updates,
+            frames, bytes, ms);
+
+        free_zclk_writer(out);
+        for (int b = 0; b < NUM_BARS; b++)
+        {
+            free_zclk_progress(bars[b]);
+        }
+        free_zclk_multi_progress(mp);
+    }
+}
+
+#ifndef _WIN32
+typedef struct progress_worker_t
+{
+    zclk_progress *bar;
+    zclk_multi_progress *mp;
+    zclk_writer *out;
+    pthread_mutex_t *lock;
+    int num_updates;
+} progress_worker;
+
+/* bumps the counter under a lock and draws inline, as handlers had to */
+static void *locked_progress_fn(void *data)
+{
+    progress_worker *w = (progress_worker *)data;
+    for (int u = 0; u < w->num_updates; u++)
+    {
+        pthread_mutex_lock(w->lock);
+        zclk_progress_add(w->bar, 1);
+        zclk_multi_progress_render(w->mp, w->out, 0);
+        pthread_mutex_unlock(w->lock);
+    }
+    return NULL;
+}
+
+static void *atomic_progress_fn(void *data)
+{
+    progress_worker *w = (progress_worker *)data;
+    for (int u = 0; u < w->num_updates; u++)
+    {
+        zclk_progress_add(w->bar, 1);
+    }
+    return NULL;
+}
+#endif
+
+static void bench_progress_threads(void)
+{
+#ifndef _WIN32
+    enum { NUM_WORKERS = 16 };
+    const int num_updates = 500000;
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0)
+    {
+        fprintf(stderr, "cannot open /dev/null\n");
+        exit(1);
+    }
+    char names[NUM_WORKERS][16];
+    printf("%-12s %10s %12s %12s\n", "mode", "workers", "total_ms",
+        "ns_per_update");
+    for (int mode = 0; mode < 2; mode++)
+    {
+        zclk_multi_progress *mp;
+        create_zclk_multi_progress(&mp);
+        zclk_writer *out;
+        create_zclk_writer_fd(&out, null_fd);
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        progress_worker workers[NUM_WORKERS];
+        pthread_t threads[NUM_WORKERS];
+        for (int b = 0; b < NUM_WORKERS; b++)
+        {
+            snprintf(names[b], sizeof(names[b]), "worker-%02d", b);
+            create_zclk_progress(&workers[b].bar, names[b], 20, num_updates);
+            workers[b].bar->message = "running";
+            workers[b].mp = mp;
+            workers[b].out = out;
+            workers[b].lock = &lock;
+            workers[b].num_updates = num_updates;
+            arraylist_add(mp->progress_ls, workers[b].bar);
+        }
+
+        double start = now_ns();
+        if (mode == 1)
+        {
+            zclk_multi_progress_start(mp, out);
+        }
+        for (int b = 0; b < NUM_WORKERS; b++)
+        {
+            pthread_create(&threads[b], NULL,
+                mode == 0 ? locked_progress_fn : atomic_progress_fn,
+                &workers[b]);
+        }
+        for (int b = 0; b < NUM_WORKERS; b++)
+        {
+            pthread_join(threads[b], NULL);
+        }
+        if (mode == 1)
+        {
+            zclk_multi_progress_stop(mp);
+        }
+        else
+        {
+            zclk_multi_progress_render(mp, out, 1);
+        }
+        double ms = (now_ns() - start) / 1e6;
+        printf("%-12s %10d %12.1f %12.1f\n",
+            mode == 0 ? "locked" : "atomic", NUM_WORKERS, ms,
+            ms * 1e6 / ((double)num_updates * NUM_WORKERS));
+
+        for (int b = 0; b < NUM_WORKERS; b++)
+        {
+            if (zclk_progress_get(workers[b].bar) != num_updates)
+            {
+                fprintf(stderr, "lost progress updates\n");
+                exit(1);
+            }
+            free_zclk_progress(workers[b].bar);
+        }
+        free_zclk_writer(out);
+        free_zclk_multi_progress(mp);
+        pthread_mutex_destroy(&lock);
+    }
+    close(null_fd);
+#endif
+}
+
+/* show_progress as it was, with a printf for each cell of the bar */
+static void show_progress_printf(zclk_progress *progress)
+{
+    printf("\r");
+    printf("%s ", progress->name);
+    printf("%s", progress->before);
+    int complete_bars =
+        (int)(zclk_progress_get(progress) / progress->total * progress->length);
+    for (int i = 0; i < complete_bars; i++)
+    {
+        printf("%s", progress->bar);
+    }
+    for (int i = complete_bars; i < progress->length; i++)
+    {
+        printf("%s", " ");
+    }
+    printf("%s", progress->after);
+    fflush(stdout);
+}
+
+static void bench_progress_bar(void)
+{
+#ifndef _WIN32
+    const int num_draws = 200000;
+    const char *modes[] = {"printf", "one_write", "rate_eta"};
+    double ns[3];
+    fflush(stdout);
+    int saved_fd = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (saved_fd < 0 || null_fd < 0)
+    {
+        fprintf(stderr, "cannot redirect stdout\n");
+        exit(1);
+    }
+    dup2(null_fd, STDOUT_FILENO);
+    for (int mode = 0; mode < 3; mode++)
+    {
+        zclk_progress *p;
+        create_zclk_progress(&p, "download", 40, num_draws);
+        if (mode == 2)
+        {
+            zclk_progress_set_flags(p, ZCLK_PROGRESS_SHOW_RATE
+                | ZCLK_PROGRESS_SHOW_ETA | ZCLK_PROGRESS_BYTES);
+        }
+        double start = now_ns();
+        for (int i = 0; i < num_draws; i++)
+        {
+            zclk_progress_add(p, 1);
+            if (mode == 0)
+            {
+                show_progress_printf(p);
+            }
+            else
+            {
+                show_progress(p);
+            }
+        }
+        ns[mode] = (now_ns() - start) / num_draws;
+        free_zclk_progress(p);
+    }
+    dup2(saved_fd, STDOUT_FILENO);
+    close(saved_fd);
+    close(null_fd);
+    printf("%-12s %10s %12s\n", "mode", "draws", "ns_per_draw");
+    for (int mode = 0; mode < 3; mode++)
+    {
+        printf("%-12s %10d %12.1f\n", modes[mode], num_draws, ns[mode]);
+    }
+#endif
+}
+
+/* help of a top-level command as it was rendered, with strcat */
+static char *help_strcat(char *help_str, zclk_command *command)
+{
+    size_t opt_len = arraylist_length(command->options);
+    size_t sub_cmd_len = arraylist_length(command->sub_commands);
+    help_str[0] = '\0';
+    for (int pass = 0; pass < 2; pass++)
+    {
+        strcat(help_str, pass == 0 ? "Usage: " : "\nOR:    ");
+        strcat(help_str, pass == 0 ? command->name : command->short_name);
+        if (opt_len > 0)
+        {
+            strcat(help_str, " [OPTIONS]");
+        }
+        if (sub_cmd_len > 0)
+        {
+            strcat(help_str, " COMMAND");
+        }
+    }
+    strcat(help_str, "\n\n");
+    strcat(help_str, command->description);
+    strcat(help_str, "\n\nOptions:\n\n");
+    for (size_t i = 0; i < opt_len; i++)
+    {
+        zclk_option *opt = arraylist_get(command->options, i);
+        strcat(help_str, "\t");
+        if (opt->short_name != NULL)
+        {
+            strcat(help_str, "-");
+            strcat(help_str, opt->short_name);
+            strcat(help_str, ", ");
+        }
+        else
+        {
+            strcat(help_str, "    ");
+        }
+        strcat(help_str, "--");
+        strcat(help_str, opt->name);
+        size_t used = 2 + strlen(opt->name);
+        if (opt->val->type == ZCLK_TYPE_STRING)
+        {
+            strcat(help_str, " string");
+            used += strlen(" string");
+        }
+        for (size_t sp = used; sp < 25; sp++)
+        {
+            strcat(help_str, " ");
+        }
+        strcat(help_str, opt->description);
+        strcat(help_str, "\n");
+    }
+    strcat(help_str, "\n\nCommands:\n\n");
+    for (size_t i = 0; i < sub_cmd_len; i++)
+    {
+        zclk_command *sc = arraylist_get(command->sub_commands, i);
+        strcat(help_str, "  ");
+        strcat(help_str, sc->name);
+        for (size_t sp = 2 + strlen(sc->name); sp < 15; sp++)
+        {
+            strcat(help_str, " ");
+        }
+        strcat(help_str, sc->description);
+        strcat(help_str, "\n");
+    }
+    strcat(help_str, "\n");
+    return help_str;
+}
+
+static void bench_help(void)
+{
+    static const int sub_command_counts[] = { 10, 120, 1000 };
+    char *help_buf = (char *)malloc(1 << 20);
+    zclk_parse_ctx *ctx;
+    make_zclk_parse_ctx(&ctx);
+
+    printf("%-12s %10s %14s %14s %14s\n", "commands", "bytes",
+        "strcat_us", "render_us", "cached_us");
+    for (size_t c = 0; c < sizeof(sub_command_counts) / sizeof(int); c++)
+    {
+        int num_sub_commands = sub_command_counts[c];
+        int reps = num_sub_commands >= 1000 ? 20 : 2000;
+        zclk_command *cmd = new_zclk_command("bench", "b",
+                                "Help benchmark", &noop_handler);
+        for (int i = 0; i < 18; i++)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "option-%d", i);
+            zclk_command_string_option(cmd, name, NULL, "", "An option");
+        }
+        zclk_command **subs = (zclk_command **)calloc(
+            (size_t)num_sub_commands, sizeof(zclk_command *));
+        for (int i = 0; i < num_sub_commands; i++)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "command-%d", i);
+            subs[i] = new_zclk_command(name, NULL,
+                "A sub-command of the benchmark", &noop_handler);
+            zclk_command_subcommand_add(cmd, subs[i]);
+        }
+        arraylist *chain;
+        arraylist_new(&chain, NULL);
+        arraylist_add(chain, cmd);
+
+        double start = now_ns();
+        for (int i = 0; i < reps; i++)
+        {
+            help_strcat(help_buf, cmd);
+        }
+        double strcat_us = (now_ns() - start) / reps / 1e3;
+
+        char *help = NULL;
+        start = now_ns();
+        for (int i = 0; i < reps; i++)
+        {
+            // dropped as adding an option would
+            free(cmd->help_cache);
+            cmd->help_cache = NULL;
+            help = get_help_for_command_ctx(ctx, chain);
+        }
+        double render_us = (now_ns() - start) / reps / 1e3;
+
+        start = now_ns();
+        for (int i = 0; i < reps; i++)
+        {
+            help = get_help_for_command_ctx(ctx, chain);
+        }
+        double cached_us = (now_ns() - start) / reps / 1e3;
+
+        if (help == NULL || strcmp(help, help_strcat(help_buf, cmd)) != 0)
+        {
+            fprintf(stderr, "help output differs\n");
+            exit(1);
+        }
+        printf("%-12d %10zu %14.2f %14.2f %14.2f\n", num_sub_commands,
+            strlen(help), strcat_us, render_us, cached_us);
+
+        arraylist_free(chain);
+        free(subs);
+        free_command(cmd);
+    }
+    free_zclk_parse_ctx(ctx);
+    free(help_buf);
+}
+
+static void bench_completion(void)
+{
+    static char *lines[][3] = {
+        { "", NULL },
+        { "command-9", NULL },
+        { "command-999", NULL },
+        { "command-5", "--", NULL },
+        { "command-5", "--output", "j" },
+    };
+    static const int line_lens[] = { 1, 1, 1, 2, 3 };
+    static const char *labels[] = { "''", "command-9", "command-999",
+        "command-5 --", "--output j" };
+    const int reps = 2000;
+    zclk_writer *out;
+    create_zclk_writer_memory(&out);
+
+    printf("%-8s %-14s %12s %12s\n", "tree", "line", "candidates",
+        "us/complete");
+    for (int frozen = 0; frozen < 2; frozen++)
+    {
+        zclk_command *root = make_wide_tree(NULL, 1000);
+        zclk_command_enable_output_option(root);
+        if (frozen)
+        {
+            zclk_command_freeze(root);
+        }
+        for (size_t l = 0; l < sizeof(line_lens) / sizeof(int); l++)
+        {
+            double start = now_ns();
+            for (int i = 0; i < reps; i++)
+            {
+                zclk_writer_clear(out);
+                if (zclk_command_complete(root, out, line_lens[l], lines[l])
+                    != ZCLK_RES_SUCCESS)
+                {
+                    fprintf(stderr, "completion failed\n");
+                    exit(1);
+                }
+            }
+            double us = (now_ns() - start) / reps / 1e3;
+            size_t len, candidates = 0;
+            const char *data = zclk_writer_get_data(out, &len);
+            for (size_t c = 0; c < len; c++)
+            {
+                candidates += data[c] == '\n';
+            }
+            printf("%-8s %-14s %12zu %12.2f\n", frozen ? "frozen" : "live",
+                labels[l], candidates, us);
+        }
+        free_command(root);
+    }
+    free_zclk_writer(out);
+}
+
+/* fills in a command of the wide tree */
+static zclk_res wide_command_loader(zclk_command *cmd, void *loader_args)
+{
+    zclk_command_int_option(cmd, "count", "c", 1, "An int option");
+    zclk_command_string_option(cmd, "name", "n", "x", "A string option");
+    zclk_command_flag_option(cmd, "verbose", "v", "A flag option");
+    zclk_command_string_argument(cmd, "file", "", "An argument", 1);
+    return ZCLK_RES_SUCCESS;
+}
+
+static void bench_lazy_tree(void)
+{
+    static const int command_counts[] = { 100, 1000, 10000 };
+    char *argv[] = { "wide", "command-42", "--count", "3", "-v", "file.txt" };
+    int argc = sizeof(argv) / sizeof(char *);
+
+    printf("%-12s %-8s %14s %16s\n", "commands", "tree", "us/start",
+        "allocs/start");
+    for (size_t c = 0; c < sizeof(command_counts) / sizeof(int); c++)
+    {
+        int num_commands = command_counts[c];
+        int reps = 200000 / num_commands;
+        for (int lazy = 0; lazy < 2; lazy++)
+        {
+            size_t allocs = ALLOC_COUNT();
+            double start = now_ns();
+            for (int r = 0; r < reps; r++)
+            {
+                zclk_command *root = new_zclk_command("wide", "w",
+                                        "Wide CLI", &noop_handler);
+                for (int i = 0; i < num_commands; i++)
+                {
+                    char name[32];
+                    snprintf(name, sizeof(name), "command-%d", i);
+                    if (lazy)
+                    {
+                        zclk_command_lazy_subcommand_add(root, name, NULL,
+                            "A command", &noop_handler, &wide_command_loader,
+                            NULL);
+                    }
+                    else
+                    {
+                        zclk_command *cmd = new_zclk_command(name, NULL,
+                                                "A command", &noop_handler);
+                        wide_command_loader(cmd, NULL);
+                        zclk_command_subcommand_add(root, cmd);
+                    }
+                }
+                if (zclk_command_exec(root, NULL, argc, argv)
+                    != ZCLK_RES_SUCCESS)
+                {
+                    fprintf(stderr, "exec failed\n");
+                    exit(1);
+                }
+                free_command(root);
+            }
+            double us = (now_ns() - start) / reps / 1e3;
+            printf("%-12d %-8s %14.1f %16.1f\n", num_commands,
+                lazy ? "lazy" : "eager", us,
+                (double)(ALLOC_COUNT() - allocs) / reps);
+        }
+    }
+}
+
+/* the handler of every command of the cached wide tree */
+static void bind_wide_command(zclk_command *cmd, zclk_command *parent,
+    void *bind_args)
+{
+    cmd->handler = &noop_handler;
+}
+
+static int same_default(zclk_val *a, zclk_val *b)
+{
+    if (a == NULL || b == NULL || a->type != b->type)
+    {
+        return a == b;
+    }
+    switch (a->type)
+    {
+    case ZCLK_TYPE_DOUBLE:
+        return a->data.dbl_value == b->data.dbl_value;
+    case ZCLK_TYPE_STRING:
+        return (a->data.str_value == NULL && b->data.str_value == NULL)
+            || (a->data.str_value != NULL && b->data.str_value != NULL
+                && strcmp(a->data.str_value, b->data.str_value) == 0);
+    default:
+        return a->data.int_value == b->data.int_value;
+    }
+}
+
+/* count the options and arguments of the cached tree whose defaults
+ * differ from those of the live tree */
+static int count_changed_defaults(zclk_command *live, zclk_command *cached)
+{
+    int changed = 0;
+    zclk_command_load(cached);
+    for (size_t i = 0; i < arraylist_length(live->options); i++)
+    {
+        zclk_option *opt = arraylist_get(live->options, i);
+        zclk_option *copy = zclk_command_get_option(cached, opt->name);
+        if (copy == NULL || !same_default(opt->default_val, copy->default_val))
+        {
+            fprintf(stderr, "default of %s %s changed\n", live->name,
+                opt->name);
+            changed++;
+        }
+    }
+    for (size_t i = 0; i < arraylist_length(live->args); i++)
+    {
+        zclk_argument *arg = arraylist_get(live->args, i);
+        zclk_argument *copy = zclk_command_get_argument(cached, arg->name);
+        if (copy == NULL || !same_default(arg->default_val, copy->default_val))
+        {
+            fprintf(stderr, "default of %s %s changed\n", live->name,
+                arg->name);
+            changed++;
+        }
+    }
+    for (size_t i = 0; i < arraylist_length(live->sub_commands); i++)
+    {
+        zclk_command *sub = arraylist_get(live->sub_commands, i);
+        zclk_command *copy = zclk_command_get_subcommand(cached, sub->name, 0);
+        changed += copy == NULL ? 1 : count_changed_defaults(sub, copy);
+    }
+    return changed;
+}
+
+/* check that a tree with non-zero defaults of every type comes back from
+ * the cache with the same defaults */
+static void check_cache_defaults(const char *path)
+{
+    zclk_command *root = new_zclk_command("defaults", NULL, "Defaults",
+        &noop_handler);
+    zclk_command *sub = new_zclk_command("sub", "s", "A command",
+        &noop_handler);
+    zclk_command_option_add(sub, new_zclk_option_bool("verbose", "V", 1,
+        "A bool option"));
+    zclk_command_option_add(sub, new_zclk_option_flag("force", "f", 1,
+        "A flag option"));
+    zclk_command_int_option(sub, "count", "c", 7, "An int option");
+    zclk_command_double_option(sub, "ratio", "r", 0.25, "A double option");
+    zclk_command_string_option(sub, "name", "n", "x", "A string option");
+    zclk_command_bool_argument(sub, "on", 1, "A bool argument", 1);
+    zclk_command_int_argument(sub, "size", 3, "An int argument", 1);
+    zclk_command_string_argument(sub, "file", "a.txt", "An argument", 1);
+    zclk_command_subcommand_add(root, sub);
+
+    zclk_cache *cache;
+    if (zclk_command_save_cache(root, path, 1) != ZCLK_RES_SUCCESS
+        || zclk_cache_open(&cache, path, 1, NULL, NULL) != ZCLK_RES_SUCCESS)
+    {
+        fprintf(stderr, "cannot write or read %s\n", path);
+        exit(1);
+    }
+    int changed = count_changed_defaults(root, zclk_cache_get_command(cache));
+    free_zclk_cache(cache);
+    free_command(root);
+    remove(path);
+    if (changed > 0)
+    {
+        fprintf(stderr, "%d defaults changed in the cache\n", changed);
+        exit(1);
+    }
+    printf("defaults: all the same after a save and open\n");
+}
+
+static void bench_tree_cache(void)
+{
+    static const int command_counts[] = { 100, 1000, 10000 };
+    const char *path = "zclk_bench_tree.cache";
+    char *argv[] = { "wide", "command-42", "--count", "3", "-v", "file.txt" };
+    int argc = sizeof(argv) / sizeof(char *);
+
+    check_cache_defaults(path);
+    printf("%-12s %14s %14s %14s %12s\n", "commands", "build_us",
+        "cached_us", "speedup", "cache_bytes");
+    for (size_t c = 0; c < sizeof(command_counts) / sizeof(int); c++)
+    {
+        int num_commands = command_counts[c];
+        int reps = 200000 / num_commands;
+
+        // stands in for the script which defines the tree
+        size_t script_cap = (size_t)num_commands * 160 + 1;
+        char *script = (char *)malloc(script_cap);
+        size_t script_len = 0;
+        for (int i = 0; i < num_commands; i++)
+        {
+            script_len += (size_t)snprintf(script + script_len,
+                script_cap - script_len,
+                "cmd:option('count', 'c', 1) cmd:option('name', 'n', 'x')"
+                " cmd:flag('verbose', 'v') cmd:argument('file') -- %d\n", i);
+        }
+
+        double start = now_ns();
+        for (int r = 0; r < reps; r++)
+        {
+            zclk_cache_hash(script, script_len);
+            zclk_command *root = make_wide_tree(NULL, num_commands);
+            zclk_command_exec(root, NULL, argc, argv);
+            free_command(root);
+        }
+        double build_us = (now_ns() - start) / reps / 1e3;
+
+        uint64_t hash = zclk_cache_hash(script, script_len);
+        zclk_command *saved = make_wide_tree(NULL, num_commands);
+        if (zclk_command_save_cache(saved, path, hash) != ZCLK_RES_SUCCESS)
+        {
+            fprintf(stderr, "cannot write %s\n", path);
+            exit(1);
+        }
+        size_t cache_bytes = sizeof(zclk_cache_header) + saved->frozen->size;
+        free_command(saved);
+
+        start = now_ns();
+        for (int r = 0; r < reps; r++)
+        {
+            zclk_cache *cache;
+            if (zclk_cache_open(&cache, path,
+                    zclk_cache_hash(script, script_len), &bind_wide_command,
+                    NULL) != ZCLK_RES_SUCCESS
+                || zclk_command_exec(zclk_cache_get_command(cache), NULL,
+                    argc, argv) != ZCLK_RES_SUCCESS)
+            {
+                fprintf(stderr, "cached start failed\n");
+                exit(1);
+            }
+            free_zclk_cache(cache);
+        }
+        double cached_us = (now_ns() - start) / reps / 1e3;
+        printf("%-12d %14.1f %14.1f %13.1fx %12zu\n", num_commands,
+            build_us, cached_us, build_us / cached_us, cache_bytes);
+
+        remove(path);
+        free(script);
+    }
+}
+
+static size_t argfile_names_seen = 0;
+
+static zclk_res count_names_handler(zclk_command *cmd, void *handler_args)
+{
+    zclk_parse_result_get_extra_args(zclk_current_parse_result(),
+        &argfile_names_seen);
+    return ZCLK_RES_SUCCESS;
+}
+
+static void bench_argfile(void)
+{
+    static const int name_counts[] = { 10000, 100000, 1000000 };
+    const char *lines_path = "zclk_bench_names.txt";
+    const char *nul_path = "zclk_bench_names.bin";
+
+    zclk_command *cmd = new_zclk_command("cp", NULL, "copy files",
+        &count_names_handler);
+    zclk_command_flag_option(cmd, "verbose", "v", "print names");
+    zclk_command_string_argument(cmd, "dest", NULL, "destination", 1);
+    zclk_command_allow_extra_args(cmd, 1);
+
+    printf("%-12s %-12s %14s %14s %14s\n", "names", "source", "ms/exec",
+        "ns/name", "allocs/exec");
+    for (size_t c = 0; c < sizeof(name_counts) / sizeof(int); c++)
+    {
+        int num_names = name_counts[c];
+        int reps = 2000000 / num_names;
+
+        // argv of the line, with the names stored after the pointers
+        char **argv = (char **)malloc((size_t)(num_names + 3)
+            * (sizeof(char *) + 24));
+        char *names = (char *)(argv + num_names + 3);
+        FILE *lines = fopen(lines_path, "wb");
+        FILE *nul = fopen(nul_path, "wb");
+        if (argv == NULL || lines == NULL || nul == NULL)
+        {
+            fprintf(stderr, "cannot write the names\n");
+            exit(1);
+        }
+        argv[0] = "cp";
+        argv[1] = "-v";
+        argv[2] = "/backup";
+        for (int i = 0; i < num_names; i++)
+        {
+            char *name = names + (size_t)i * 24;
+            snprintf(name, 24, "src/file-%08d.c", i);
+            argv[i + 3] = name;
+            fprintf(lines, "%s\n", name);
+            fwrite(name, 1, strlen(name) + 1, nul);
+        }
+        fclose(lines);
+        fclose(nul);
+
+        char at_arg[64];
+        snprintf(at_arg, sizeof(at_arg), "@%s", lines_path);
+        char *at_argv[] = { "cp", "-v", "/backup", at_arg };
+        char *from_argv[] = { "cp", "-v", "/backup", "--args-from",
+            (char *)nul_path };
+        struct
+        {
+            const char *name;
+            int argc;
+            char **argv;
+        } sources[] = {
+            { "argv", num_names + 3, argv },
+            { "@file", 4, at_argv },
+            { "--args-from", 5, from_argv },
+        };
+
+        for (size_t s = 0; s < sizeof(sources) / sizeof(sources[0]); s++)
+        {
+            size_t allocs = ALLOC_COUNT();
+            double start = now_ns();
+            for (int r = 0; r < reps; r++)
+            {
+                argfile_names_seen = 0;
+                if (zclk_command_exec(cmd, NULL, sources[s].argc,
+                        sources[s].argv) != ZCLK_RES_SUCCESS
+                    || argfile_names_seen != (size_t)num_names)
+                {
+                    fprintf(stderr, "exec with %s failed\n",
+                        sources[s].name);
+                    exit(1);
+                }
+            }
+            double elapsed = now_ns() - start;
+            printf("%-12d %-12s %14.2f %14.1f %14.1f\n", num_names,
+                sources[s].name, elapsed / reps / 1e6,
+                elapsed / reps / num_names,
+                (double)(ALLOC_COUNT() - allocs) / reps);
+        }
+
+        remove(lines_path);
+        remove(nul_path);
+        free(argv);
+    }
+    free_command(cmd);
+}
+
+/* peak resident set size of the process in KB, 0 if unknown */
+static long peak_rss_kb(void)
+{
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0;
+}
+
+static void make_bench_row(size_t r, char cells[][32], const char **row)
+{
+    snprintf(cells[0], 32, "%zu", r);
+    snprintf(cells[1], 32, "object-%zu.tar.gz", r * 7919);
+    snprintf(cells[3], 32, "%zu", (r * 2654435761u) % 100000);
+    row[0] = cells[0];
+    row[1] = cells[1];
+    row[2] = r % 3 ? "ok" : "pending";
+    row[3] = cells[3];
+    row[4] = "2020-01-01T00:00:00Z";
+}
+
+/* the layout used before the columnar table, one string per cell */
+static char ***make_row_major_table(size_t num_rows)
+{
+    char cells[5][32];
+    const char *row[5];
+    char ***values = (char ***)calloc(num_rows, sizeof(char **));
+    for (size_t r = 0; r < num_rows; r++)
+    {
+        make_bench_row(r, cells, row);
+        values[r] = (char **)calloc(5, sizeof(char *));
+        for (size_t c = 0; c < 5; c++)
+        {
+            values[r][c] = zclk_str_clone(row[c]);
+        }
+    }
+    return values;
+}
+
+static void free_row_major_table(char ***values, size_t num_rows)
+{
+    for (size_t r = 0; r < num_rows; r++)
+    {
+        for (size_t c = 0; c < 5; c++)
+        {
+            free(values[r][c]);
+        }
+        free(values[r]);
+    }
+    free(values);
+}
+
+static zclk_table *make_columnar_table(size_t num_rows, int typed)
+{
+    char cells[5][32];
+    const char *row[5];
+    zclk_table *tbl;
+    create_zclk_table(&tbl, num_rows, 5);
+    if (typed)
+    {
+        zclk_table_set_col_type(tbl, 0, ZCLK_TABLE_COL_INT);
+        zclk_table_set_col_type(tbl, 3, ZCLK_TABLE_COL_INT);
+    }
+    for (size_t r = 0; r < num_rows; r++)
+    {
+        make_bench_row(r, cells, row);
+        for (size_t c = 0; c < 5; c++)
+        {
+            if (typed && (c == 0 || c == 3))
+            {
+                zclk_table_set_row_int(tbl, r, c, strtoll(row[c], NULL, 10));
+            }
+            else
+            {
+                zclk_table_set_row_val(tbl, r, c, (char *)row[c]);
+            }
+        }
+    }
+    return tbl;
+}
+
+static void bench_table_storage(void)
+{
+    const size_t num_rows = 1000000;
+    printf("%-12s %12s %12s %12s\n", "layout", "allocs", "heap_kb",
+        "build_ms");
+    for (int layout = 0; layout < 3; layout++)
+    {
+        size_t allocs = ALLOC_COUNT();
+        size_t heap = HEAP_IN_USE();
+        double start = now_ns();
+        char ***values = NULL;
+        zclk_table *tbl = NULL;
+        if (layout == 0)
+        {
+            values = make_row_major_table(num_rows);
+        }
+        else
+        {
+            tbl = make_columnar_table(num_rows, layout == 2);
+        }
+        double elapsed = (now_ns() - start) / 1e6;
+        allocs = ALLOC_COUNT() - allocs;
+        heap = HEAP_IN_USE() - heap;
+        printf("%-12s %12zu %12zu %12.1f\n",
+            layout == 0 ? "row_major" : (layout == 1 ? "columnar" : "typed"),
+            allocs, heap / 1024, elapsed);
+        if (values != NULL)
+        {
+            free_row_major_table(values, num_rows);
+        }
+        free_zclk_table(tbl);
+    }
+}
+
+#ifndef _WIN32
+typedef struct pipe_reader_t
+{
+    int fd;
+    double start_ns;
+    double first_byte_ns;
+} pipe_reader;
+
+static void *pipe_reader_fn(void *data)
+{
+    pipe_reader *r = (pipe_reader *)data;
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(r->fd, buf, sizeof(buf))) > 0)
+    {
+        if (r->first_byte_ns == 0)
+        {
+            r->first_byte_ns = now_ns();
+        }
+    }
+    return NULL;
+}
+
+/* a field of /proc/self/status (e.g. "VmRSS:") in KB, 0 if unknown */
+static long proc_status_kb(const char *field)
+{
+    long kb = 0;
+#ifdef __linux__
+    char line[256];
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL)
+    {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (strncmp(line, field, strlen(field)) == 0)
+        {
+            kb = strtol(line + strlen(field), NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+#endif
+    return kb;
+}
+
+/*
+ * Reset the peak RSS of the process to its current RSS (Linux only),
+ * and return the current RSS in KB, 0 if unknown.
+ */
+static long reset_peak_rss_kb(void)
+{
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f != NULL)
+    {
+        fputs("5", f);
+        fclose(f);
+    }
+#endif
+    return proc_status_kb("VmRSS:");
+}
+
+/* growth of the peak RSS in KB since reset_peak_rss_kb returned start */
+static long peak_rss_growth_kb(long start)
+{
+    long peak = proc_status_kb("VmHWM:");
+    if (peak == 0)
+    {
+        peak = peak_rss_kb();
+    }
+    return peak > start ? peak - start : 0;
+}
+
+static void time_table_to_pipe(int use_stream, size_t num_rows)
+{
+    static const char *headers[] = { "id", "name", "status", "size",
+                                     "updated" };
+    /* each path runs in a child process, so that the peak RSS is not
+       the one left by the earlier benchmarks or the other path, and the
+       free heap is given back first so that the child cannot reuse
+       resident pages */
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        fprintf(stderr, "cannot fork\n");
+        exit(1);
+    }
+    if (pid > 0)
+    {
+        int status;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+        {
+            fprintf(stderr, "table streaming child failed\n");
+            exit(1);
+        }
+        return;
+    }
+    long start_rss = reset_peak_rss_kb();
+
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        fprintf(stderr, "cannot create pipe\n");
+        exit(1);
+    }
+    pipe_reader reader = { fds[0], 0, 0 };
+    pthread_t thread;
+    pthread_create(&thread, NULL, &pipe_reader_fn, &reader);
+
+    zclk_writer *writer;
+    create_zclk_writer_fd(&writer, fds[1]);
+    char cells[5][32];
+    const char *row[5];
+
+    size_t allocs = ALLOC_COUNT();
+    double start = now_ns();
+    if (use_stream)
+    {
+        zclk_table_stream *stream;
+        create_zclk_table_stream(&stream, writer, 5,
+            ZCLK_TABLE_STREAM_SAMPLE_ROWS);
+        for (size_t c = 0; c < 5; c++)
+        {
+            zclk_table_stream_set_header(stream, c, headers[c]);
+        }
+        for (size_t r = 0; r < num_rows; r++)
+        {
+            make_bench_row(r, cells, row);
+            zclk_table_stream_push_row(stream, row);
+        }
+        write_result(writer, ZCLK_RES_SUCCESS, ZCLK_RESULT_TABLE_STREAM,
+            stream);
+        free_zclk_table_stream(stream);
+    }
+    else
+    {
+        zclk_table *tbl;
+        create_zclk_table(&tbl, num_rows, 5);
+        for (size_t c = 0; c < 5; c++)
+        {
+            zclk_table_set_header(tbl, c, (char *)headers[c]);
+        }
+        for (size_t r = 0; r < num_rows; r++)
+        {
+            make_bench_row(r, cells, row);
+            for (size_t c = 0; c < 5; c++)
+            {
+                zclk_table_set_row_val(tbl, r, c, (char *)row[c]);
+            }
+        }
+        write_result(writer, ZCLK_RES_SUCCESS, ZCLK_RESULT_TABLE, tbl);
+        free_zclk_table(tbl);
+    }
+    double end = now_ns();
+    allocs = ALLOC_COUNT() - allocs;
+
+    free_zclk_writer(writer);
+    close(fds[1]);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+
+    printf("%-12s %14.1f %12.1f %12zu %14ld\n",
+        use_stream ? "stream" : "table", (reader.first_byte_ns - start) / 1e6,
+        (end - start) / 1e6, allocs, peak_rss_growth_kb(start_rss));
+    fflush(stdout);
+    _exit(0);
+}
+#endif
+
+static void bench_table_streaming(void)
+{
+#ifndef _WIN32
+    const size_t num_rows = 1000000;
+    printf("%-12s %14s %12s %12s %14s\n", "path", "first_byte_ms",
+        "total_ms", "allocs", "rss_growth_kb");
+    time_table_to_pipe(1, num_rows);
+    time_table_to_pipe(0, num_rows);
+#endif
+}
+
+typedef struct suite_params_t
+{
+    int depth;
+    int fanout;
+    int options;
+    int max_tokens;
+    int iterations;
+    const char *format;
+} suite_params;
+
+typedef enum
+{
+    STAGE_ARGV = 0,
+    STAGE_DISPATCH,
+    STAGE_OPTIONS,
+    STAGE_ARGS,
+    STAGE_EXEC,
+    NUM_STAGES
+} suite_stage;
+
+static const char *stage_names[NUM_STAGES] = {
+    "make_zclk_argv", "get_command_to_exec", "parse_options", "parse_args",
+    "exec_command"
+};
+
+/*
+ * Options are named after the level of their command, so that the options
+ * of every command in the invoked chain can be given on the command line.
+ */
+static zclk_command *make_synthetic_command(zclk_arena *arena,
+    const char *name, int level, const suite_params *p)
+{
+    zclk_command *cmd = new_zclk_command_in(arena, name, NULL,
+                            "A synthetic command", &noop_handler);
+    for (int o = 0; o < p->options; o++)
+    {
+        char opt_name[32], short_name[32];
+        snprintf(opt_name, sizeof(opt_name), "l%d-option-%d", level, o);
+        snprintf(short_name, sizeof(short_name), "l%do%d", level, o);
+        switch (o % 3)
+        {
+        case 0:
+            zclk_command_int_option(cmd, opt_name, short_name, 0,
+                "An int option");
+            break;
+        case 1:
+            zclk_command_string_option(cmd, opt_name, short_name, "",
+                "A string option");
+            break;
+        default:
+            zclk_command_flag_option(cmd, opt_name, short_name,
+                "A flag option");
+            break;
+        }
+    }
+    if (level < p->depth)
+    {
+        for (int f = 0; f < p->fanout; f++)
+        {
+            char child[32];
+            snprintf(child, sizeof(child), "command-%d", f);
+            zclk_command_subcommand_add(cmd,
+                make_synthetic_command(arena, child, level + 1, p));
+        }
+    }
+    else
+    {
+        zclk_command_string_argument(cmd, "file", "", "An argument", 1);
+    }
+    return cmd;
+}
+
+/*
+ * Fill argv with the path to the last leaf, option tokens of the chain up
+ * to argc - 1 tokens and the argument of the leaf. The strings are owned
+ * by the pool, freed by the caller.
+ */
+static int make_synthetic_argv(const suite_params *p, int argc,
+    char **argv, char **pool)
+{
+    int n = 0, pooled = 0;
+    argv[n++] = "synthetic";
+    for (int l = 1; l <= p->depth; l++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "command-%d", p->fanout - 1);
+        argv[n++] = pool[pooled++] = zclk_str_clone(name);
+    }
+    int num_chain_options = (p->depth + 1) * p->options;
+    for (int k = 0; num_chain_options > 0 && n < argc - 2; k++)
+    {
+        int level = k % (p->depth + 1);
+        int o = (k / (p->depth + 1)) % p->options;
+        char token[64];
+        switch (o % 3)
+        {
+        case 0:
+            snprintf(token, sizeof(token), "--l%d-option-%d", level, o);
+            argv[n++] = pool[pooled++] = zclk_str_clone(token);
+            argv[n++] = "42";
+            break;
+        case 1:
+            snprintf(token, sizeof(token), "--l%d-option-%d=value", level, o);
+            argv[n++] = pool[pooled++] = zclk_str_clone(token);
+            break;
+        default:
+            snprintf(token, sizeof(token), "-l%do%d", level, o);
+            argv[n++] = pool[pooled++] = zclk_str_clone(token);
+            break;
+        }
+    }
+    argv[n++] = "file.txt";
+    return n;
+}
+
+/*
+ * Run the parse up to (and including) the given stage, the cost of a
+ * stage is the difference with the previous one.
+ */
+static double time_stage(zclk_parse_ctx *ctx, arraylist *commands,
+    int argc, char **argv, int iterations, suite_stage stage,
+    double *allocs_per_parse)
+{
+    size_t allocs = ALLOC_COUNT();
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        zclk_res res = ZCLK_RES_SUCCESS;
+        if (stage == STAGE_EXEC)
+        {
+            res = exec_command_ctx(ctx, commands, NULL, argc, argv);
+        }
+        else
+        {
+            zclk_argv *av;
+            res = make_zclk_argv(&av, argc, argv);
+            if (res == ZCLK_RES_SUCCESS && stage >= STAGE_DISPATCH)
+            {
+                arraylist *chain = get_command_to_exec(commands, av);
+                if (stage >= STAGE_OPTIONS)
+                {
+                    zclk_parse_result *result;
+                    res = make_zclk_parse_result(&result, chain);
+                    if (res == ZCLK_RES_SUCCESS)
+                    {
+                        res = parse_options_ctx(ctx, result, av);
+                    }
+                    if (res == ZCLK_RES_SUCCESS && stage >= STAGE_ARGS)
+                    {
+                        res = parse_args_ctx(ctx, result, av);
+                    }
+                    free_zclk_parse_result(result);
+                }
+                else
+                {
+                    arraylist_free(chain);
+                }
+            }
+            free_zclk_argv(av);
+        }
+        if (res != ZCLK_RES_SUCCESS)
+        {
+            fprintf(stderr, "%s failed with error %d: %s\n",
+                stage_names[stage], res,
+                zclk_parse_ctx_get_error_message(ctx));
+            exit(1);
+        }
+    }
+    double elapsed = (now_ns() - start) / iterations;
+    *allocs_per_parse = (double)(ALLOC_COUNT() - allocs) / iterations;
+    return elapsed;
+}
+
+static void print_suite_row(const suite_params *p, int first,
+    const char *function, int tokens, int iterations, double ns,
+    double allocs, long rss_kb)
+{
+    if (strcmp(p->format, "csv") == 0)
+    {
+        if (first)
+        {
+            printf("function,depth,fanout,options,tokens,iterations,"
+                "ns_per_parse,allocs_per_parse,peak_rss_kb\n");
+        }
+        printf("%s,%d,%d,%d,%d,%d,%.1f,%.1f,%ld\n", function, p->depth,
+            p->fanout, p->options, tokens, iterations, ns, allocs, rss_kb);
+    }
+    else if (strcmp(p->format, "json") == 0)
+    {
+        printf("%s\n    {\"function\": \"%s\", \"depth\": %d, "
+            "\"fanout\": %d, \"options\": %d, \"tokens\": %d, "
+            "\"iterations\": %d, \"ns_per_parse\": %.1f, "
+            "\"allocs_per_parse\": %.1f, \"peak_rss_kb\": %ld}",
+            first ? "{\"benchmark\": \"zclk_parser\", \"results\": [" : ",",
+            function, p->depth, p->fanout, p->options, tokens, iterations,
+            ns, allocs, rss_kb);
+    }
+    else
+    {
+        if (first)
+        {
+            printf("%-20s %8s %8s %12s %14s %12s\n", "function", "tokens",
+                "iters", "ns/parse", "allocs/parse", "peak_rss_kb");
+        }
+        printf("%-20s %8d %8d %12.1f %14.1f %12ld\n", function, tokens,
+            iterations, ns, allocs, rss_kb);
+    }
+}
+
+static void bench_parser_suite(const suite_params *p)
+{
+    zclk_arena *arena;
+    create_zclk_arena(&arena, 0);
+    zclk_command *root = make_synthetic_command(arena, "synthetic", 0, p);
+
+    arraylist *commands;
+    arraylist_new(&commands, NULL);
+    arraylist_add(commands, root);
+
+    zclk_parse_ctx *ctx;
+    make_zclk_parse_ctx(&ctx);
+
+    int max_tokens = p->max_tokens < p->depth + 2 ? p->depth + 2
+                        : p->max_tokens;
+    char **argv = (char **)calloc((size_t)max_tokens, sizeof(char *));
+    char **pool = (char **)calloc((size_t)max_tokens, sizeof(char *));
+    if (argv == NULL || pool == NULL)
+    {
+        fprintf(stderr, "allocation failed\n");
+        exit(1);
+    }
+
+    if (strcmp(p->format, "text") == 0)
+    {
+        printf("tree: depth %d, fanout %d, %d options per command\n",
+            p->depth, p->fanout, p->options);
+    }
+
+    int first = 1;
+    int tokens = p->depth + 2;
+    int prev_argc = 0;
+    while (1)
+    {
+        for (int i = 0; i < max_tokens && pool[i] != NULL; i++)
+        {
+            free(pool[i]);
+            pool[i] = NULL;
+        }
+        int argc = make_synthetic_argv(p, tokens, argv, pool);
+        if (argc == prev_argc)
+        {
+            /* no options to make the command line longer */
+            break;
+        }
+        prev_argc = argc;
+        int iterations = p->iterations > 0 ? p->iterations
+                            : (argc < 200 ? 100000 : 20000000 / argc);
+
+        double ns[NUM_STAGES], allocs[NUM_STAGES];
+        for (int stage = STAGE_ARGV; stage < NUM_STAGES; stage++)
+        {
+            ns[stage] = time_stage(ctx, commands, argc, argv, iterations,
+                            (suite_stage)stage, &allocs[stage]);
+        }
+        long rss_kb = peak_rss_kb();
+        for (int stage = STAGE_ARGV; stage < NUM_STAGES; stage++)
+        {
+            int cumulative = (stage > STAGE_ARGV && stage < STAGE_EXEC);
+            print_suite_row(p, first, stage_names[stage], argc, iterations,
+                cumulative ? ns[stage] - ns[stage - 1] : ns[stage],
+                cumulative ? allocs[stage] - allocs[stage - 1]
+                    : allocs[stage],
+                rss_kb);
+            first = 0;
+        }
+
+        if (tokens >= max_tokens)
+        {
+            break;
+        }
+        tokens = tokens * 8 > max_tokens ? max_tokens : tokens * 8;
+    }
+    if (strcmp(p->format, "json") == 0)
+    {
+        printf("\n]}\n");
+    }
+
+    for (int i = 0; i < max_tokens && pool[i] != NULL; i++)
+    {
+        free(pool[i]);
+    }
+    free(argv);
+    free(pool);
+    free_zclk_parse_ctx(ctx);
+    arraylist_free(commands);
+    free_zclk_arena(arena);
+}
+
+static zclk_res all_benchmarks_handler(zclk_command* cmd, void* handler_args)
+{
+    /* the handler of the top-level command also runs for sub-commands */
+    if (zclk_parse_result_get_command(zclk_current_parse_result()) != cmd)
+    {
+        return ZCLK_RES_SUCCESS;
+    }
+    int max_tokens = zclk_argument_get_val_int(
+                        zclk_command_get_argument(cmd, "max_tokens"));
+    int num_threads = zclk_argument_get_val_int(
+                        zclk_command_get_argument(cmd, "threads"));
+
+    printf("** argv scaling\n");
+    bench_argv_scaling(max_tokens);
+
+    printf("\n** option lookup\n");
+    bench_option_lookup();
+
+    printf("\n** frozen dispatch\n");
+    bench_frozen_dispatch();
+
+    printf("\n** tree allocations\n");
+    bench_tree_allocations();
+
+    printf("\n** threaded parse\n");
+    bench_threaded_parse(num_threads);
+
+    printf("\n** number parsing\n");
+    bench_number_parsing();
+
+    printf("\n** table output\n");
+    bench_table_output();
+
+    printf("\n** table storage\n");
+    bench_table_storage();
+
+    printf("\n** table streaming\n");
+    bench_table_streaming();
+
+    printf("\n** parallel table output\n");
+    bench_table_parallel();
+
+    printf("\n** structured output\n");
+    bench_structured_output();
+
+    printf("\n** dict\n");
+    bench_dict();
+
+    printf("\n** progress redraw\n");
+    bench_progress_redraw();
+
+    printf("\n** progress threads\n");
+    bench_progress_threads();
+
+    printf("\n** progress bar\n");
+    bench_progress_bar();
+
+    printf("\n** help\n");
+    bench_help();
+
+    printf("\n** completion\n");
+    bench_completion();
+
+    printf("\n** lazy tree\n");
+    bench_lazy_tree();
+
+    printf("\n** tree cache\n");
+    bench_tree_cache();
+
+    printf("\n** argument file\n");
+    bench_argfile();
+    return ZCLK_RES_SUCCESS;
+}
+
+static zclk_res suite_handler(zclk_command* cmd, void* handler_args)
+{
+    suite_params p;
+    p.depth = zclk_option_get_val_int(zclk_command_get_option(cmd, "depth"));
+    p.fanout = zclk_option_get_val_int(
+                    zclk_command_get_option(cmd, "fanout"));
+    p.options = zclk_option_get_val_int(
+                    zclk_command_get_option(cmd, "options"));
+    p.max_tokens = zclk_option_get_val_int(
+                    zclk_command_get_option(cmd, "max-tokens"));
+    p.iterations = zclk_option_get_val_int(
+                    zclk_command_get_option(cmd, "iterations"));
+    p.format = zclk_option_get_val_string(
+                    zclk_command_get_option(cmd, "format"));
+    if (p.depth < 0 || p.fanout < 1 || p.options < 0 || p.iterations < 0
+        || (strcmp(p.format, "text") != 0 && strcmp(p.format, "csv") != 0
+            && strcmp(p.format, "json") != 0))
+    {
+        fprintf(stderr, "invalid suite parameters\n");
+        return ZCLK_RES_ERR_UNKNOWN;
+    }
+    bench_parser_suite(&p);
+    return ZCLK_RES_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+    zclk_command *cmd = new_zclk_command(argv[0], "bench",
+                            "zclk benchmarks", &all_benchmarks_handler);
+    zclk_command_int_argument(cmd, "max_tokens", 1000000,
+        "Largest command line of the argv scaling benchmark", 1);
+    zclk_command_int_argument(cmd, "threads", 8,
+        "Number of threads of the threaded parse benchmark", 1);
+
+    zclk_command *suite = new_zclk_command("suite", "s",
+                            "Parser and dispatch benchmark suite",
+                            &suite_handler);
+    zclk_command_int_option(suite, "depth", "d", 3,
+        "Depth of the synthetic command tree");
+    zclk_command_int_option(suite, "fanout", "f", 8,
+        "Sub-commands of each command");
+    zclk_command_int_option(suite, "options", "o", 10,
+        "Options of each command");
+    zclk_command_int_option(suite, "max-tokens", "t", 4096,
+        "Length of the longest command line");
+    zclk_command_int_option(suite, "iterations", "i", 0,
+        "Parses per measurement (0 to scale with the length)");
+    zclk_command_string_option(suite, "format", "F", "text",
+        "Output format: text, csv or json");
+    zclk_command_subcommand_add(cmd, suite);
+
+    zclk_res err = zclk_command_exec(cmd, NULL, argc, argv);
+    free_command(cmd);
+    return err == ZCLK_RES_SUCCESS ? 0 : 1;
+}
@@ -7,16 +7,54 @@
 
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 #include "zclk.h"
-
-#define ZCLK_SIZE_OF_HELP_STR 4096
-#define ZCLK_SIZE_OF_PROGNAME_STR 1024
-static char help_str[ZCLK_SIZE_OF_HELP_STR];
-static char progname_str[ZCLK_SIZE_OF_PROGNAME_STR];
-static char short_progname_str[ZCLK_SIZE_OF_PROGNAME_STR];
-
-static char error_message_str[ZCLK_SIZE_OF_HELP_STR];
+#include "zclk_atomic.h"
+
+// context used by the functions which do not take one
+static zclk_parse_ctx default_parse_ctx;
+
+// guards the help caches of the commands, help can be requested with
+// different contexts on many threads at once
+#ifdef _WIN32
+static SRWLOCK help_cache_lock = SRWLOCK_INIT;
+#define help_cache_acquire() AcquireSRWLockExclusive(&help_cache_lock)
+#define help_cache_release() ReleaseSRWLockExclusive(&help_cache_lock)
+#else
+static pthread_mutex_t help_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#define help_cache_acquire() pthread_mutex_lock(&help_cache_lock)
+#define help_cache_release() pthread_mutex_unlock(&help_cache_lock)
+#endif
+
+// runs the loaders of lazy commands one at a time
+#ifdef _WIN32
+static SRWLOCK command_load_lock = SRWLOCK_INIT;
+#define command_load_acquire() AcquireSRWLockExclusive(&command_load_lock)
+#define command_load_release() ReleaseSRWLockExclusive(&command_load_lock)
+#else
+static pthread_mutex_t command_load_lock = PTHREAD_MUTEX_INITIALIZER;
+#define command_load_acquire() pthread_mutex_lock(&command_load_lock)
+#define command_load_release() pthread_mutex_unlock(&command_load_lock)
+#endif
+
+// number of loaders running on this thread, which holds the load lock
+static ZCLK_THREAD_LOCAL int command_load_depth = 0;
+
+// result of the exec whose handlers are running on this thread
+static ZCLK_THREAD_LOCAL zclk_parse_result *current_parse_result = NULL;
+
+// sink of the command whose handler is running on this thread
+static ZCLK_THREAD_LOCAL zclk_writer *current_writer = NULL;
+
+// format chosen with --output for the handlers running on this thread
+static ZCLK_THREAD_LOCAL zclk_output_format current_output_format =
+	ZCLK_OUTPUT_TABLE;
 
 void print_args(int argc, char **argv)
 {
@@ -26,9 +64,35 @@ void print_args(int argc, char **argv)
 	}
 }
 
+/**
+ * Allocate zeroed memory from the arena, or from the heap if it is NULL.
+ */
+static void *alloc_in(zclk_arena *arena, size_t size)
+{
+	if (arena != NULL)
+	{
+		return zclk_arena_alloc(arena, size);
+	}
+	return calloc(1, size);
+}
+
+static char *str_clone_in(zclk_arena *arena, const char *from)
+{
+	if (arena != NULL)
+	{
+		return zclk_arena_str_clone(arena, from);
+	}
+	return zclk_str_clone(from);
+}
+
 zclk_res make_zclk_val(zclk_val **val, zclk_type type)
 {
-	(*val) = (zclk_val *)calloc(1, sizeof(zclk_val));
+	return make_zclk_val_in(NULL, val, type);
+}
+
+zclk_res make_zclk_val_in(zclk_arena *arena, zclk_val **val, zclk_type type)
+{
+	(*val) = (zclk_val *)alloc_in(arena, sizeof(zclk_val));
 	if ((*val) == NULL)
 	{
 		return ZCLK_RES_ERR_ALLOC_FAILED;
@@ -76,7 +140,7 @@ zclk_val* new_zclk_val_string(const char* string_val)
 	zclk_res res = make_zclk_val(&val, ZCLK_TYPE_STRING);
 	if(res == ZCLK_RES_SUCCESS)
 	{
-		val->data.str_value = zclk_str_clone(string_val);
+		zclk_val_set_string(val, string_val);
 	}
 	return val;
 }
@@ -157,12 +221,69 @@ void zclk_val_set_dobule(zclk_val *val, double dval)
 	}
 }
 
+/**
+ * Free the string of a string value if the value owns it.
+ */
+static void val_release_string(zclk_val *val)
+{
+	if (zclk_val_is_string(val))
+	{
+		if (val->str_owned)
+		{
+			free(val->data.str_value);
+		}
+		val->data.str_value = NULL;
+		val->str_owned = 0;
+	}
+}
+
 void zclk_val_set_string(zclk_val *val, const char* sval)
 {
 	if(val!= NULL)
 	{
-		val->data.str_value = zclk_str_clone(sval);
+		zclk_val_take_string(val, zclk_str_clone(sval));
+	}
+}
+
+void zclk_val_borrow_string(zclk_val *val, const char* sval)
+{
+	if(val!= NULL)
+	{
+		val_release_string(val);
+		val->data.str_value = (char *)sval;
+		val->str_owned = 0;
+	}
+}
+
+void zclk_val_take_string(zclk_val *val, char* sval)
+{
+	if(val!= NULL)
+	{
+		val_release_string(val);
+		val->data.str_value = sval;
+		val->str_owned = (sval != NULL);
+	}
+}
+
+zclk_res zclk_val_own_string(zclk_val *val)
+{
+	if (zclk_val_is_string(val) && !val->str_owned
+		&& val->data.str_value != NULL)
+	{
+		char *copy = zclk_str_clone(val->data.str_value);
+		if (copy == NULL)
+		{
+			return ZCLK_RES_ERR_ALLOC_FAILED;
+		}
+		val->data.str_value = copy;
+		val->str_owned = 1;
 	}
+	return ZCLK_RES_SUCCESS;
+}
+
+int zclk_val_is_string_owned(zclk_val *val)
+{
+	return zclk_val_is_string(val) && val->str_owned;
 }
 
 void zclk_val_set_flag(zclk_val *val, int fval)
@@ -175,15 +296,17 @@ void zclk_val_set_flag(zclk_val *val, int fval)
 
 void free_zclk_val(zclk_val * val)
 {
-	if (zclk_val_is_string(val))
-	{
-		free(val->data.str_value);
-	}
+	val_release_string(val);
 	free(val);
 }
 
 void copy_zclk_val(zclk_val *to, zclk_val *from)
 {
+	if (to == from)
+	{
+		return;
+	}
+	val_release_string(to);
 	to->type = from->type;
 	if(zclk_val_is_bool(from))
 	{
@@ -199,7 +322,7 @@ void copy_zclk_val(zclk_val *to, zclk_val *from)
 	}
 	if(zclk_val_is_string(from))
 	{
-		to->data.str_value = from->data.str_value;
+		zclk_val_borrow_string(to, from->data.str_value);
 	}
 	if(zclk_val_is_flag(from))
 	{
@@ -207,6 +330,19 @@ void copy_zclk_val(zclk_val *to, zclk_val *from)
 	}
 }
 
+static zclk_res number_res_to_zclk_res(zclk_number_res res)
+{
+	switch (res)
+	{
+	case ZCLK_NUMBER_OK:
+		return ZCLK_RES_SUCCESS;
+	case ZCLK_NUMBER_RANGE:
+		return ZCLK_RES_ERR_VALUE_OUT_OF_RANGE;
+	default:
+		return ZCLK_RES_ERR_INVALID_VALUE;
+	}
+}
+
 zclk_res parse_zclk_val(zclk_val *val, char *input)
 {
 	if (input == NULL)
@@ -215,45 +351,38 @@ zclk_res parse_zclk_val(zclk_val *val, char *input)
 	}
 	else
 	{
-		int v, n;
+		int v;
 		double d;
+		zclk_number_res res;
 		switch (val->type)
 		{
 		case ZCLK_TYPE_BOOLEAN:
-			n = sscanf(input, "%d", &v);
-			if (n == 1)
+			res = zclk_parse_int(input, &v);
+			if (res == ZCLK_NUMBER_OK)
 			{
-				if (v > 0)
-				{
-					zclk_val_set_bool(val, 1);
-				}
-				else
-				{
-					zclk_val_set_bool(val, 0);
-				}
+				zclk_val_set_bool(val, v > 0 ? 1 : 0);
 			}
-			break;
+			return number_res_to_zclk_res(res);
 		case ZCLK_TYPE_INT:
-			n = sscanf(input, "%d", &v);
-			if (n == 1)
+			res = zclk_parse_int(input, &v);
+			if (res == ZCLK_NUMBER_OK)
 			{
 				zclk_val_set_int(val, v);
 			}
-			break;
+			return number_res_to_zclk_res(res);
 		case ZCLK_TYPE_DOUBLE:
-			n = sscanf(input, "%lf", &d);
-			if (n == 1)
+			res = zclk_parse_double(input, &d);
+			if (res == ZCLK_NUMBER_OK)
 			{
 				zclk_val_set_dobule(val, d);
 			}
-			break;
+			return number_res_to_zclk_res(res);
 		case ZCLK_TYPE_STRING:
-			zclk_val_set_string(val, input);
-			break;
+			zclk_val_borrow_string(val, input);
+			return ZCLK_RES_SUCCESS;
 		default:
 			return ZCLK_RES_ERR_UNKNOWN;
 		}
-		return ZCLK_RES_SUCCESS;
 	}
 }
 
@@ -297,16 +426,25 @@ int zclk_val_to_lua(lua_State *L, zclk_val *val)
 zclk_res make_option(zclk_option **option, const char *name, const char *short_name,
 	zclk_val* val, zclk_val* default_val, const char *description)
 {
-	(*option) = (zclk_option *)calloc(1, sizeof(zclk_option));
+	return make_option_in(NULL, option, name, short_name, val, default_val,
+		description);
+}
+
+zclk_res make_option_in(zclk_arena *arena, zclk_option **option,
+	const char *name, const char *short_name, zclk_val* val,
+	zclk_val* default_val, const char *description)
+{
+	(*option) = (zclk_option *)alloc_in(arena, sizeof(zclk_option));
 	if ((*option) == NULL)
 	{
 		return ZCLK_RES_ERR_ALLOC_FAILED;
 	}
-	(*option)->name = zclk_str_clone(name);
-	(*option)->short_name = zclk_str_clone(short_name);
-	(*option)->description = zclk_str_clone(description);
+	(*option)->name = str_clone_in(arena, name);
+	(*option)->short_name = str_clone_in(arena, short_name);
+	(*option)->description = str_clone_in(arena, description);
 	(*option)->val = val;
 	(*option)->default_val = default_val;
+	(*option)->arena = arena;
 	return ZCLK_RES_SUCCESS;
 }
 
@@ -382,13 +520,31 @@ const char *zclk_option_get_desc(zclk_option *opt)
 	return (opt->name);
 }
 
+zclk_val *zclk_option_get_val(zclk_option *opt)
+{
+	if(opt == NULL)
+	{
+		return NULL;
+	}
+	if(current_parse_result != NULL)
+	{
+		zclk_val *val = zclk_parse_result_get_option(current_parse_result,
+			opt);
+		if(val != NULL)
+		{
+			return val;
+		}
+	}
+	return opt->val;
+}
+
 int zclk_option_get_val_bool(zclk_option *opt)
 {
 	if(opt == NULL)
 	{
 		return 0;
 	}
-	return zclk_val_get_bool(opt->val);
+	return zclk_val_get_bool(zclk_option_get_val(opt));
 }
 
 int zclk_option_get_val_int(zclk_option *opt)
@@ -397,7 +553,7 @@ int zclk_option_get_val_int(zclk_option *opt)
 	{
 		return 0;
 	}
-	return zclk_val_get_int(opt->val);
+	return zclk_val_get_int(zclk_option_get_val(opt));
 }
 
 double zclk_option_get_val_double(zclk_option *opt)
@@ -406,7 +562,7 @@ double zclk_option_get_val_double(zclk_option *opt)
 	{
 		return 0;
 	}
-	return zclk_val_get_double(opt->val);
+	return zclk_val_get_double(zclk_option_get_val(opt));
 }
 
 const char* zclk_option_get_val_string(zclk_option *opt)
@@ -415,7 +571,7 @@ const char* zclk_option_get_val_string(zclk_option *opt)
 	{
 		return NULL;
 	}
-	return zclk_val_get_string(opt->val);
+	return zclk_val_get_string(zclk_option_get_val(opt));
 }
 
 int zclk_option_get_val_flag(zclk_option *opt)
@@ -424,7 +580,7 @@ int zclk_option_get_val_flag(zclk_option *opt)
 	{
 		return 0;
 	}
-	return zclk_val_get_flag(opt->val);
+	return zclk_val_get_flag(zclk_option_get_val(opt));
 }
 
 int zclk_option_get_default_val_bool(zclk_option *opt)
@@ -474,6 +630,13 @@ int zclk_option_get_default_val_flag(zclk_option *opt)
 
 void free_option(zclk_option *option)
 {
+	if (option->arena != NULL)
+	{
+		// released with the arena, except strings set on the values
+		val_release_string(option->val);
+		val_release_string(option->default_val);
+		return;
+	}
 	if (option->short_name)
 	{
 		free(option->short_name);
@@ -483,11 +646,8 @@ void free_option(zclk_option *option)
 		free(option->description);
 	}
 
-	free(option->val);
-	if (option->default_val)
-	{
-		free(option->default_val);
-	}
+	free_zclk_val(option->val);
+	free_zclk_val(option->default_val);
 	free(option->name);
 	free(option);
 }
@@ -528,7 +688,7 @@ int zclk_option_to_lua(lua_State *L, zclk_option *option)
 		}
 		lua_setfield(L, -2, "short_name");
 
-		zclk_val_to_lua(L, option->val);
+		zclk_val_to_lua(L, zclk_option_get_val(option));
 		lua_setfield(L, -2, "val");
 
 		zclk_val_to_lua(L, option->default_val);
@@ -565,16 +725,24 @@ void zclk_fill_options_in_list(arraylist* optlist, zclk_option* options[]) {
 zclk_res make_argument(zclk_argument **arg, const char* name, zclk_val* val, 
 	zclk_val* default_val, const char* description)
 {
-	(*arg) = (zclk_argument *)calloc(1, sizeof(zclk_argument));
+	return make_argument_in(NULL, arg, name, val, default_val, description);
+}
+
+zclk_res make_argument_in(zclk_arena *arena, zclk_argument **arg,
+	const char* name, zclk_val* val, zclk_val* default_val,
+	const char* description)
+{
+	(*arg) = (zclk_argument *)alloc_in(arena, sizeof(zclk_argument));
 	if ((*arg) == NULL)
 	{
 		return ZCLK_RES_ERR_ALLOC_FAILED;
 	}
-	(*arg)->name = zclk_str_clone(name);
-	(*arg)->description = zclk_str_clone(description);
+	(*arg)->name = str_clone_in(arena, name);
+	(*arg)->description = str_clone_in(arena, description);
 	(*arg)->optional = 0;
 	(*arg)->val = val;
 	(*arg)->default_val = default_val;
+	(*arg)->arena = arena;
 	return ZCLK_RES_SUCCESS;
 }
 
@@ -645,13 +813,31 @@ const char *zclk_argument_get_desc(zclk_argument *arg)
 }
 
 
+zclk_val *zclk_argument_get_val(zclk_argument *arg)
+{
+	if(arg == NULL)
+	{
+		return NULL;
+	}
+	if(current_parse_result != NULL)
+	{
+		zclk_val *val = zclk_parse_result_get_argument(current_parse_result,
+			arg);
+		if(val != NULL)
+		{
+			return val;
+		}
+	}
+	return arg->val;
+}
+
 int zclk_argument_get_val_bool(zclk_argument *arg)
 {
 	if(arg == NULL)
 	{
 		return 0;
 	}
-	return zclk_val_get_bool(arg->val);
+	return zclk_val_get_bool(zclk_argument_get_val(arg));
 }
 
 int zclk_argument_get_val_int(zclk_argument *arg)
@@ -660,7 +846,7 @@ int zclk_argument_get_val_int(zclk_argument *arg)
 	{
 		return 0;
 	}
-	return zclk_val_get_int(arg->val);
+	return zclk_val_get_int(zclk_argument_get_val(arg));
 }
 
 double zclk_argument_get_val_double(zclk_argument *arg)
@@ -669,7 +855,7 @@ double zclk_argument_get_val_double(zclk_argument *arg)
 	{
 		return 0;
 	}
-	return zclk_val_get_double(arg->val);
+	return zclk_val_get_double(zclk_argument_get_val(arg));
 }
 
 const char* zclk_argument_get_val_string(zclk_argument *arg)
@@ -678,7 +864,7 @@ const char* zclk_argument_get_val_string(zclk_argument *arg)
 	{
 		return 0;
 	}
-	return zclk_val_get_string(arg->val);
+	return zclk_val_get_string(zclk_argument_get_val(arg));
 }
 
 int zclk_argument_get_val_flag(zclk_argument *arg)
@@ -687,7 +873,7 @@ int zclk_argument_get_val_flag(zclk_argument *arg)
 	{
 		return 0;
 	}
-	return zclk_val_get_flag(arg->val);
+	return zclk_val_get_flag(zclk_argument_get_val(arg));
 }
 
 int zclk_argument_get_default_val_bool(zclk_argument *arg)
@@ -738,15 +924,19 @@ int zclk_argument_get_default_val_flag(zclk_argument *arg)
 
 void free_argument(zclk_argument *arg)
 {
-	if (arg->description)
+	if (arg->arena != NULL)
 	{
-		free(arg->description);
+		// released with the arena, except strings set on the values
+		val_release_string(arg->val);
+		val_release_string(arg->default_val);
+		return;
 	}
-	free(arg->val);
-	if (arg->default_val)
+	if (arg->description)
 	{
-		free(arg->default_val);
+		free(arg->description);
 	}
+	free_zclk_val(arg->val);
+	free_zclk_val(arg->default_val);
 	free(arg->name);
 	free(arg);
 }
@@ -763,7 +953,7 @@ int zclk_argument_to_lua(lua_State *L, zclk_argument* arg)
 		lua_settable(L, -3);
 
 		lua_pushstring(L, "val");
-		zclk_val_to_lua(L, arg->val);
+		zclk_val_to_lua(L, zclk_argument_get_val(arg));
 		lua_settable(L, -3);
 
 		lua_pushstring(L, "default_val");
@@ -787,17 +977,116 @@ void arraylist_zclk_argument_to_lua(lua_State *L, int index, void *data) {
 }
 #endif //LUA_ENABLED
 
+/**
+ * Copy the value into the arena of the command (or the heap).
+ */
+static zclk_val *command_val(zclk_command *cmd, zclk_val *init)
+{
+	zclk_val *val;
+	if (make_zclk_val_in(cmd->arena, &val, init->type) != ZCLK_RES_SUCCESS)
+	{
+		return NULL;
+	}
+	val->data = init->data;
+	if (zclk_val_is_string(init))
+	{
+		// strings in the arena are released with it
+		val->data.str_value = str_clone_in(cmd->arena, init->data.str_value);
+		val->str_owned = (cmd->arena == NULL && val->data.str_value != NULL);
+	}
+	return val;
+}
+
+/**
+ * Create an option with the given default in the arena of the command
+ * and add it to the command.
+ */
+static zclk_option *command_option_in(zclk_command *cmd, const char *name,
+	const char *short_name, zclk_val init, const char *desc)
+{
+	zclk_option *option;
+	if (cmd != NULL && make_option_in(cmd->arena, &option, name, short_name,
+			command_val(cmd, &init), command_val(cmd, &init), desc)
+				== ZCLK_RES_SUCCESS
+		&& zclk_command_option_add(cmd, option) == ZCLK_RES_SUCCESS)
+	{
+		return option;
+	}
+	return NULL;
+}
+
+/**
+ * Create an argument with the given default in the arena of the command
+ * and add it to the command.
+ */
+static void command_argument_in(zclk_command *cmd, const char *name,
+	zclk_val init, const char *desc)
+{
+	zclk_argument *arg;
+	if (cmd != NULL && make_argument_in(cmd->arena, &arg, name,
+			command_val(cmd, &init), command_val(cmd, &init), desc)
+				== ZCLK_RES_SUCCESS)
+	{
+		zclk_command_argument_add(cmd, arg);
+	}
+}
+
+/**
+ * Free the option, argument and sub-command lists of the command. These
+ * are the only heap memory held by a command in an arena.
+ */
+static void command_release_lists(zclk_command *command)
+{
+	arraylist_free(command->options);
+	arraylist_free(command->sub_commands);
+	arraylist_free(command->args);
+}
+
+/**
+ * Free the heap memory held by a heap command, other than the command
+ * object and its names.
+ */
+static void command_release(zclk_command *command)
+{
+	free(command->help_cache);
+	free(command->option_index);
+	free_zclk_trie(command->sub_command_index);
+	// the root of a frozen tree (index 0) owns it
+	if (command->frozen != NULL && command->frozen_id == 0)
+	{
+		free_zclk_frozen(command->frozen);
+	}
+	command_release_lists(command);
+}
+
 zclk_res make_command(zclk_command **command, const char *name, const char *short_name,
 						 const char *description, zclk_command_fn handler)
 {
-	(*command) = (zclk_command *)calloc(1, sizeof(zclk_command));
+	return make_command_in(NULL, command, name, short_name, description,
+		handler);
+}
+
+/**
+ * Create a command without the built-in options.
+ */
+static zclk_res command_init_in(zclk_arena *arena, zclk_command **command,
+	const char *name, const char *short_name, const char *description,
+	zclk_command_fn handler)
+{
+	(*command) = (zclk_command *)alloc_in(arena, sizeof(zclk_command));
 	if ((*command) == NULL)
 	{
 		return ZCLK_RES_ERR_ALLOC_FAILED;
 	}
-	(*command)->name = zclk_str_clone(name);
-	(*command)->short_name = zclk_str_clone(short_name);
-	(*command)->description = zclk_str_clone(description);
+	if (arena != NULL && zclk_arena_add_cleanup(arena,
+			(zclk_arena_cleanup_fn)&command_release_lists, (*command)) != 0)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	(*command)->arena = arena;
+	(*command)->name = str_clone_in(arena, name);
+	(*command)->short_name = str_clone_in(arena, short_name);
+	(*command)->description = str_clone_in(arena, description);
 	(*command)->handler = handler;
 	(*command)->error_handler = (zclk_command_output_handler)&print_handler;
 	(*command)->success_handler = (zclk_command_output_handler)&print_handler;
@@ -806,11 +1095,9 @@ zclk_res make_command(zclk_command **command, const char *name, const char *shor
 	#ifdef LUA_ENABLED
 		set_lua_convertor((*command)->options, &arraylist_zclk_option_to_lua);
 	#endif //LUA_ENABLED
-	//arraylist_new(&((*command)->sub_commands), (void (*)(void *)) & free_command);
-	// sub-commands are to be freed individually as this works with the lua
-	// automatic garbage collection model.
-	// otherwise if sub-commands are freed by command gc call,
-	// then sub-command free fails with dangling pointer...
+	// sub-commands are freed by free_command of the command they were
+	// first added to (their parent), not by the list, as a command can be
+	// in more than one list.
 	arraylist_new(&((*command)->sub_commands), NULL);
 	arraylist_new(&((*command)->args), (void (*)(void *)) & free_argument);
 
@@ -818,201 +1105,661 @@ zclk_res make_command(zclk_command **command, const char *name, const char *shor
 		set_lua_convertor((*command)->args, &arraylist_zclk_argument_to_lua);
 	#endif //LUA_ENABLED
 
-	zclk_command_option_add(
-		(*command),
-		new_zclk_option(ZCLK_OPTION_HELP_LONG,
-					  ZCLK_OPTION_HELP_SHORT, zclk_flag(0),
-					  zclk_flag(0), ZCLK_OPTION_HELP_DESC));
-
 	return ZCLK_RES_SUCCESS;
 }
 
+/**
+ * Add the --help option every command has.
+ */
+static void command_add_builtin_options(zclk_command *command)
+{
+	zclk_val help_init = { .type = ZCLK_TYPE_FLAG };
+	command_option_in(command, ZCLK_OPTION_HELP_LONG,
+		ZCLK_OPTION_HELP_SHORT, help_init, ZCLK_OPTION_HELP_DESC);
+}
+
+zclk_res make_command_in(zclk_arena *arena, zclk_command **command,
+	const char *name, const char *short_name, const char *description,
+	zclk_command_fn handler)
+{
+	zclk_res res = command_init_in(arena, command, name, short_name,
+		description, handler);
+	if (res == ZCLK_RES_SUCCESS)
+	{
+		command_add_builtin_options(*command);
+	}
+	return res;
+}
+
 zclk_command* new_zclk_command(const char* name, const char* short_name,
 	const char* description, zclk_command_fn handler) {
+	return new_zclk_command_in(NULL, name, short_name, description, handler);
+}
+
+zclk_command* new_zclk_command_in(zclk_arena* arena, const char* name,
+	const char* short_name, const char* description, zclk_command_fn handler) {
 	zclk_command* cmd;
-	if (make_command(&cmd, name, short_name, description, handler) == ZCLK_RES_SUCCESS) {
+	if (make_command_in(arena, &cmd, name, short_name, description, handler) == ZCLK_RES_SUCCESS) {
 		return cmd;
 	}
 	return NULL;
 }
 
-zclk_res zclk_command_subcommand_add(zclk_command *cmd, 
-											zclk_command *subcommand)
+/**
+ * FNV-1a hash of the first len chars of the name. Long and short names
+ * hash differently, and 0 is reserved to mark an empty slot.
+ */
+static size_t option_index_hash(const char *name, size_t len, int is_short)
 {
-	if(cmd == NULL || subcommand == NULL) 
+	size_t h = (size_t)14695981039346656037ULL;
+	for (size_t i = 0; i < len; i++)
 	{
-		return ZCLK_RES_ERR_UNKNOWN;
+		h ^= (unsigned char)name[i];
+		h *= (size_t)1099511628211ULL;
 	}
-
-	arraylist_add(cmd->sub_commands, subcommand);
-	return ZCLK_RES_SUCCESS;
+	h ^= (size_t)is_short;
+	return h == 0 ? 1 : h;
 }
 
-zclk_res zclk_command_option_add(
-							zclk_command *cmd,
-							zclk_option* option
-						)
+static zclk_option_slot *option_index_probe(zclk_option_slot *slots,
+	size_t cap, const char *name, size_t len, int is_short, size_t hash)
 {
-	if(cmd == NULL || option == NULL) 
+	size_t mask = cap - 1;
+	for (size_t i = hash & mask; ; i = (i + 1) & mask)
 	{
-		return ZCLK_RES_ERR_UNKNOWN;
+		zclk_option_slot *slot = &slots[i];
+		if (slot->hash == 0)
+		{
+			return slot;
+		}
+		if (slot->hash == hash && slot->is_short == is_short
+			&& strncmp(slot->key, name, len) == 0 && slot->key[len] == '\0')
+		{
+			return slot;
+		}
 	}
+}
 
-	arraylist_add(cmd->options, option);
+static zclk_res option_index_grow(zclk_command *cmd)
+{
+	size_t new_cap = cmd->option_index_cap == 0 ? 16
+		: cmd->option_index_cap * 2;
+	zclk_option_slot *slots = (zclk_option_slot *)alloc_in(cmd->arena,
+		new_cap * sizeof(zclk_option_slot));
+	if (slots == NULL)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	for (size_t i = 0; i < cmd->option_index_cap; i++)
+	{
+		zclk_option_slot *old = &cmd->option_index[i];
+		if (old->hash != 0)
+		{
+			*option_index_probe(slots, new_cap, old->key, strlen(old->key),
+				old->is_short, old->hash) = *old;
+		}
+	}
+	if (cmd->arena == NULL)
+	{
+		free(cmd->option_index);
+	}
+	cmd->option_index = slots;
+	cmd->option_index_cap = new_cap;
 	return ZCLK_RES_SUCCESS;
 }
 
-zclk_res zclk_command_argument_add(
-							zclk_command *cmd,
-							zclk_argument* arg
-						)
+static zclk_res option_index_put(zclk_command *cmd, const char *key,
+	int is_short, zclk_option *option)
 {
-	if(cmd == NULL || arg == NULL) 
+	if (key == NULL)
 	{
-		return ZCLK_RES_ERR_UNKNOWN;
+		return ZCLK_RES_SUCCESS;
 	}
-
-	arraylist_add(cmd->args, arg);
+	// keep the load factor under 1/2
+	if ((cmd->option_index_used + 1) * 2 > cmd->option_index_cap)
+	{
+		zclk_res res = option_index_grow(cmd);
+		if (res != ZCLK_RES_SUCCESS)
+		{
+			return res;
+		}
+	}
+	size_t len = strlen(key);
+	size_t hash = option_index_hash(key, len, is_short);
+	zclk_option_slot *slot = option_index_probe(cmd->option_index,
+		cmd->option_index_cap, key, len, is_short, hash);
+	if (slot->hash == 0)
+	{
+		cmd->option_index_used += 1;
+	}
+	// a later option with the same name replaces the earlier one
+	slot->key = key;
+	slot->hash = hash;
+	slot->is_short = is_short;
+	slot->option = option;
 	return ZCLK_RES_SUCCESS;
 }
 
-void zclk_command_bool_option(zclk_command *cmd, const char *name, 
-				const char* short_name, const char *desc)
+/**
+ * Index any options added to the options list directly
+ * (i.e. not through zclk_command_option_add).
+ */
+static void option_index_sync(zclk_command *cmd)
 {
-	zclk_command_option_add(cmd, 
-			new_zclk_option_bool(
-					name,
-					short_name,
-					0,
-					desc
-				));
+	size_t opt_len = arraylist_length(cmd->options);
+	while (cmd->option_index_count < opt_len)
+	{
+		zclk_option *opt = arraylist_get(cmd->options,
+			cmd->option_index_count);
+		if (option_index_put(cmd, opt->name, 0, opt) != ZCLK_RES_SUCCESS
+			|| option_index_put(cmd, opt->short_name, 1, opt)
+				!= ZCLK_RES_SUCCESS)
+		{
+			return;
+		}
+		cmd->option_index_count += 1;
+	}
 }
 
-void zclk_command_int_option(zclk_command *cmd, const char *name, 
-				const char* short_name, int default_val, const char *desc)
+/**
+ * Check if the command is part of a tree frozen in memory. The commands
+ * of a tree mapped from a cache also point to its block, but can change.
+ */
+static int command_is_frozen(zclk_command *cmd)
 {
-	zclk_command_option_add(cmd, 
-			new_zclk_option_int(
-					name,
-					short_name,
-					default_val,
-					desc
-				));
+	return cmd->frozen != NULL && cmd->frozen->cache == NULL;
 }
 
+static int command_load_pending(zclk_command *cmd);
 
-void zclk_command_double_option(zclk_command *cmd, const char *name, 
-				const char* short_name, double default_val, const char *desc)
+/**
+ * Check if a command of a frozen tree can be parsed on the block, which a
+ * command mapped from a cache can as long as its lists are not filled in,
+ * or hold just what the block has.
+ */
+static int command_on_block(zclk_command *cmd)
 {
-	zclk_command_option_add(cmd, 
-			new_zclk_option_double(
-					name,
-					short_name,
-					default_val,
-					desc
-				));
+	if (cmd->frozen == NULL)
+	{
+		return 0;
+	}
+	if (command_is_frozen(cmd) || command_load_pending(cmd))
+	{
+		return 1;
+	}
+	const zclk_frozen_command *fc = zclk_frozen_get_command(cmd->frozen,
+		cmd->frozen_id);
+	return arraylist_length(cmd->options) == fc->num_options
+		&& arraylist_length(cmd->args) == fc->num_args
+		&& arraylist_length(cmd->sub_commands) == fc->num_children;
 }
 
-
-void zclk_command_string_option(zclk_command *cmd, const char *name, 
-				const char* short_name, const char *default_val, 
-				const char *desc)
+/**
+ * Check if the command can be changed. A command mapped from a cache is
+ * filled in from the block first, so that what is added comes after it.
+ */
+static zclk_res command_check_mutable(zclk_command *cmd)
 {
-	zclk_command_option_add(cmd, 
-			new_zclk_option_string(
-					name,
-					short_name,
-					default_val,
-					desc
-				));
+	if (command_is_frozen(cmd))
+	{
+		return ZCLK_RES_ERR_FROZEN;
+	}
+	if (cmd->frozen != NULL)
+	{
+		zclk_command_load(cmd);
+	}
+	return ZCLK_RES_SUCCESS;
 }
 
-void zclk_command_flag_option(zclk_command *cmd, const char *name, 
-				const char* short_name, const char *desc)
+/**
+ * Find an option of the command by the first len chars of the given name.
+ * Long names and short names are looked up separately.
+ */
+static zclk_option *option_index_find(zclk_command *cmd, const char *name,
+	size_t len, int is_short)
 {
-	zclk_command_option_add(cmd, 
-			new_zclk_option_flag(
-					name,
-					short_name,
-					0,
-					desc
-				));
+	if (command_is_frozen(cmd))
+	{
+		uint32_t opt_id = zclk_frozen_find_option(cmd->frozen,
+			cmd->frozen_id, name, len, is_short);
+		return opt_id == ZCLK_FROZEN_NULL ? NULL
+			: cmd->frozen->options[opt_id];
+	}
+	option_index_sync(cmd);
+	if (cmd->option_index_cap == 0)
+	{
+		return NULL;
+	}
+	zclk_option_slot *slot = option_index_probe(cmd->option_index,
+		cmd->option_index_cap, name, len, is_short,
+		option_index_hash(name, len, is_short));
+	return slot->option;
 }
 
-
-void zclk_command_bool_argument(zclk_command *cmd, const char *name, 
+/**
+ * Drop the rendered help of the command, after its options, arguments or
+ * sub-commands changed.
+ */
+static void command_help_invalidate(zclk_command *cmd)
+{
+	help_cache_acquire();
+	if (cmd->arena == NULL)
+	{
+		free(cmd->help_cache);
+	}
+	cmd->help_cache = NULL;
+	cmd->help_cache_len = 0;
+	help_cache_release();
+}
+
+/**
+ * Index any sub-commands not yet in the trie of the command (including
+ * those added to the sub_commands list directly). The first sub-command
+ * to use a name keeps it.
+ */
+static zclk_res sub_command_index_sync(zclk_command *cmd)
+{
+	size_t sub_cmd_len = arraylist_length(cmd->sub_commands);
+	if (cmd->sub_command_index_count == sub_cmd_len)
+	{
+		return ZCLK_RES_SUCCESS;
+	}
+	if (cmd->sub_command_index == NULL
+		&& create_zclk_trie_in(cmd->arena, &(cmd->sub_command_index)) != 0)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	while (cmd->sub_command_index_count < sub_cmd_len)
+	{
+		zclk_command *sc = arraylist_get(cmd->sub_commands,
+			cmd->sub_command_index_count);
+		if (zclk_trie_get(cmd->sub_command_index, sc->name) == NULL
+			&& zclk_trie_put(cmd->sub_command_index, sc->name, sc) != 0)
+		{
+			return ZCLK_RES_ERR_ALLOC_FAILED;
+		}
+		if (sc->short_name != NULL
+			&& zclk_trie_get(cmd->sub_command_index, sc->short_name) == NULL
+			&& zclk_trie_put(cmd->sub_command_index, sc->short_name, sc) != 0)
+		{
+			return ZCLK_RES_ERR_ALLOC_FAILED;
+		}
+		cmd->sub_command_index_count += 1;
+	}
+	return ZCLK_RES_SUCCESS;
+}
+
+zclk_res zclk_command_subcommand_add(zclk_command *cmd, 
+											zclk_command *subcommand)
+{
+	if(cmd == NULL || subcommand == NULL) 
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	zclk_res res = command_check_mutable(cmd);
+	if (res != ZCLK_RES_SUCCESS)
+	{
+		return res;
+	}
+
+	arraylist_add(cmd->sub_commands, subcommand);
+	if (subcommand->parent == NULL)
+	{
+		subcommand->parent = cmd;
+	}
+	command_help_invalidate(cmd);
+	return sub_command_index_sync(cmd);
+}
+
+zclk_command* new_zclk_lazy_command_in(zclk_arena *arena,
+	const char *name, const char *short_name, const char *description,
+	zclk_command_fn handler, zclk_command_loader_fn loader,
+	void *loader_args)
+{
+	if (loader == NULL)
+	{
+		return NULL;
+	}
+	// the built-in options are added along with the rest when it loads
+	zclk_command *cmd;
+	if (command_init_in(arena, &cmd, name, short_name, description,
+		handler) != ZCLK_RES_SUCCESS)
+	{
+		return NULL;
+	}
+	cmd->loader = loader;
+	cmd->loader_args = loader_args;
+	cmd->load_pending = 1;
+	return cmd;
+}
+
+zclk_command* zclk_command_lazy_subcommand_add(zclk_command *cmd,
+	const char *name, const char *short_name, const char *description,
+	zclk_command_fn handler, zclk_command_loader_fn loader,
+	void *loader_args)
+{
+	if (cmd == NULL || command_check_mutable(cmd) != ZCLK_RES_SUCCESS)
+	{
+		return NULL;
+	}
+	zclk_command *sub = new_zclk_lazy_command_in(cmd->arena, name,
+		short_name, description, handler, loader, loader_args);
+	if (sub == NULL)
+	{
+		return NULL;
+	}
+	// the index is synced again on lookup if it could not grow here
+	zclk_command_subcommand_add(cmd, sub);
+	return sub;
+}
+
+/**
+ * Check if the loader of the command is yet to finish. The flag is
+ * cleared atomically once it has, so no lock is needed to check it.
+ */
+static int command_load_pending(zclk_command *cmd)
+{
+	return zclk_atomic_load_long(&cmd->load_pending) != 0;
+}
+
+static void command_load_done(zclk_command *cmd)
+{
+	zclk_atomic_store_long(&cmd->load_pending, 0);
+}
+
+zclk_res zclk_command_load(zclk_command *cmd)
+{
+	if (cmd == NULL)
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	if (!command_load_pending(cmd))
+	{
+		return cmd->load_res;
+	}
+	zclk_command_load_lock();
+	if (cmd->loader != NULL)
+	{
+		// cleared first, so that the loader can use the accessors
+		zclk_command_loader_fn loader = cmd->loader;
+		cmd->loader = NULL;
+		command_add_builtin_options(cmd);
+		cmd->load_res = loader(cmd, cmd->loader_args);
+		command_load_done(cmd);
+	}
+	zclk_command_load_unlock();
+	return cmd->load_res;
+}
+
+void zclk_command_load_lock()
+{
+	// a loader which loads other commands already holds the lock
+	if (command_load_depth == 0)
+	{
+		command_load_acquire();
+	}
+	command_load_depth += 1;
+}
+
+void zclk_command_load_unlock()
+{
+	command_load_depth -= 1;
+	if (command_load_depth == 0)
+	{
+		command_load_release();
+	}
+}
+
+int zclk_command_is_loaded(zclk_command *cmd)
+{
+	return cmd != NULL && !command_load_pending(cmd);
+}
+
+zclk_command* zclk_command_get_subcommand(zclk_command *cmd,
+	const char *name, int allow_abbrev)
+{
+	if (cmd == NULL || name == NULL)
+	{
+		return NULL;
+	}
+	if (command_on_block(cmd))
+	{
+		uint32_t cmd_id = zclk_frozen_find_subcommand(cmd->frozen,
+			cmd->frozen_id, name, allow_abbrev);
+		return cmd_id == ZCLK_FROZEN_NULL ? NULL
+			: zclk_frozen_get_live_command(cmd->frozen, cmd_id);
+	}
+	zclk_command_load(cmd);
+	if (sub_command_index_sync(cmd) != ZCLK_RES_SUCCESS)
+	{
+		return NULL;
+	}
+	if (allow_abbrev)
+	{
+		return zclk_trie_get_prefix(cmd->sub_command_index, name, NULL);
+	}
+	return zclk_trie_get(cmd->sub_command_index, name);
+}
+
+void zclk_command_allow_abbreviations(zclk_command *cmd, int allow)
+{
+	if (cmd != NULL)
+	{
+		cmd->allow_abbrev = allow;
+	}
+}
+
+void zclk_command_allow_extra_args(zclk_command *cmd, int allow)
+{
+	if (cmd != NULL)
+	{
+		cmd->allow_extra_args = allow;
+	}
+}
+
+zclk_res zclk_command_enable_output_option(zclk_command *cmd)
+{
+	if (cmd == NULL)
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	if (command_is_frozen(cmd))
+	{
+		return ZCLK_RES_ERR_FROZEN;
+	}
+	zclk_command_load(cmd);
+	if (cmd->output_option != NULL)
+	{
+		return ZCLK_RES_SUCCESS;
+	}
+	if (zclk_command_get_option(cmd, ZCLK_OPTION_OUTPUT_LONG) != NULL)
+	{
+		return ZCLK_RES_ERR_INVALID_VALUE;
+	}
+	zclk_val output_init = { .type = ZCLK_TYPE_STRING };
+	output_init.data.str_value = (char *)"table";
+	cmd->output_option = command_option_in(cmd, ZCLK_OPTION_OUTPUT_LONG,
+		NULL, output_init, ZCLK_OPTION_OUTPUT_DESC);
+	if (cmd->output_option == NULL)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	return ZCLK_RES_SUCCESS;
+}
+
+void zclk_command_set_writer(zclk_command *cmd, zclk_writer *writer)
+{
+	if (cmd != NULL)
+	{
+		cmd->writer = writer;
+	}
+}
+
+zclk_writer *zclk_command_get_writer(zclk_command *cmd)
+{
+	if (cmd == NULL)
+	{
+		return NULL;
+	}
+	return cmd->writer;
+}
+
+zclk_writer *zclk_current_writer()
+{
+	if (current_writer == NULL)
+	{
+		return zclk_stdout_writer();
+	}
+	return current_writer;
+}
+
+zclk_output_format zclk_current_output_format()
+{
+	return current_output_format;
+}
+
+zclk_res zclk_command_option_add(
+							zclk_command *cmd,
+							zclk_option* option
+						)
+{
+	if(cmd == NULL || option == NULL) 
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	zclk_res res = command_check_mutable(cmd);
+	if (res != ZCLK_RES_SUCCESS)
+	{
+		return res;
+	}
+
+	option->owner = cmd;
+	option->slot = arraylist_length(cmd->options);
+	arraylist_add(cmd->options, option);
+	option_index_sync(cmd);
+	command_help_invalidate(cmd);
+	return ZCLK_RES_SUCCESS;
+}
+
+zclk_res zclk_command_argument_add(
+							zclk_command *cmd,
+							zclk_argument* arg
+						)
+{
+	if(cmd == NULL || arg == NULL) 
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	zclk_res res = command_check_mutable(cmd);
+	if (res != ZCLK_RES_SUCCESS)
+	{
+		return res;
+	}
+
+	arg->owner = cmd;
+	arg->slot = arraylist_length(cmd->args);
+	arraylist_add(cmd->args, arg);
+	command_help_invalidate(cmd);
+	return ZCLK_RES_SUCCESS;
+}
+
+void zclk_command_bool_option(zclk_command *cmd, const char *name, 
+				const char* short_name, const char *desc)
+{
+	zclk_val init = { .type = ZCLK_TYPE_BOOLEAN };
+	command_option_in(cmd, name, short_name, init, desc);
+}
+
+void zclk_command_int_option(zclk_command *cmd, const char *name, 
+				const char* short_name, int default_val, const char *desc)
+{
+	zclk_val init = { .type = ZCLK_TYPE_INT };
+	init.data.int_value = default_val;
+	command_option_in(cmd, name, short_name, init, desc);
+}
+
+
+void zclk_command_double_option(zclk_command *cmd, const char *name, 
+				const char* short_name, double default_val, const char *desc)
+{
+	zclk_val init = { .type = ZCLK_TYPE_DOUBLE };
+	init.data.dbl_value = default_val;
+	command_option_in(cmd, name, short_name, init, desc);
+}
+
+
+void zclk_command_string_option(zclk_command *cmd, const char *name, 
+				const char* short_name, const char *default_val, 
+				const char *desc)
+{
+	zclk_val init = { .type = ZCLK_TYPE_STRING };
+	init.data.str_value = (char *)default_val;
+	command_option_in(cmd, name, short_name, init, desc);
+}
+
+void zclk_command_flag_option(zclk_command *cmd, const char *name, 
+				const char* short_name, const char *desc)
+{
+	zclk_val init = { .type = ZCLK_TYPE_FLAG };
+	command_option_in(cmd, name, short_name, init, desc);
+}
+
+
+void zclk_command_bool_argument(zclk_command *cmd, const char *name, 
 				int default_val, const char *desc, int nargs)
 {
-	zclk_command_argument_add(cmd,
-			new_zclk_argument_bool(
-				name,
-				default_val,
-				desc,
-				nargs));
+	zclk_val init = { .type = ZCLK_TYPE_BOOLEAN };
+	init.data.bool_value = default_val;
+	command_argument_in(cmd, name, init, desc);
 }
 
 void zclk_command_int_argument(zclk_command *cmd, const char *name, 
 				int default_val, const char *desc, int nargs)
 {
-	zclk_command_argument_add(cmd,
-			new_zclk_argument_int(
-				name,
-				default_val,
-				desc,
-				nargs));
+	zclk_val init = { .type = ZCLK_TYPE_INT };
+	init.data.int_value = default_val;
+	command_argument_in(cmd, name, init, desc);
 }
 
 
 void zclk_command_double_argument(zclk_command *cmd, const char *name, 
 				double default_val, const char *desc, int nargs)
 {
-	zclk_command_argument_add(cmd,
-			new_zclk_argument_double(
-				name,
-				default_val,
-				desc,
-				nargs));
+	zclk_val init = { .type = ZCLK_TYPE_DOUBLE };
+	init.data.dbl_value = default_val;
+	command_argument_in(cmd, name, init, desc);
 }
 
 
 void zclk_command_string_argument(zclk_command *cmd, const char *name, 
 				const char *default_val, const char *desc, int nargs)
 {
-	zclk_command_argument_add(cmd,
-			new_zclk_argument_string(
-				name,
-				default_val,
-				desc,
-				nargs));
+	zclk_val init = { .type = ZCLK_TYPE_STRING };
+	init.data.str_value = (char *)default_val;
+	command_argument_in(cmd, name, init, desc);
 }
 
 
 void zclk_command_flag_argument(zclk_command *cmd, const char *name, 
 				int default_val, const char *desc, int nargs)
 {
-	zclk_command_argument_add(cmd,
-			new_zclk_argument_flag(
-				name,
-				default_val,
-				desc,
-				nargs));
+	zclk_val init = { .type = ZCLK_TYPE_FLAG };
+	init.data.bool_value = default_val;
+	command_argument_in(cmd, name, init, desc);
 }
 
 zclk_option* zclk_command_get_option(zclk_command *cmd, const char *name)
 {
 	if(cmd != NULL && name != NULL)
 	{
-		size_t opt_len = arraylist_length(cmd->options);
-		for (size_t i = 0; i < opt_len; i++)
+		zclk_command_load(cmd);
+		size_t len = strlen(name);
+		zclk_option *x = option_index_find(cmd, name, len, 0);
+		if (x == NULL)
 		{
-			zclk_option *x = arraylist_get(cmd->options, i);
-			if ((x->name != NULL && strcmp(x->name, name) == 0) 
-				|| (x->short_name != NULL 
-						&& strcmp(x->short_name, name) == 0))
-			{
-				return x;
-			}
+			x = option_index_find(cmd, name, len, 1);
 		}
+		return x;
 	}
 	return NULL;
 }
@@ -1021,6 +1768,7 @@ zclk_argument* zclk_command_get_argument(zclk_command *cmd, const char *name)
 {
 	if(cmd != NULL && name != NULL)
 	{
+		zclk_command_load(cmd);
 		size_t opt_len = arraylist_length(cmd->args);
 		for (size_t i = 0; i < opt_len; i++)
 		{
@@ -1035,33 +1783,124 @@ zclk_argument* zclk_command_get_argument(zclk_command *cmd, const char *name)
 }
 
 
+zclk_res zclk_command_parse(zclk_command* cmd, int argc, char* argv[],
+	zclk_parse_result** result)
+{
+	return zclk_command_parse_ctx(&default_parse_ctx, cmd, argc, argv,
+		result);
+}
+
+zclk_res zclk_command_parse_ctx(zclk_parse_ctx* ctx, zclk_command* cmd,
+	int argc, char* argv[], zclk_parse_result** result)
+{
+	arraylist *toplevel_commands;
+	arraylist_new(&toplevel_commands, NULL);
+	arraylist_add(toplevel_commands, cmd);
+	zclk_res err = parse_command_ctx(ctx, toplevel_commands, argc, argv,
+		result);
+	arraylist_free(toplevel_commands);
+	ctx->error = err;
+	return err;
+}
+
 zclk_res zclk_command_exec(zclk_command* cmd, 
 	void* exec_args, int argc, char* argv[])
 {
+	return zclk_command_exec_ctx(&default_parse_ctx, cmd, exec_args,
+		argc, argv);
+}
+
+zclk_res zclk_command_exec_ctx(zclk_parse_ctx* ctx, zclk_command* cmd, 
+	void* exec_args, int argc, char* argv[])
+{
+	// hidden entry points of the completion scripts, no handler is run
+	int complete = argc >= 2 && strcmp(argv[1], ZCLK_COMPLETE_COMMAND) == 0;
+	if (complete || (argc >= 2
+		&& strcmp(argv[1], ZCLK_COMPLETION_SCRIPT_COMMAND) == 0))
+	{
+		zclk_writer *writer = cmd->writer != NULL ? cmd->writer
+			: zclk_current_writer();
+		zclk_res err = complete
+			? zclk_command_complete(cmd, writer, argc - 2, argv + 2)
+			: zclk_command_completion_script(cmd, writer,
+				argc >= 3 ? argv[2] : "bash");
+		zclk_writer_flush(writer);
+		return err;
+	}
+
+	// args read from files point into the mappings of the files, which
+	// are kept until the handlers have run
+	zclk_res err = ZCLK_RES_SUCCESS;
+	zclk_args *args = NULL;
+	if (zclk_args_has_files(argc, argv))
+	{
+		const char *failed_path;
+		if (create_zclk_args(&args, argc, argv, &failed_path) == 0)
+		{
+			argc = args->argc;
+			argv = args->argv;
+		}
+		else if (failed_path == NULL)
+		{
+			snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+				"Could not allocate memory for the args.");
+			err = ZCLK_RES_ERR_ALLOC_FAILED;
+		}
+		else if (failed_path[0] == '\0')
+		{
+			snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+				"No file given for %s.", ZCLK_ARGFILE_OPTION);
+			err = ZCLK_RES_ERR_INVALID_VALUE;
+		}
+		else
+		{
+			snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+				"Could not read args from %s.", failed_path);
+			err = ZCLK_RES_ERR_INVALID_VALUE;
+		}
+		ctx->error = err;
+	}
+
 	arraylist *toplevel_commands;
 	arraylist_new(&toplevel_commands, NULL);
 	arraylist_add(toplevel_commands, cmd);
-	zclk_res err = exec_command(toplevel_commands, 
-										exec_args, argc, argv);
+	if (err == ZCLK_RES_SUCCESS)
+	{
+		err = exec_command_ctx(ctx, toplevel_commands, exec_args, argc,
+			argv);
+	}
 	if (err != ZCLK_RES_SUCCESS)
 	{
 		//printf("Error: invalid command. Error code: %d\n", err);
 		printf("Error: ");
-		printf("%s", error_message_str);
+		printf("%s", ctx->error_message_str);
 		printf("\n\n");
 		if(err != ZCLK_RES_ERR_COMMAND_NOT_FOUND)
 		{
-			char* help_message_str = get_help_for_command(toplevel_commands);
+			char* help_message_str = get_help_for_command_ctx(ctx,
+				toplevel_commands);
 			printf("%s", help_message_str);
 		}
 	}
+	arraylist_free(toplevel_commands);
+	free_zclk_args(args);
 	return err;
 }
 
 void free_command(zclk_command *command)
 {
-	if(command != NULL)
+	// commands in an arena are released with the arena
+	if(command != NULL && command->arena == NULL)
 	{
+		size_t sub_cmd_len = arraylist_length(command->sub_commands);
+		for (size_t i = 0; i < sub_cmd_len; i++)
+		{
+			zclk_command *sc = arraylist_get(command->sub_commands, i);
+			if (sc->parent == command)
+			{
+				free_command(sc);
+			}
+		}
 		if (command->short_name)
 		{
 			free(command->short_name);
@@ -1071,258 +1910,477 @@ void free_command(zclk_command *command)
 			free(command->description);
 		}
 		free(command->name);
-		arraylist_free(command->options);
-		arraylist_free(command->sub_commands);
-		arraylist_free(command->args);
+		command_release(command);
 		free(command);
 	}
 }
 
-char *get_program_name(arraylist *cmds_to_exec)
+/**
+ * Write the names (or short names, where set) of the chain of commands
+ * into buf, separated by spaces, with any path stripped from each name.
+ * Names which do not fit are cut off.
+ */
+static char *program_name_into(char *buf, size_t cap,
+	arraylist *cmds_to_exec, int use_short_names)
 {
+	size_t len = 0;
 	size_t cmd_len = arraylist_length(cmds_to_exec);
-	memset(progname_str, 0, ZCLK_SIZE_OF_PROGNAME_STR);
-	for (int i = 0; i < cmd_len; i++)
-	{
-		char *command = ((zclk_command *)arraylist_get(cmds_to_exec, i))->name;
-		char *p = command;
-		for (int i = 0; i < strlen(command); i++)
+	buf[0] = '\0';
+	for (size_t i = 0; i < cmd_len; i++)
+	{
+		zclk_command *cmd = arraylist_get(cmds_to_exec, i);
+		const char *name = use_short_names && cmd->short_name != NULL
+			? cmd->short_name : cmd->name;
+		const char *p = name;
+		for (const char *c = name; *c != '\0'; c++)
 		{
-			if (command[i] == '/' || command[i] == '\\')
+			if (*c == '/' || *c == '\\')
 			{
-				p = command + i + 1;
+				p = c + 1;
 			}
 		}
-		strcat(progname_str, p);
-		if (i != (cmd_len - 1))
+		int n = snprintf(buf + len, cap - len, i == 0 ? "%s" : " %s", p);
+		if (n < 0 || (size_t)n >= cap - len)
 		{
-			strcat(progname_str, " ");
+			break;
 		}
+		len += (size_t)n;
 	}
-	return progname_str;
+	return buf;
+}
+
+static char *get_program_name_ctx(zclk_parse_ctx *ctx,
+	arraylist *cmds_to_exec)
+{
+	return program_name_into(ctx->progname_str, ZCLK_SIZE_OF_PROGNAME_STR,
+		cmds_to_exec, 0);
+}
+
+char *get_program_name(arraylist *cmds_to_exec)
+{
+	return get_program_name_ctx(&default_parse_ctx, cmds_to_exec);
+}
+
+static char *get_short_program_name_ctx(zclk_parse_ctx *ctx,
+	arraylist *cmds_to_exec)
+{
+	return program_name_into(ctx->short_progname_str,
+		ZCLK_SIZE_OF_PROGNAME_STR, cmds_to_exec, 1);
 }
 
 char *get_short_program_name(arraylist *cmds_to_exec)
 {
-	size_t cmd_len = arraylist_length(cmds_to_exec);
-	memset(short_progname_str, 0, ZCLK_SIZE_OF_PROGNAME_STR);
-	for (int i = 0; i < cmd_len; i++)
+	return get_short_program_name_ctx(&default_parse_ctx, cmds_to_exec);
+}
+
+char *get_help_for_command(arraylist *cmds_to_exec)
+{
+	return get_help_for_command_ctx(&default_parse_ctx, cmds_to_exec);
+}
+
+/**
+ * Write the part of the help which depends only on the command: the end
+ * of the usage line (written after each program name), then the
+ * description, options and sub-commands.
+ */
+static void render_command_help(zclk_writer *w, zclk_command *command,
+	size_t *usage_len)
+{
+	size_t opt_len = arraylist_length(command->options);
+	size_t sub_cmd_len = arraylist_length(command->sub_commands);
+	size_t cmd_args_len = arraylist_length(command->args);
+
+	if (opt_len > 0)
+	{
+		zclk_writer_puts(w, " [OPTIONS]");
+	}
+	if (sub_cmd_len > 0)
 	{
-		char *command = ((zclk_command *)arraylist_get(cmds_to_exec, i))->short_name;
-		char *p = command;
-		for (int i = 0; i < strlen(command); i++)
+		zclk_writer_puts(w, " COMMAND");
+	}
+	for (size_t ac = 0; ac < cmd_args_len; ac++)
+	{
+		zclk_argument *arg = arraylist_get(command->args, ac);
+		zclk_writer_puts(w, " <");
+		zclk_writer_puts(w, arg->name);
+		zclk_writer_putc(w, '>');
+	}
+	zclk_writer_get_data(w, usage_len);
+
+	zclk_writer_puts(w, "\n\n");
+	zclk_writer_puts(w, command->description);
+	zclk_writer_puts(w, "\n\n");
+
+	if (opt_len > 0)
+	{
+		zclk_writer_puts(w, "Options:\n\n");
+		for (size_t i = 0; i < opt_len; i++)
 		{
-			if (command[i] == '/' || command[i] == '\\')
+			zclk_option *opt = arraylist_get(command->options, i);
+			// replaced by a later option with the same name
+			if (opt->name != NULL
+				&& zclk_command_get_option(command, opt->name) != opt)
+			{
+				continue;
+			}
+			zclk_writer_putc(w, '\t');
+			if (opt->short_name != NULL)
+			{
+				zclk_writer_putc(w, '-');
+				zclk_writer_puts(w, opt->short_name);
+				zclk_writer_puts(w, ", ");
+			}
+			else
+			{
+				zclk_writer_puts(w, "    ");
+			}
+
+			size_t used = 0;
+			if (opt->name != NULL)
+			{
+				zclk_writer_puts(w, "--");
+				zclk_writer_puts(w, opt->name);
+				used = 2 + strlen(opt->name);
+				if (opt->val->type == ZCLK_TYPE_STRING)
+				{
+					zclk_writer_puts(w, " string");
+					used += strlen(" string");
+				}
+			}
+			if (used < 25)
 			{
-				p = command + i + 1;
+				zclk_writer_fill(w, ' ', 25 - used);
 			}
+			zclk_writer_puts(w, opt->description);
+			zclk_writer_putc(w, '\n');
 		}
-		strcat(short_progname_str, p);
-		if (i != (cmd_len - 1))
+		zclk_writer_putc(w, '\n');
+	}
+
+	if (sub_cmd_len > 0)
+	{
+		zclk_writer_puts(w, "\nCommands:\n\n");
+		for (size_t i = 0; i < sub_cmd_len; i++)
 		{
-			strcat(short_progname_str, " ");
+			zclk_command *sc = arraylist_get(command->sub_commands, i);
+			size_t used = 2 + strlen(sc->name);
+			zclk_writer_puts(w, "  ");
+			zclk_writer_puts(w, sc->name);
+			if (used < 15)
+			{
+				zclk_writer_fill(w, ' ', 15 - used);
+			}
+			zclk_writer_puts(w, sc->description);
+			zclk_writer_putc(w, '\n');
 		}
+		zclk_writer_putc(w, '\n');
 	}
-	return short_progname_str;
 }
 
-char *get_help_for_command(arraylist *cmds_to_exec)
+/**
+ * Render the help of the command into its cache, unless the cache is
+ * still current. (Options, arguments and sub-commands added to the lists
+ * directly are caught by the counts.) Called with the lock held.
+ */
+static zclk_res command_help_sync(zclk_command *command)
 {
-	if (arraylist_length(cmds_to_exec) > 0)
+	size_t opt_len = arraylist_length(command->options);
+	size_t sub_cmd_len = arraylist_length(command->sub_commands);
+	size_t cmd_args_len = arraylist_length(command->args);
+	if (command->help_cache != NULL
+		&& command->help_num_options == opt_len
+		&& command->help_num_sub_commands == sub_cmd_len
+		&& command->help_num_args == cmd_args_len)
 	{
-		zclk_command *command = arraylist_get(cmds_to_exec, 
-			arraylist_length(cmds_to_exec) - 1);
+		return ZCLK_RES_SUCCESS;
+	}
 
-		memset(help_str, 0, ZCLK_SIZE_OF_HELP_STR);
-		sprintf(help_str, "Usage: %s", get_program_name(cmds_to_exec));
+	zclk_writer *w;
+	if (create_zclk_writer_memory(&w) != 0)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	size_t usage_len = 0;
+	render_command_help(w, command, &usage_len);
+	size_t len;
+	const char *data = zclk_writer_get_data(w, &len);
+	char *cache = w->error ? NULL
+		: (char *)alloc_in(command->arena, len + 1);
+	if (cache == NULL)
+	{
+		free_zclk_writer(w);
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	memcpy(cache, data, len + 1);
+	free_zclk_writer(w);
 
-		size_t opt_len = arraylist_length(command->options);
-		if (opt_len > 0)
-		{
-			strcat(help_str, " [OPTIONS]");
-		}
+	if (command->arena == NULL)
+	{
+		free(command->help_cache);
+	}
+	command->help_cache = cache;
+	command->help_cache_len = len;
+	command->help_usage_len = usage_len;
+	command->help_num_options = opt_len;
+	command->help_num_sub_commands = sub_cmd_len;
+	command->help_num_args = cmd_args_len;
+	return ZCLK_RES_SUCCESS;
+}
 
-		size_t sub_cmd_len = arraylist_length(command->sub_commands);
-		if (sub_cmd_len > 0)
-		{
-			strcat(help_str, " COMMAND");
-		}
+char *get_help_for_command_ctx(zclk_parse_ctx *ctx, arraylist *cmds_to_exec)
+{
+	if (arraylist_length(cmds_to_exec) == 0)
+	{
+		return NULL;
+	}
+	zclk_command *command = arraylist_get(cmds_to_exec,
+		arraylist_length(cmds_to_exec) - 1);
+	if (ctx->help == NULL && create_zclk_writer_memory(&(ctx->help)) != 0)
+	{
+		return NULL;
+	}
+	zclk_writer *w = ctx->help;
+	zclk_writer_clear(w);
+	zclk_command_load(command);
 
-		size_t cmd_args_len = arraylist_length(command->args);
-		for (int ac = 0; ac < cmd_args_len; ac++)
-		{
-			zclk_argument *arg = arraylist_get(command->args, ac);
-			strcat(help_str, " <");
-			strcat(help_str, arg->name);
-			strcat(help_str, ">");
-		}
+	zclk_writer_puts(w, "Usage: ");
+	zclk_writer_puts(w, get_program_name_ctx(ctx, cmds_to_exec));
 
-		strcat(help_str, "\nOR:    ");
-		strcat(help_str, get_short_program_name(cmds_to_exec));
+	help_cache_acquire();
+	if (command_help_sync(command) != ZCLK_RES_SUCCESS)
+	{
+		help_cache_release();
+		return NULL;
+	}
+	const char *cache = command->help_cache;
+	size_t usage_len = command->help_usage_len;
+	zclk_writer_write(w, cache, usage_len);
+	zclk_writer_puts(w, "\nOR:    ");
+	zclk_writer_puts(w, get_short_program_name_ctx(ctx, cmds_to_exec));
+	zclk_writer_write(w, cache, command->help_cache_len);
+	help_cache_release();
 
-		if (opt_len > 0)
-		{
-			strcat(help_str, " [OPTIONS]");
-		}
+	if (w->error)
+	{
+		return NULL;
+	}
+	return (char *)zclk_writer_get_data(w, NULL);
+}
 
-		if (sub_cmd_len > 0)
-		{
-			strcat(help_str, " COMMAND");
-		}
+zclk_res make_zclk_argv(zclk_argv **av, int argc, char **argv)
+{
+	(*av) = (zclk_argv *)calloc(1, sizeof(zclk_argv));
+	if ((*av) == NULL)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	if (argc < 0)
+	{
+		argc = 0;
+	}
+	// kinds and the consumed bitmap share one block
+	size_t bitmap_len = ((size_t)argc + 7) / 8;
+	(*av)->kinds = (unsigned char *)calloc((size_t)argc + bitmap_len + 1,
+		sizeof(unsigned char));
+	if ((*av)->kinds == NULL)
+	{
+		free(*av);
+		(*av) = NULL;
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	(*av)->consumed = (*av)->kinds + argc;
+	(*av)->argc = argc;
+	(*av)->argv = argv;
 
-		for (int ac = 0; ac < cmd_args_len; ac++)
+	int terminated = 0;
+	for (int i = 0; i < argc; i++)
+	{
+		const char *tok = argv[i];
+		unsigned char kind = ZCLK_TOKEN_POSITIONAL;
+		if (!terminated && tok != NULL && tok[0] == '-' && tok[1] != '\0')
 		{
-			zclk_argument *arg = arraylist_get(command->args, ac);
-			strcat(help_str, " <");
-			strcat(help_str, arg->name);
-			strcat(help_str, ">");
+			if (tok[1] != '-')
+			{
+				kind = ZCLK_TOKEN_SHORT;
+			}
+			else if (tok[2] == '\0')
+			{
+				kind = ZCLK_TOKEN_TERMINATOR;
+				terminated = 1;
+			}
+			else if (strchr(tok + 2, '=') != NULL)
+			{
+				kind = ZCLK_TOKEN_LONG_VALUE;
+			}
+			else
+			{
+				kind = ZCLK_TOKEN_LONG;
+			}
 		}
+		(*av)->kinds[i] = kind;
+	}
+	return ZCLK_RES_SUCCESS;
+}
 
-		strcat(help_str, "\n\n");
-		strcat(help_str, command->description);
-		strcat(help_str, "\n\n");
+void free_zclk_argv(zclk_argv *av)
+{
+	if (av != NULL)
+	{
+		free(av->kinds);
+		free(av);
+	}
+}
 
-		if (opt_len > 0)
-		{
-			strcat(help_str, "Options:\n\n");
-			for (size_t i = 0; i < opt_len; i++)
-			{
-				zclk_option *opt = arraylist_get(command->options, i);
-				strcat(help_str, "\t");
-				if (opt->short_name != NULL)
-				{
-					strcat(help_str, "-");
-					strcat(help_str, opt->short_name);
-					strcat(help_str, ", ");
-				}
-				else
-				{
-					strcat(help_str, "    ");
-				}
+int zclk_argv_is_consumed(zclk_argv *av, int index)
+{
+	return (av->consumed[index >> 3] >> (index & 7)) & 1;
+}
 
-				size_t used = 0;
-				if (opt->name != NULL)
-				{
-					strcat(help_str, "--");
-					strcat(help_str, opt->name);
-					used = 2 + strlen(opt->name);
-					if (opt->val->type == ZCLK_TYPE_STRING)
-					{
-						strcat(help_str, " string");
-						used += strlen(" string");
-					}
-				}
-				for (size_t sp = used; sp < 25; sp++)
-				{
-					strcat(help_str, " ");
-				}
-				strcat(help_str, opt->description);
-				strcat(help_str, "\n");
-			}
-			strcat(help_str, "\n");
-		}
+void zclk_argv_consume(zclk_argv *av, int index)
+{
+	av->consumed[index >> 3] |= (unsigned char)(1 << (index & 7));
+}
 
-		if (sub_cmd_len > 0)
+int zclk_argv_remaining(zclk_argv *av)
+{
+	int remaining = 0;
+	for (int i = 0; i < av->argc; i++)
+	{
+		if (!zclk_argv_is_consumed(av, i))
 		{
-			strcat(help_str, "\nCommands:\n\n");
-			for (size_t i = 0; i < sub_cmd_len; i++)
-			{
-				zclk_command *sc = arraylist_get(command->sub_commands, i);
-				size_t used = 0;
-				strcat(help_str, "  ");
-				strcat(help_str, sc->name);
-				used = 2 + strlen(sc->name);
-				for (size_t sp = used; sp < 15; sp++)
-				{
-					strcat(help_str, " ");
-				}
-				strcat(help_str, sc->description);
-				strcat(help_str, "\n");
-			}
-			strcat(help_str, "\n");
+			remaining += 1;
 		}
-
-		return help_str;
 	}
-	return NULL;
+	return remaining;
 }
 
-int gobble(int argc, char **argv, int at_pos)
+/**
+ * Find an option by the first len chars of the name in an option token.
+ * The deepest command of the chain is searched first.
+ */
+static zclk_option *find_option_in_chain(arraylist *cmds, const char *name,
+	size_t len, int is_short)
 {
-	if (at_pos > (argc - 1))
+	size_t cmd_len = arraylist_length(cmds);
+	for (size_t i = cmd_len; i > 0; i--)
 	{
-		return argc;
+		zclk_command *cmd = arraylist_get(cmds, i - 1);
+		zclk_option *opt = option_index_find(cmd, name, len, is_short);
+		if (opt != NULL)
+		{
+			return opt;
+		}
 	}
-	else
+	return NULL;
+}
+
+/**
+ * Find the type of an option by the first len chars of the name in an
+ * option token, from the frozen tree of a command where it has one.
+ * The deepest command of the chain is searched first. Returns -1 if no
+ * command of the chain has the option.
+ */
+static int find_option_type_in_chain(arraylist *cmds, const char *name,
+	size_t len, int is_short)
+{
+	size_t cmd_len = arraylist_length(cmds);
+	for (size_t i = cmd_len; i > 0; i--)
 	{
-		for (int i = at_pos; i < argc; i++)
+		zclk_command *cmd = arraylist_get(cmds, i - 1);
+		if (command_on_block(cmd))
 		{
-			// printf("--\t %d, %d, %s\n", i, at_pos, argv[i]);
-			if (i == argc)
-			{
-				argv[i] = NULL;
-			}
-			else
+			uint32_t opt_id = zclk_frozen_find_option(cmd->frozen,
+				cmd->frozen_id, name, len, is_short);
+			if (opt_id != ZCLK_FROZEN_NULL)
 			{
-				argv[i] = argv[i + 1];
+				return (int)cmd->frozen->values[opt_id].type;
 			}
+			continue;
+		}
+		zclk_option *opt = option_index_find(cmd, name, len, is_short);
+		if (opt != NULL)
+		{
+			return (int)opt->val->type;
 		}
-		return argc - 1;
 	}
+	return -1;
 }
 
-arraylist *get_command_to_exec(arraylist *commands, int *argc,
-							   char **argv)
+arraylist *get_command_to_exec(arraylist *commands, zclk_argv *av)
 {
-	//First read all commands
-	arraylist *cmd_names;
-	arraylist_new(&cmd_names, &free);
-
 	arraylist *cmds_to_exec = NULL;
 	arraylist_new(&cmds_to_exec, NULL);
 
-	zclk_command *cmd_to_exec = NULL;
-
-	arraylist *cmd_list = commands;
-	while (1)
+	// the command whose sub-commands are matched next, 
+	// NULL to match the top-level commands
+	zclk_command *parent = NULL;
+	int allow_abbrev = 0;
+	for (int i = 0; i < av->argc; i++)
 	{
-		int found = 0;
-		for (int i = 0; i < *argc; i++)
+		unsigned char kind = av->kinds[i];
+		if (kind == ZCLK_TOKEN_TERMINATOR)
 		{
-			char *cmd_name = argv[i];
-			if (cmd_list != NULL)
+			// no commands after the end of options marker
+			break;
+		}
+		if (kind == ZCLK_TOKEN_LONG || kind == ZCLK_TOKEN_SHORT)
+		{
+			// skip the value of a known option, so that it is never
+			// mistaken for a sub-command
+			int is_short = (kind == ZCLK_TOKEN_SHORT);
+			const char *name = av->argv[i] + (is_short ? 1 : 2);
+			int type = find_option_type_in_chain(cmds_to_exec, name,
+				strlen(name), is_short);
+			if (type >= 0 && type != ZCLK_TYPE_FLAG)
+			{
+				i++;
+			}
+			continue;
+		}
+		if (kind != ZCLK_TOKEN_POSITIONAL)
+		{
+			continue;
+		}
+
+		char *cmd_name = av->argv[i];
+		zclk_command *found = NULL;
+		if (parent == NULL)
+		{
+			size_t cmd_list_len = arraylist_length(commands);
+			for (size_t j = 0; j < cmd_list_len; j++)
 			{
-				for (int j = 0; j < arraylist_length(cmd_list); j++)
+				zclk_command *cmd = (zclk_command *)arraylist_get(commands, j);
+				if (strcmp(cmd_name, cmd->name) == 0
+					|| (cmd->short_name != NULL
+						&& strcmp(cmd_name, cmd->short_name) == 0))
 				{
-					zclk_command *cmd = (zclk_command *)arraylist_get(cmd_list,
-																	j);
-					if (strcmp(cmd_name, cmd->name) == 0 
-						|| strcmp(cmd_name, cmd->short_name) == 0)
-					{
-						found = 1;
-						cmd_list = cmd->sub_commands;
-						arraylist_add(cmd_names, zclk_str_clone(cmd->name));
-						//printf("found command %s\n", cmd->name);
-						cmd_to_exec = cmd;
-						arraylist_add(cmds_to_exec, cmd);
-						break;
-					}
+					found = cmd;
+					break;
 				}
 			}
-			if (found)
+		}
+		else
+		{
+			found = zclk_command_get_subcommand(parent, cmd_name,
+				allow_abbrev);
+		}
+
+		if (found != NULL)
+		{
+			av->kinds[i] = ZCLK_TOKEN_COMMAND;
+			zclk_argv_consume(av, i);
+			arraylist_add(cmds_to_exec, found);
+			parent = found;
+			allow_abbrev = allow_abbrev || found->allow_abbrev;
+			// a lazy command is filled in only now that it is reached,
+			// the commands of a frozen tree are matched on the block
+			if (found->frozen == NULL
+				&& zclk_command_load(found) != ZCLK_RES_SUCCESS)
 			{
-				//gobble at location and break
-				*argc = gobble(*argc, argv, i);
 				break;
 			}
 		}
-		//if no command found in last loop, break
-		if (found == 0)
-		{
-			break;
-		}
 	}
-	//arraylist_free(cmd_names);
 	return cmds_to_exec;
 }
 
@@ -1331,7 +2389,14 @@ zclk_res help_cmd_handler(arraylist *commands, void *handler_args,
 		zclk_command_output_handler error_handler)
 {
 	//First read all commands
-	arraylist *cmds_to_exec = get_command_to_exec(commands, &argc, argv);
+	zclk_argv *av;
+	zclk_res err = make_zclk_argv(&av, argc, argv);
+	if (err != ZCLK_RES_SUCCESS)
+	{
+		return err;
+	}
+	arraylist *cmds_to_exec = get_command_to_exec(commands, av);
+	free_zclk_argv(av);
 	if (arraylist_length(cmds_to_exec) > 0)
 	{
 		zclk_command *cmd_to_exec = 
@@ -1342,12 +2407,14 @@ zclk_res help_cmd_handler(arraylist *commands, void *handler_args,
 				"No valid command found. Run again with" \
 				" --help to see usage.\n");
 			
+			arraylist_free(cmds_to_exec);
 			return ZCLK_RES_ERR_COMMAND_NOT_FOUND;
 		}
 
 		char *help_str = cmd_to_exec->description;
 		success_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, help_str);
 	}
+	arraylist_free(cmds_to_exec);
 	return ZCLK_RES_SUCCESS;
 }
 
@@ -1385,444 +2452,1453 @@ zclk_res get_help_for(char **help_str, arraylist *commands,
 	return ZCLK_RES_ERR_UNKNOWN;
 }
 
-zclk_res parse_options(arraylist *options, int *argc, char **argv)
-{
-	while (1)
+/**
+ * Get the frozen tree all commands of the chain are part of, and can be
+ * parsed on, or NULL.
+ */
+static const zclk_frozen *chain_frozen(arraylist *cmds)
+{
+	size_t num_commands = arraylist_length(cmds);
+	if (num_commands == 0)
+	{
+		return NULL;
+	}
+	const zclk_frozen *frozen = ((zclk_command *)arraylist_get(cmds,
+		0))->frozen;
+	for (size_t i = 0; i < num_commands && frozen != NULL; i++)
+	{
+		zclk_command *cmd = arraylist_get(cmds, i);
+		if (cmd->frozen != frozen || !command_on_block(cmd))
+		{
+			return NULL;
+		}
+	}
+	return frozen;
+}
+
+zclk_res make_zclk_parse_result(zclk_parse_result **result, arraylist *cmds)
+{
+	size_t num_commands = arraylist_length(cmds);
+	const zclk_frozen *frozen = chain_frozen(cmds);
+	size_t num_options = 0, num_args = 0;
+	for (size_t i = 0; i < num_commands; i++)
+	{
+		zclk_command *cmd = arraylist_get(cmds, i);
+		if (frozen != NULL)
+		{
+			const zclk_frozen_command *fc = zclk_frozen_get_command(frozen,
+				cmd->frozen_id);
+			num_options += fc->num_options;
+			num_args += fc->num_args;
+		}
+		else
+		{
+			num_options += arraylist_length(cmd->options);
+			num_args += arraylist_length(cmd->args);
+		}
+	}
+	size_t num_values = num_options + num_args;
+
+	// struct, values, bases, frozen ids and flags in one block, in order
+	// of alignment
+	size_t size = sizeof(zclk_parse_result)
+		+ num_values * sizeof(zclk_val)
+		+ 2 * (num_commands + 1) * sizeof(size_t)
+		+ (frozen != NULL ? num_commands * sizeof(uint32_t) : 0)
+		+ num_values;
+	(*result) = (zclk_parse_result *)calloc(1, size);
+	if ((*result) == NULL)
+	{
+		arraylist_free(cmds);
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	zclk_parse_result *r = (*result);
+	r->commands = cmds;
+	r->num_commands = num_commands;
+	r->num_values = num_values;
+	r->values = (zclk_val *)(r + 1);
+	r->option_base = (size_t *)(r->values + num_values);
+	r->arg_base = r->option_base + num_commands + 1;
+	r->is_set = (unsigned char *)(r->arg_base + num_commands + 1);
+	if (frozen != NULL)
+	{
+		r->frozen = frozen;
+		r->frozen_ids = (uint32_t *)r->is_set;
+		r->is_set = (unsigned char *)(r->frozen_ids + num_commands);
+	}
+
+	size_t opt_slot = 0, arg_slot = num_options;
+	for (size_t i = 0; i < num_commands; i++)
+	{
+		zclk_command *cmd = arraylist_get(cmds, i);
+		r->option_base[i] = opt_slot;
+		r->arg_base[i] = arg_slot;
+		if (frozen != NULL)
+		{
+			// the initial values of the command are contiguous in the tree
+			const zclk_frozen_header *h =
+				(const zclk_frozen_header *)frozen->block;
+			const zclk_frozen_command *fc = zclk_frozen_get_command(frozen,
+				cmd->frozen_id);
+			r->frozen_ids[i] = cmd->frozen_id;
+			memcpy(r->values + opt_slot, frozen->values + fc->first_option,
+				fc->num_options * sizeof(zclk_val));
+			memcpy(r->values + arg_slot,
+				frozen->values + h->num_options + fc->first_arg,
+				fc->num_args * sizeof(zclk_val));
+			opt_slot += fc->num_options;
+			arg_slot += fc->num_args;
+			continue;
+		}
+		size_t len = arraylist_length(cmd->options);
+		for (size_t j = 0; j < len; j++)
+		{
+			zclk_option *opt = arraylist_get(cmd->options, j);
+			r->values[opt_slot] = *(opt->val);
+			r->values[opt_slot].str_owned = 0;
+			opt_slot++;
+		}
+		len = arraylist_length(cmd->args);
+		for (size_t j = 0; j < len; j++)
+		{
+			zclk_argument *arg = arraylist_get(cmd->args, j);
+			r->values[arg_slot] = *(arg->val);
+			r->values[arg_slot].str_owned = 0;
+			arg_slot++;
+		}
+	}
+	r->option_base[num_commands] = opt_slot;
+	r->arg_base[num_commands] = arg_slot;
+	return ZCLK_RES_SUCCESS;
+}
+
+void free_zclk_parse_result(zclk_parse_result *result)
+{
+	if (result != NULL)
+	{
+		arraylist_free(result->commands);
+		free(result->extra_args);
+		free(result);
+	}
+}
+
+zclk_command *zclk_parse_result_get_command(zclk_parse_result *result)
+{
+	if (result == NULL || result->num_commands == 0)
+	{
+		return NULL;
+	}
+	return arraylist_get(result->commands, result->num_commands - 1);
+}
+
+/**
+ * Find the slot of an item of the chain. The owner and slot recorded when
+ * the item was added give the answer directly, items put in the lists by
+ * hand (or added to more than one command) are searched for.
+ */
+static long result_find_slot(zclk_parse_result *result, void *item,
+	zclk_command *owner, size_t item_slot, int is_arg)
+{
+	size_t *bases = is_arg ? result->arg_base : result->option_base;
+	for (size_t i = result->num_commands; i > 0; i--)
+	{
+		zclk_command *cmd = arraylist_get(result->commands, i - 1);
+		if (cmd == owner)
+		{
+			size_t len = bases[i] - bases[i - 1];
+			arraylist *list = is_arg ? cmd->args : cmd->options;
+			if (item_slot < len && arraylist_get(list, item_slot) == item)
+			{
+				return (long)(bases[i - 1] + item_slot);
+			}
+		}
+	}
+	for (size_t i = result->num_commands; i > 0; i--)
+	{
+		zclk_command *cmd = arraylist_get(result->commands, i - 1);
+		size_t len = bases[i] - bases[i - 1];
+		arraylist *list = is_arg ? cmd->args : cmd->options;
+		for (size_t j = 0; j < len; j++)
+		{
+			if (arraylist_get(list, j) == item)
+			{
+				return (long)(bases[i - 1] + j);
+			}
+		}
+	}
+	return -1;
+}
+
+static long result_option_slot(zclk_parse_result *result, zclk_option *opt)
+{
+	return result_find_slot(result, opt, opt->owner, opt->slot, 0);
+}
+
+static long result_argument_slot(zclk_parse_result *result,
+	zclk_argument *arg)
+{
+	return result_find_slot(result, arg, arg->owner, arg->slot, 1);
+}
+
+/**
+ * Find the slot of an option of the command at position i of the chain
+ * by the first len chars of its name, -1 if the command has no such
+ * option. In a frozen chain the slot follows from the index of the
+ * option in the tree.
+ */
+static long result_command_option_slot(zclk_parse_result *result,
+	size_t i, const char *name, size_t len, int is_short)
+{
+	if (result->frozen != NULL)
+	{
+		uint32_t cmd_id = result->frozen_ids[i];
+		uint32_t opt_id = zclk_frozen_find_option(result->frozen, cmd_id,
+			name, len, is_short);
+		if (opt_id == ZCLK_FROZEN_NULL)
+		{
+			return -1;
+		}
+		return (long)(result->option_base[i] + opt_id
+			- zclk_frozen_get_command(result->frozen, cmd_id)->first_option);
+	}
+	zclk_option *opt = option_index_find(arraylist_get(result->commands, i),
+		name, len, is_short);
+	return opt == NULL ? -1 : result_option_slot(result, opt);
+}
+
+zclk_val *zclk_parse_result_get_option(zclk_parse_result *result,
+	zclk_option *opt)
+{
+	if (result == NULL || opt == NULL)
+	{
+		return NULL;
+	}
+	long slot = result_option_slot(result, opt);
+	return slot < 0 ? NULL : &result->values[slot];
+}
+
+zclk_val *zclk_parse_result_get_option_by_name(zclk_parse_result *result,
+	const char *name)
+{
+	if (result == NULL || name == NULL)
+	{
+		return NULL;
+	}
+	size_t len = strlen(name);
+	for (size_t i = result->num_commands; i > 0; i--)
+	{
+		long slot = result_command_option_slot(result, i - 1, name, len, 0);
+		if (slot < 0)
+		{
+			slot = result_command_option_slot(result, i - 1, name, len, 1);
+		}
+		if (slot >= 0)
+		{
+			return &result->values[slot];
+		}
+	}
+	return NULL;
+}
+
+zclk_val *zclk_parse_result_get_argument(zclk_parse_result *result,
+	zclk_argument *arg)
+{
+	if (result == NULL || arg == NULL)
+	{
+		return NULL;
+	}
+	long slot = result_argument_slot(result, arg);
+	return slot < 0 ? NULL : &result->values[slot];
+}
+
+zclk_val *zclk_parse_result_get_argument_by_name(zclk_parse_result *result,
+	const char *name)
+{
+	zclk_argument *arg = zclk_command_get_argument(
+		zclk_parse_result_get_command(result), name);
+	return zclk_parse_result_get_argument(result, arg);
+}
+
+int zclk_parse_result_option_is_set(zclk_parse_result *result,
+	zclk_option *opt)
+{
+	if (result == NULL || opt == NULL)
+	{
+		return 0;
+	}
+	long slot = result_option_slot(result, opt);
+	return slot < 0 ? 0 : result->is_set[slot];
+}
+
+int zclk_parse_result_argument_is_set(zclk_parse_result *result,
+	zclk_argument *arg)
+{
+	if (result == NULL || arg == NULL)
+	{
+		return 0;
+	}
+	long slot = result_argument_slot(result, arg);
+	return slot < 0 ? 0 : result->is_set[slot];
+}
+
+zclk_parse_result *zclk_current_parse_result()
+{
+	return current_parse_result;
+}
+
+char **zclk_parse_result_get_extra_args(zclk_parse_result *result,
+	size_t *count)
+{
+	(*count) = result != NULL ? result->num_extra_args : 0;
+	return (*count) > 0 ? result->extra_args : NULL;
+}
+
+/**
+ * Move the args left over after parsing to the result.
+ */
+static zclk_res result_take_extra_args(zclk_parse_result *result,
+	zclk_argv *av, int extra_args)
+{
+	result->extra_args = (char **)malloc((size_t)extra_args
+		* sizeof(char *));
+	if (result->extra_args == NULL)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	for (int i = 0; i < av->argc; i++)
+	{
+		if (!zclk_argv_is_consumed(av, i))
+		{
+			result->extra_args[result->num_extra_args++] = av->argv[i];
+			zclk_argv_consume(av, i);
+		}
+	}
+	return ZCLK_RES_SUCCESS;
+}
+
+zclk_res parse_options(zclk_parse_result *result, zclk_argv *av)
+{
+	return parse_options_ctx(&default_parse_ctx, result, av);
+}
+
+zclk_res parse_options_ctx(zclk_parse_ctx *ctx, zclk_parse_result *result,
+	zclk_argv *av)
+{
+	for (int i = 0; i < av->argc; i++)
+	{
+		if (zclk_argv_is_consumed(av, i))
+		{
+			continue;
+		}
+		unsigned char kind = av->kinds[i];
+		if (kind == ZCLK_TOKEN_TERMINATOR)
+		{
+			// everything after the marker is an argument
+			zclk_argv_consume(av, i);
+			break;
+		}
+		if (kind != ZCLK_TOKEN_LONG && kind != ZCLK_TOKEN_LONG_VALUE
+			&& kind != ZCLK_TOKEN_SHORT)
+		{
+			continue;
+		}
+
+		char *option = av->argv[i];
+		int is_short = (kind == ZCLK_TOKEN_SHORT);
+		const char *name = option + (is_short ? 1 : 2);
+		const char *inline_value = NULL;
+		size_t name_len;
+		if (kind == ZCLK_TOKEN_LONG_VALUE)
+		{
+			inline_value = strchr(name, '=');
+			name_len = (size_t)(inline_value - name);
+			inline_value += 1;
+		}
+		else
+		{
+			name_len = strlen(name);
+		}
+
+		// the deepest command of the chain is searched first
+		long slot = -1;
+		for (size_t c = result->num_commands; c > 0 && slot < 0; c--)
+		{
+			slot = result_command_option_slot(result, c - 1, name, name_len,
+				is_short);
+		}
+		if (slot < 0)
+		{
+			snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+				"Unknown option %s.", option);
+			return ZCLK_RES_ERR_OPTION_NOT_FOUND;
+		}
+		zclk_argv_consume(av, i);
+		zclk_val *val = &result->values[slot];
+		result->is_set[slot] = 1;
+
+		//read option value if it is not a flag
+		if (val->type == ZCLK_TYPE_FLAG)
+		{
+			if (inline_value != NULL)
+			{
+				snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+					"Option %.*s does not take a value.",
+					(int)(name_len + 2), option);
+				return ZCLK_RES_ERR_OPTION_NOT_FOUND;
+			}
+			zclk_val_set_bool(val, 1);
+		}
+		else
+		{
+			if (inline_value == NULL)
+			{
+				// the value is the next token not bound to a command
+				int v = i + 1;
+				while (v < av->argc && zclk_argv_is_consumed(av, v))
+				{
+					v++;
+				}
+				if (v == av->argc || av->kinds[v] == ZCLK_TOKEN_TERMINATOR)
+				{
+					snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+						"Value missing for option %s.", option);
+					return ZCLK_RES_ERR_OPTION_NOT_FOUND;
+				}
+				av->kinds[v] = ZCLK_TOKEN_VALUE;
+				zclk_argv_consume(av, v);
+				inline_value = av->argv[v];
+			}
+			zclk_res err = parse_zclk_val(val, (char *)inline_value);
+			if (err != ZCLK_RES_SUCCESS)
+			{
+				snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+					"%s value '%s' for option %.*s.",
+					err == ZCLK_RES_ERR_VALUE_OUT_OF_RANGE ? "Out of range"
+						: "Invalid", inline_value,
+					(int)(name - option + name_len), option);
+				return err;
+			}
+		}
+	}
+
+	return ZCLK_RES_SUCCESS;
+}
+
+zclk_res parse_args(zclk_parse_result *result, zclk_argv *av)
+{
+	return parse_args_ctx(&default_parse_ctx, result, av);
+}
+
+zclk_res parse_args_ctx(zclk_parse_ctx *ctx, zclk_parse_result *result,
+	zclk_argv *av)
+{
+	// the last command in the chain can have args
+	size_t last = result->num_commands - 1;
+	zclk_command *last_cmd = arraylist_get(result->commands, last);
+	size_t base = result->arg_base[last];
+	size_t args_len = result->arg_base[last + 1] - base;
+	size_t next_arg = 0;
+	for (int i = 0; i < av->argc && next_arg < args_len; i++)
+	{
+		if (zclk_argv_is_consumed(av, i))
+		{
+			continue;
+		}
+		zclk_res err = parse_zclk_val(&result->values[base + next_arg],
+			av->argv[i]);
+		if (err != ZCLK_RES_SUCCESS)
+		{
+			const char *arg_name;
+			if (result->frozen != NULL)
+			{
+				const zclk_frozen_command *fc = zclk_frozen_get_command(
+					result->frozen, result->frozen_ids[last]);
+				arg_name = zclk_frozen_get_string(result->frozen,
+					zclk_frozen_get_argument(result->frozen,
+						fc->first_arg + (uint32_t)next_arg)->name);
+			}
+			else
+			{
+				zclk_argument *arg = arraylist_get(last_cmd->args, next_arg);
+				arg_name = arg->name;
+			}
+			snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+				"%s value '%s' for argument %s.",
+				err == ZCLK_RES_ERR_VALUE_OUT_OF_RANGE ? "Out of range"
+					: "Invalid", av->argv[i], arg_name);
+			return err;
+		}
+		result->is_set[base + next_arg] = 1;
+		zclk_argv_consume(av, i);
+		next_arg += 1;
+	}
+	// missing args keep their default values, it is the responsibility
+	// of the program to deal with them.
+	return ZCLK_RES_SUCCESS;
+}
+
+void print_options(arraylist *options)
+{
+	if (options != NULL)
+	{
+		size_t options_len = arraylist_length(options);
+		for (int i = 0; i < options_len; i++)
+		{
+			zclk_option *o = arraylist_get(options, i);
+			switch (o->val->type)
+			{
+			case ZCLK_TYPE_BOOLEAN:
+				printf("Options%d %s, %s = %d\n", i, o->name, 
+					o->short_name, zclk_val_get_bool(o->val));
+				break;
+			case ZCLK_TYPE_FLAG:
+				printf("Options%d %s, %s = %d\n", i, o->name, 
+					o->short_name, zclk_val_get_bool(o->val));
+				break;
+			case ZCLK_TYPE_STRING:
+				printf("Options%d %s, %s = %s\n", i, o->name, 
+					o->short_name, zclk_val_get_string(o->val));
+				break;
+			case ZCLK_TYPE_INT:
+				printf("Options%d %s, %s = %d\n", i, o->name, 
+					o->short_name, zclk_val_get_int(o->val));
+				break;
+			case ZCLK_TYPE_DOUBLE:
+				printf("Options%d %s, %s = %g\n", i, o->name, 
+					o->short_name, zclk_val_get_double(o->val));
+				break;
+			default:
+				printf("Options%d %s, %s has unknown type\n", i, 
+					o->name, o->short_name);
+				break;
+			}
+		}
+	}
+}
+
+zclk_res exec_command(arraylist *commands, void *handler_args,
+						 int argc, char **argv)
+{
+	return exec_command_ctx(&default_parse_ctx, commands, handler_args,
+		argc, argv);
+}
+
+zclk_res parse_command_ctx(zclk_parse_ctx *ctx, arraylist *commands,
+	int argc, char **argv, zclk_parse_result **result)
+{
+	zclk_res err = ZCLK_RES_SUCCESS;
+	(*result) = NULL;
+
+	zclk_argv *av;
+	err = make_zclk_argv(&av, argc, argv);
+	if (err != ZCLK_RES_SUCCESS)
+	{
+		return err;
+	}
+
+	//First read all commands
+	arraylist *cmds_to_exec = get_command_to_exec(commands, av);
+	if (arraylist_length(cmds_to_exec) == 0)
+	{
+		snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+			"No valid command found. Run again with --help to see usage.");
+		arraylist_free(cmds_to_exec);
+		free_zclk_argv(av);
+		return ZCLK_RES_ERR_COMMAND_NOT_FOUND;
+	}
+	// a chain parsed on a frozen block needs none of the live lists
+	int on_block = chain_frozen(cmds_to_exec) != NULL;
+	for (size_t i = 0; !on_block && i < arraylist_length(cmds_to_exec); i++)
+	{
+		zclk_command *cmd = arraylist_get(cmds_to_exec, i);
+		err = zclk_command_load(cmd);
+		if (err != ZCLK_RES_SUCCESS)
+		{
+			snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+				"Could not load command %s.", cmd->name);
+			arraylist_free(cmds_to_exec);
+			free_zclk_argv(av);
+			return err;
+		}
+	}
+
+	err = make_zclk_parse_result(result, cmds_to_exec);
+
+	//Then read all options
+	if (err == ZCLK_RES_SUCCESS)
+	{
+		err = parse_options_ctx(ctx, *result, av);
+	}
+
+	// help can be requested at any level of the command chain
+	for (size_t i = 0; err == ZCLK_RES_SUCCESS
+		&& i < (*result)->num_commands; i++)
+	{
+		long slot = result_command_option_slot(*result, i,
+			ZCLK_OPTION_HELP_LONG, strlen(ZCLK_OPTION_HELP_LONG), 0);
+		if (slot >= 0 && zclk_val_get_bool(&(*result)->values[slot]))
+		{
+			(*result)->help_requested = 1;
+		}
+	}
+
+	if (err == ZCLK_RES_SUCCESS && !(*result)->help_requested)
+	{
+		//Now read all arguments
+		err = parse_args_ctx(ctx, *result, av);
+
+		//anything leftover
+		int extra_args = zclk_argv_remaining(av);
+		if (err == ZCLK_RES_SUCCESS && extra_args > 0
+			&& zclk_parse_result_get_command(*result)->allow_extra_args)
+		{
+			err = result_take_extra_args(*result, av, extra_args);
+		}
+		else if (err == ZCLK_RES_SUCCESS && extra_args > 0)
+		{
+			snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+				"%d extra arguments found.\n", extra_args);
+			err = ZCLK_RES_ERR_EXTRA_ARGS_FOUND;
+		}
+	}
+
+	if (err != ZCLK_RES_SUCCESS)
+	{
+		free_zclk_parse_result(*result);
+		(*result) = NULL;
+	}
+	free_zclk_argv(av);
+	return err;
+}
+
+/**
+ * Get the format given with the --output option of the innermost command
+ * in the chain which has it set, the current format if none has.
+ */
+static zclk_res get_output_format(zclk_parse_ctx *ctx,
+	zclk_parse_result *result, zclk_output_format *format)
+{
+	(*format) = current_output_format;
+	for (size_t i = result->num_commands; i > 0; i--)
+	{
+		zclk_command *cmd = arraylist_get(result->commands, i - 1);
+		long slot;
+		if (result->frozen != NULL)
+		{
+			// the block records which commands have the option
+			const zclk_frozen_command *fc = zclk_frozen_get_command(
+				result->frozen, result->frozen_ids[i - 1]);
+			slot = (fc->flags & ZCLK_FROZEN_OUTPUT_OPTION) == 0 ? -1
+				: result_command_option_slot(result, i - 1,
+					ZCLK_OPTION_OUTPUT_LONG,
+					strlen(ZCLK_OPTION_OUTPUT_LONG), 0);
+		}
+		else
+		{
+			zclk_option *opt = cmd->output_option;
+			// a command can replace the option with one of its own
+			slot = opt == NULL || zclk_command_get_option(cmd,
+				ZCLK_OPTION_OUTPUT_LONG) != opt ? -1
+				: result_option_slot(result, opt);
+		}
+		if (slot < 0 || !result->is_set[slot])
+		{
+			continue;
+		}
+		const char *name = zclk_val_get_string(&result->values[slot]);
+		if (zclk_output_format_parse(format, name) != 0)
+		{
+			snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
+				"Invalid output format '%s', expected table, json, csv" \
+				" or ndjson.\n", name == NULL ? "" : name);
+			return ZCLK_RES_ERR_INVALID_VALUE;
+		}
+		break;
+	}
+	return ZCLK_RES_SUCCESS;
+}
+
+/**
+ * The word being completed, and where the completions go.
+ */
+typedef struct
+{
+	zclk_writer *writer;
+	const char *before;		///< written before each candidate
+	const char *prefix;		///< the part of the word to match
+	size_t prefix_len;
+} complete_state;
+
+/**
+ * Write a candidate and the first line of its description.
+ */
+static void complete_write(complete_state *st, const char *candidate,
+	size_t len, const char *desc)
+{
+	zclk_writer_puts(st->writer, st->before);
+	zclk_writer_write(st->writer, candidate, len);
+	zclk_writer_putc(st->writer, '\t');
+	if (desc != NULL)
+	{
+		zclk_writer_write(st->writer, desc, strcspn(desc, "\r\n"));
+	}
+	zclk_writer_putc(st->writer, '\n');
+}
+
+static void complete_sub_command(const char *key, size_t key_len,
+	void *value, void *ctx)
+{
+	complete_state *st = (complete_state *)ctx;
+	zclk_command *sc = (zclk_command *)value;
+	// a short name is offered only if the name does not match
+	if (strcmp(key, sc->name) != 0
+		&& strncmp(sc->name, st->prefix, st->prefix_len) == 0)
+	{
+		return;
+	}
+	complete_write(st, key, key_len, sc->description);
+}
+
+static void complete_sub_commands(complete_state *st, zclk_command *cmd)
+{
+	if (command_on_block(cmd))
+	{
+		zclk_frozen_foreach_subcommand(cmd->frozen, cmd->frozen_id,
+			st->prefix, &complete_sub_command, st);
+	}
+	else if (sub_command_index_sync(cmd) == ZCLK_RES_SUCCESS
+		&& cmd->sub_command_index != NULL)
+	{
+		zclk_trie_foreach_prefix(cmd->sub_command_index, st->prefix,
+			&complete_sub_command, st);
+	}
+}
+
+/**
+ * Offer the options of the chain which the word can still become,
+ * skipping those replaced by an option of the same name further down.
+ */
+static void complete_options(complete_state *st, arraylist *chain,
+	int is_long)
+{
+	size_t cmd_len = arraylist_length(chain);
+	for (size_t c = cmd_len; c > 0; c--)
+	{
+		zclk_command *cmd = arraylist_get(chain, c - 1);
+		size_t opt_len = arraylist_length(cmd->options);
+		for (size_t i = 0; i < opt_len; i++)
+		{
+			zclk_option *opt = arraylist_get(cmd->options, i);
+			if (!is_long && opt->short_name != NULL
+				&& strncmp(opt->short_name, st->prefix, st->prefix_len) == 0
+				&& find_option_in_chain(chain, opt->short_name,
+					strlen(opt->short_name), 1) == opt)
+			{
+				st->before = "-";
+				complete_write(st, opt->short_name, strlen(opt->short_name),
+					opt->description);
+			}
+			// a lone - also lists the long names
+			if ((is_long || st->prefix_len == 0) && opt->name != NULL
+				&& strncmp(opt->name, st->prefix, st->prefix_len) == 0
+				&& find_option_in_chain(chain, opt->name,
+					strlen(opt->name), 0) == opt)
+			{
+				st->before = "--";
+				complete_write(st, opt->name, strlen(opt->name),
+					opt->description);
+			}
+		}
+	}
+}
+
+/**
+ * Offer the values of an option, which are known only for --output.
+ */
+static void complete_values(complete_state *st, zclk_option *opt)
+{
+	if (opt->owner == NULL || opt != opt->owner->output_option)
+	{
+		return;
+	}
+	const char *name;
+	for (int f = 0; (name = zclk_output_format_name((zclk_output_format)f))
+		!= NULL; f++)
+	{
+		if (strncmp(name, st->prefix, st->prefix_len) == 0)
+		{
+			complete_write(st, name, strlen(name), NULL);
+		}
+	}
+}
+
+zclk_res zclk_command_complete(zclk_command *cmd, zclk_writer *writer,
+	int argc, char *argv[])
+{
+	if (cmd == NULL || writer == NULL || argc < 0)
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	arraylist *chain;
+	arraylist_new(&chain, NULL);
+	arraylist_add(chain, cmd);
+	zclk_command_load(cmd);
+
+	// follow the complete words down the tree, as get_command_to_exec does
+	zclk_command *parent = cmd;
+	zclk_option *pending = NULL;
+	int terminated = 0;
+	for (int i = 0; i < argc - 1; i++)
 	{
-		zclk_option *found = NULL;
-		for (int i = 0; i < *argc; i++)
+		const char *word = argv[i];
+		if (pending != NULL)
 		{
-			char *option = argv[i];
-			char *long_option_name = NULL;
-			char *short_option_name = NULL;
-			if (strlen(option) > 1 && option[0] == '-')
+			// bash splits --name=value into --name, = and value
+			if (strcmp(word, "=") != 0)
 			{
-				int skip_count = 0;
-				if (option[1] == '-')
-				{
-					//long option
-					long_option_name = option + 2;
-				}
-				else
-				{
-					//short option
-					short_option_name = option + 1;
-				}
-				size_t options_len = arraylist_length(options);
-				for (int j = 0; j < options_len; j++)
-				{
-					zclk_option *opt = arraylist_get(options, j);
-					if (long_option_name && opt->name != NULL)
-					{
-						if (strcmp(long_option_name, opt->name) == 0)
-						{
-							found = opt;
-						}
-					}
-					if (short_option_name && opt->short_name != NULL)
-					{
-						if (strcmp(short_option_name, opt->short_name) == 0)
-						{
-							found = opt;
-						}
-					}
-				}
-				if (found == NULL)
-				{
-					snprintf(error_message_str, ZCLK_SIZE_OF_HELP_STR,
-						"Unknown option %s.", option);
-					return ZCLK_RES_ERR_OPTION_NOT_FOUND;
-				}
-				else
-				{
-					//printf("Found %s\n", found->name);
-					skip_count += 1;
-					//read option value if it is not a flag
-					if (found->val->type == ZCLK_TYPE_FLAG)
-					{
-						zclk_val_set_bool(found->val, 1);
-					}
-					else
-					{
-						if (i == (*argc - 1))
-						{
-							snprintf(error_message_str, ZCLK_SIZE_OF_HELP_STR,
-								"Value missing for option %s.", option);
-							return ZCLK_RES_ERR_OPTION_NOT_FOUND;
-						}
-						else
-						{
-							skip_count += 1;
-							char *value = argv[i + 1];
-							parse_zclk_val(found->val, value);
-						}
-					}
-					for (int sk = 0; sk < skip_count; sk++)
-					{
-						//gobble at location and break
-						//printf("GOBBLING FOR %s, argc = %d\n", found->name, *argc);
-						*argc = gobble(*argc, argv, i);
-					}
-					break;
-				}
+				pending = NULL;
 			}
+			continue;
 		}
-		if (found == NULL)
+		if (!terminated && word[0] == '-' && word[1] != '\0')
 		{
-			// no option found in last loop
-			break;
+			if (strcmp(word, "--") == 0)
+			{
+				terminated = 1;
+				continue;
+			}
+			int is_short = word[1] != '-';
+			const char *name = word + (is_short ? 1 : 2);
+			if (!is_short && strchr(name, '=') != NULL)
+			{
+				continue;
+			}
+			zclk_option *opt = find_option_in_chain(chain, name,
+				strlen(name), is_short);
+			if (opt != NULL && opt->val->type != ZCLK_TYPE_FLAG)
+			{
+				pending = opt;
+			}
+			continue;
+		}
+		zclk_command *found = terminated ? NULL
+			: zclk_command_get_subcommand(parent, word, parent->allow_abbrev);
+		if (found != NULL)
+		{
+			parent = found;
+			arraylist_add(chain, found);
+			zclk_command_load(found);
 		}
 	}
 
-	return ZCLK_RES_SUCCESS;
-}
-
-zclk_res parse_args(arraylist *args, int *argc, char **argv)
-{
-	size_t args_len = arraylist_length(args);
-	// printf("args len %d\n", args_len);
-	if (args_len <= *argc)
+	complete_state st;
+	st.writer = writer;
+	st.before = "";
+	st.prefix = argc > 0 ? argv[argc - 1] : "";
+	st.prefix_len = strlen(st.prefix);
+	const char *eq;
+	if (pending != NULL)
 	{
-		for (int i = 0; i < args_len; i++)
-		{
-			zclk_argument *arg = arraylist_get(args, i);
-			char *argval = argv[i];
-			//check if we have
-			parse_zclk_val(arg->val, argval);
-			// printf("Argval %s\n", argval);
-		}
-		for (int i = 0; i < args_len; i++)
+		complete_values(&st, pending);
+	}
+	else if (terminated)
+	{
+		// only arguments follow --
+	}
+	else if (strncmp(st.prefix, "--", 2) == 0
+		&& (eq = strchr(st.prefix, '=')) != NULL)
+	{
+		zclk_option *opt = find_option_in_chain(chain, st.prefix + 2,
+			(size_t)(eq - st.prefix - 2), 0);
+		if (opt != NULL)
 		{
-			*argc = gobble(*argc, argv, 0);
-			// printf("new argc = %d, %p\n", *argc, argc);
+			// keep the --name= the shell replaces along with the value
+			char before[256];
+			snprintf(before, sizeof(before), "%.*s",
+				(int)(eq - st.prefix + 1), st.prefix);
+			st.before = before;
+			st.prefix = eq + 1;
+			st.prefix_len = strlen(st.prefix);
+			complete_values(&st, opt);
 		}
 	}
+	else if (st.prefix[0] == '-')
+	{
+		int is_long = st.prefix[1] == '-';
+		st.prefix += is_long ? 2 : 1;
+		st.prefix_len -= is_long ? 2 : 1;
+		complete_options(&st, chain, is_long);
+	}
 	else
 	{
-		// snprintf(error_message_str, ZCLK_SIZE_OF_HELP_STR,
-		// 	"Required arguments missing.");
-		// return ZCLK_RES_ERR_ARG_NOT_FOUND;
-		for (int i = 0; i < *argc; i++)
-		{
-			zclk_argument *arg = arraylist_get(args, i);
-			char *argval = argv[i];
-			//check if we have
-			parse_zclk_val(arg->val, argval);
-			//			printf("Argval %s\n", argval);
-		}
-		int tmp_argc = *argc;
-		for (int i = 0; i < tmp_argc; i++)
-		{
-			*argc = gobble(*argc, argv, 0);
-			// printf("new argc = %d\n", *argc);
-		}
+		complete_sub_commands(&st, parent);
 	}
-	return ZCLK_RES_SUCCESS;
+	arraylist_free(chain);
+	return writer->error ? ZCLK_RES_ERR_UNKNOWN : ZCLK_RES_SUCCESS;
 }
 
-void print_options(arraylist *options)
+/**
+ * Write the name of the program with any path stripped, keeping only
+ * letters, digits and _ if ident is set (for the names of functions).
+ */
+static void write_program_name(zclk_writer *w, zclk_command *cmd, int ident)
 {
-	if (options != NULL)
+	const char *p = cmd->name;
+	for (const char *c = cmd->name; *c != '\0'; c++)
 	{
-		size_t options_len = arraylist_length(options);
-		for (int i = 0; i < options_len; i++)
+		if (*c == '/' || *c == '\\')
 		{
-			zclk_option *o = arraylist_get(options, i);
-			switch (o->val->type)
-			{
-			case ZCLK_TYPE_BOOLEAN:
-				printf("Options%d %s, %s = %d\n", i, o->name, 
-					o->short_name, zclk_val_get_bool(o->val));
-				break;
-			case ZCLK_TYPE_FLAG:
-				printf("Options%d %s, %s = %d\n", i, o->name, 
-					o->short_name, zclk_val_get_bool(o->val));
-				break;
-			case ZCLK_TYPE_STRING:
-				printf("Options%d %s, %s = %s\n", i, o->name, 
-					o->short_name, zclk_val_get_string(o->val));
-				break;
-			case ZCLK_TYPE_INT:
-				printf("Options%d %s, %s = %d\n", i, o->name, 
-					o->short_name, zclk_val_get_int(o->val));
-				break;
-			case ZCLK_TYPE_DOUBLE:
-				printf("Options%d %s, %s = %g\n", i, o->name, 
-					o->short_name, zclk_val_get_double(o->val));
-				break;
-			default:
-				printf("Options%d %s, %s has unknown type\n", i, 
-					o->name, o->short_name);
-				break;
-			}
+			p = c + 1;
 		}
 	}
+	for (; *p != '\0'; p++)
+	{
+		int keep = (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')
+			|| (*p >= '0' && *p <= '9') || *p == '_';
+		zclk_writer_putc(w, ident && !keep ? '_' : *p);
+	}
 }
 
-zclk_res exec_command(arraylist *commands, void *handler_args,
-						 int argc, char **argv)
+zclk_res zclk_command_completion_script(zclk_command *cmd,
+	zclk_writer *writer, const char *shell)
 {
-	zclk_res err = ZCLK_RES_SUCCESS;
-
-	//First read all commands
-	arraylist *cmds_to_exec = get_command_to_exec(commands, &argc, argv);
-	size_t len_cmds = arraylist_length(cmds_to_exec);
-	arraylist *all_options, *all_args;
-	arraylist_new(&all_options, NULL);
-	#ifdef LUA_ENABLED
-		set_lua_convertor(all_options, &arraylist_zclk_option_to_lua);
-	#endif //LUA_ENABLED
-	arraylist_new(&all_args, NULL);
-	#ifdef LUA_ENABLED
-		set_lua_convertor(all_args, &arraylist_zclk_argument_to_lua);
-	#endif //LUA_ENABLED
+	if (cmd == NULL || writer == NULL || shell == NULL)
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	// each script is split where the program name goes (%n), and the
+	// name of the completion function (%f)
+	const char *script;
+	if (strcmp(shell, "bash") == 0)
+	{
+		script =
+			"# bash completion for %n\n"
+			"_zclk_%f() {\n"
+			"\tlocal IFS=$'\\n'\n"
+			"\tCOMPREPLY=($(\"${COMP_WORDS[0]}\" " ZCLK_COMPLETE_COMMAND
+				" \"${COMP_WORDS[@]:1:COMP_CWORD}\" 2>/dev/null"
+				" | cut -f1))\n"
+			"}\n"
+			"complete -o default -F _zclk_%f %n\n";
+	}
+	else if (strcmp(shell, "zsh") == 0)
+	{
+		script =
+			"#compdef %n\n"
+			"_zclk_%f() {\n"
+			"\tlocal -a lines cands\n"
+			"\tlocal line\n"
+			"\tlines=(\"${(@f)$(\"${words[1]}\" " ZCLK_COMPLETE_COMMAND
+				" \"${(@)words[2,CURRENT]}\" 2>/dev/null)}\")\n"
+			"\tfor line in $lines; do\n"
+			"\t\tcands+=(\"${${line%%$'\\t'*}//:/\\\\:}:${line#*$'\\t'}\")\n"
+			"\tdone\n"
+			"\t_describe 'command' cands\n"
+			"}\n"
+			"if [ \"$funcstack[1]\" = \"_%n\" ]; then\n"
+			"\t_zclk_%f \"$@\"\n"
+			"else\n"
+			"\tcompdef _zclk_%f %n\n"
+			"fi\n";
+	}
+	else if (strcmp(shell, "fish") == 0)
+	{
+		script =
+			"# fish completion for %n\n"
+			"function __zclk_%f_complete\n"
+			"\tset -l tokens (commandline -opc) (commandline -ct)\n"
+			"\t$tokens[1] " ZCLK_COMPLETE_COMMAND
+				" $tokens[2..-1] 2>/dev/null\n"
+			"end\n"
+			"complete -c %n -f -a '(__zclk_%f_complete)'\n";
+	}
+	else
+	{
+		return ZCLK_RES_ERR_INVALID_VALUE;
+	}
 
-	for (int i = 0; i < len_cmds; i++)
+	const char *run = script;
+	for (const char *c = script; *c != '\0'; c++)
 	{
-		zclk_command *cmd_to_exec = arraylist_get(cmds_to_exec, i);
-		size_t len_options = arraylist_length(cmd_to_exec->options);
-		for (int j = 0; j < len_options; j++)
-		{
-			zclk_option *opt_to_add = arraylist_get(cmd_to_exec->options, j);
-			size_t opt_len = arraylist_length(all_options);
-			int opt_exists = 0;
-			for (size_t k = 0; k < opt_len; k++)
-			{
-				zclk_option* opt_to_cmp = arraylist_get(all_options, k);
-				if (strcmp(zclk_option_get_name(opt_to_add), 
-						zclk_option_get_name(opt_to_cmp)) == 0
-					&& strcmp(zclk_option_get_short_name(opt_to_add), 
-						zclk_option_get_short_name(opt_to_cmp)) == 0)
-				{
-					opt_exists = 1;
-					//printf("Option %s already exists.\n", zclk_option_get_name(opt_to_add));
-				}
-			}
-			if (opt_exists == 0)
-			{
-				arraylist_add(all_options, opt_to_add);
-			}
-		}
-		size_t len_args = arraylist_length(cmd_to_exec->args);
-		for (int j = 0; j < len_args; j++)
+		if (c[0] == '%' && (c[1] == 'n' || c[1] == 'f'))
 		{
-			arraylist_add(all_args, arraylist_get(cmd_to_exec->args, j));
+			zclk_writer_write(writer, run, (size_t)(c - run));
+			write_program_name(writer, cmd, c[1] == 'f');
+			run = c + 2;
+			c++;
 		}
 	}
+	zclk_writer_puts(writer, run);
+	return writer->error ? ZCLK_RES_ERR_UNKNOWN : ZCLK_RES_SUCCESS;
+}
 
-	//print_args(argc, argv);
+zclk_res exec_command_ctx(zclk_parse_ctx *ctx, arraylist *commands,
+	void *handler_args, int argc, char **argv)
+{
+	zclk_output_format format;
+	zclk_parse_result *result;
+	zclk_res err = parse_command_ctx(ctx, commands, argc, argv, &result);
 
-	//Then read all options
-	err = parse_options(all_options, &argc, argv);
 	if (err != ZCLK_RES_SUCCESS)
 	{
-		return err;
+		// error message is already set
 	}
-
-	//print_options(all_options);
-
-	zclk_option *help_option = get_option_by_name(all_options, ZCLK_OPTION_HELP_LONG);
-	if (zclk_val_get_bool(help_option->val))
+	else if (result->help_requested)
 	{
-		char *help_str = get_help_for_command(cmds_to_exec);
+		char *help_str = get_help_for_command_ctx(ctx, result->commands);
 		if (help_str == NULL)
 		{
-			// print_handler(ZCLK_RES_ERR_COMMAND_NOT_FOUND, 
-			//				ZCLK_RESULT_STRING,
-			// 			  	"No valid command found. "\
-			//				"Run again with --help to see usage.\n");
-
-			snprintf(error_message_str, ZCLK_SIZE_OF_HELP_STR,
+			snprintf(ctx->error_message_str, ZCLK_SIZE_OF_HELP_STR,
 				"No valid sub-command found. Run main command with --help" \
 				" for a list of available sub-commands.");
 
-			return ZCLK_RES_ERR_COMMAND_NOT_FOUND;
+			err = ZCLK_RES_ERR_COMMAND_NOT_FOUND;
+		}
+		else
+		{
+			// help goes to the writer of the invoked command
+			zclk_writer *writer = NULL;
+			for (size_t i = 0; i < result->num_commands; i++)
+			{
+				zclk_command *cmd = arraylist_get(result->commands, i);
+				if (cmd->writer != NULL)
+				{
+					writer = cmd->writer;
+				}
+			}
+			write_result(writer != NULL ? writer : zclk_current_writer(),
+				ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, help_str);
 		}
-		print_handler(ZCLK_RES_SUCCESS, ZCLK_RESULT_STRING, help_str);
+	}
+	else if ((err = get_output_format(ctx, result, &format))
+		!= ZCLK_RES_SUCCESS)
+	{
+		// error message is already set
 	}
 	else
 	{
-		for (int i = 0; i < len_cmds; i++)
+		// handlers read their values from the result, an exec from within
+		// a handler gets its own result and restores this one on return
+		zclk_parse_result *outer = current_parse_result;
+		zclk_writer *outer_writer = current_writer;
+		zclk_output_format outer_format = current_output_format;
+		current_parse_result = result;
+		current_output_format = format;
+		for (size_t i = 0; i < result->num_commands
+			&& err == ZCLK_RES_SUCCESS; i++)
 		{
-			zclk_command *cmd_to_exec = arraylist_get(cmds_to_exec, i);
-			if (cmd_to_exec == NULL)
-			{
-				snprintf(error_message_str, ZCLK_SIZE_OF_HELP_STR,
-					"No valid sub-command found. Run main command with" \
-					" --help for a list of available sub-commands.");
-				return ZCLK_RES_ERR_COMMAND_NOT_FOUND;
-			}
-
-			// for the last command in the chain, it can have args
-			if (i == (len_cmds - 1))
+			zclk_command *cmd_to_exec = arraylist_get(result->commands, i);
+			// the writer is inherited from the parent commands
+			if (cmd_to_exec->writer != NULL)
 			{
-				//Now read all arguments
-				err = parse_args(cmd_to_exec->args, &argc, argv);
-				if (err != ZCLK_RES_SUCCESS)
-				{
-					return err;
-				}
-
-				//anything leftover
-				if (argc > 0)
-				{
-					snprintf(error_message_str, ZCLK_SIZE_OF_HELP_STR,
-						"%d extra arguments found.\n", argc);
-					return ZCLK_RES_ERR_EXTRA_ARGS_FOUND;
-				}
+				current_writer = cmd_to_exec->writer;
 			}
-
 			if (cmd_to_exec->handler != NULL)
 			{
 				err = cmd_to_exec->handler(cmd_to_exec, handler_args);
 			}
 		}
+		current_parse_result = outer;
+		current_writer = outer_writer;
+		current_output_format = outer_format;
 	}
 
-	arraylist_free(cmds_to_exec);
-	arraylist_free(all_options);
-	arraylist_free(all_args);
+	free_zclk_parse_result(result);
+	ctx->error = err;
 	return err;
 }
 
-void print_table_result(void* result)
+zclk_res make_zclk_parse_ctx(zclk_parse_ctx **ctx)
 {
-	zclk_table* result_tbl = (zclk_table*)result;
-	size_t* col_widths;
-	col_widths = (size_t*)calloc(result_tbl->num_cols, sizeof(size_t));
-	char** col_fmtspec;
-	col_fmtspec = (char**)calloc(result_tbl->num_cols, sizeof(char*));
-	char* header;
-	char* value;
-	int min_width = 4, max_width = 25;
+	(*ctx) = (zclk_parse_ctx *)calloc(1, sizeof(zclk_parse_ctx));
+	if ((*ctx) == NULL)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	return ZCLK_RES_SUCCESS;
+}
 
-	//calculate column widths, and create format specifiers
-	for (int i = 0; i < result_tbl->num_cols; i++)
+void free_zclk_parse_ctx(zclk_parse_ctx *ctx)
+{
+	if (ctx != NULL)
 	{
-		zclk_table_get_header(&header, result_tbl, i);
-		size_t col_width = strlen(header);
-		for (int j = 0; j < result_tbl->num_rows; j++)
-		{
-			zclk_table_get_row_val(&value, result_tbl, j, i);
-			if (value != NULL)
-			{
-				if (strlen(value) > col_width)
-				{
-					col_width = strlen(value);
-				}
-			}
-		}
-		if (col_width < min_width)
-		{
-			col_width = min_width;
-		}
-		if (col_width > max_width)
+		zclk_parse_ctx_release(ctx);
+		free(ctx);
+	}
+}
+
+void zclk_parse_ctx_release(zclk_parse_ctx *ctx)
+{
+	if (ctx != NULL)
+	{
+		free_zclk_writer(ctx->help);
+		ctx->help = NULL;
+	}
+}
+
+zclk_parse_ctx *zclk_default_parse_ctx()
+{
+	return &default_parse_ctx;
+}
+
+zclk_res zclk_parse_ctx_get_error(zclk_parse_ctx *ctx)
+{
+	return ctx->error;
+}
+
+const char *zclk_parse_ctx_get_error_message(zclk_parse_ctx *ctx)
+{
+	return ctx->error_message_str;
+}
+
+/**
+ * Write the header of a table, and the rule below it.
+ */
+static void write_table_header(zclk_writer *writer, zclk_table *tbl,
+							   size_t *col_widths)
+{
+	char *header;
+	zclk_writer_putc(writer, '\n');
+	size_t line_width = 0;
+	for (size_t i = 0; i < tbl->num_cols; i++)
+	{
+		zclk_table_get_header(&header, tbl, i);
+		zclk_table_write_cell(writer, header, col_widths[i]);
+		line_width += col_widths[i] + 1;
+	}
+	zclk_writer_putc(writer, '\n');
+	zclk_writer_fill(writer, '-', line_width);
+	zclk_writer_putc(writer, '\n');
+}
+
+/**
+ * Write the rows [first, last) of a table.
+ */
+static void write_table_rows(zclk_writer *writer, zclk_table *tbl,
+							 size_t *col_widths, size_t first, size_t last)
+{
+	char num_str[ZCLK_TABLE_NUM_STR_SIZE];
+	const char *value;
+	size_t len;
+	for (size_t i = first; i < last; i++)
+	{
+		for (size_t j = 0; j < tbl->num_cols; j++)
 		{
-			col_width = max_width;
+			zclk_table_format_row_val(&value, &len, num_str, tbl, i, j);
+			zclk_table_write_cell_len(writer, value, len, col_widths[j]);
 		}
-		char* fmtspec = (char*)calloc(16, sizeof(char));
-		if (fmtspec != NULL)
+		zclk_writer_putc(writer, '\n');
+	}
+}
+
+/**
+ * Get the rendered widths of the columns of a table (NULL on error).
+ */
+static size_t *table_render_widths(zclk_table *tbl)
+{
+	size_t *col_widths;
+	col_widths = (size_t *)calloc(tbl->num_cols, sizeof(size_t));
+	if (col_widths == NULL)
+	{
+		return NULL;
+	}
+	// the widths are kept up to date by the table as cells are set
+	for (size_t i = 0; i < tbl->num_cols; i++)
+	{
+		zclk_table_get_col_render_width(&col_widths[i], tbl, i);
+	}
+	return col_widths;
+}
+
+void write_table_result(zclk_writer *writer, void *result)
+{
+	zclk_table *result_tbl = (zclk_table *)result;
+	size_t *col_widths = table_render_widths(result_tbl);
+	if (col_widths == NULL)
+	{
+		return;
+	}
+	write_table_header(writer, result_tbl, col_widths);
+	write_table_rows(writer, result_tbl, col_widths, 0,
+					 result_tbl->num_rows);
+	zclk_writer_putc(writer, '\n');
+	free(col_widths);
+}
+
+#ifndef _WIN32
+/**
+ * A chunk of rows being formatted by a worker of a parallel render.
+ * A slot is reused for every window-th chunk.
+ */
+typedef struct
+{
+	zclk_writer *out;
+	int done;
+} table_render_slot;
+
+/**
+ * State shared by the workers of a parallel render. Workers take chunks
+ * in order, but at most window chunks ahead of the last one written out,
+ * which bounds the memory used.
+ */
+typedef struct
+{
+	zclk_table *tbl;
+	size_t *col_widths;
+	size_t num_chunks;
+	size_t window;
+	size_t next_chunk;
+	size_t written;
+	table_render_slot *slots;
+	pthread_mutex_t lock;
+	pthread_cond_t chunk_done;
+	pthread_cond_t chunk_written;
+} table_render_ctx;
+
+static void *table_render_worker(void *arg)
+{
+	table_render_ctx *ctx = (table_render_ctx *)arg;
+	pthread_mutex_lock(&ctx->lock);
+	while (ctx->next_chunk < ctx->num_chunks)
+	{
+		size_t chunk = ctx->next_chunk;
+		if (chunk >= ctx->written + ctx->window)
 		{
-			sprintf(fmtspec, "%%-%zu.%zus", (col_width + 1), col_width);
-			col_widths[i] = col_width;
-			col_fmtspec[i] = fmtspec;
+			pthread_cond_wait(&ctx->chunk_written, &ctx->lock);
+			continue;
 		}
-		else
+		ctx->next_chunk++;
+		pthread_mutex_unlock(&ctx->lock);
+
+		table_render_slot *slot = &ctx->slots[chunk % ctx->window];
+		size_t first = chunk * ZCLK_TABLE_RENDER_CHUNK_ROWS;
+		size_t last = first + ZCLK_TABLE_RENDER_CHUNK_ROWS;
+		if (last > ctx->tbl->num_rows)
 		{
-			col_fmtspec[i] = "fatal error creating format specifiers";
+			last = ctx->tbl->num_rows;
 		}
+		write_table_rows(slot->out, ctx->tbl, ctx->col_widths, first, last);
+
+		pthread_mutex_lock(&ctx->lock);
+		slot->done = 1;
+		pthread_cond_broadcast(&ctx->chunk_done);
 	}
+	pthread_mutex_unlock(&ctx->lock);
+	return NULL;
+}
 
-	printf("\n");
-	for (int i = 0; i < result_tbl->num_cols; i++)
+/**
+ * Format the rows on num_threads workers, writing the chunks out in
+ * order. Returns -1 (having written nothing) if the workers could not be
+ * set up.
+ */
+static int write_table_rows_parallel(zclk_writer *writer, zclk_table *tbl,
+									 size_t *col_widths, int num_threads)
+{
+	table_render_ctx ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.tbl = tbl;
+	ctx.col_widths = col_widths;
+	ctx.num_chunks = (tbl->num_rows + ZCLK_TABLE_RENDER_CHUNK_ROWS - 1)
+		/ ZCLK_TABLE_RENDER_CHUNK_ROWS;
+	ctx.window = 2 * (size_t)num_threads;
+	ctx.slots = (table_render_slot *)calloc(ctx.window,
+		sizeof(table_render_slot));
+	pthread_t *workers = (pthread_t *)calloc(num_threads, sizeof(pthread_t));
+	int res = (ctx.slots == NULL || workers == NULL) ? -1 : 0;
+	for (size_t i = 0; res == 0 && i < ctx.window; i++)
 	{
-		zclk_table_get_header(&header, result_tbl, i);
-		printf(col_fmtspec[i], header);
+		res = create_zclk_writer_memory(&ctx.slots[i].out);
 	}
-	printf("\n");
-	for (int i = 0; i < result_tbl->num_cols; i++)
+	if (res != 0)
 	{
-		for (int j = 0; j < col_widths[i] + 1; j++)
-		{
-			printf("-");
-		}
+		goto cleanup;
 	}
-	printf("\n");
+	pthread_mutex_init(&ctx.lock, NULL);
+	pthread_cond_init(&ctx.chunk_done, NULL);
+	pthread_cond_init(&ctx.chunk_written, NULL);
 
-	for (int i = 0; i < result_tbl->num_rows; i++)
+	int started = 0;
+	while (started < num_threads
+		&& pthread_create(&workers[started], NULL, table_render_worker, &ctx)
+			== 0)
+	{
+		started++;
+	}
+	if (started == 0)
+	{
+		res = -1;
+	}
+	else
 	{
-		for (int j = 0; j < result_tbl->num_cols; j++)
+		for (size_t chunk = 0; chunk < ctx.num_chunks; chunk++)
 		{
-			zclk_table_get_row_val(&value, result_tbl, i, j);
-			if (value == NULL)
-			{
-				printf(col_fmtspec[j], "");
-			}
-			else
+			table_render_slot *slot = &ctx.slots[chunk % ctx.window];
+			pthread_mutex_lock(&ctx.lock);
+			while (!slot->done)
 			{
-				printf(col_fmtspec[j], value);
+				pthread_cond_wait(&ctx.chunk_done, &ctx.lock);
 			}
+			pthread_mutex_unlock(&ctx.lock);
+
+			size_t len;
+			const char *data = zclk_writer_get_data(slot->out, &len);
+			zclk_writer_write(writer, data, len);
+			zclk_writer_clear(slot->out);
+
+			pthread_mutex_lock(&ctx.lock);
+			slot->done = 0;
+			ctx.written++;
+			pthread_cond_broadcast(&ctx.chunk_written);
+			pthread_mutex_unlock(&ctx.lock);
 		}
-		printf("\n");
 	}
-	printf("\n");
+	for (int i = 0; i < started; i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+	pthread_cond_destroy(&ctx.chunk_written);
+	pthread_cond_destroy(&ctx.chunk_done);
+	pthread_mutex_destroy(&ctx.lock);
+
+cleanup:
+	for (size_t i = 0; ctx.slots != NULL && i < ctx.window; i++)
+	{
+		free_zclk_writer(ctx.slots[i].out);
+	}
+	free(ctx.slots);
+	free(workers);
+	return res;
+}
+#endif
 
-	for (int i = 0; i < result_tbl->num_cols; i++)
+void write_table_result_parallel(zclk_writer *writer, void *result,
+								 int num_threads)
+{
+	zclk_table *result_tbl = (zclk_table *)result;
+#ifndef _WIN32
+	if (num_threads <= 0)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		num_threads = cpus > 0 ? (int)cpus : 1;
+	}
+	size_t num_chunks = (result_tbl->num_rows + ZCLK_TABLE_RENDER_CHUNK_ROWS
+		- 1) / ZCLK_TABLE_RENDER_CHUNK_ROWS;
+	if ((size_t)num_threads > num_chunks)
+	{
+		num_threads = (int)num_chunks;
+	}
+	if (num_threads > 1)
 	{
-		free(col_fmtspec[i]);
+		size_t *col_widths = table_render_widths(result_tbl);
+		if (col_widths == NULL)
+		{
+			return;
+		}
+		write_table_header(writer, result_tbl, col_widths);
+		if (write_table_rows_parallel(writer, result_tbl, col_widths,
+				num_threads) != 0)
+		{
+			write_table_rows(writer, result_tbl, col_widths, 0,
+							 result_tbl->num_rows);
+		}
+		zclk_writer_putc(writer, '\n');
+		free(col_widths);
+		return;
 	}
+#endif
+	write_table_result(writer, result_tbl);
+}
+
+void print_table_result(void* result)
+{
+	zclk_writer *writer = zclk_current_writer();
+	write_table_result(writer, result);
+	zclk_writer_flush(writer);
 }
 
 zclk_res print_handler(zclk_res result_flag, zclk_result_type res_type,
 	void* result)
 {
-	if (res_type == ZCLK_RESULT_STRING)
+	return write_result_as(zclk_current_writer(), zclk_current_output_format(),
+		result_flag, res_type, result);
+}
+
+zclk_res write_result(zclk_writer *writer, zclk_res result_flag,
+	zclk_result_type res_type, void *result)
+{
+	return write_result_as(writer, ZCLK_OUTPUT_TABLE, result_flag, res_type,
+		result);
+}
+
+zclk_res write_result_as(zclk_writer *writer, zclk_output_format format,
+	zclk_res result_flag, zclk_result_type res_type, void *result)
+{
+	if (format != ZCLK_OUTPUT_TABLE
+		&& (res_type == ZCLK_RESULT_TABLE || res_type == ZCLK_RESULT_DICT))
+	{
+		if (res_type == ZCLK_RESULT_TABLE)
+		{
+			zclk_encode_table(writer, (zclk_table *)result, format);
+		}
+		else
+		{
+			zclk_encode_dict(writer, (zclk_dict *)result, format);
+		}
+	}
+	else if (res_type == ZCLK_RESULT_STRING)
 	{
 		if (result != NULL)
 		{
-			char* result_str = (char*)result;
-			printf("%s", result_str);
+			zclk_writer_puts(writer, (char *)result);
 		}
 	}
 	else if (res_type == ZCLK_RESULT_TABLE)
 	{
-		print_table_result(result);
+		write_table_result(writer, result);
+	}
+	else if (res_type == ZCLK_RESULT_TABLE_STREAM)
+	{
+		// the rows are already written to the writer of the stream, in
+		// the format it was given when it was created
+		zclk_table_stream *stream = (zclk_table_stream *)result;
+		if (stream->num_rows == 0)
+		{
+			zclk_table_stream_set_format(stream, format);
+		}
+		zclk_table_stream_finish(stream);
+		// the output is complete, so the command does not fail over it
+		if (format != ZCLK_OUTPUT_TABLE && stream->format != (int)format)
+		{
+			fprintf(stderr, "Warning: the table was already written as %s," \
+				" not %s.\n",
+				zclk_output_format_name((zclk_output_format)stream->format),
+				zclk_output_format_name(format));
+		}
 	}
 	else if (res_type == ZCLK_RESULT_DICT)
 	{
 		zclk_dict* result_dict = (zclk_dict*)result;
 		zclk_dict_foreach(result_dict, k, v)
 		{
-			printf("%-26.25s: %s\n", k, v);
+			zclk_table_write_cell(writer, k, 25);
+			zclk_writer_write(writer, ": ", 2);
+			zclk_writer_puts(writer, v);
+			zclk_writer_putc(writer, '\n');
 		}
-		printf("\n");
+		zclk_writer_putc(writer, '\n');
 	}
 	else if (res_type == ZCLK_RESULT_PROGRESS)
 	{
-		zclk_multi_progress* result_progress = (zclk_multi_progress*)result;
-		if (result_progress->old_count > 0)
-		{
-			printf("\033[%dA", result_progress->old_count);
-			fflush(stdout);
-		}
-		size_t new_len = arraylist_length(result_progress->progress_ls);
-		//		printf("To remove %d, to write %d\n", result_progress->old_count, new_len);
-		for (size_t i = 0; i < new_len; i++)
-		{
-			zclk_progress* p = (zclk_progress*)arraylist_get(
-				result_progress->progress_ls, i);
-			printf("\033[K%s: %s", p->name, p->message);
-			char* progress = p->extra;
-			if (progress != NULL)
-			{
-				printf(" %s", progress);
-			}
-			printf("\n");
-		}
+		// coalesced to the frame rate, only the changed lines are redrawn,
+		// and every frame is drawn once the progress is finished
+		zclk_multi_progress_render((zclk_multi_progress *)result, writer, 0);
 	}
 	else
 	{
-		printf("This result type is not handled %d\n", res_type);
+		zclk_writer_printf(writer, "This result type is not handled %d\n",
+			res_type);
 	}
+	zclk_writer_flush(writer);
 	return ZCLK_RES_SUCCESS;
 }
@@ -13,6 +13,7 @@
 
 #include "zclk_common.h"
 
+#include <stdint.h>
 #include <coll_arraylist.h>
 
 #ifdef LUA_ENABLED
@@ -23,6 +24,12 @@
 #include "zclk_table.h"
 #include "zclk_dict.h"
 #include "zclk_progress.h"
+#include "zclk_trie.h"
+#include "zclk_arena.h"
+#include "zclk_number.h"
+#include "zclk_writer.h"
+#include "zclk_encode.h"
+#include "zclk_argfile.h"
 
 #ifdef __cplusplus  
 extern "C" {
@@ -35,6 +42,11 @@ extern "C" {
 /** Help option description */
 #define ZCLK_OPTION_HELP_DESC "Print help for command."
 
+/** Output format option long name */
+#define ZCLK_OPTION_OUTPUT_LONG "output"
+/** Output format option description */
+#define ZCLK_OPTION_OUTPUT_DESC "Output format: table, json, csv or ndjson."
+
 /**
  * @brief This enum defines the possible error codes 
  * 	generated by functions in the API.
@@ -48,7 +60,10 @@ typedef enum
 	ZCLK_RES_ERR_COMMAND_NOT_FOUND = 3,
 	ZCLK_RES_ERR_OPTION_NOT_FOUND = 4,
 	ZCLK_RES_ERR_ARG_NOT_FOUND = 5,
-	ZCLK_RES_ERR_EXTRA_ARGS_FOUND = 6
+	ZCLK_RES_ERR_EXTRA_ARGS_FOUND = 6,
+	ZCLK_RES_ERR_FROZEN = 7,
+	ZCLK_RES_ERR_INVALID_VALUE = 8,
+	ZCLK_RES_ERR_VALUE_OUT_OF_RANGE = 9
 } zclk_res;
 
 /**
@@ -78,12 +93,23 @@ typedef enum
 	ZCLK_RESULT_STRING = 0,
 	ZCLK_RESULT_TABLE = 1,
 	ZCLK_RESULT_DICT = 2,
-	ZCLK_RESULT_PROGRESS = 3
+	ZCLK_RESULT_PROGRESS = 3,
+	ZCLK_RESULT_TABLE_STREAM = 4
 } zclk_result_type;
 
 /**
  * @brief This struct holds the value of the argument or option.
  * 
+ * A string value either owns its string, which is freed with the value
+ * or when the string is replaced, or borrows it from somewhere else:
+ * 
+ * - \c new_zclk_val_string() and \c zclk_val_set_string() copy the string
+ *   and own the copy.
+ * - \c zclk_val_take_string() takes ownership of a malloc'd string.
+ * - \c zclk_val_borrow_string() and \c copy_zclk_val() only point at the
+ *   string, which must outlive its use through the value.
+ * - Parsed values borrow from the argv passed to exec, use
+ *   \c zclk_val_own_string() to keep one after argv goes away.
  */
 typedef struct zclk_val_t
 {
@@ -94,6 +120,7 @@ typedef struct zclk_val_t
 		double dbl_value;	///< double value
 		char* str_value;	///< string value
 	} data;					///< data of the value
+	int str_owned;			///< flag indicating the string is owned
 } zclk_val;
 
 MODULE_API int zclk_val_is_type(zclk_val *val, zclk_type type);
@@ -203,13 +230,48 @@ MODULE_API void zclk_val_set_int(zclk_val *val, int ival);
 MODULE_API void zclk_val_set_dobule(zclk_val *val, double dval);
 
 /**
- * @brief set the string value
+ * @brief set the string value to a copy of the given string
+ * (the previous string is freed if the value owns it)
  * 
  * @param val value object
  * @param bval string value
  */
 MODULE_API void zclk_val_set_string(zclk_val *val, const char* sval);
 
+/**
+ * @brief set the string value to the given string without copying it
+ * (the previous string is freed if the value owns it)
+ * 
+ * @param val value object
+ * @param sval string which must outlive its use through the value
+ */
+MODULE_API void zclk_val_borrow_string(zclk_val *val, const char* sval);
+
+/**
+ * @brief set the string value to the given string and take ownership
+ * of it (the previous string is freed if the value owns it)
+ * 
+ * @param val value object
+ * @param sval string allocated with malloc, freed with the value
+ */
+MODULE_API void zclk_val_take_string(zclk_val *val, char* sval);
+
+/**
+ * @brief make the value own its string, copying it if it is borrowed
+ * 
+ * @param val value object
+ * @return error code
+ */
+MODULE_API zclk_res zclk_val_own_string(zclk_val *val);
+
+/**
+ * @brief check if the value owns its string
+ * 
+ * @param val value object
+ * @return flag indicating the string is freed with the value
+ */
+MODULE_API int zclk_val_is_string_owned(zclk_val *val);
+
 /**
  * @brief set the flag value
  * 
@@ -314,6 +376,9 @@ typedef struct zclk_option_t
 	zclk_val* val;			///< value of the option
 	zclk_val* default_val;	///< default value of the option
 	char* description;		///< textural description of the option
+	zclk_arena* arena;		///< arena the option is allocated in, or NULL
+	struct zclk_command_t* owner;	///< command the option was added to
+	size_t slot;			///< position in the options of the owner
 } zclk_option;
 
 #ifdef LUA_ENABLED
@@ -346,6 +411,9 @@ typedef struct zclk_argument_t
 	zclk_val* default_val;	///< default value of the argument
 	char* description;		///< textual description
 	int optional;			///< flag indicating if argument is optional
+	zclk_arena* arena;		///< arena the argument is allocated in, or NULL
+	struct zclk_command_t* owner;	///< command the argument was added to
+	size_t slot;			///< position in the args of the owner
 } zclk_argument;
 
 #ifdef LUA_ENABLED
@@ -368,6 +436,173 @@ MODULE_API int zclk_argument_to_lua(lua_State *L, zclk_argument* arg);
 MODULE_API void arraylist_zclk_argument_to_lua(lua_State *L, int index, void *data);
 #endif //LUA_ENABLED
 
+/**
+ * @brief A slot in the open addressing option index of a command.
+ *
+ * Every option is indexed twice, by its long name and by its short name.
+ */
+typedef struct zclk_option_slot_t
+{
+	const char* key;		///< long or short name (owned by the option)
+	size_t hash;			///< hash of the key, 0 for an empty slot
+	int is_short;			///< flag indicating the key is the short name
+	zclk_option* option;	///< the indexed option
+} zclk_option_slot;
+
+/** Offset used for a NULL string in a frozen command tree */
+#define ZCLK_FROZEN_NULL 0xFFFFFFFFu
+/** Magic number at the start of a frozen command tree ("ZCLK") */
+#define ZCLK_FROZEN_MAGIC 0x4B4C435Au
+/** Version of the frozen command tree layout */
+#define ZCLK_FROZEN_VERSION 2u
+/** Flag of a frozen command to pass leftover args on */
+#define ZCLK_FROZEN_ALLOW_EXTRA_ARGS 1u
+/** Flag of a frozen command with the --output option enabled */
+#define ZCLK_FROZEN_OUTPUT_OPTION 2u
+
+/**
+ * @brief Header of a frozen command tree block.
+ *
+ * A frozen tree is one contiguous, immutable block which contains only
+ * offsets and indexes (no pointers), so it can be shared read-only
+ * between threads or written to a file as is. All sections start at an
+ * 8 byte aligned offset from the start of the block.
+ */
+typedef struct zclk_frozen_header_t
+{
+	uint32_t magic;				///< ZCLK_FROZEN_MAGIC
+	uint32_t version;			///< ZCLK_FROZEN_VERSION
+	uint32_t size;				///< total size of the block in bytes
+	uint32_t num_commands;		///< number of commands (root is 0)
+	uint32_t num_options;		///< number of options
+	uint32_t num_args;			///< number of arguments
+	uint32_t num_keys;			///< number of sub-command keys
+	uint32_t num_slots;			///< number of option index slots
+	uint32_t commands_off;		///< offset of the commands section
+	uint32_t options_off;		///< offset of the options section
+	uint32_t args_off;			///< offset of the arguments section
+	uint32_t keys_off;			///< offset of the sub-command keys section
+	uint32_t slots_off;			///< offset of the option index section
+	uint32_t strings_off;		///< offset of the interned string pool
+	uint32_t strings_size;		///< size of the string pool
+	uint32_t reserved;			///< padding (0)
+} zclk_frozen_header;
+
+/**
+ * @brief A command in a frozen command tree.
+ * The children of a command are stored next to each other.
+ */
+typedef struct zclk_frozen_command_t
+{
+	uint32_t name;				///< string offset of the name
+	uint32_t short_name;		///< string offset of the short name
+	uint32_t description;		///< string offset of the description
+	uint32_t parent;			///< index of the parent (ZCLK_FROZEN_NULL)
+	uint32_t first_child;		///< index of the first sub-command
+	uint32_t num_children;		///< number of sub-commands
+	uint32_t first_key;			///< index of the first sub-command key
+	uint32_t num_keys;			///< number of sub-command keys
+	uint32_t first_option;		///< index of the first option
+	uint32_t num_options;		///< number of options
+	uint32_t first_slot;		///< index of the first option index slot
+	uint32_t num_slots;			///< number of option index slots (2^n)
+	uint32_t first_arg;			///< index of the first argument
+	uint32_t num_args;			///< number of arguments
+	uint32_t allow_abbrev;		///< flag to resolve unique prefixes
+	uint32_t flags;				///< ZCLK_FROZEN_ALLOW_EXTRA_ARGS and such
+} zclk_frozen_command;
+
+/**
+ * @brief Packed descriptor of an option or argument in a frozen tree.
+ */
+typedef struct zclk_frozen_option_t
+{
+	uint32_t name;				///< string offset of the name
+	uint32_t short_name;		///< string offset of the short name
+	uint32_t description;		///< string offset of the description
+	uint32_t type;				///< zclk_type of the value
+	union {
+		int64_t int_value;		///< default of bool, int and flag values
+		double dbl_value;		///< default of double values
+		uint32_t str_value;		///< string offset of the default string
+	} default_val;				///< default value
+} zclk_frozen_option;
+
+/**
+ * @brief A sub-command name (or short name) in a frozen tree.
+ * The keys of a command are sorted by name.
+ */
+typedef struct zclk_frozen_key_t
+{
+	uint32_t name;				///< string offset of the name
+	uint32_t command;			///< index of the sub-command
+} zclk_frozen_key;
+
+/**
+ * @brief A slot of the open addressing option index in a frozen tree.
+ */
+typedef struct zclk_frozen_slot_t
+{
+	uint32_t hash;				///< hash of the name, 0 for an empty slot
+	uint32_t ref;				///< option index + 1, top bit set for short
+} zclk_frozen_slot;
+
+/**
+ * @brief A frozen command tree, along with the live objects it was
+ * compiled from.
+ */
+typedef struct zclk_frozen_t
+{
+	const unsigned char* block;			///< the immutable tree block
+	size_t size;						///< size of the block
+	struct zclk_command_t** commands;	///< live command of each command
+	struct zclk_option_t** options;		///< live option of each option
+	struct zclk_argument_t** args;		///< live argument of each argument
+	zclk_val* values;					///< initial value of each option,
+										///< then of each argument
+	struct zclk_cache_t* cache;			///< cache the block is mapped
+										///< from, NULL if frozen in memory
+} zclk_frozen;
+
+/** Magic number at the start of a command tree cache file ("ZCKC") */
+#define ZCLK_CACHE_MAGIC 0x434B435Au
+/** Version of the command tree cache file layout */
+#define ZCLK_CACHE_VERSION 1u
+
+/**
+ * @brief Header of a command tree cache file, followed by a frozen block.
+ */
+typedef struct zclk_cache_header_t
+{
+	uint32_t magic;				///< ZCLK_CACHE_MAGIC
+	uint32_t version;			///< ZCLK_CACHE_VERSION
+	uint32_t frozen_version;	///< ZCLK_FROZEN_VERSION of the block
+	uint32_t block_size;		///< size of the frozen block
+	uint64_t source_hash;		///< hash of what the tree was defined by
+} zclk_cache_header;
+
+/**
+ * @brief Function called for each command built from a cache, to set its
+ * handler (and anything else which cannot be stored in the file).
+ */
+typedef void (*zclk_cache_bind_fn)(struct zclk_command_t* cmd,
+	struct zclk_command_t* parent, void* bind_args);
+
+/**
+ * @brief A command tree mapped from a cache file.
+ */
+typedef struct zclk_cache_t
+{
+	zclk_frozen frozen;				///< the mapped block, and the commands
+									///< built from it so far
+	const unsigned char* map;		///< the mapped file
+	size_t map_size;				///< size of the mapped file
+	zclk_arena* arena;				///< arena of the commands built from it
+	zclk_cache_bind_fn bind;		///< binds the commands built from it
+	void* bind_args;				///< args passed to bind
+	struct zclk_command_t* root;	///< top-level command
+} zclk_cache;
+
 /**
  * @brief Fill the entries in the given option array into an arraylist
  * 
@@ -391,6 +626,13 @@ struct zclk_command_t;
 typedef zclk_res(*zclk_command_fn)(struct zclk_command_t* cmd,
 										void* handler_args);
 
+/**
+ * @brief defines a function to fill in a lazy command (its options,
+ * arguments and sub-commands) the first time it is used
+ */
+typedef zclk_res(*zclk_command_loader_fn)(struct zclk_command_t* cmd,
+										void* loader_args);
+
 /**
  * @brief A CLI Command Ojbect
  */
@@ -409,6 +651,30 @@ typedef struct zclk_command_t
 		success_handler;			///< success handler for the command
 	int lua_handler_ref;			///< lua ref for handler
 	int lua_udata_ref;				///< lua ref for the udata of this object
+	zclk_option_slot* option_index;	///< hash index of options by name
+	size_t option_index_cap;		///< number of slots in the option index
+	size_t option_index_used;		///< number of used slots
+	size_t option_index_count;		///< number of options indexed
+	zclk_trie* sub_command_index;	///< trie of sub-commands by name
+	size_t sub_command_index_count;	///< number of sub-commands indexed
+	int allow_abbrev;				///< flag to resolve unique prefixes
+	zclk_frozen* frozen;			///< frozen tree this command is part of
+	uint32_t frozen_id;				///< index of this command in the tree
+	zclk_arena* arena;				///< arena the command is allocated in
+	zclk_writer* writer;			///< sink for the output, or NULL
+	zclk_option* output_option;		///< the --output option, if enabled
+	char* help_cache;				///< rendered help, NULL until needed
+	size_t help_cache_len;			///< length of the rendered help
+	size_t help_usage_len;			///< length of the usage part of it
+	size_t help_num_options;		///< options when the help was rendered
+	size_t help_num_args;			///< args when the help was rendered
+	size_t help_num_sub_commands;	///< sub-commands when it was rendered
+	zclk_command_loader_fn loader;	///< fills in a lazy command, NULL once run
+	void* loader_args;				///< args passed to the loader
+	zclk_res load_res;				///< result of the loader
+	long load_pending;				///< set until the loader has run (atomic)
+	int allow_extra_args;			///< flag to pass leftover args on
+	struct zclk_command_t* parent;	///< command it was first added to
 } zclk_command;
 
 /**
@@ -420,6 +686,17 @@ typedef struct zclk_command_t
  */
 MODULE_API zclk_res make_zclk_val(zclk_val** val, zclk_type type);
 
+/**
+ * Create a new value object of given type in the given arena.
+ *
+ * @param arena arena to allocate from (NULL to use the heap)
+ * @param val object to create
+ * @param type
+ * @return error code
+ */
+MODULE_API zclk_res make_zclk_val_in(zclk_arena* arena, zclk_val** val,
+	zclk_type type);
+
 /**
  * Free the created value
  */
@@ -433,6 +710,7 @@ MODULE_API void clear_zclk_val(zclk_val* val);
 /**
  * Copy values from 'from' to 'to'.
  * Can be used to reset to defaults.
+ * A string is not copied, 'to' borrows it from 'from'.
  *
  * @param to val to set
  * @param from val to read from
@@ -443,10 +721,14 @@ MODULE_API void copy_zclk_val(zclk_val* to, zclk_val* from);
  * Parse the input and read the value of the type of the val object.
  * (Should not be called when the values is a flag.)
  * The value should be set as soon as the argument/option is seen
+ * Numbers are parsed strictly (see zclk_number.h), the whole input must be
+ * a number or the value is left unchanged. A string value borrows the
+ * input without copying it.
  *
  * @param val object whose value will be set
  * @param input string input
- * @return error code
+ * @return error code, ZCLK_RES_ERR_INVALID_VALUE if the input is not a
+ * 	number, ZCLK_RES_ERR_VALUE_OUT_OF_RANGE if it does not fit the type
  */
 MODULE_API zclk_res parse_zclk_val(zclk_val* val, char* input);
 
@@ -465,6 +747,23 @@ MODULE_API zclk_res make_option(zclk_option** option, const char* name,
 	const char* short_name, zclk_val* val, zclk_val* default_val, 
 	const char* description);
 
+/**
+ * (Internal Use) Create a new option in the given arena. The names and
+ * description are copied into the arena, the values are used as given.
+ *
+ * @param arena arena to allocate from (NULL to use the heap)
+ * @param option object to create
+ * @param name
+ * @param short_name
+ * @param val
+ * @param default_val
+ * @param description
+ * @return error code
+ */
+MODULE_API zclk_res make_option_in(zclk_arena* arena, zclk_option** option,
+	const char* name, const char* short_name, zclk_val* val,
+	zclk_val* default_val, const char* description);
+
 /**
  * @brief (Internal Use) Create an option object
  * 
@@ -500,6 +799,16 @@ MODULE_API const char *zclk_option_get_name(zclk_option *opt);
 MODULE_API const char *zclk_option_get_short_name(zclk_option *opt);
 MODULE_API const char *zclk_option_get_desc(zclk_option *opt);
 
+/**
+ * @brief Get the value of the option.
+ * In a command handler this is the value parsed for the running exec,
+ * otherwise it is the initial value of the option.
+ * 
+ * @param opt option
+ * @return value of the option
+ */
+MODULE_API zclk_val *zclk_option_get_val(zclk_option *opt);
+
 MODULE_API int zclk_option_get_val_bool(zclk_option *opt);
 MODULE_API int zclk_option_get_val_int(zclk_option *opt);
 MODULE_API double zclk_option_get_val_double(zclk_option *opt);
@@ -522,6 +831,10 @@ MODULE_API void free_option(zclk_option* option);
 /**
  * @brief Get the option by name object
  * 
+ * NOTE:
+ * This scans the given list. To find an option of a command use
+ * \c zclk_command_get_option() which uses the hash index of the command.
+ * 
  * @param options options list
  * @param name name of option to retrieve
  * @return zclk_option* option with the given name
@@ -547,6 +860,20 @@ MODULE_API zclk_option* get_option_by_name(arraylist* options,
 MODULE_API zclk_res make_argument(zclk_argument** arg, const char* name, 
 	zclk_val* val, zclk_val* default_val, const char* desc);
 
+/**
+ * (Internal Use) Create a new argument in the given arena.
+ *
+ * @param arena arena to allocate from (NULL to use the heap)
+ * @param arg object to create
+ * @param name
+ * @param val
+ * @param default_val
+ * @param desc
+ * @return error code
+ */
+MODULE_API zclk_res make_argument_in(zclk_arena* arena, zclk_argument** arg,
+	const char* name, zclk_val* val, zclk_val* default_val, const char* desc);
+
 /**
  * @brief (Internal use) Create an argument object
  * 
@@ -579,6 +906,15 @@ MODULE_API zclk_argument *new_zclk_argument_flag(const char *name,
 MODULE_API const char *zclk_argument_get_name(zclk_argument *opt);
 MODULE_API const char *zclk_argument_get_desc(zclk_argument *opt);
 
+/**
+ * @brief Get the value of the argument.
+ * @see zclk_option_get_val
+ * 
+ * @param arg argument
+ * @return value of the argument
+ */
+MODULE_API zclk_val *zclk_argument_get_val(zclk_argument *arg);
+
 MODULE_API int zclk_argument_get_val_bool(zclk_argument *opt);
 MODULE_API int zclk_argument_get_val_int(zclk_argument *opt);
 MODULE_API double zclk_argument_get_val_double(zclk_argument *opt);
@@ -629,9 +965,58 @@ MODULE_API zclk_command* new_zclk_command(
 							zclk_command_fn handler
 						);
 
+/**
+ * Create a new command in the given arena.
+ * The command, its names, and the options and arguments added to it with
+ * the \c zclk_command_<type>_option() and \c zclk_command_<type>_argument()
+ * functions are allocated from the arena. Create the sub-commands in the
+ * same arena, and the whole tree is released by one call to
+ * free_zclk_arena (free_command does nothing for such commands).
+ *
+ * The option index, the sub-command trie, the rendered help and the
+ * frozen block of the tree are allocated from the arena as well. Only
+ * the option, argument and sub-command lists are on the heap (the
+ * arraylist grows its own storage), and a cleanup the command registers
+ * with the arena frees them. So releasing the tree frees the blocks of
+ * the arena plus three lists per command.
+ *
+ * @param arena arena to allocate from (NULL to use the heap)
+ * @param command obj to be created
+ * @param name
+ * @param short_name
+ * @param description
+ * @param handler function ptr to handler
+ * @return error code
+ */
+MODULE_API zclk_res make_command_in(zclk_arena* arena, zclk_command** command,
+	const char* name, const char* short_name, const char* description,
+	zclk_command_fn handler);
+
+/**
+ * @brief Create a command object in the given arena
+ * @see make_command_in
+ * 
+ * @param arena arena to allocate from (NULL to use the heap)
+ * @param name 
+ * @param short_name 
+ * @param description 
+ * @param handler 
+ * @return zclk_command* created command object
+ */
+MODULE_API zclk_command* new_zclk_command_in(
+							zclk_arena* arena,
+							const char* name, 
+							const char* short_name,
+    						const char* description, 
+							zclk_command_fn handler
+						);
+
 /**
  * @brief Add a subcommand to the given command
  * 
+ * The first command a subcommand is added to owns it, and frees it in
+ * free_command.
+ *
  * @param cmd command
  * @param subcommand subcommand to add
  * @return error code
@@ -641,6 +1026,374 @@ MODULE_API zclk_res zclk_command_subcommand_add(
 							zclk_command *subcommand
 						);
 
+/**
+ * @brief Add a lazy subcommand to the given command. Only its name, short
+ * name, description and handler exist until dispatch, help or completion
+ * reaches it (or the tree is frozen), when the built-in options are added
+ * and the loader is run once to add its options, arguments and
+ * sub-commands. So startup costs only as much as the path which is
+ * invoked.
+ *
+ * Loaders run one at a time, under a lock, so a lazy tree can be parsed
+ * on many threads at once. A loader can use its own command and load
+ * other commands.
+ *
+ * @param cmd command
+ * @param name name of the subcommand
+ * @param short_name short name of the subcommand
+ * @param description description of the subcommand
+ * @param handler handler of the subcommand
+ * @param loader function which fills in the subcommand
+ * @param loader_args args passed to the loader
+ * @return the subcommand (allocated in the arena of cmd, and freed like
+ * 			any other subcommand), or NULL on error
+ */
+MODULE_API zclk_command* zclk_command_lazy_subcommand_add(
+							zclk_command *cmd,
+							const char *name,
+							const char *short_name,
+							const char *description,
+							zclk_command_fn handler,
+							zclk_command_loader_fn loader,
+							void *loader_args
+						);
+
+/**
+ * @brief Create a lazy command which is not a subcommand (yet), like the
+ * commands of zclk_command_lazy_subcommand_add.
+ *
+ * @param arena arena to allocate from (NULL to use the heap)
+ * @param name name of the command
+ * @param short_name short name of the command
+ * @param description description of the command
+ * @param handler handler of the command
+ * @param loader function which fills in the command
+ * @param loader_args args passed to the loader
+ * @return the command, or NULL on error
+ */
+MODULE_API zclk_command* new_zclk_lazy_command_in(
+							zclk_arena* arena,
+							const char *name,
+							const char *short_name,
+							const char *description,
+							zclk_command_fn handler,
+							zclk_command_loader_fn loader,
+							void *loader_args
+						);
+
+/**
+ * @brief Run the loader of a lazy command, if it has not run yet.
+ *
+ * @param cmd command
+ * @return error code of the loader (also on later calls)
+ */
+MODULE_API zclk_res zclk_command_load(zclk_command *cmd);
+
+/**
+ * (Internal Use) Take the lock the loaders of lazy commands run under.
+ * A thread which holds it can take it again.
+ */
+MODULE_API void zclk_command_load_lock();
+
+/**
+ * (Internal Use) Release the lock taken by zclk_command_load_lock.
+ */
+MODULE_API void zclk_command_load_unlock();
+
+/**
+ * @brief Check if the command is filled in, i.e. it is not lazy or its
+ * loader has run.
+ *
+ * @param cmd command
+ * @return 1 if loaded, 0 otherwise
+ */
+MODULE_API int zclk_command_is_loaded(zclk_command *cmd);
+
+/**
+ * @brief Find a sub-command of the given command by name or short name.
+ *
+ * The lookup costs O(length of name), using the trie of sub-commands.
+ * If abbreviations are allowed, an unambiguous prefix of a name also
+ * resolves to the sub-command.
+ *
+ * @param cmd command
+ * @param name name, short name (or prefix) of the sub-command
+ * @param allow_abbrev flag to allow unambiguous prefixes
+ * @return sub-command if found, NULL otherwise
+ */
+MODULE_API zclk_command* zclk_command_get_subcommand(
+							zclk_command *cmd,
+							const char *name,
+							int allow_abbrev
+						);
+
+/**
+ * @brief Allow sub-commands of this command (and of all its descendants)
+ * to be invoked using an unambiguous prefix of their names,
+ * for e.g. \c dep for \c deploy.
+ *
+ * @param cmd command
+ * @param allow flag to allow abbreviations
+ */
+MODULE_API void zclk_command_allow_abbreviations(zclk_command *cmd, int allow);
+
+/**
+ * @brief Allow more args than the arguments of this command when it is
+ * the invoked command. The leftover args are handed to the handler with
+ * zclk_parse_result_get_extra_args instead of failing the parse, e.g. for
+ * a list of files given in an argument file.
+ *
+ * @param cmd command
+ * @param allow flag to allow extra args
+ */
+MODULE_API void zclk_command_allow_extra_args(zclk_command *cmd, int allow);
+
+/**
+ * @brief Add the --output option to this command, to choose the format
+ * print_handler writes table and dict results in (see
+ * zclk_current_output_format). It applies to the sub-commands as well, so
+ * it is usually enabled on the root.
+ *
+ * @param cmd command
+ * @return error code, ZCLK_RES_ERR_INVALID_VALUE if the command already
+ * 			has an option named "output"
+ */
+MODULE_API zclk_res zclk_command_enable_output_option(zclk_command *cmd);
+
+/**
+ * @brief Set the sink for the output of this command (and of all its
+ * descendants which do not have their own). The writer is not owned by
+ * the command.
+ *
+ * @param cmd command
+ * @param writer sink, NULL to use stdout
+ */
+MODULE_API void zclk_command_set_writer(zclk_command *cmd,
+	zclk_writer *writer);
+
+/**
+ * @brief Get the sink for the output of this command.
+ *
+ * @param cmd command
+ * @return writer set on the command, or NULL
+ */
+MODULE_API zclk_writer* zclk_command_get_writer(zclk_command *cmd);
+
+/**
+ * @brief Get the sink of the command whose handler is running on this
+ * thread. print_handler writes to it.
+ *
+ * @return current writer, the stdout writer outside of a handler or when
+ * 			no writer is set
+ */
+MODULE_API zclk_writer* zclk_current_writer();
+
+/**
+ * @brief Get the output format chosen with the --output option (see
+ * zclk_command_enable_output_option) of the command whose handler is
+ * running on this thread (or of one of its parents, the innermost one
+ * given wins). print_handler writes table and dict results in this
+ * format.
+ *
+ * An option named "output" added to a command in any other way is not
+ * interpreted.
+ *
+ * @return current output format, ZCLK_OUTPUT_TABLE outside of a handler
+ * 			or when the option is not given
+ */
+MODULE_API zclk_output_format zclk_current_output_format();
+
+/**
+ * @brief Compile a finished command tree into one contiguous immutable
+ * block (see zclk_frozen_header).
+ *
+ * The block uses index based children, packed option descriptors and an
+ * interned string pool. Once frozen, sub-command and option lookups for
+ * every command of the tree run on the frozen form, and the tree can no
+ * longer be changed (options, arguments and sub-commands cannot be
+ * added).
+ *
+ * A command line of a frozen tree is parsed on the block: the value table
+ * is copied from the initial values decoded from the option descriptors
+ * (one copy per command of the chain), and options are bound to their
+ * value slots by their index in the block, without going through the
+ * option and argument lists of the live commands. The initial values are
+ * the defaults of the options and arguments at the time of freezing.
+ *
+ * @param cmd the root command of the tree
+ * @return error code
+ */
+MODULE_API zclk_res zclk_command_freeze(zclk_command *cmd);
+
+/**
+ * @brief Check if the command is part of a frozen tree (the commands
+ * mapped from a cache can still be changed, and are not frozen).
+ *
+ * @param cmd command
+ * @return 1 if frozen, 0 otherwise
+ */
+MODULE_API int zclk_command_is_frozen(zclk_command *cmd);
+
+/**
+ * @brief Free a frozen tree (the live commands are not freed).
+ *
+ * @param frozen frozen tree
+ */
+MODULE_API void free_zclk_frozen(zclk_frozen* frozen);
+
+/**
+ * (Internal Use) Find an option of a frozen command by name.
+ *
+ * @param frozen frozen tree
+ * @param cmd_id index of the command
+ * @param name name (the first len chars are used)
+ * @param len length of name
+ * @param is_short flag indicating name is a short name
+ * @return index of the option, or ZCLK_FROZEN_NULL
+ */
+MODULE_API uint32_t zclk_frozen_find_option(const zclk_frozen* frozen,
+	uint32_t cmd_id, const char* name, size_t len, int is_short);
+
+/**
+ * (Internal Use) Get the descriptor of a command of a frozen tree.
+ *
+ * @param frozen frozen tree
+ * @param cmd_id index of the command
+ * @return command descriptor
+ */
+MODULE_API const zclk_frozen_command* zclk_frozen_get_command(
+	const zclk_frozen* frozen, uint32_t cmd_id);
+
+/**
+ * (Internal Use) Find a sub-command of a frozen command by name.
+ *
+ * @param frozen frozen tree
+ * @param cmd_id index of the command
+ * @param name name, short name (or prefix) of the sub-command
+ * @param allow_abbrev flag to allow unambiguous prefixes
+ * @return index of the sub-command, or ZCLK_FROZEN_NULL
+ */
+MODULE_API uint32_t zclk_frozen_find_subcommand(const zclk_frozen* frozen,
+	uint32_t cmd_id, const char* name, int allow_abbrev);
+
+/**
+ * (Internal Use) Visit the names and short names of the sub-commands of a
+ * frozen command which start with the given prefix, in sorted order. The
+ * value passed to fn is the live sub-command.
+ *
+ * @param frozen frozen tree
+ * @param cmd_id index of the command
+ * @param prefix prefix (empty string to visit all)
+ * @param fn function called for every name
+ * @param ctx context passed to fn
+ * @return number of names visited
+ */
+MODULE_API size_t zclk_frozen_foreach_subcommand(const zclk_frozen* frozen,
+	uint32_t cmd_id, const char* prefix, zclk_trie_visit_fn fn, void* ctx);
+
+/**
+ * (Internal Use) Get the live command of a command of a frozen tree. The
+ * commands of a tree mapped from a cache are built when first asked for.
+ *
+ * @param frozen frozen tree
+ * @param cmd_id index of the command
+ * @return the command, or NULL on error
+ */
+MODULE_API struct zclk_command_t* zclk_frozen_get_live_command(
+	const zclk_frozen* frozen, uint32_t cmd_id);
+
+/**
+ * (Internal Use) Get the descriptor of an argument of a frozen tree.
+ *
+ * @param frozen frozen tree
+ * @param arg_id index of the argument
+ * @return argument descriptor
+ */
+MODULE_API const zclk_frozen_option* zclk_frozen_get_argument(
+	const zclk_frozen* frozen, uint32_t arg_id);
+
+/**
+ * (Internal Use) Get a string of a frozen tree.
+ *
+ * @param frozen frozen tree
+ * @param off string offset
+ * @return the string, NULL for ZCLK_FROZEN_NULL
+ */
+MODULE_API const char* zclk_frozen_get_string(const zclk_frozen* frozen,
+	uint32_t off);
+
+/**
+ * @brief Get the 64-bit FNV-1a hash of some data, for e.g. of the script
+ * which defines a command tree, to check if its cache is still current.
+ *
+ * @param data data
+ * @param len length of the data
+ * @return hash
+ */
+MODULE_API uint64_t zclk_cache_hash(const void* data, size_t len);
+
+/**
+ * @brief Get the zclk_cache_hash of the contents of a file.
+ *
+ * @param hash the hash
+ * @param path path of the file
+ * @return error code
+ */
+MODULE_API zclk_res zclk_cache_hash_file(uint64_t* hash, const char* path);
+
+/**
+ * @brief Write a command tree to a cache file: the frozen block of the
+ * tree (freezing it first if needed) after a header with the hash of its
+ * source. The file is written next to the path and renamed over it, so a
+ * reader never sees a partial cache.
+ *
+ * @param cmd top-level command
+ * @param path path of the cache file
+ * @param source_hash hash of what the tree was defined by
+ * @return error code
+ */
+MODULE_API zclk_res zclk_command_save_cache(zclk_command* cmd,
+	const char* path, uint64_t source_hash);
+
+/**
+ * @brief Map a cache file, and check it is current.
+ *
+ * A command line is dispatched directly on the mapped block, as on a
+ * frozen tree: sub-commands are looked up in the block and options are
+ * bound to their value slots by their index in the block. Only a bare
+ * command (name, description and handler) is built for each command the
+ * command line goes through, and passed to bind. The options, arguments
+ * and sub-commands of a command are built from the block only when help,
+ * completion, zclk_command_get_option and such ask for them, or when the
+ * command is changed. A command which was changed is dispatched on its
+ * live lists.
+ *
+ * @param cache the cache
+ * @param path path of the cache file
+ * @param source_hash hash of what the tree is defined by now
+ * @param bind function called for every command built, or NULL
+ * @param bind_args args passed to bind
+ * @return error code, ZCLK_RES_ERR_INVALID_VALUE if the file is corrupt
+ * 			or stale (the tree must then be built and saved again)
+ */
+MODULE_API zclk_res zclk_cache_open(zclk_cache** cache, const char* path,
+	uint64_t source_hash, zclk_cache_bind_fn bind, void* bind_args);
+
+/**
+ * @brief Get the top-level command of a cache.
+ *
+ * @param cache the cache
+ * @return top-level command (owned by the cache)
+ */
+MODULE_API zclk_command* zclk_cache_get_command(zclk_cache* cache);
+
+/**
+ * @brief Free a cache, its commands and the mapping.
+ *
+ * @param cache the cache
+ */
+MODULE_API void free_zclk_cache(zclk_cache* cache);
+
 /**
  * @brief Add an option to the given command
  * 
@@ -787,6 +1540,9 @@ MODULE_API void zclk_command_flag_argument(zclk_command *cmd, const char *name,
 /**
  * @brief Get the option object corresponding to given name
  * 
+ * The name is looked up in the hash index of the command,
+ * first as a long name and then as a short name.
+ * 
  * @param cmd command object
  * @param name name of the option
  * @return zclk_option option if found, NULL otherwise
@@ -838,9 +1594,88 @@ MODULE_API zclk_argument* zclk_command_get_argument(zclk_command *cmd,
 							: 0);											\
 					i++)
 
+/** Size of the error message buffer of a parse context */
+#define ZCLK_SIZE_OF_HELP_STR 4096
+/** Size of the program name buffers of a parse context */
+#define ZCLK_SIZE_OF_PROGNAME_STR 1024
+
+/**
+ * @brief State of one parse/exec call.
+ * 
+ * The help, program name and error strings returned by the exec and help
+ * functions live in the context, so calls made with different contexts
+ * can run at the same time on different threads. The functions which do
+ * not take a context use a single default context, and must not be called
+ * concurrently. A context which was not made with make_zclk_parse_ctx
+ * must be released with zclk_parse_ctx_release.
+ */
+typedef struct zclk_parse_ctx_t
+{
+	zclk_writer* help;								///< help text, grown as needed
+	char progname_str[ZCLK_SIZE_OF_PROGNAME_STR];	///< program name
+	char short_progname_str[ZCLK_SIZE_OF_PROGNAME_STR];	///< short name
+	char error_message_str[ZCLK_SIZE_OF_HELP_STR];	///< last error message
+	zclk_res error;									///< last exec result
+} zclk_parse_ctx;
+
+/**
+ * @brief Create a parse context.
+ * (A zero-initialized zclk_parse_ctx can also be used directly.)
+ * 
+ * @param ctx context to create
+ * @return error code
+ */
+MODULE_API zclk_res make_zclk_parse_ctx(zclk_parse_ctx** ctx);
+
+/**
+ * @brief Free a parse context.
+ * 
+ * @param ctx context to free
+ */
+MODULE_API void free_zclk_parse_ctx(zclk_parse_ctx* ctx);
+
+/**
+ * @brief Free the buffers of a context, e.g. of a zero-initialized
+ * zclk_parse_ctx. The context can still be used afterwards.
+ *
+ * @param ctx context
+ */
+MODULE_API void zclk_parse_ctx_release(zclk_parse_ctx* ctx);
+
+/**
+ * @brief Get the context used by the functions which do not take one.
+ * 
+ * @return default context
+ */
+MODULE_API zclk_parse_ctx* zclk_default_parse_ctx();
+
+/**
+ * @brief Get the result of the last exec in the context.
+ * 
+ * @param ctx context
+ * @return error code
+ */
+MODULE_API zclk_res zclk_parse_ctx_get_error(zclk_parse_ctx* ctx);
+
+/**
+ * @brief Get the message of the last error in the context.
+ * 
+ * @param ctx context
+ * @return error message
+ */
+MODULE_API const char* zclk_parse_ctx_get_error_message(zclk_parse_ctx* ctx);
+
 /**
  * @brief Execute the command with the given args
  * 
+ * Args of the form \c @path and \c --args-from \c path (or
+ * \c --args-from=path) are replaced by the args read from the file, one
+ * per line or NUL delimited, before the line is parsed. The file is mapped
+ * and split in place, and unmapped when the exec returns. An \c @ arg
+ * after "--", or one which does not name a readable file, is kept as it
+ * is.
+ * @see zclk_argfile.h
+ * 
  * @param cmd Command to execute
  * @param exec_args exec args
  * @param argc arg count
@@ -852,13 +1687,370 @@ MODULE_API zclk_res zclk_command_exec(
 	void *exec_args,
 	int argc, char *argv[]);
 
+/**
+ * @brief Execute the command with the given args, using the given context
+ * @see zclk_command_exec
+ * 
+ * @param ctx parse context
+ * @param cmd Command to execute
+ * @param exec_args exec args
+ * @param argc arg count
+ * @param argv arg values
+ * @return error code
+ */
+MODULE_API zclk_res zclk_command_exec_ctx(
+	zclk_parse_ctx *ctx,
+	zclk_command *cmd,
+	void *exec_args,
+	int argc, char *argv[]);
+
+/** Hidden first argument which asks for the completions of a line */
+#define ZCLK_COMPLETE_COMMAND "__complete"
+/** Hidden first argument which asks for the completion script of a shell */
+#define ZCLK_COMPLETION_SCRIPT_COMMAND "__completion"
+
+/**
+ * @brief Write the completions of the last (partial) word of a command
+ * line, one per line, as the word followed by a tab and a description.
+ * The candidates are the sub-commands of the innermost command named on
+ * the line, the options of the chain of commands when the word starts
+ * with -, and the formats when it is the value of --output. No handler
+ * is run.
+ *
+ * zclk_command_exec does this (to the writer of the command, or stdout)
+ * when it is run as: prog __complete WORD... and writes the script for a
+ * shell when run as: prog __completion bash|zsh|fish
+ *
+ * @param cmd top-level command
+ * @param writer writer for the completions
+ * @param argc number of words after the program name
+ * @param argv words after the program name, the last one being completed
+ * @return error code
+ */
+MODULE_API zclk_res zclk_command_complete(zclk_command* cmd,
+	zclk_writer* writer, int argc, char* argv[]);
+
+/**
+ * @brief Write a completion script for a shell. The script asks the
+ * program for the completions (with __complete) on each Tab press, so it
+ * never goes out of date.
+ *
+ * @param cmd top-level command
+ * @param writer writer for the script
+ * @param shell bash, zsh or fish
+ * @return error code, ZCLK_RES_ERR_INVALID_VALUE for an unknown shell
+ */
+MODULE_API zclk_res zclk_command_completion_script(zclk_command* cmd,
+	zclk_writer* writer, const char* shell);
+
+/**
+ * @brief The values of one parse of a command line.
+ *
+ * Parsing never writes to the command definitions, so one tree can be
+ * parsed any number of times (and on many threads at once). The values
+ * live in a table with one slot per option/argument of each command in
+ * the invoked chain, allocated with the result in a single block. Each
+ * slot starts as a copy of the initial value of its option/argument.
+ * String values are borrowed, from argv or from the definitions, and are
+ * valid as long as both are.
+ *
+ * When the whole chain is part of one frozen tree, the slots of each
+ * command are copied from the values decoded from the tree, and options
+ * are bound to slots by their index in it.
+ */
+typedef struct zclk_parse_result_t
+{
+	arraylist* commands;		///< chain from top-level to invoked command
+	size_t num_commands;		///< number of commands in the chain
+	size_t* option_base;		///< first option slot of each command
+	size_t* arg_base;			///< first argument slot of each command
+	size_t num_values;			///< number of slots
+	zclk_val* values;			///< value of each slot
+	unsigned char* is_set;		///< whether each slot was given on the line
+	int help_requested;			///< --help was given for any command
+	char** extra_args;			///< leftover args, if the command allows them
+	size_t num_extra_args;		///< number of leftover args
+	const zclk_frozen* frozen;	///< frozen tree of the whole chain, or NULL
+	uint32_t* frozen_ids;		///< index of each command in the frozen tree
+} zclk_parse_result;
+
+/**
+ * @brief Create the value table for a command chain.
+ * The result owns the chain list and frees it.
+ * 
+ * @param result result to create
+ * @param cmds chain of commands from top-level to the invoked command
+ * @return error code
+ */
+MODULE_API zclk_res make_zclk_parse_result(zclk_parse_result** result,
+	arraylist* cmds);
+
+/**
+ * @brief Free a parse result.
+ * 
+ * @param result result to free
+ */
+MODULE_API void free_zclk_parse_result(zclk_parse_result* result);
+
+/**
+ * @brief Get the command invoked by the parsed line.
+ * 
+ * @param result parse result
+ * @return last command of the chain
+ */
+MODULE_API zclk_command* zclk_parse_result_get_command(
+	zclk_parse_result* result);
+
+/**
+ * @brief Get the parsed value of an option of any command in the chain.
+ * 
+ * @param result parse result
+ * @param opt option
+ * @return value, or NULL if the option is not in the chain
+ */
+MODULE_API zclk_val* zclk_parse_result_get_option(zclk_parse_result* result,
+	zclk_option* opt);
+
+/**
+ * @brief Get the parsed value of an option by its name (or short name),
+ * searching from the invoked command up to the top-level command.
+ * 
+ * @param result parse result
+ * @param name name of the option
+ * @return value, or NULL if there is no such option
+ */
+MODULE_API zclk_val* zclk_parse_result_get_option_by_name(
+	zclk_parse_result* result, const char* name);
+
+/**
+ * @brief Get the parsed value of an argument of any command in the chain.
+ * 
+ * @param result parse result
+ * @param arg argument
+ * @return value, or NULL if the argument is not in the chain
+ */
+MODULE_API zclk_val* zclk_parse_result_get_argument(zclk_parse_result* result,
+	zclk_argument* arg);
+
+/**
+ * @brief Get the parsed value of an argument of the invoked command.
+ * 
+ * @param result parse result
+ * @param name name of the argument
+ * @return value, or NULL if there is no such argument
+ */
+MODULE_API zclk_val* zclk_parse_result_get_argument_by_name(
+	zclk_parse_result* result, const char* name);
+
+/**
+ * @brief Check if the option was given on the command line.
+ * 
+ * @param result parse result
+ * @param opt option
+ * @return 1 if the option was given, 0 otherwise
+ */
+MODULE_API int zclk_parse_result_option_is_set(zclk_parse_result* result,
+	zclk_option* opt);
+
+/**
+ * @brief Check if the argument was given on the command line.
+ * 
+ * @param result parse result
+ * @param arg argument
+ * @return 1 if the argument was given, 0 otherwise
+ */
+MODULE_API int zclk_parse_result_argument_is_set(zclk_parse_result* result,
+	zclk_argument* arg);
+
+/**
+ * @brief Get the result being handled by the current thread, i.e. the
+ * result of the exec whose command handlers are running.
+ * 
+ * @return current result, or NULL outside of a command handler
+ */
+MODULE_API zclk_parse_result* zclk_current_parse_result();
+
+/**
+ * @brief Get the args left over after the arguments of the invoked
+ * command, in order.
+ * @see zclk_command_allow_extra_args
+ * 
+ * @param result parse result
+ * @param count set to the number of extra args
+ * @return extra args (borrowed from argv), or NULL if there are none
+ */
+MODULE_API char** zclk_parse_result_get_extra_args(zclk_parse_result* result,
+	size_t* count);
+
+/**
+ * @brief Parse a command line without running any handler.
+ * 
+ * @param cmd top-level command
+ * @param argc arg count
+ * @param argv arg values
+ * @param result parsed values (NULL on error), free with
+ * 				free_zclk_parse_result
+ * @return error code
+ */
+MODULE_API zclk_res zclk_command_parse(zclk_command* cmd, int argc,
+	char* argv[], zclk_parse_result** result);
+
+/**
+ * @brief Parse a command line, using the given context for errors.
+ * @see zclk_command_parse
+ */
+MODULE_API zclk_res zclk_command_parse_ctx(zclk_parse_ctx* ctx,
+	zclk_command* cmd, int argc, char* argv[], zclk_parse_result** result);
+
+/**
+ * @brief Parse a command line for any of the given top-level commands.
+ * If help is requested the arguments are not parsed, and
+ * help_requested is set in the result.
+ * 
+ * @param ctx parse context
+ * @param commands list of top-level commands
+ * @param argc arg count
+ * @param argv arg values
+ * @param result parsed values (NULL on error)
+ * @return error code
+ */
+MODULE_API zclk_res parse_command_ctx(zclk_parse_ctx* ctx,
+	arraylist* commands, int argc, char** argv, zclk_parse_result** result);
+
 /**
  * Free a command object
  * 
+ * NOTE:
+ * The sub-commands added with zclk_command_subcommand_add are owned by the
+ * command they were first added to, and are freed along with it (do not
+ * free them separately). Commands allocated in an arena are released
+ * with the arena, and this does nothing for them.
+ * 
  * @param command command object to free
  */
 MODULE_API void free_command(zclk_command* command);
 
+/**
+ * @brief Lexical class of a single command line token.
+ *
+ * Every token is classified once when the command line is tokenized
+ * (long, short, long with inline value, terminator or positional).
+ * Dispatch and option parsing then refine positional tokens into
+ * commands and option values.
+ */
+typedef enum
+{
+	ZCLK_TOKEN_POSITIONAL = 0,	///< plain word, or anything after "--"
+	ZCLK_TOKEN_LONG = 1,		///< long option e.g. --name
+	ZCLK_TOKEN_LONG_VALUE = 2,	///< long option with value e.g. --name=val
+	ZCLK_TOKEN_SHORT = 3,		///< short option e.g. -n
+	ZCLK_TOKEN_TERMINATOR = 4,	///< the "--" end of options marker
+	ZCLK_TOKEN_COMMAND = 5,		///< word matched to a (sub)command
+	ZCLK_TOKEN_VALUE = 6		///< word used as the value of an option
+} zclk_token_type;
+
+/**
+ * @brief A tokenized command line.
+ *
+ * The caller's argv is never modified. Tokens bound to a command,
+ * option or argument are marked in the consumed bitmap instead,
+ * so that every stage of the parse is a single forward pass.
+ */
+typedef struct zclk_argv_t
+{
+	int argc;					///< number of tokens
+	char** argv;				///< the tokens (not owned)
+	unsigned char* kinds;		///< zclk_token_type of every token
+	unsigned char* consumed;	///< bitmap of tokens already bound
+} zclk_argv;
+
+/**
+ * @brief Tokenize the given command line in a single pass.
+ *
+ * @param av tokenized command line to create
+ * @param argc arg count
+ * @param argv arg values (referenced, not copied)
+ * @return error code
+ */
+MODULE_API zclk_res make_zclk_argv(zclk_argv** av, int argc, char** argv);
+
+/**
+ * @brief Free a tokenized command line (the tokens are not freed).
+ *
+ * @param av tokenized command line
+ */
+MODULE_API void free_zclk_argv(zclk_argv* av);
+
+/**
+ * @brief Check if the token at the given index is already bound.
+ *
+ * @param av tokenized command line
+ * @param index token index
+ * @return 1 if consumed, 0 otherwise
+ */
+MODULE_API int zclk_argv_is_consumed(zclk_argv* av, int index);
+
+/**
+ * @brief Mark the token at the given index as bound.
+ *
+ * @param av tokenized command line
+ * @param index token index
+ */
+MODULE_API void zclk_argv_consume(zclk_argv* av, int index);
+
+/**
+ * @brief Count the tokens which are not yet bound.
+ *
+ * @param av tokenized command line
+ * @return number of unconsumed tokens
+ */
+MODULE_API int zclk_argv_remaining(zclk_argv* av);
+
+/**
+ * (Internal Use) Find the chain of commands named in the command line.
+ * Matched tokens are marked as consumed commands.
+ *
+ * @param commands list of top-level commands
+ * @param av tokenized command line
+ * @return list of commands from top-level to the invoked sub-command
+ */
+MODULE_API arraylist* get_command_to_exec(arraylist* commands, zclk_argv* av);
+
+/**
+ * (Internal Use) Bind all option tokens (and their values) in one pass.
+ * An option token is matched to the options of the deepest command in
+ * the chain first, and then to the options of its parents.
+ *
+ * @param result values of the chain of commands being parsed
+ * @param av tokenized command line
+ * @return error code
+ */
+MODULE_API zclk_res parse_options(zclk_parse_result* result, zclk_argv* av);
+
+/**
+ * (Internal Use) parse_options with the error message written to ctx.
+ * @see parse_options
+ */
+MODULE_API zclk_res parse_options_ctx(zclk_parse_ctx* ctx,
+	zclk_parse_result* result, zclk_argv* av);
+
+/**
+ * (Internal Use) Bind the remaining tokens to the arguments of the
+ * invoked command from left to right.
+ *
+ * @param result values of the chain of commands being parsed
+ * @param av tokenized command line
+ * @return error code
+ */
+MODULE_API zclk_res parse_args(zclk_parse_result* result, zclk_argv* av);
+
+/**
+ * (Internal Use) parse_args with the error message written to ctx.
+ * @see parse_args
+ */
+MODULE_API zclk_res parse_args_ctx(zclk_parse_ctx* ctx,
+	zclk_parse_result* result, zclk_argv* av);
+
 /**
 * Get help for a command
 * @param cmds_to_exec the list of commands and subcommands parsed
@@ -866,6 +2058,17 @@ MODULE_API void free_command(zclk_command* command);
 */
 MODULE_API char* get_help_for_command(arraylist* cmds_to_exec);
 
+/**
+* Get help for a command, using the buffers of the given context.
+* The help of each command is rendered once and cached in the command,
+* until its options, arguments or sub-commands change.
+* @param ctx parse context
+* @param cmds_to_exec the list of commands and subcommands parsed
+* @return string with command help (valid until the next call with ctx)
+*/
+MODULE_API char* get_help_for_command_ctx(zclk_parse_ctx* ctx,
+	arraylist* cmds_to_exec);
+
 /**
  * Run the help command for all commands or single command
  *
@@ -906,14 +2109,93 @@ MODULE_API zclk_res exec_command(arraylist* commands, void* handler_args,
 	int argc, char** argv);
 
 /**
- * @brief Print a tabular result object to the stdout
+ * Execute a single line containing one top-level command, using the given
+ * context for the help and error messages.
+ * @see exec_command
+ *
+ * @param ctx parse context
+ * @param commands the list of commands registered 
+ * 						(this is a list of zclk_command*)
+ * @param handler_args an args value to be passed to the command handler
+ * @param argc the number of tokens in the line
+ * @param argv args as an array of strings
+ */
+MODULE_API zclk_res exec_command_ctx(zclk_parse_ctx* ctx,
+	arraylist* commands, void* handler_args, int argc, char** argv);
+
+/**
+ * @brief Print a tabular result object to the current writer
+ * @see zclk_current_writer
  * 
  * @param result table result object
  */
 MODULE_API void print_table_result(void* result);
 
 /**
- * @brief A Print handler prints the result of the command
+ * @brief Write a tabular result object to the given writer
+ * 
+ * @param writer writer
+ * @param result table result object
+ */
+MODULE_API void write_table_result(zclk_writer* writer, void* result);
+
+/**
+ * @brief Write a tabular result object to the given writer, formatting
+ * chunks of ZCLK_TABLE_RENDER_CHUNK_ROWS rows on a pool of threads. The
+ * output is the same as that of write_table_result. The table must not be
+ * changed while it is written. (Tables of one chunk, and all tables on
+ * Windows, are written on the calling thread.)
+ * 
+ * @param writer writer
+ * @param result table result object
+ * @param num_threads number of threads, 0 for one per online CPU
+ */
+MODULE_API void write_table_result_parallel(zclk_writer* writer,
+	void* result, int num_threads);
+
+/**
+ * @brief Write the result of a command to the given writer, and flush it
+ * 
+ * @param writer writer
+ * @param result_flag error flag
+ * @param res_type result type
+ * @param result result object
+ * @return error code
+ */
+MODULE_API zclk_res write_result(zclk_writer* writer, zclk_res result_flag,
+	zclk_result_type res_type, void* result);
+
+/**
+ * @brief Write the result of a command to the given writer in the given
+ * format, and flush it. Table and dict results are encoded, other results
+ * are written as they are in every format.
+ *
+ * The rows of a table stream are written as they are pushed, so a stream
+ * is only encoded if it was given the format with
+ * zclk_table_stream_set_format before its first row (or it has no rows).
+ * A stream already written in another format is finished as it is, with
+ * a warning on stderr.
+ * 
+ * @param writer writer
+ * @param format output format
+ * @param result_flag error flag
+ * @param res_type result type
+ * @param result result object
+ * @return error code
+ */
+MODULE_API zclk_res write_result_as(zclk_writer* writer,
+	zclk_output_format format, zclk_res result_flag,
+	zclk_result_type res_type, void* result);
+
+/**
+ * @brief A Print handler prints the result of the command to the current
+ * writer, in the current output format
+ * @see zclk_current_output_format
+ *
+ * A ZCLK_RESULT_PROGRESS result is drawn at most fps times a second, so
+ * an update which comes too soon after the last frame is not drawn. The
+ * final state is always drawn once every progress object has reached its
+ * total, or after zclk_multi_progress_finish.
  * 
  * @param result_flag error flag
  * @param res_type result type
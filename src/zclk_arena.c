@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2020 Abhishek Mishra
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "zclk_arena.h"
+
+#define ARENA_ALIGN (_Alignof(max_align_t))
+
+static size_t arena_align_up(size_t size) {
+	return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+/**
+ * Add a block which can hold at least size bytes. Blocks double in size
+ * so a tree of n objects lives in O(log n) blocks.
+ */
+static int arena_grow(zclk_arena* arena, size_t size) {
+	size_t block_size = arena->block_size;
+	while (block_size < size) {
+		block_size *= 2;
+	}
+	zclk_arena_block* block = (zclk_arena_block*) calloc(1,
+			sizeof(zclk_arena_block) + block_size);
+	if (block == NULL) {
+		return -1;
+	}
+	block->size = block_size;
+	block->next = arena->head;
+	arena->head = block;
+	arena->num_blocks += 1;
+	if (arena->block_size < ZCLK_ARENA_MAX_BLOCK_SIZE) {
+		arena->block_size *= 2;
+	}
+	return 0;
+}
+
+int create_zclk_arena(zclk_arena** arena, size_t block_size) {
+	(*arena) = (zclk_arena*) calloc(1, sizeof(zclk_arena));
+	if (!(*arena)) {
+		return -1;
+	}
+	(*arena)->block_size = arena_align_up(
+			block_size == 0 ? ZCLK_ARENA_DEFAULT_BLOCK_SIZE : block_size);
+	return 0;
+}
+
+void free_zclk_arena(zclk_arena* arena) {
+	if (arena != NULL) {
+		for (zclk_arena_cleanup* c = arena->cleanups; c != NULL; c = c->next) {
+			c->fn(c->ptr);
+		}
+		zclk_arena_block* block = arena->head;
+		while (block != NULL) {
+			zclk_arena_block* next = block->next;
+			free(block);
+			block = next;
+		}
+		free(arena);
+	}
+}
+
+void* zclk_arena_alloc(zclk_arena* arena, size_t size) {
+	if (arena == NULL) {
+		return NULL;
+	}
+	size = arena_align_up(size == 0 ? 1 : size);
+	zclk_arena_block* block = arena->head;
+	if (block == NULL || block->size - block->used < size) {
+		if (arena_grow(arena, size) != 0) {
+			return NULL;
+		}
+		block = arena->head;
+	}
+	// blocks are calloc'd and never reused, so the memory is still zero
+	void* ptr = (char*) block->data + block->used;
+	block->used += size;
+	arena->bytes_used += size;
+	return ptr;
+}
+
+char* zclk_arena_str_clone(zclk_arena* arena, const char* from) {
+	char* to = NULL;
+	if (from != NULL) {
+		size_t len = strlen(from);
+		to = (char*) zclk_arena_alloc(arena, len + 1);
+		if (to != NULL) {
+			memcpy(to, from, len + 1);
+		}
+	}
+	return to;
+}
+
+int zclk_arena_add_cleanup(zclk_arena* arena, zclk_arena_cleanup_fn fn,
+		void* ptr) {
+	if (fn == NULL) {
+		return -1;
+	}
+	zclk_arena_cleanup* c = (zclk_arena_cleanup*) zclk_arena_alloc(arena,
+			sizeof(zclk_arena_cleanup));
+	if (c == NULL) {
+		return -1;
+	}
+	c->fn = fn;
+	c->ptr = ptr;
+	c->next = arena->cleanups;
+	arena->cleanups = c;
+	return 0;
+}
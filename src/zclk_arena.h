@@ -0,0 +1,118 @@
+// Copyright (c) 2020 Abhishek Mishra
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+/**
+ * \file zclk_arena.h
+ * \brief A bump allocator used to build a command tree in a few blocks.
+ *
+ * Objects allocated from an arena are never freed individually, all the
+ * memory is released together by free_zclk_arena. Heap memory owned by
+ * objects in the arena is released by cleanups registered with it, which
+ * free_zclk_arena runs one by one.
+ */
+
+#ifndef SRC_ZCLK_ARENA_H_
+#define SRC_ZCLK_ARENA_H_
+
+#include "zclk_common.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Size of the first block of an arena if none is given */
+#define ZCLK_ARENA_DEFAULT_BLOCK_SIZE 4096
+
+/** Blocks grow by doubling up to this size */
+#define ZCLK_ARENA_MAX_BLOCK_SIZE (1024 * 1024)
+
+/**
+ * @brief A block of memory of the arena.
+ */
+typedef struct zclk_arena_block_t {
+	struct zclk_arena_block_t* next;	///< previously filled block
+	size_t size;						///< usable size of the block
+	size_t used;						///< bytes handed out
+	max_align_t data[];					///< memory of the block
+} zclk_arena_block;
+
+/**
+ * @brief A function run when the arena is freed.
+ */
+typedef void (*zclk_arena_cleanup_fn)(void* ptr);
+
+/**
+ * @brief A cleanup registered with the arena (allocated in the arena).
+ */
+typedef struct zclk_arena_cleanup_t {
+	zclk_arena_cleanup_fn fn;			///< function to run
+	void* ptr;							///< argument of the function
+	struct zclk_arena_cleanup_t* next;	///< previously registered cleanup
+} zclk_arena_cleanup;
+
+/**
+ * @brief An arena of memory.
+ */
+typedef struct zclk_arena_t {
+	zclk_arena_block* head;			///< block being filled
+	size_t block_size;				///< size of the next block
+	size_t num_blocks;				///< number of blocks allocated
+	size_t bytes_used;				///< bytes handed out in all blocks
+	zclk_arena_cleanup* cleanups;	///< cleanups, last registered first
+} zclk_arena;
+
+/**
+ * @brief Create an arena.
+ *
+ * @param arena arena to create
+ * @param block_size size of the first block (0 for the default)
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int create_zclk_arena(zclk_arena** arena, size_t block_size);
+
+/**
+ * @brief Run the cleanups of the arena (last registered first) and free
+ * all of its memory.
+ *
+ * @param arena arena
+ */
+MODULE_API void free_zclk_arena(zclk_arena* arena);
+
+/**
+ * @brief Allocate zeroed memory from the arena, aligned for any type.
+ *
+ * @param arena arena
+ * @param size number of bytes
+ * @return memory, or NULL on error
+ */
+MODULE_API void* zclk_arena_alloc(zclk_arena* arena, size_t size);
+
+/**
+ * @brief Copy a string into the arena.
+ *
+ * @param arena arena
+ * @param from string to copy
+ * @return copy, or NULL if from is NULL or there is an error.
+ */
+MODULE_API char* zclk_arena_str_clone(zclk_arena* arena, const char* from);
+
+/**
+ * @brief Register a function to run on ptr when the arena is freed, for
+ * e.g. to release heap memory owned by an object in the arena.
+ *
+ * @param arena arena
+ * @param fn function to run
+ * @param ptr argument of the function
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_arena_add_cleanup(zclk_arena* arena,
+	zclk_arena_cleanup_fn fn, void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_ZCLK_ARENA_H_ */
@@ -0,0 +1,296 @@
+/**
+ * Copyright (c) 2020 Abhishek Mishra
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "zclk_argfile.h"
+
+/**
+ * Get the path of the file named by argv[i], NULL if it names none, ""
+ * if the path is missing. count is set to the number of args used.
+ */
+static const char* argfile_path(int argc, char** argv, int i, int* count) {
+	const char* arg = argv[i];
+	size_t opt_len = sizeof(ZCLK_ARGFILE_OPTION) - 1;
+	(*count) = 1;
+	if (arg == NULL) {
+		return NULL;
+	}
+	if (arg[0] == ZCLK_ARGFILE_PREFIX && arg[1] != '\0') {
+		return arg + 1;
+	}
+	if (strncmp(arg, ZCLK_ARGFILE_OPTION, opt_len) != 0) {
+		return NULL;
+	}
+	if (arg[opt_len] == '=') {
+		return arg + opt_len + 1;
+	}
+	if (arg[opt_len] != '\0') {
+		return NULL;
+	}
+	if (i + 1 < argc && argv[i + 1] != NULL) {
+		(*count) = 2;
+		return argv[i + 1];
+	}
+	return "";
+}
+
+static int is_terminator(const char* arg) {
+	return arg != NULL && arg[0] == '-' && arg[1] == '-' && arg[2] == '\0';
+}
+
+int zclk_args_has_files(int argc, char** argv) {
+	int count;
+	for (int i = 1; i < argc && !is_terminator(argv[i]); i++) {
+		if (argfile_path(argc, argv, i, &count) != NULL) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Map the file privately, so that delimiters can be overwritten without
+ * touching the file.
+ */
+static int argfile_map(zclk_argfile* f, const char* path) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return -1;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)
+			|| (unsigned long long) size.QuadPart > (size_t) -1) {
+		CloseHandle(file);
+		return -1;
+	}
+	if (size.QuadPart == 0) {
+		CloseHandle(file);
+		return 0;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0,
+			NULL);
+	CloseHandle(file);
+	if (mapping == NULL) {
+		return -1;
+	}
+	// the view keeps the mapping alive
+	void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(mapping);
+	if (view == NULL) {
+		return -1;
+	}
+	f->data = (char*) view;
+	f->size = (size_t) size.QuadPart;
+	return 0;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (unsigned long long) st.st_size > (size_t) -1) {
+		close(fd);
+		return -1;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	void* map = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	f->data = (char*) map;
+	f->size = (size_t) st.st_size;
+	return 0;
+#endif
+}
+
+static void argfile_unmap(zclk_argfile* f) {
+	if (f->data != NULL) {
+#ifdef _WIN32
+		UnmapViewOfFile(f->data);
+#else
+		munmap(f->data, f->size);
+#endif
+	}
+	free(f->tail);
+}
+
+/**
+ * Map the file, pick its delimiter and count its records. An unterminated
+ * last record is copied, as there may be no room after it in the mapping
+ * for a NUL.
+ */
+static int argfile_open(zclk_argfile* f, const char* path) {
+	if (argfile_map(f, path) != 0) {
+		return -1;
+	}
+	if (f->size == 0) {
+		return 0;
+	}
+	f->delim = memchr(f->data, '\0', f->size) != NULL ? '\0' : '\n';
+
+	const char* p = f->data;
+	const char* end = f->data + f->size;
+	const char* last = p;
+	const char* d;
+	while ((d = (const char*) memchr(p, f->delim, (size_t) (end - p)))
+			!= NULL) {
+		f->num_records += 1;
+		p = d + 1;
+		last = p;
+	}
+	f->split_len = (size_t) (last - f->data);
+	if (last < end) {
+		size_t len = (size_t) (end - last);
+		f->tail = (char*) malloc(len + 1);
+		if (f->tail == NULL) {
+			return -1;
+		}
+		memcpy(f->tail, last, len);
+		f->tail[len] = '\0';
+		f->num_records += 1;
+	}
+	return 0;
+}
+
+/**
+ * Add the record (if not empty) to out, dropping the \r of a \r\n line
+ * break.
+ */
+static void argfile_add(zclk_argfile* f, char* rec, char* rec_end,
+		char** out, int* n) {
+	if (f->delim == '\n' && rec_end > rec && rec_end[-1] == '\r') {
+		rec_end[-1] = '\0';
+	}
+	if (rec[0] != '\0') {
+		out[(*n)++] = rec;
+	}
+}
+
+/**
+ * Split the records of the file in place, into out.
+ */
+static void argfile_split(zclk_argfile* f, char** out, int* n) {
+	char* p = f->data;
+	char* end = f->data + f->split_len;
+	while (p < end) {
+		char* d = (char*) memchr(p, f->delim, (size_t) (end - p));
+		// writing a NUL over a NUL would only dirty the page
+		if (f->delim != '\0') {
+			(*d) = '\0';
+		}
+		argfile_add(f, p, d, out, n);
+		p = d + 1;
+	}
+	if (f->tail != NULL) {
+		argfile_add(f, f->tail, f->tail + strlen(f->tail), out, n);
+	}
+}
+
+int create_zclk_args(zclk_args** args, int argc, char** argv,
+		const char** failed_path) {
+	(*failed_path) = NULL;
+	(*args) = (zclk_args*) calloc(1, sizeof(zclk_args));
+	if (!(*args)) {
+		return -1;
+	}
+	zclk_args* a = (*args);
+	// at most one file per arg
+	a->files = (zclk_argfile*) calloc(argc > 0 ? (size_t) argc : 1,
+			sizeof(zclk_argfile));
+	if (a->files == NULL) {
+		free_zclk_args(a);
+		(*args) = NULL;
+		return -1;
+	}
+
+	// open all the files first, to size argv once
+	size_t total = 0;
+	int terminated = 0;
+	int count;
+	for (int i = 0; i < argc; i += count) {
+		const char* path = i > 0 && !terminated
+				? argfile_path(argc, argv, i, &count) : NULL;
+		if (path == NULL) {
+			count = 1;
+			terminated = terminated || (i > 0 && is_terminator(argv[i]));
+			total += 1;
+			continue;
+		}
+		zclk_argfile* f = &(a->files[a->num_files]);
+		a->num_files += 1;
+		f->arg_index = i;
+		f->arg_count = count;
+		if (path[0] != '\0' && argfile_open(f, path) == 0) {
+			total += f->num_records;
+			continue;
+		}
+		if (argv[i][0] == ZCLK_ARGFILE_PREFIX) {
+			// an @word which is not a readable file is an ordinary arg
+			argfile_unmap(f);
+			memset(f, 0, sizeof(zclk_argfile));
+			a->num_files -= 1;
+			total += 1;
+			continue;
+		}
+		(*failed_path) = path;
+		free_zclk_args(a);
+		(*args) = NULL;
+		return -1;
+	}
+
+	if (total >= INT_MAX) {
+		free_zclk_args(a);
+		(*args) = NULL;
+		return -1;
+	}
+	a->argv = (char**) malloc((total + 1) * sizeof(char*));
+	if (a->argv == NULL) {
+		free_zclk_args(a);
+		(*args) = NULL;
+		return -1;
+	}
+	size_t next_file = 0;
+	for (int i = 0; i < argc; i++) {
+		if (next_file < a->num_files && a->files[next_file].arg_index == i) {
+			zclk_argfile* f = &(a->files[next_file++]);
+			argfile_split(f, a->argv, &(a->argc));
+			i += f->arg_count - 1;
+		} else {
+			a->argv[a->argc++] = argv[i];
+		}
+	}
+	a->argv[a->argc] = NULL;
+	return 0;
+}
+
+void free_zclk_args(zclk_args* args) {
+	if (args != NULL) {
+		for (size_t i = 0; i < args->num_files; i++) {
+			argfile_unmap(&(args->files[i]));
+		}
+		free(args->files);
+		free(args->argv);
+		free(args);
+	}
+}
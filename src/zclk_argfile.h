@@ -0,0 +1,103 @@
+// Copyright (c) 2020 Abhishek Mishra
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+/**
+ * \file zclk_argfile.h
+ * \brief Expansion of argument files (response files) given on the
+ * command line as \c @path or \c --args-from \c path.
+ *
+ * Each file is mapped privately (copy on write) and its records are split
+ * in place, by writing a NUL over each delimiter, so the expanded args
+ * point into the mapping and nothing is copied per record. Records are
+ * separated by NULs if the file contains any (e.g. the output of
+ * \c find \c -print0), otherwise by line breaks (\c \\n or \c \\r\\n).
+ * Empty records are skipped, and args read from a file are not expanded
+ * again.
+ *
+ * As with gcc and javac, an \c @word which does not name a file that can
+ * be read is kept as an ordinary arg, so values such as handles and
+ * e-mail addresses still reach the parser. A file named with
+ * \c --args-from must be readable.
+ */
+
+#ifndef SRC_ZCLK_ARGFILE_H_
+#define SRC_ZCLK_ARGFILE_H_
+
+#include "zclk_common.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Prefix of an arg naming a file to read args from */
+#define ZCLK_ARGFILE_PREFIX '@'
+
+/** Option naming a file to read args from */
+#define ZCLK_ARGFILE_OPTION "--args-from"
+
+/**
+ * @brief A file mapped to read args from.
+ */
+typedef struct zclk_argfile_t {
+	char* data;			///< private mapping of the file, NULL if empty
+	size_t size;		///< size of the file
+	size_t split_len;	///< bytes of the mapping with delimited records
+	char* tail;			///< copy of an unterminated last record, or NULL
+	char delim;			///< record delimiter ('\0' or '\n')
+	size_t num_records;	///< upper bound of the records in the file
+	int arg_index;		///< index of the arg naming the file
+	int arg_count;		///< args naming it (2 for --args-from path)
+} zclk_argfile;
+
+/**
+ * @brief Args with the argument files expanded.
+ */
+typedef struct zclk_args_t {
+	int argc;				///< number of args
+	char** argv;			///< args, NULL terminated
+	zclk_argfile* files;	///< files the args point into
+	size_t num_files;		///< number of files
+} zclk_args;
+
+/**
+ * @brief Check if any of the args (after the program name and before a
+ * "--") names an argument file.
+ *
+ * @param argc number of args
+ * @param argv args
+ * @return 1 if there are files to expand, 0 otherwise
+ */
+MODULE_API int zclk_args_has_files(int argc, char** argv);
+
+/**
+ * @brief Expand the argument files named in argv, in the position of the
+ * \c @path or \c --args-from \c path args. The other args, the args
+ * after a "--", and \c @word args which do not name a readable file are
+ * kept as they are.
+ *
+ * @param args args to create
+ * @param argc number of args
+ * @param argv args
+ * @param failed_path set to the path given with \c --args-from if it
+ * could not be read, "" if \c --args-from was given without a path, NULL
+ * if memory ran out
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int create_zclk_args(zclk_args** args, int argc, char** argv,
+		const char** failed_path);
+
+/**
+ * @brief Unmap the files and free the args.
+ *
+ * @param args args
+ */
+MODULE_API void free_zclk_args(zclk_args* args);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_ZCLK_ARGFILE_H_ */
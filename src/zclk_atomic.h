@@ -0,0 +1,108 @@
+// Copyright (c) 2020 Abhishek Mishra
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+/**
+ * \file zclk_atomic.h
+ * \brief Atomic access to plain integer fields of the public structs
+ * (internal to the library).
+ *
+ * The fields are declared without _Atomic, so that C and C++ translation
+ * units see the same types, and are only read and written through these
+ * functions. All of them are sequentially consistent.
+ */
+
+#ifndef SRC_ZCLK_ATOMIC_H_
+#define SRC_ZCLK_ATOMIC_H_
+
+#include <stdint.h>
+#if defined(__GNUC__) || defined(__clang__)
+// the __atomic builtins work on plain objects
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#elif !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#endif
+
+static inline long zclk_atomic_load_long(volatile long* p) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#elif defined(_MSC_VER)
+	return _InterlockedCompareExchange(p, 0, 0);
+#elif !defined(__STDC_NO_ATOMICS__)
+	return atomic_load((volatile _Atomic long*) p);
+#else
+	return *p;
+#endif
+}
+
+static inline void zclk_atomic_store_long(volatile long* p, long value) {
+#if defined(__GNUC__) || defined(__clang__)
+	__atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+#elif defined(_MSC_VER)
+	_InterlockedExchange(p, value);
+#elif !defined(__STDC_NO_ATOMICS__)
+	atomic_store((volatile _Atomic long*) p, value);
+#else
+	(*p) = value;
+#endif
+}
+
+static inline uint64_t zclk_atomic_load_u64(volatile uint64_t* p) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#elif defined(_MSC_VER)
+	return (uint64_t) _InterlockedCompareExchange64((volatile __int64*) p,
+			0, 0);
+#elif !defined(__STDC_NO_ATOMICS__)
+	return atomic_load((volatile _Atomic uint64_t*) p);
+#else
+	return *p;
+#endif
+}
+
+static inline void zclk_atomic_store_u64(volatile uint64_t* p,
+		uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+	__atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+#elif defined(_MSC_VER)
+	_InterlockedExchange64((volatile __int64*) p, (__int64) value);
+#elif !defined(__STDC_NO_ATOMICS__)
+	atomic_store((volatile _Atomic uint64_t*) p, value);
+#else
+	(*p) = value;
+#endif
+}
+
+/**
+ * Replace *p with desired if it is expected, otherwise set expected to
+ * *p. Returns 1 if replaced.
+ */
+static inline int zclk_atomic_cas_u64(volatile uint64_t* p,
+		uint64_t* expected, uint64_t desired) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __atomic_compare_exchange_n(p, expected, desired, 1,
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#elif defined(_MSC_VER)
+	uint64_t prev = (uint64_t) _InterlockedCompareExchange64(
+			(volatile __int64*) p, (__int64) desired, (__int64) *expected);
+	if (prev == *expected) {
+		return 1;
+	}
+	(*expected) = prev;
+	return 0;
+#elif !defined(__STDC_NO_ATOMICS__)
+	return atomic_compare_exchange_weak((volatile _Atomic uint64_t*) p,
+			expected, desired);
+#else
+	if (*p == *expected) {
+		(*p) = desired;
+		return 1;
+	}
+	(*expected) = *p;
+	return 0;
+#endif
+}
+
+#endif /* SRC_ZCLK_ATOMIC_H_ */
@@ -19,6 +19,13 @@
 #  define MODULE_API
 #endif
 
+/** Storage class of per-thread variables */
+#if defined(_MSC_VER)
+#  define ZCLK_THREAD_LOCAL __declspec(thread)
+#else
+#  define ZCLK_THREAD_LOCAL _Thread_local
+#endif
+
 #ifdef __cplusplus  
 extern "C" {
 #endif
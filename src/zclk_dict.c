@@ -6,42 +6,221 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "zclk_dict.h"
 
+/* marks a slot whose entry was removed */
+#define INDEX_TOMBSTONE UINT32_MAX
+
 int create_zclk_dict(zclk_dict** dict) {
 	(*dict) = (zclk_dict*)calloc(1, sizeof(zclk_dict));
 	if(!(*dict)) {
 		return -1;
 	}
-	arraylist_new(&((*dict)->keys), &free);
-	arraylist_new(&((*dict)->vals), &free);
 	return 0;
 }
 
 void free_zclk_dict(zclk_dict* dict) {
-	arraylist_free(dict->keys);
-	arraylist_free(dict->vals);
+	if (dict == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < dict->num_entries; i++) {
+		free(dict->entries[i].key);
+		free(dict->entries[i].value);
+	}
+	free(dict->entries);
+	free(dict->index);
 	free(dict);
 }
 
+/**
+ * FNV-1a hash of the key, never 0.
+ */
+static size_t dict_hash(const char* key) {
+	size_t h = (size_t) 14695981039346656037ULL;
+	for (const unsigned char* p = (const unsigned char*) key; *p; p++) {
+		h ^= *p;
+		h *= (size_t) 1099511628211ULL;
+	}
+	return h == 0 ? 1 : h;
+}
+
+/**
+ * Find the slot of the key, or the slot where it would be inserted (the
+ * first tombstone on the way, if any).
+ */
+static uint32_t* dict_probe(zclk_dict* dict, const char* key, size_t hash) {
+	size_t mask = dict->index_cap - 1;
+	uint32_t* insert_at = NULL;
+	for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+		uint32_t* slot = &dict->index[i];
+		if (*slot == 0) {
+			return insert_at != NULL ? insert_at : slot;
+		}
+		if (*slot == INDEX_TOMBSTONE) {
+			if (insert_at == NULL) {
+				insert_at = slot;
+			}
+			continue;
+		}
+		zclk_dict_entry* e = &dict->entries[*slot - 1];
+		if (e->hash == hash && strcmp(e->key, key) == 0) {
+			return slot;
+		}
+	}
+}
+
+/**
+ * Rebuild the index with room for at least min_count keys, moving the
+ * entries down over the removed ones.
+ */
+static int dict_rebuild(zclk_dict* dict, size_t min_count) {
+	size_t cap = 16;
+	while (cap < min_count * 2) {
+		cap *= 2;
+	}
+	uint32_t* index = (uint32_t*) calloc(cap, sizeof(uint32_t));
+	if (index == NULL) {
+		return -1;
+	}
+	size_t n = 0;
+	for (size_t i = 0; i < dict->num_entries; i++) {
+		if (dict->entries[i].key != NULL) {
+			dict->entries[n++] = dict->entries[i];
+		}
+	}
+	dict->num_entries = n;
+	free(dict->index);
+	dict->index = index;
+	dict->index_cap = cap;
+	dict->index_used = n;
+	size_t mask = cap - 1;
+	for (size_t i = 0; i < n; i++) {
+		size_t s = dict->entries[i].hash & mask;
+		while (index[s] != 0) {
+			s = (s + 1) & mask;
+		}
+		index[s] = (uint32_t) (i + 1);
+	}
+	return 0;
+}
+
 int zclk_dict_put(zclk_dict* dict, char* key, char* value) {
-	arraylist_add(dict->keys, zclk_str_clone(key));
-	arraylist_add(dict->vals, zclk_str_clone(value));
+	if (dict == NULL || key == NULL) {
+		return -1;
+	}
+	size_t hash = dict_hash(key);
+	if (dict->index_cap > 0) {
+		uint32_t* slot = dict_probe(dict, key, hash);
+		if (*slot != 0 && *slot != INDEX_TOMBSTONE) {
+			zclk_dict_entry* e = &dict->entries[*slot - 1];
+			char* v = zclk_str_clone(value);
+			if (v == NULL && value != NULL) {
+				return -1;
+			}
+			free(e->value);
+			e->value = v;
+			return 0;
+		}
+	}
+
+	// keep the load factor (counting tombstones) under 1/2
+	if ((dict->index_used + 1) * 2 > dict->index_cap
+			&& dict_rebuild(dict, dict->count + 1) != 0) {
+		return -1;
+	}
+	if (dict->num_entries == dict->entries_cap) {
+		if (dict->num_entries >= INDEX_TOMBSTONE - 1) {
+			return -1;
+		}
+		size_t cap = dict->entries_cap == 0 ? 8 : dict->entries_cap * 2;
+		zclk_dict_entry* entries = (zclk_dict_entry*) realloc(dict->entries,
+				cap * sizeof(zclk_dict_entry));
+		if (entries == NULL) {
+			return -1;
+		}
+		dict->entries = entries;
+		dict->entries_cap = cap;
+	}
+	zclk_dict_entry* e = &dict->entries[dict->num_entries];
+	e->key = zclk_str_clone(key);
+	e->value = zclk_str_clone(value);
+	e->hash = hash;
+	if (e->key == NULL || (e->value == NULL && value != NULL)) {
+		free(e->key);
+		free(e->value);
+		return -1;
+	}
+	uint32_t* slot = dict_probe(dict, key, hash);
+	if (*slot == 0) {
+		dict->index_used += 1;
+	}
+	(*slot) = (uint32_t) (dict->num_entries + 1);
+	dict->num_entries += 1;
+	dict->count += 1;
 	return 0;
 }
 
-//TODO: Not implemented
 int zclk_dict_remove(zclk_dict* dict, char* key) {
-	return -1;
+	if (dict == NULL || key == NULL || dict->count == 0) {
+		return -1;
+	}
+	uint32_t* slot = dict_probe(dict, key, dict_hash(key));
+	if (*slot == 0 || *slot == INDEX_TOMBSTONE) {
+		return -1;
+	}
+	zclk_dict_entry* e = &dict->entries[*slot - 1];
+	free(e->key);
+	free(e->value);
+	e->key = NULL;
+	e->value = NULL;
+	(*slot) = INDEX_TOMBSTONE;
+	dict->count -= 1;
+
+	if (dict->count == 0) {
+		// nothing to keep, start over without freeing
+		memset(dict->index, 0, dict->index_cap * sizeof(uint32_t));
+		dict->index_used = 0;
+		dict->num_entries = 0;
+	} else if (dict->num_entries - dict->count > dict->count) {
+		// more than half of the entries are holes
+		dict_rebuild(dict, dict->count);
+	}
+	return 0;
 }
 
-//TODO: Not implemented
 int zclk_dict_get(zclk_dict* dict, char* key, char** value) {
-	return -1;
+	if (dict == NULL || key == NULL || dict->count == 0) {
+		return -1;
+	}
+	uint32_t* slot = dict_probe(dict, key, dict_hash(key));
+	if (*slot == 0 || *slot == INDEX_TOMBSTONE) {
+		return -1;
+	}
+	(*value) = dict->entries[*slot - 1].value;
+	return 0;
 }
 
-//TODO: Not implemented
 int zclk_dict_keys(zclk_dict* dict, char** keys) {
-	return -1;
+	if (dict == NULL || keys == NULL) {
+		return -1;
+	}
+	size_t n = 0;
+	for (size_t i = 0; i < dict->num_entries; i++) {
+		if (dict->entries[i].key != NULL) {
+			keys[n++] = dict->entries[i].key;
+		}
+	}
+	return 0;
+}
+
+size_t zclk_dict_count(zclk_dict* dict) {
+	return dict == NULL ? 0 : dict->count;
 }
 
+size_t zclk_dict_next(zclk_dict* dict, size_t pos) {
+	while (pos < dict->num_entries && dict->entries[pos].key == NULL) {
+		pos++;
+	}
+	return pos;
+}
@@ -7,41 +7,102 @@
 #define SRC_CLD_DICT_H_
 
 #include "zclk_common.h"
-#include <coll_arraylist.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus  
 extern "C" {
 #endif
 
+/**
+ * @brief An entry of a dict. The key is NULL once the entry is removed.
+ */
+typedef struct zclk_dict_entry_t {
+	char* key;				///< key (owned by the dict)
+	char* value;			///< value (owned by the dict, can be NULL)
+	size_t hash;			///< hash of the key
+} zclk_dict_entry;
+
+/**
+ * @brief A map of strings to strings which iterates in insertion order.
+ *
+ * The entries are kept in an array in the order they were first put, and
+ * found through an open addressing (linear probing) index of the entries.
+ * Removed entries leave a hole in the array until more than half of it
+ * is holes, when the array is compacted.
+ */
 typedef struct zclk_dict_t {
-	arraylist* keys;
-	arraylist* vals;
+	zclk_dict_entry* entries;	///< entries in insertion order
+	size_t num_entries;			///< entries in the array, including holes
+	size_t entries_cap;			///< size of the entries array
+	size_t count;				///< number of keys
+	uint32_t* index;			///< entry + 1 per slot, 0 if empty
+	size_t index_cap;			///< number of slots (a power of 2)
+	size_t index_used;			///< slots which are not empty
 } zclk_dict;
 
 MODULE_API int create_zclk_dict(zclk_dict** dict);
 
 MODULE_API void free_zclk_dict(zclk_dict* dict);
 
+/**
+ * @brief Set the value of a key. The key and value are copied. The value
+ * of an existing key is replaced, and the key keeps its place in the
+ * iteration order.
+ *
+ * @return 0 on success, -1 on error
+ */
 MODULE_API int zclk_dict_put(zclk_dict* dict, char* key, char* value);
 
+/**
+ * @brief Remove a key and its value.
+ *
+ * @return 0 on success, -1 if there is no such key
+ */
 MODULE_API int zclk_dict_remove(zclk_dict* dict, char* key);
 
+/**
+ * @brief Get the value of a key. The value is owned by the dict, and
+ * valid until the key is put or removed.
+ *
+ * @return 0 on success, -1 if there is no such key
+ */
 MODULE_API int zclk_dict_get(zclk_dict* dict, char* key, char** value);
 
+/**
+ * @brief Get the keys in insertion order. The keys are owned by the dict.
+ *
+ * @param dict dict
+ * @param keys array of at least zclk_dict_count(dict) keys to fill
+ * @return 0 on success, -1 on error
+ */
 MODULE_API int zclk_dict_keys(zclk_dict* dict, char** keys);
 
-#define zclk_dict_foreach(dict, key, value) \
-	char* key; \
-	char* value; \
+/**
+ * @brief Get the number of keys.
+ */
+MODULE_API size_t zclk_dict_count(zclk_dict* dict);
+
+/**
+ * @brief Get the position of the first entry at or after pos which is not
+ * removed (num_entries if there is none). Used by zclk_dict_foreach.
+ */
+MODULE_API size_t zclk_dict_next(zclk_dict* dict, size_t pos);
+
+/**
+ * Iterate over the keys and values in insertion order. The dict must not
+ * be changed in the loop.
+ */
+#define zclk_dict_foreach(dict, key_var, value_var) \
+	char* key_var; \
+	char* value_var; \
 	size_t i; \
-	size_t len = arraylist_length(dict->keys); \
-	for(i = 0, \
-			key = (char*)arraylist_get(dict->keys, i), \
-			value = (char*)arraylist_get(dict->vals, i); \
-			i < len; \
-			i++, \
-			key = (char*)arraylist_get(dict->keys, i), \
-			value = (char*)arraylist_get(dict->vals, i))
+	size_t len = (dict)->num_entries; \
+	for(i = zclk_dict_next((dict), 0); \
+			i < len \
+			&& ((key_var = (dict)->entries[i].key), \
+				(value_var = (dict)->entries[i].value), 1); \
+			i = zclk_dict_next((dict), i + 1))
 
 #ifdef __cplusplus 
 }
@@ -0,0 +1,472 @@
+/**
+ * Copyright (c) 2020 Abhishek Mishra
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "zclk_encode.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ZCLK_ENCODE_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) \
+		|| (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ZCLK_ENCODE_SSE2
+#endif
+
+static const char* format_names[] = { "table", "json", "csv", "ndjson" };
+
+int zclk_output_format_parse(zclk_output_format* format, const char* name) {
+	if (name == NULL) {
+		return -1;
+	}
+	for (int i = 0; i < (int) (sizeof(format_names) / sizeof(char*)); i++) {
+		if (strcmp(name, format_names[i]) == 0) {
+			(*format) = (zclk_output_format) i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char* zclk_output_format_name(zclk_output_format format) {
+	if ((int) format < 0
+			|| (int) format >= (int) (sizeof(format_names) / sizeof(char*))) {
+		return NULL;
+	}
+	return format_names[format];
+}
+
+/* sets of characters which need escaping */
+#define SPECIAL_JSON 0
+#define SPECIAL_CSV 1
+
+#define BYTES_ONES 0x0101010101010101ULL
+#define BYTES_HIGHS 0x8080808080808080ULL
+
+/* high bit set in the bytes of x which are 0 (or follow a 0 byte) */
+#define BYTES_ZERO(x) (((x) - BYTES_ONES) & ~(x) & BYTES_HIGHS)
+
+/* high bit set in the bytes of x which are less than n (n <= 128) */
+#define BYTES_LESS(x, n) (((x) - BYTES_ONES * (n)) & ~(x) & BYTES_HIGHS)
+
+static int is_special(unsigned char c, int kind) {
+	if (kind == SPECIAL_JSON) {
+		return c < 0x20 || c == '"' || c == '\\';
+	}
+	return c == ',' || c == '"' || c == '\n' || c == '\r';
+}
+
+/**
+ * Find the first character of the given set, len if there is none.
+ */
+static size_t find_special(const char* str, size_t len, int kind) {
+	size_t i = 0;
+#ifdef ZCLK_ENCODE_AVX2
+	{
+		__m256i quote = _mm256_set1_epi8('"');
+		__m256i other = _mm256_set1_epi8(kind == SPECIAL_JSON ? '\\' : ',');
+		__m256i nl = _mm256_set1_epi8('\n');
+		__m256i cr = _mm256_set1_epi8('\r');
+		__m256i ctl = _mm256_set1_epi8(0x1F);
+		while (i + 32 <= len) {
+			__m256i v = _mm256_loadu_si256((const __m256i*) (str + i));
+			__m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+					_mm256_cmpeq_epi8(v, other));
+			if (kind == SPECIAL_JSON) {
+				// max(v, 0x1F) == 0x1F for the (unsigned) bytes below 0x20
+				m = _mm256_or_si256(m,
+						_mm256_cmpeq_epi8(_mm256_max_epu8(v, ctl), ctl));
+			} else {
+				m = _mm256_or_si256(m, _mm256_or_si256(
+						_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, cr)));
+			}
+			if (_mm256_movemask_epi8(m) != 0) {
+				break;
+			}
+			i += 32;
+		}
+	}
+#endif
+#ifdef ZCLK_ENCODE_SSE2
+	{
+		__m128i quote = _mm_set1_epi8('"');
+		__m128i other = _mm_set1_epi8(kind == SPECIAL_JSON ? '\\' : ',');
+		__m128i nl = _mm_set1_epi8('\n');
+		__m128i cr = _mm_set1_epi8('\r');
+		__m128i ctl = _mm_set1_epi8(0x1F);
+		while (i + 16 <= len) {
+			__m128i v = _mm_loadu_si128((const __m128i*) (str + i));
+			__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+					_mm_cmpeq_epi8(v, other));
+			if (kind == SPECIAL_JSON) {
+				m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl));
+			} else {
+				m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, nl),
+						_mm_cmpeq_epi8(v, cr)));
+			}
+			if (_mm_movemask_epi8(m) != 0) {
+				break;
+			}
+			i += 16;
+		}
+	}
+#endif
+	while (i + 8 <= len) {
+		uint64_t x;
+		memcpy(&x, str + i, 8);
+		uint64_t m;
+		if (kind == SPECIAL_JSON) {
+			m = BYTES_ZERO(x ^ (BYTES_ONES * '"'))
+					| BYTES_ZERO(x ^ (BYTES_ONES * '\\')) | BYTES_LESS(x, 0x20);
+		} else {
+			m = BYTES_ZERO(x ^ (BYTES_ONES * '"'))
+					| BYTES_ZERO(x ^ (BYTES_ONES * ','))
+					| BYTES_ZERO(x ^ (BYTES_ONES * '\n'))
+					| BYTES_ZERO(x ^ (BYTES_ONES * '\r'));
+		}
+		if (m != 0) {
+			break;
+		}
+		i += 8;
+	}
+	while (i < len && !is_special((unsigned char) str[i], kind)) {
+		i++;
+	}
+	return i;
+}
+
+int zclk_json_write_string(zclk_writer* writer, const char* str,
+		size_t len) {
+	static const char hex[] = "0123456789abcdef";
+	if (writer == NULL) {
+		return -1;
+	}
+	if (str == NULL) {
+		return zclk_writer_write(writer, "null", 4);
+	}
+	zclk_writer_putc(writer, '"');
+	size_t i = 0;
+	while (i < len) {
+		size_t run = find_special(str + i, len - i, SPECIAL_JSON);
+		zclk_writer_write(writer, str + i, run);
+		i += run;
+		if (i == len) {
+			break;
+		}
+		unsigned char c = (unsigned char) str[i++];
+		char esc[6] = { '\\', (char) c, '0', '0', 0, 0 };
+		size_t esc_len = 2;
+		switch (c) {
+		case '"':
+		case '\\':
+			break;
+		case '\n':
+			esc[1] = 'n';
+			break;
+		case '\r':
+			esc[1] = 'r';
+			break;
+		case '\t':
+			esc[1] = 't';
+			break;
+		case '\b':
+			esc[1] = 'b';
+			break;
+		case '\f':
+			esc[1] = 'f';
+			break;
+		default:
+			esc[1] = 'u';
+			esc[4] = hex[c >> 4];
+			esc[5] = hex[c & 0xF];
+			esc_len = 6;
+			break;
+		}
+		zclk_writer_write(writer, esc, esc_len);
+	}
+	zclk_writer_putc(writer, '"');
+	return writer->error ? -1 : 0;
+}
+
+int zclk_csv_write_field(zclk_writer* writer, const char* str, size_t len) {
+	if (writer == NULL) {
+		return -1;
+	}
+	if (str == NULL) {
+		return 0;
+	}
+	if (find_special(str, len, SPECIAL_CSV) == len) {
+		return zclk_writer_write(writer, str, len);
+	}
+	// quoted, with quotes doubled
+	zclk_writer_putc(writer, '"');
+	const char* end = str + len;
+	while (str < end) {
+		const char* quote = (const char*) memchr(str, '"', end - str);
+		size_t run = quote == NULL ? (size_t) (end - str)
+				: (size_t) (quote - str) + 1;
+		zclk_writer_write(writer, str, run);
+		if (quote != NULL) {
+			zclk_writer_putc(writer, '"');
+		}
+		str += run;
+	}
+	zclk_writer_putc(writer, '"');
+	return writer->error ? -1 : 0;
+}
+
+/**
+ * Write a value of the table as JSON: a string, a number or null.
+ */
+static void json_write_cell(zclk_writer* writer, zclk_table* table,
+		size_t row_id, size_t col_id, char* buf) {
+	const char* value;
+	size_t len;
+	zclk_table_format_row_val(&value, &len, buf, table, row_id, col_id);
+	zclk_table_col_type type = table->columns[col_id].type;
+	if (value == NULL) {
+		zclk_writer_write(writer, "null", 4);
+	} else if (type == ZCLK_TABLE_COL_STRING) {
+		zclk_json_write_string(writer, value, len);
+	} else if (type == ZCLK_TABLE_COL_DOUBLE
+			&& !isfinite(((double*) table->columns[col_id].native)[row_id])) {
+		// JSON has no inf or nan
+		zclk_writer_write(writer, "null", 4);
+	} else {
+		zclk_writer_write(writer, value, len);
+	}
+}
+
+/**
+ * Encode the "header": prefix of every column once, into keys. Returns
+ * the offsets of the prefixes (num_cols + 1 of them), or NULL on error.
+ */
+static size_t* json_encode_keys(zclk_writer* keys, zclk_table* table) {
+	size_t* offsets = (size_t*) calloc(table->num_cols + 1, sizeof(size_t));
+	if (offsets == NULL) {
+		return NULL;
+	}
+	for (size_t j = 0; j < table->num_cols; j++) {
+		zclk_writer_get_data(keys, &offsets[j]);
+		char* header = table->header[j];
+		if (header != NULL) {
+			zclk_json_write_string(keys, header, strlen(header));
+		} else {
+			// a column without a header is keyed by its index
+			zclk_writer_printf(keys, "\"%zu\"", j);
+		}
+		zclk_writer_putc(keys, ':');
+	}
+	zclk_writer_get_data(keys, &offsets[table->num_cols]);
+	if (keys->error) {
+		free(offsets);
+		return NULL;
+	}
+	return offsets;
+}
+
+static int encode_table_json(zclk_writer* writer, zclk_table* table,
+		int ndjson) {
+	char buf[ZCLK_TABLE_NUM_STR_SIZE];
+	zclk_writer* keys;
+	if (create_zclk_writer_memory(&keys) != 0) {
+		return -1;
+	}
+	size_t* offsets = json_encode_keys(keys, table);
+	if (offsets == NULL) {
+		free_zclk_writer(keys);
+		return -1;
+	}
+	const char* key_data = zclk_writer_get_data(keys, NULL);
+
+	if (!ndjson) {
+		zclk_writer_putc(writer, '[');
+	}
+	for (size_t i = 0; i < table->num_rows; i++) {
+		if (!ndjson) {
+			zclk_writer_write(writer, i == 0 ? "\n" : ",\n", i == 0 ? 1 : 2);
+		}
+		zclk_writer_putc(writer, '{');
+		for (size_t j = 0; j < table->num_cols; j++) {
+			if (j > 0) {
+				zclk_writer_putc(writer, ',');
+			}
+			zclk_writer_write(writer, key_data + offsets[j],
+					offsets[j + 1] - offsets[j]);
+			json_write_cell(writer, table, i, j, buf);
+		}
+		zclk_writer_putc(writer, '}');
+		if (ndjson) {
+			zclk_writer_putc(writer, '\n');
+		}
+	}
+	if (!ndjson) {
+		zclk_writer_write(writer, table->num_rows > 0 ? "\n]\n" : "]\n",
+				table->num_rows > 0 ? 3 : 2);
+	}
+
+	free(offsets);
+	free_zclk_writer(keys);
+	return writer->error ? -1 : 0;
+}
+
+static int encode_table_csv(zclk_writer* writer, zclk_table* table) {
+	char buf[ZCLK_TABLE_NUM_STR_SIZE];
+	const char* value;
+	size_t len;
+	for (size_t j = 0; j < table->num_cols; j++) {
+		if (j > 0) {
+			zclk_writer_putc(writer, ',');
+		}
+		char* header = table->header[j];
+		zclk_csv_write_field(writer, header,
+				header == NULL ? 0 : strlen(header));
+	}
+	zclk_writer_putc(writer, '\n');
+	for (size_t i = 0; i < table->num_rows; i++) {
+		for (size_t j = 0; j < table->num_cols; j++) {
+			if (j > 0) {
+				zclk_writer_putc(writer, ',');
+			}
+			zclk_table_format_row_val(&value, &len, buf, table, i, j);
+			zclk_csv_write_field(writer, value, len);
+		}
+		zclk_writer_putc(writer, '\n');
+	}
+	return writer->error ? -1 : 0;
+}
+
+int zclk_encode_table(zclk_writer* writer, zclk_table* table,
+		zclk_output_format format) {
+	if (writer == NULL || table == NULL) {
+		return -1;
+	}
+	switch (format) {
+	case ZCLK_OUTPUT_JSON:
+		return encode_table_json(writer, table, 0);
+	case ZCLK_OUTPUT_NDJSON:
+		return encode_table_json(writer, table, 1);
+	case ZCLK_OUTPUT_CSV:
+		return encode_table_csv(writer, table);
+	default:
+		return -1;
+	}
+}
+
+int zclk_encode_dict(zclk_writer* writer, zclk_dict* dict,
+		zclk_output_format format) {
+	if (writer == NULL || dict == NULL) {
+		return -1;
+	}
+	if (format == ZCLK_OUTPUT_JSON || format == ZCLK_OUTPUT_NDJSON) {
+		int first = 1;
+		zclk_writer_putc(writer, '{');
+		zclk_dict_foreach(dict, key, value) {
+			if (!first) {
+				zclk_writer_putc(writer, ',');
+			}
+			first = 0;
+			zclk_json_write_string(writer, key, strlen(key));
+			zclk_writer_putc(writer, ':');
+			zclk_json_write_string(writer, value,
+					value == NULL ? 0 : strlen(value));
+		}
+		zclk_writer_write(writer, "}\n", 2);
+	} else if (format == ZCLK_OUTPUT_CSV) {
+		zclk_writer_write(writer, "key,value\n", 10);
+		zclk_dict_foreach(dict, key, value) {
+			zclk_csv_write_field(writer, key, strlen(key));
+			zclk_writer_putc(writer, ',');
+			zclk_csv_write_field(writer, value,
+					value == NULL ? 0 : strlen(value));
+			zclk_writer_putc(writer, '\n');
+		}
+	} else {
+		return -1;
+	}
+	return writer->error ? -1 : 0;
+}
+
+/**
+ * Write the CSV header row of the columns.
+ */
+static void encode_csv_header(zclk_writer* writer, char** header,
+		size_t num_cols) {
+	for (size_t j = 0; j < num_cols; j++) {
+		if (j > 0) {
+			zclk_writer_putc(writer, ',');
+		}
+		zclk_csv_write_field(writer, header[j],
+				header[j] == NULL ? 0 : strlen(header[j]));
+	}
+	zclk_writer_putc(writer, '\n');
+}
+
+int zclk_encode_row(zclk_writer* writer, zclk_output_format format,
+		char** header, size_t num_cols, const char** values, size_t row) {
+	if (writer == NULL || header == NULL || values == NULL) {
+		return -1;
+	}
+	if (format == ZCLK_OUTPUT_CSV) {
+		if (row == 0) {
+			encode_csv_header(writer, header, num_cols);
+		}
+		for (size_t j = 0; j < num_cols; j++) {
+			if (j > 0) {
+				zclk_writer_putc(writer, ',');
+			}
+			zclk_csv_write_field(writer, values[j],
+					values[j] == NULL ? 0 : strlen(values[j]));
+		}
+		zclk_writer_putc(writer, '\n');
+		return writer->error ? -1 : 0;
+	}
+	if (format != ZCLK_OUTPUT_JSON && format != ZCLK_OUTPUT_NDJSON) {
+		return -1;
+	}
+	if (format == ZCLK_OUTPUT_JSON) {
+		zclk_writer_write(writer, row == 0 ? "[\n" : ",\n", 2);
+	}
+	zclk_writer_putc(writer, '{');
+	for (size_t j = 0; j < num_cols; j++) {
+		if (j > 0) {
+			zclk_writer_putc(writer, ',');
+		}
+		if (header[j] != NULL) {
+			zclk_json_write_string(writer, header[j], strlen(header[j]));
+		} else {
+			zclk_writer_printf(writer, "\"%zu\"", j);
+		}
+		zclk_writer_putc(writer, ':');
+		zclk_json_write_string(writer, values[j],
+				values[j] == NULL ? 0 : strlen(values[j]));
+	}
+	zclk_writer_putc(writer, '}');
+	if (format == ZCLK_OUTPUT_NDJSON) {
+		zclk_writer_putc(writer, '\n');
+	}
+	return writer->error ? -1 : 0;
+}
+
+int zclk_encode_rows_end(zclk_writer* writer, zclk_output_format format,
+		char** header, size_t num_cols, size_t num_rows) {
+	if (writer == NULL) {
+		return -1;
+	}
+	if (format == ZCLK_OUTPUT_JSON) {
+		zclk_writer_write(writer, num_rows > 0 ? "\n]\n" : "[]\n", 3);
+	} else if (format == ZCLK_OUTPUT_CSV && num_rows == 0) {
+		encode_csv_header(writer, header, num_cols);
+	}
+	return writer->error ? -1 : 0;
+}
@@ -0,0 +1,143 @@
+// Copyright (c) 2020 Abhishek Mishra
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+/**
+ * \file zclk_encode.h
+ * \brief Machine readable encodings (JSON, CSV and NDJSON) of table,
+ * table stream and dict results.
+ *
+ * The encoders write straight to a zclk_writer. Strings are scanned 16
+ * (SSE2) or 32 (AVX2) bytes at a time, or 8 at a time without SIMD, for
+ * the characters which need escaping, and the runs in between are copied
+ * as is.
+ */
+
+#ifndef SRC_ZCLK_ENCODE_H_
+#define SRC_ZCLK_ENCODE_H_
+
+#include "zclk_common.h"
+#include "zclk_writer.h"
+#include "zclk_table.h"
+#include "zclk_dict.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Formats in which results can be written.
+ */
+typedef enum {
+	ZCLK_OUTPUT_TABLE = 0,	///< human readable layout
+	ZCLK_OUTPUT_JSON = 1,	///< a JSON array of row objects (an object for a dict)
+	ZCLK_OUTPUT_CSV = 2,	///< CSV (RFC 4180 quoting) with a header row
+	ZCLK_OUTPUT_NDJSON = 3	///< one JSON object per line
+} zclk_output_format;
+
+/**
+ * @brief Get the format with the given name (table, json, csv or ndjson).
+ *
+ * @param format format
+ * @param name name of the format
+ * @return 0 on success, -1 if there is no such format
+ */
+MODULE_API int zclk_output_format_parse(zclk_output_format* format,
+	const char* name);
+
+/**
+ * @brief Get the name of a format.
+ *
+ * @param format format
+ * @return name, or NULL for an unknown format
+ */
+MODULE_API const char* zclk_output_format_name(zclk_output_format format);
+
+/**
+ * @brief Write a string as a quoted JSON string. Bytes other than quotes,
+ * backslashes and control characters are copied unchanged.
+ *
+ * @param writer writer
+ * @param str string (null is written for NULL)
+ * @param len length of the string in bytes
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_json_write_string(zclk_writer* writer, const char* str,
+	size_t len);
+
+/**
+ * @brief Write a CSV field, quoted only if it contains a comma, a quote or
+ * a line break.
+ *
+ * @param writer writer
+ * @param str field (an empty field is written for NULL)
+ * @param len length of the field in bytes
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_csv_write_field(zclk_writer* writer, const char* str,
+	size_t len);
+
+/**
+ * @brief Write a table in a machine readable format. Each row is an
+ * object keyed by the column headers, with the values of int and double
+ * columns as JSON numbers, and unset values as null (or empty CSV
+ * fields).
+ *
+ * @param writer writer
+ * @param table table
+ * @param format ZCLK_OUTPUT_JSON, ZCLK_OUTPUT_CSV or ZCLK_OUTPUT_NDJSON
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_encode_table(zclk_writer* writer, zclk_table* table,
+	zclk_output_format format);
+
+/**
+ * @brief Write a dict in a machine readable format: an object (on one line
+ * for JSON and NDJSON), or key and value columns for CSV.
+ *
+ * @param writer writer
+ * @param dict dict
+ * @param format ZCLK_OUTPUT_JSON, ZCLK_OUTPUT_CSV or ZCLK_OUTPUT_NDJSON
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_encode_dict(zclk_writer* writer, zclk_dict* dict,
+	zclk_output_format format);
+
+/**
+ * @brief Write one row of a table whose rows are encoded as they come,
+ * with all values as strings. The first row (row 0) also opens the JSON
+ * array or writes the CSV header row.
+ *
+ * @param writer writer
+ * @param format ZCLK_OUTPUT_JSON, ZCLK_OUTPUT_CSV or ZCLK_OUTPUT_NDJSON
+ * @param header num_cols column names (a NULL name is keyed by index)
+ * @param num_cols number of columns
+ * @param values num_cols values (NULL values are null or empty)
+ * @param row index of the row
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_encode_row(zclk_writer* writer, zclk_output_format format,
+	char** header, size_t num_cols, const char** values, size_t row);
+
+/**
+ * @brief End a table written with zclk_encode_row: close the JSON array,
+ * or write the CSV header row if there were no rows.
+ *
+ * @param writer writer
+ * @param format ZCLK_OUTPUT_JSON, ZCLK_OUTPUT_CSV or ZCLK_OUTPUT_NDJSON
+ * @param header num_cols column names
+ * @param num_cols number of columns
+ * @param num_rows number of rows written
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_encode_rows_end(zclk_writer* writer,
+	zclk_output_format format, char** header, size_t num_cols,
+	size_t num_rows);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_ZCLK_ENCODE_H_ */
@@ -0,0 +1,1406 @@
+/**
+ * Copyright (c) 2020 Abhishek Mishra
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "zclk.h"
+
+#define FROZEN_ALIGN(x) (((x) + 7) & ~((size_t)7))
+#define FROZEN_SHORT_BIT 0x80000000u
+
+#define FROZEN_SECTION(fz, type, off) \
+		((const type *)((fz)->block + (off)))
+
+/**
+ * 32-bit FNV-1a hash of the first len chars of an option name.
+ * Long and short names hash differently, 0 marks an empty slot.
+ */
+static uint32_t frozen_option_hash(const char *name, size_t len, int is_short)
+{
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= (unsigned char)name[i];
+		h *= 16777619u;
+	}
+	h ^= (uint32_t)is_short;
+	return h == 0 ? 1 : h;
+}
+
+static const zclk_frozen_header *frozen_header(const zclk_frozen *frozen)
+{
+	return (const zclk_frozen_header *)frozen->block;
+}
+
+static const char *frozen_str(const zclk_frozen *frozen, uint32_t off)
+{
+	if (off == ZCLK_FROZEN_NULL)
+	{
+		return NULL;
+	}
+	return (const char *)(frozen->block + frozen_header(frozen)->strings_off
+		+ off);
+}
+
+/* ---------------------------- string pool ---------------------------- */
+
+typedef struct frozen_pool_slot_t
+{
+	uint32_t hash;
+	uint32_t off;
+	size_t len;
+} frozen_pool_slot;
+
+/**
+ * Interned strings of the tree being frozen. Equal strings (like the
+ * help option of every command) are stored once.
+ */
+typedef struct frozen_pool_t
+{
+	char *data;
+	size_t len;
+	size_t cap;
+	frozen_pool_slot *slots;
+	size_t num_slots;
+	size_t used;
+	int failed;
+} frozen_pool;
+
+static int frozen_pool_grow_slots(frozen_pool *pool)
+{
+	size_t num_slots = pool->num_slots == 0 ? 256 : pool->num_slots * 2;
+	frozen_pool_slot *slots = (frozen_pool_slot *)calloc(num_slots,
+		sizeof(frozen_pool_slot));
+	if (slots == NULL)
+	{
+		return -1;
+	}
+	for (size_t i = 0; i < pool->num_slots; i++)
+	{
+		frozen_pool_slot *old = &pool->slots[i];
+		if (old->hash != 0)
+		{
+			size_t j = old->hash & (num_slots - 1);
+			while (slots[j].hash != 0)
+			{
+				j = (j + 1) & (num_slots - 1);
+			}
+			slots[j] = *old;
+		}
+	}
+	free(pool->slots);
+	pool->slots = slots;
+	pool->num_slots = num_slots;
+	return 0;
+}
+
+static uint32_t frozen_pool_intern(frozen_pool *pool, const char *s)
+{
+	if (s == NULL || pool->failed)
+	{
+		return ZCLK_FROZEN_NULL;
+	}
+	if ((pool->used + 1) * 2 > pool->num_slots
+		&& frozen_pool_grow_slots(pool) != 0)
+	{
+		pool->failed = 1;
+		return ZCLK_FROZEN_NULL;
+	}
+
+	size_t len = strlen(s);
+	uint32_t hash = frozen_option_hash(s, len, 0);
+	size_t mask = pool->num_slots - 1;
+	size_t i = hash & mask;
+	while (pool->slots[i].hash != 0)
+	{
+		frozen_pool_slot *slot = &pool->slots[i];
+		if (slot->hash == hash && slot->len == len
+			&& memcmp(pool->data + slot->off, s, len) == 0)
+		{
+			return slot->off;
+		}
+		i = (i + 1) & mask;
+	}
+
+	if (pool->len + len + 1 > pool->cap)
+	{
+		size_t cap = pool->cap == 0 ? 4096 : pool->cap;
+		while (pool->len + len + 1 > cap)
+		{
+			cap *= 2;
+		}
+		char *data = (char *)realloc(pool->data, cap);
+		if (data == NULL)
+		{
+			pool->failed = 1;
+			return ZCLK_FROZEN_NULL;
+		}
+		pool->data = data;
+		pool->cap = cap;
+	}
+	uint32_t off = (uint32_t)pool->len;
+	memcpy(pool->data + pool->len, s, len + 1);
+	pool->len += len + 1;
+
+	pool->slots[i].hash = hash;
+	pool->slots[i].off = off;
+	pool->slots[i].len = len;
+	pool->used += 1;
+	return off;
+}
+
+/* ------------------------------ freezing ----------------------------- */
+
+typedef struct frozen_sort_key_t
+{
+	const char *name;
+	uint32_t command;
+} frozen_sort_key;
+
+/**
+ * Order keys by name, and a shared name by the order the sub-commands
+ * were added in (qsort is not stable), so the first one keeps the name
+ * as in the live trie.
+ */
+static int frozen_sort_key_cmp(const void *a, const void *b)
+{
+	const frozen_sort_key *ka = (const frozen_sort_key *)a;
+	const frozen_sort_key *kb = (const frozen_sort_key *)b;
+	int res = strcmp(ka->name, kb->name);
+	if (res != 0)
+	{
+		return res;
+	}
+	return (ka->command > kb->command) - (ka->command < kb->command);
+}
+
+static void frozen_pack_val(frozen_pool *pool, zclk_frozen_option *fo,
+	zclk_val *val)
+{
+	fo->type = val != NULL ? (uint32_t)val->type : ZCLK_TYPE_STRING;
+	fo->default_val.int_value = 0;
+	if (val == NULL)
+	{
+		fo->default_val.str_value = ZCLK_FROZEN_NULL;
+		return;
+	}
+	switch (val->type)
+	{
+	case ZCLK_TYPE_DOUBLE:
+		fo->default_val.dbl_value = val->data.dbl_value;
+		break;
+	case ZCLK_TYPE_STRING:
+		fo->default_val.str_value = frozen_pool_intern(pool,
+			val->data.str_value);
+		break;
+	default:
+		fo->default_val.int_value = val->data.int_value;
+		break;
+	}
+}
+
+/**
+ * The sections of the block, built separately before being copied
+ * into one allocation.
+ */
+typedef struct frozen_build_t
+{
+	zclk_command **cmds;
+	zclk_frozen_command *fcmds;
+	size_t num_cmds;
+	zclk_option **opts;
+	zclk_frozen_option *fopts;
+	size_t num_opts;
+	zclk_argument **args;
+	zclk_frozen_option *fargs;
+	size_t num_args;
+	zclk_frozen_key *keys;
+	size_t num_keys;
+	zclk_frozen_slot *slots;
+	size_t num_slots;
+	frozen_pool pool;
+} frozen_build;
+
+static void frozen_build_free(frozen_build *b)
+{
+	free(b->cmds);
+	free(b->fcmds);
+	free(b->opts);
+	free(b->fopts);
+	free(b->args);
+	free(b->fargs);
+	free(b->keys);
+	free(b->slots);
+	free(b->pool.data);
+	free(b->pool.slots);
+}
+
+static size_t frozen_slots_for(size_t num_options)
+{
+	// every option has two keys, keep the load factor under 1/2
+	size_t num_slots = 4;
+	while (num_slots < num_options * 4)
+	{
+		num_slots *= 2;
+	}
+	return num_slots;
+}
+
+/**
+ * Lay out all commands breadth first (so that siblings are contiguous),
+ * and count the options, arguments, keys and slots.
+ */
+static zclk_res frozen_collect(frozen_build *b, zclk_command *root)
+{
+	size_t cap = 64;
+	b->cmds = (zclk_command **)malloc(cap * sizeof(zclk_command *));
+	if (b->cmds == NULL)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	b->cmds[0] = root;
+	b->num_cmds = 1;
+	for (size_t i = 0; i < b->num_cmds; i++)
+	{
+		zclk_command *cmd = b->cmds[i];
+		// the frozen tree is complete, lazy commands are filled in now
+		zclk_res res = zclk_command_load(cmd);
+		if (res != ZCLK_RES_SUCCESS)
+		{
+			return res;
+		}
+		size_t sub_cmd_len = arraylist_length(cmd->sub_commands);
+		if (b->num_cmds + sub_cmd_len > cap)
+		{
+			while (b->num_cmds + sub_cmd_len > cap)
+			{
+				cap *= 2;
+			}
+			zclk_command **cmds = (zclk_command **)realloc(b->cmds,
+				cap * sizeof(zclk_command *));
+			if (cmds == NULL)
+			{
+				return ZCLK_RES_ERR_ALLOC_FAILED;
+			}
+			b->cmds = cmds;
+		}
+		for (size_t j = 0; j < sub_cmd_len; j++)
+		{
+			b->cmds[b->num_cmds++] = arraylist_get(cmd->sub_commands, j);
+		}
+		size_t opt_len = arraylist_length(cmd->options);
+		b->num_opts += opt_len;
+		b->num_args += arraylist_length(cmd->args);
+		b->num_keys += 2 * sub_cmd_len;
+		b->num_slots += frozen_slots_for(opt_len);
+	}
+	if (b->num_cmds >= ZCLK_FROZEN_NULL || b->num_opts >= FROZEN_SHORT_BIT)
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+
+	b->fcmds = (zclk_frozen_command *)calloc(b->num_cmds,
+		sizeof(zclk_frozen_command));
+	b->opts = (zclk_option **)calloc(b->num_opts + 1, sizeof(zclk_option *));
+	b->fopts = (zclk_frozen_option *)calloc(b->num_opts + 1,
+		sizeof(zclk_frozen_option));
+	b->args = (zclk_argument **)calloc(b->num_args + 1,
+		sizeof(zclk_argument *));
+	b->fargs = (zclk_frozen_option *)calloc(b->num_args + 1,
+		sizeof(zclk_frozen_option));
+	b->keys = (zclk_frozen_key *)calloc(b->num_keys + 1,
+		sizeof(zclk_frozen_key));
+	b->slots = (zclk_frozen_slot *)calloc(b->num_slots + 1,
+		sizeof(zclk_frozen_slot));
+	if (b->fcmds == NULL || b->opts == NULL || b->fopts == NULL
+		|| b->args == NULL || b->fargs == NULL || b->keys == NULL
+		|| b->slots == NULL)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	return ZCLK_RES_SUCCESS;
+}
+
+static void frozen_slot_put(frozen_build *b, zclk_frozen_command *fc,
+	const char *key, int is_short, uint32_t option)
+{
+	if (key == NULL)
+	{
+		return;
+	}
+	size_t len = strlen(key);
+	uint32_t hash = frozen_option_hash(key, len, is_short);
+	uint32_t mask = fc->num_slots - 1;
+	for (uint32_t i = hash & mask; ; i = (i + 1) & mask)
+	{
+		zclk_frozen_slot *slot = &b->slots[fc->first_slot + i];
+		if (slot->hash == 0)
+		{
+			slot->hash = hash;
+			slot->ref = (option + 1) | (is_short ? FROZEN_SHORT_BIT : 0);
+			return;
+		}
+		if (slot->hash == hash
+			&& ((slot->ref & FROZEN_SHORT_BIT) != 0) == (is_short != 0))
+		{
+			zclk_option *other = b->opts[(slot->ref & ~FROZEN_SHORT_BIT) - 1];
+			const char *other_key = is_short ? other->short_name : other->name;
+			if (strcmp(other_key, key) == 0)
+			{
+				// a later option with the same name replaces the earlier
+				slot->ref = (option + 1) | (is_short ? FROZEN_SHORT_BIT : 0);
+				return;
+			}
+		}
+	}
+}
+
+static zclk_res frozen_fill(frozen_build *b)
+{
+	frozen_pool *pool = &b->pool;
+	size_t next_opt = 0, next_arg = 0, next_key = 0, next_slot = 0;
+	size_t next_child = 1;
+	frozen_sort_key *sort_keys = NULL;
+	size_t sort_cap = 0;
+
+	for (size_t i = 0; i < b->num_cmds; i++)
+	{
+		zclk_command *cmd = b->cmds[i];
+		zclk_frozen_command *fc = &b->fcmds[i];
+		fc->name = frozen_pool_intern(pool, cmd->name);
+		fc->short_name = frozen_pool_intern(pool, cmd->short_name);
+		fc->description = frozen_pool_intern(pool, cmd->description);
+		fc->allow_abbrev = (uint32_t)(cmd->allow_abbrev != 0);
+		fc->flags = (cmd->allow_extra_args ? ZCLK_FROZEN_ALLOW_EXTRA_ARGS : 0)
+			| (cmd->output_option != NULL ? ZCLK_FROZEN_OUTPUT_OPTION : 0);
+		if (i == 0)
+		{
+			fc->parent = ZCLK_FROZEN_NULL;
+		}
+
+		// sub-commands, and their names sorted for binary search
+		size_t sub_cmd_len = arraylist_length(cmd->sub_commands);
+		fc->first_child = (uint32_t)next_child;
+		fc->num_children = (uint32_t)sub_cmd_len;
+		if (2 * sub_cmd_len > sort_cap)
+		{
+			sort_cap = 2 * sub_cmd_len;
+			free(sort_keys);
+			sort_keys = (frozen_sort_key *)malloc(sort_cap
+				* sizeof(frozen_sort_key));
+			if (sort_keys == NULL)
+			{
+				return ZCLK_RES_ERR_ALLOC_FAILED;
+			}
+		}
+		size_t num_keys = 0;
+		for (size_t j = 0; j < sub_cmd_len; j++)
+		{
+			zclk_command *sc = b->cmds[next_child + j];
+			b->fcmds[next_child + j].parent = (uint32_t)i;
+			sort_keys[num_keys].name = sc->name;
+			sort_keys[num_keys++].command = (uint32_t)(next_child + j);
+			if (sc->short_name != NULL)
+			{
+				sort_keys[num_keys].name = sc->short_name;
+				sort_keys[num_keys++].command = (uint32_t)(next_child + j);
+			}
+		}
+		next_child += sub_cmd_len;
+		if (num_keys > 0)
+		{
+			qsort(sort_keys, num_keys, sizeof(frozen_sort_key),
+				&frozen_sort_key_cmp);
+		}
+		fc->first_key = (uint32_t)next_key;
+		for (size_t k = 0; k < num_keys; k++)
+		{
+			// the first sub-command to use a name keeps it
+			if (k > 0 && strcmp(sort_keys[k].name, sort_keys[k - 1].name) == 0)
+			{
+				continue;
+			}
+			b->keys[next_key].name = frozen_pool_intern(pool,
+				sort_keys[k].name);
+			b->keys[next_key++].command = sort_keys[k].command;
+		}
+		fc->num_keys = (uint32_t)(next_key - fc->first_key);
+
+		// options and their hash index
+		size_t opt_len = arraylist_length(cmd->options);
+		fc->first_option = (uint32_t)next_opt;
+		fc->num_options = (uint32_t)opt_len;
+		fc->first_slot = (uint32_t)next_slot;
+		fc->num_slots = (uint32_t)frozen_slots_for(opt_len);
+		next_slot += fc->num_slots;
+		for (size_t j = 0; j < opt_len; j++)
+		{
+			zclk_option *opt = arraylist_get(cmd->options, j);
+			zclk_frozen_option *fo = &b->fopts[next_opt];
+			b->opts[next_opt] = opt;
+			fo->name = frozen_pool_intern(pool, opt->name);
+			fo->short_name = frozen_pool_intern(pool, opt->short_name);
+			fo->description = frozen_pool_intern(pool, opt->description);
+			frozen_pack_val(pool, fo, opt->default_val);
+			frozen_slot_put(b, fc, opt->name, 0, (uint32_t)next_opt);
+			frozen_slot_put(b, fc, opt->short_name, 1, (uint32_t)next_opt);
+			next_opt++;
+		}
+
+		size_t args_len = arraylist_length(cmd->args);
+		fc->first_arg = (uint32_t)next_arg;
+		fc->num_args = (uint32_t)args_len;
+		for (size_t j = 0; j < args_len; j++)
+		{
+			zclk_argument *arg = arraylist_get(cmd->args, j);
+			zclk_frozen_option *fa = &b->fargs[next_arg];
+			b->args[next_arg] = arg;
+			fa->name = frozen_pool_intern(pool, arg->name);
+			fa->short_name = ZCLK_FROZEN_NULL;
+			fa->description = frozen_pool_intern(pool, arg->description);
+			frozen_pack_val(pool, fa, arg->default_val);
+			next_arg++;
+		}
+	}
+	free(sort_keys);
+	b->num_keys = next_key;
+	return pool->failed ? ZCLK_RES_ERR_ALLOC_FAILED : ZCLK_RES_SUCCESS;
+}
+
+static zclk_res frozen_assemble(frozen_build *b, zclk_frozen **frozen)
+{
+	zclk_frozen_header h;
+	memset(&h, 0, sizeof(h));
+	h.magic = ZCLK_FROZEN_MAGIC;
+	h.version = ZCLK_FROZEN_VERSION;
+	h.num_commands = (uint32_t)b->num_cmds;
+	h.num_options = (uint32_t)b->num_opts;
+	h.num_args = (uint32_t)b->num_args;
+	h.num_keys = (uint32_t)b->num_keys;
+	h.num_slots = (uint32_t)b->num_slots;
+
+	size_t off = FROZEN_ALIGN(sizeof(h));
+	h.commands_off = (uint32_t)off;
+	off = FROZEN_ALIGN(off + b->num_cmds * sizeof(zclk_frozen_command));
+	h.options_off = (uint32_t)off;
+	off = FROZEN_ALIGN(off + b->num_opts * sizeof(zclk_frozen_option));
+	h.args_off = (uint32_t)off;
+	off = FROZEN_ALIGN(off + b->num_args * sizeof(zclk_frozen_option));
+	h.keys_off = (uint32_t)off;
+	off = FROZEN_ALIGN(off + b->num_keys * sizeof(zclk_frozen_key));
+	h.slots_off = (uint32_t)off;
+	off = FROZEN_ALIGN(off + b->num_slots * sizeof(zclk_frozen_slot));
+	h.strings_off = (uint32_t)off;
+	h.strings_size = (uint32_t)b->pool.len;
+	off = FROZEN_ALIGN(off + b->pool.len);
+	if (off > 0xFFFFFFFFu)
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	h.size = (uint32_t)off;
+
+	(*frozen) = (zclk_frozen *)calloc(1, sizeof(zclk_frozen));
+	unsigned char *block = (unsigned char *)calloc(1, off);
+	if ((*frozen) == NULL || block == NULL)
+	{
+		free(*frozen);
+		free(block);
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	memcpy(block, &h, sizeof(h));
+	memcpy(block + h.commands_off, b->fcmds,
+		b->num_cmds * sizeof(zclk_frozen_command));
+	memcpy(block + h.options_off, b->fopts,
+		b->num_opts * sizeof(zclk_frozen_option));
+	memcpy(block + h.args_off, b->fargs,
+		b->num_args * sizeof(zclk_frozen_option));
+	memcpy(block + h.keys_off, b->keys,
+		b->num_keys * sizeof(zclk_frozen_key));
+	memcpy(block + h.slots_off, b->slots,
+		b->num_slots * sizeof(zclk_frozen_slot));
+	if (b->pool.len > 0)
+	{
+		memcpy(block + h.strings_off, b->pool.data, b->pool.len);
+	}
+
+	(*frozen)->block = block;
+	(*frozen)->size = off;
+	// the live objects are handed over to the frozen tree
+	(*frozen)->commands = b->cmds;
+	(*frozen)->options = b->opts;
+	(*frozen)->args = b->args;
+	b->cmds = NULL;
+	b->opts = NULL;
+	b->args = NULL;
+	return ZCLK_RES_SUCCESS;
+}
+
+/**
+ * Decode the default value of every option and argument of the block
+ * into frozen->values, the initial values of a parse of the tree.
+ */
+static zclk_res frozen_decode_values(zclk_frozen *frozen)
+{
+	const zclk_frozen_header *h = frozen_header(frozen);
+	size_t num_values = (size_t)h->num_options + h->num_args;
+	frozen->values = (zclk_val *)calloc(num_values + 1, sizeof(zclk_val));
+	if (frozen->values == NULL)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	const zclk_frozen_option *opts = FROZEN_SECTION(frozen,
+		zclk_frozen_option, h->options_off);
+	const zclk_frozen_option *args = FROZEN_SECTION(frozen,
+		zclk_frozen_option, h->args_off);
+	for (size_t i = 0; i < num_values; i++)
+	{
+		const zclk_frozen_option *fo = i < h->num_options ? &opts[i]
+			: &args[i - h->num_options];
+		zclk_val *val = &frozen->values[i];
+		val->type = (zclk_type)fo->type;
+		switch (fo->type)
+		{
+		case ZCLK_TYPE_DOUBLE:
+			val->data.dbl_value = fo->default_val.dbl_value;
+			break;
+		case ZCLK_TYPE_STRING:
+			val->data.str_value = (char *)frozen_str(frozen,
+				fo->default_val.str_value);
+			break;
+		default:
+			val->data.int_value = (int)fo->default_val.int_value;
+			break;
+		}
+	}
+	return ZCLK_RES_SUCCESS;
+}
+
+zclk_res zclk_command_freeze(zclk_command *cmd)
+{
+	if (cmd == NULL)
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	if (cmd->frozen != NULL)
+	{
+		return ZCLK_RES_ERR_FROZEN;
+	}
+
+	frozen_build b;
+	memset(&b, 0, sizeof(b));
+	zclk_frozen *frozen = NULL;
+	zclk_res res = frozen_collect(&b, cmd);
+	if (res == ZCLK_RES_SUCCESS)
+	{
+		res = frozen_fill(&b);
+	}
+	if (res == ZCLK_RES_SUCCESS)
+	{
+		res = frozen_assemble(&b, &frozen);
+	}
+	frozen_build_free(&b);
+	if (res == ZCLK_RES_SUCCESS
+		&& (res = frozen_decode_values(frozen)) != ZCLK_RES_SUCCESS)
+	{
+		free_zclk_frozen(frozen);
+	}
+	if (res != ZCLK_RES_SUCCESS)
+	{
+		return res;
+	}
+	// the block of a tree in an arena is released with it
+	if (cmd->arena != NULL && zclk_arena_add_cleanup(cmd->arena,
+			(zclk_arena_cleanup_fn)&free_zclk_frozen, frozen) != 0)
+	{
+		free_zclk_frozen(frozen);
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+
+	for (uint32_t i = 0; i < frozen_header(frozen)->num_commands; i++)
+	{
+		zclk_command *c = frozen->commands[i];
+		// a command reachable twice keeps its first position
+		if (c->frozen == NULL)
+		{
+			c->frozen = frozen;
+			c->frozen_id = i;
+		}
+	}
+	return ZCLK_RES_SUCCESS;
+}
+
+int zclk_command_is_frozen(zclk_command *cmd)
+{
+	return cmd != NULL && cmd->frozen != NULL && cmd->frozen->cache == NULL;
+}
+
+void free_zclk_frozen(zclk_frozen *frozen)
+{
+	if (frozen != NULL)
+	{
+		free((void *)frozen->block);
+		free(frozen->commands);
+		free(frozen->options);
+		free(frozen->args);
+		free(frozen->values);
+		free(frozen);
+	}
+}
+
+/* ------------------------------- lookup ------------------------------ */
+
+uint32_t zclk_frozen_find_option(const zclk_frozen *frozen, uint32_t cmd_id,
+	const char *name, size_t len, int is_short)
+{
+	const zclk_frozen_header *h = frozen_header(frozen);
+	const zclk_frozen_command *fc = FROZEN_SECTION(frozen,
+		zclk_frozen_command, h->commands_off) + cmd_id;
+	if (fc->num_slots == 0)
+	{
+		return ZCLK_FROZEN_NULL;
+	}
+	const zclk_frozen_slot *slots = FROZEN_SECTION(frozen, zclk_frozen_slot,
+		h->slots_off) + fc->first_slot;
+	const zclk_frozen_option *opts = FROZEN_SECTION(frozen,
+		zclk_frozen_option, h->options_off);
+
+	uint32_t hash = frozen_option_hash(name, len, is_short);
+	uint32_t mask = fc->num_slots - 1;
+	for (uint32_t i = hash & mask; slots[i].hash != 0; i = (i + 1) & mask)
+	{
+		if (slots[i].hash == hash
+			&& ((slots[i].ref & FROZEN_SHORT_BIT) != 0) == (is_short != 0))
+		{
+			uint32_t opt_id = (slots[i].ref & ~FROZEN_SHORT_BIT) - 1;
+			const char *key = frozen_str(frozen, is_short
+				? opts[opt_id].short_name : opts[opt_id].name);
+			if (strncmp(key, name, len) == 0 && key[len] == '\0')
+			{
+				return opt_id;
+			}
+		}
+	}
+	return ZCLK_FROZEN_NULL;
+}
+
+const zclk_frozen_command *zclk_frozen_get_command(const zclk_frozen *frozen,
+	uint32_t cmd_id)
+{
+	return FROZEN_SECTION(frozen, zclk_frozen_command,
+		frozen_header(frozen)->commands_off) + cmd_id;
+}
+
+const zclk_frozen_option *zclk_frozen_get_argument(const zclk_frozen *frozen,
+	uint32_t arg_id)
+{
+	return FROZEN_SECTION(frozen, zclk_frozen_option,
+		frozen_header(frozen)->args_off) + arg_id;
+}
+
+const char *zclk_frozen_get_string(const zclk_frozen *frozen, uint32_t off)
+{
+	return frozen_str(frozen, off);
+}
+
+uint32_t zclk_frozen_find_subcommand(const zclk_frozen *frozen,
+	uint32_t cmd_id, const char *name, int allow_abbrev)
+{
+	const zclk_frozen_header *h = frozen_header(frozen);
+	const zclk_frozen_command *fc = FROZEN_SECTION(frozen,
+		zclk_frozen_command, h->commands_off) + cmd_id;
+	const zclk_frozen_key *keys = FROZEN_SECTION(frozen, zclk_frozen_key,
+		h->keys_off) + fc->first_key;
+
+	// lower bound of name in the sorted keys
+	uint32_t lo = 0, hi = fc->num_keys;
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (strcmp(frozen_str(frozen, keys[mid].name), name) < 0)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	if (lo == fc->num_keys)
+	{
+		return ZCLK_FROZEN_NULL;
+	}
+	const char *key = frozen_str(frozen, keys[lo].name);
+	if (strcmp(key, name) == 0)
+	{
+		return keys[lo].command;
+	}
+	if (!allow_abbrev)
+	{
+		return ZCLK_FROZEN_NULL;
+	}
+
+	// all keys starting with the prefix follow the lower bound
+	size_t len = strlen(name);
+	uint32_t found = ZCLK_FROZEN_NULL;
+	for (uint32_t i = lo; i < fc->num_keys; i++)
+	{
+		if (strncmp(frozen_str(frozen, keys[i].name), name, len) != 0)
+		{
+			break;
+		}
+		if (found != ZCLK_FROZEN_NULL && found != keys[i].command)
+		{
+			// ambiguous prefix
+			return ZCLK_FROZEN_NULL;
+		}
+		found = keys[i].command;
+	}
+	return found;
+}
+
+size_t zclk_frozen_foreach_subcommand(const zclk_frozen *frozen,
+	uint32_t cmd_id, const char *prefix, zclk_trie_visit_fn fn, void *ctx)
+{
+	const zclk_frozen_header *h = frozen_header(frozen);
+	const zclk_frozen_command *fc = FROZEN_SECTION(frozen,
+		zclk_frozen_command, h->commands_off) + cmd_id;
+	const zclk_frozen_key *keys = FROZEN_SECTION(frozen, zclk_frozen_key,
+		h->keys_off) + fc->first_key;
+
+	// lower bound of the prefix in the sorted keys
+	uint32_t lo = 0, hi = fc->num_keys;
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (strcmp(frozen_str(frozen, keys[mid].name), prefix) < 0)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	size_t len = strlen(prefix);
+	size_t visited = 0;
+	for (uint32_t i = lo; i < fc->num_keys; i++)
+	{
+		const char *key = frozen_str(frozen, keys[i].name);
+		if (strncmp(key, prefix, len) != 0)
+		{
+			break;
+		}
+		zclk_command *sub = zclk_frozen_get_live_command(frozen,
+			keys[i].command);
+		if (sub != NULL)
+		{
+			fn(key, strlen(key), sub, ctx);
+			visited++;
+		}
+	}
+	return visited;
+}
+
+/* ------------------------------- cache ------------------------------- */
+
+#define CACHE_FNV_OFFSET 14695981039346656037ULL
+#define CACHE_FNV_PRIME 1099511628211ULL
+
+/**
+ * Loader argument of a command built from a cache.
+ */
+typedef struct cache_node_t
+{
+	zclk_cache *cache;
+	uint32_t id;
+} cache_node;
+
+static uint64_t cache_hash_update(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= p[i];
+		h *= CACHE_FNV_PRIME;
+	}
+	return h;
+}
+
+uint64_t zclk_cache_hash(const void *data, size_t len)
+{
+	return cache_hash_update(CACHE_FNV_OFFSET, data, len);
+}
+
+zclk_res zclk_cache_hash_file(uint64_t *hash, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	char buf[16384];
+	uint64_t h = CACHE_FNV_OFFSET;
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+	{
+		h = cache_hash_update(h, buf, n);
+	}
+	int failed = ferror(f);
+	fclose(f);
+	if (failed)
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	(*hash) = h;
+	return ZCLK_RES_SUCCESS;
+}
+
+zclk_res zclk_command_save_cache(zclk_command *cmd, const char *path,
+	uint64_t source_hash)
+{
+	if (cmd == NULL || path == NULL)
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	if (cmd->frozen == NULL)
+	{
+		zclk_res res = zclk_command_freeze(cmd);
+		if (res != ZCLK_RES_SUCCESS)
+		{
+			return res;
+		}
+	}
+	else if (cmd->frozen_id != 0)
+	{
+		// part of a larger frozen tree
+		return ZCLK_RES_ERR_FROZEN;
+	}
+
+	zclk_cache_header h;
+	memset(&h, 0, sizeof(h));
+	h.magic = ZCLK_CACHE_MAGIC;
+	h.version = ZCLK_CACHE_VERSION;
+	h.frozen_version = ZCLK_FROZEN_VERSION;
+	h.block_size = (uint32_t)cmd->frozen->size;
+	h.source_hash = source_hash;
+
+	size_t path_len = strlen(path);
+	char *tmp_path = (char *)malloc(path_len + 5);
+	if (tmp_path == NULL)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	memcpy(tmp_path, path, path_len);
+	memcpy(tmp_path + path_len, ".tmp", 5);
+
+	zclk_res res = ZCLK_RES_ERR_UNKNOWN;
+	FILE *f = fopen(tmp_path, "wb");
+	if (f != NULL)
+	{
+		int written = fwrite(&h, sizeof(h), 1, f) == 1
+			&& fwrite(cmd->frozen->block, 1, cmd->frozen->size, f)
+				== cmd->frozen->size;
+		if (fclose(f) == 0 && written)
+		{
+#ifdef _WIN32
+			// rename does not replace an existing file on windows
+			remove(path);
+#endif
+			if (rename(tmp_path, path) == 0)
+			{
+				res = ZCLK_RES_SUCCESS;
+			}
+		}
+		if (res != ZCLK_RES_SUCCESS)
+		{
+			remove(tmp_path);
+		}
+	}
+	free(tmp_path);
+	return res;
+}
+
+/**
+ * Map the whole file read-only.
+ */
+static int cache_map(zclk_cache *cache, const char *path)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return -1;
+	}
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+	{
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	CloseHandle(file);
+	if (mapping == NULL)
+	{
+		return -1;
+	}
+	// the view keeps the mapping alive
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (view == NULL)
+	{
+		return -1;
+	}
+	cache->map = (const unsigned char *)view;
+	cache->map_size = (size_t)size.QuadPart;
+	return 0;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		return -1;
+	}
+	cache->map = (const unsigned char *)map;
+	cache->map_size = (size_t)st.st_size;
+	return 0;
+#endif
+}
+
+static int cache_section_fits(uint32_t off, uint32_t count, size_t item_size,
+	size_t size)
+{
+	return off == FROZEN_ALIGN(off) && off <= size
+		&& (size - off) / item_size >= count;
+}
+
+static int cache_str_fits(const zclk_frozen_header *h, uint32_t off)
+{
+	return off == ZCLK_FROZEN_NULL || off < h->strings_size;
+}
+
+/**
+ * Check that every offset and index in a block read from a file stays
+ * within the block, so that a corrupt file cannot make lookups read
+ * outside of it.
+ */
+static int cache_check_block(const zclk_frozen *frozen)
+{
+	const zclk_frozen_header *h = frozen_header(frozen);
+	size_t size = frozen->size;
+	if (size < sizeof(zclk_frozen_header) || h->magic != ZCLK_FROZEN_MAGIC
+		|| h->version != ZCLK_FROZEN_VERSION || h->size != size
+		|| h->num_commands == 0
+		|| !cache_section_fits(h->commands_off, h->num_commands,
+			sizeof(zclk_frozen_command), size)
+		|| !cache_section_fits(h->options_off, h->num_options,
+			sizeof(zclk_frozen_option), size)
+		|| !cache_section_fits(h->args_off, h->num_args,
+			sizeof(zclk_frozen_option), size)
+		|| !cache_section_fits(h->keys_off, h->num_keys,
+			sizeof(zclk_frozen_key), size)
+		|| !cache_section_fits(h->slots_off, h->num_slots,
+			sizeof(zclk_frozen_slot), size)
+		|| !cache_section_fits(h->strings_off, h->strings_size, 1, size)
+		|| h->strings_size == 0
+		|| frozen->block[h->strings_off + h->strings_size - 1] != '\0')
+	{
+		return -1;
+	}
+	const zclk_frozen_command *cmds = FROZEN_SECTION(frozen,
+		zclk_frozen_command, h->commands_off);
+	for (uint32_t i = 0; i < h->num_commands; i++)
+	{
+		const zclk_frozen_command *fc = &cmds[i];
+		if (!cache_str_fits(h, fc->name) || fc->name == ZCLK_FROZEN_NULL
+			|| !cache_str_fits(h, fc->short_name)
+			|| !cache_str_fits(h, fc->description)
+			|| (i == 0 ? fc->parent != ZCLK_FROZEN_NULL : fc->parent >= i)
+			|| fc->first_child > h->num_commands
+			|| fc->num_children > h->num_commands - fc->first_child
+			|| fc->first_key > h->num_keys
+			|| fc->num_keys > h->num_keys - fc->first_key
+			|| fc->first_option > h->num_options
+			|| fc->num_options > h->num_options - fc->first_option
+			|| fc->first_slot > h->num_slots
+			|| fc->num_slots > h->num_slots - fc->first_slot
+			|| (fc->num_slots & (fc->num_slots - 1)) != 0
+			|| fc->first_arg > h->num_args
+			|| fc->num_args > h->num_args - fc->first_arg)
+		{
+			return -1;
+		}
+	}
+	for (int section = 0; section < 2; section++)
+	{
+		uint32_t num = section == 0 ? h->num_options : h->num_args;
+		const zclk_frozen_option *opts = FROZEN_SECTION(frozen,
+			zclk_frozen_option, section == 0 ? h->options_off : h->args_off);
+		for (uint32_t i = 0; i < num; i++)
+		{
+			if (!cache_str_fits(h, opts[i].name)
+				|| !cache_str_fits(h, opts[i].short_name)
+				|| !cache_str_fits(h, opts[i].description)
+				|| opts[i].type > ZCLK_TYPE_FLAG
+				|| (opts[i].type == ZCLK_TYPE_STRING
+					&& !cache_str_fits(h, opts[i].default_val.str_value)))
+			{
+				return -1;
+			}
+		}
+	}
+	const zclk_frozen_key *keys = FROZEN_SECTION(frozen, zclk_frozen_key,
+		h->keys_off);
+	for (uint32_t i = 0; i < h->num_keys; i++)
+	{
+		if (keys[i].name >= h->strings_size
+			|| keys[i].command >= h->num_commands)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Add a bool or flag option with its default, which the
+ * zclk_command_<type>_option functions of these types do not take.
+ */
+static void cache_add_switch(zclk_command *cmd, zclk_type type,
+	const char *name, const char *short_name, int default_val,
+	const char *desc)
+{
+	zclk_val *val;
+	zclk_val *default_obj;
+	zclk_option *option;
+	if (make_zclk_val_in(cmd->arena, &val, type) != ZCLK_RES_SUCCESS
+		|| make_zclk_val_in(cmd->arena, &default_obj, type)
+			!= ZCLK_RES_SUCCESS
+		|| make_option_in(cmd->arena, &option, name, short_name, val,
+			default_obj, desc) != ZCLK_RES_SUCCESS)
+	{
+		return;
+	}
+	if (type == ZCLK_TYPE_BOOLEAN)
+	{
+		zclk_val_set_bool(val, default_val);
+		zclk_val_set_bool(default_obj, default_val);
+	}
+	else
+	{
+		zclk_val_set_flag(val, default_val);
+		zclk_val_set_flag(default_obj, default_val);
+	}
+	zclk_command_option_add(cmd, option);
+}
+
+/**
+ * Add an option or argument described in the block to the command.
+ */
+static void cache_add_value(zclk_command *cmd, const zclk_frozen *frozen,
+	const zclk_frozen_option *fo, int is_arg)
+{
+	const char *name = frozen_str(frozen, fo->name);
+	const char *short_name = frozen_str(frozen, fo->short_name);
+	const char *desc = frozen_str(frozen, fo->description);
+	int int_value = (int)fo->default_val.int_value;
+	switch (fo->type)
+	{
+	case ZCLK_TYPE_BOOLEAN:
+		if (is_arg)
+		{
+			zclk_command_bool_argument(cmd, name, int_value, desc, 1);
+		}
+		else
+		{
+			cache_add_switch(cmd, ZCLK_TYPE_BOOLEAN, name, short_name,
+				int_value, desc);
+		}
+		break;
+	case ZCLK_TYPE_INT:
+		if (is_arg)
+		{
+			zclk_command_int_argument(cmd, name, int_value, desc, 1);
+		}
+		else
+		{
+			zclk_command_int_option(cmd, name, short_name, int_value, desc);
+		}
+		break;
+	case ZCLK_TYPE_DOUBLE:
+		if (is_arg)
+		{
+			zclk_command_double_argument(cmd, name,
+				fo->default_val.dbl_value, desc, 1);
+		}
+		else
+		{
+			zclk_command_double_option(cmd, name, short_name,
+				fo->default_val.dbl_value, desc);
+		}
+		break;
+	case ZCLK_TYPE_STRING:
+		if (is_arg)
+		{
+			zclk_command_string_argument(cmd, name,
+				frozen_str(frozen, fo->default_val.str_value), desc, 1);
+		}
+		else
+		{
+			zclk_command_string_option(cmd, name, short_name,
+				frozen_str(frozen, fo->default_val.str_value), desc);
+		}
+		break;
+	default:
+		if (is_arg)
+		{
+			zclk_command_flag_argument(cmd, name, int_value, desc, 1);
+		}
+		else
+		{
+			cache_add_switch(cmd, ZCLK_TYPE_FLAG, name, short_name,
+				int_value, desc);
+		}
+		break;
+	}
+}
+
+static zclk_command *cache_command_at(zclk_cache *cache, uint32_t id);
+
+/**
+ * Fill in a command from the block: its options, arguments and
+ * sub-commands.
+ */
+static zclk_res cache_fill(zclk_cache *cache, zclk_command *cmd, uint32_t id)
+{
+	const zclk_frozen *frozen = &cache->frozen;
+	const zclk_frozen_header *h = frozen_header(frozen);
+	const zclk_frozen_command *fc = FROZEN_SECTION(frozen,
+		zclk_frozen_command, h->commands_off) + id;
+	const zclk_frozen_option *opts = FROZEN_SECTION(frozen,
+		zclk_frozen_option, h->options_off) + fc->first_option;
+	const zclk_frozen_option *args = FROZEN_SECTION(frozen,
+		zclk_frozen_option, h->args_off) + fc->first_arg;
+
+	for (uint32_t i = 0; i < fc->num_options; i++)
+	{
+		const char *name = frozen_str(frozen, opts[i].name);
+		// --help, which every command already has, comes first
+		if (i == 0 && name != NULL
+			&& strcmp(name, ZCLK_OPTION_HELP_LONG) == 0)
+		{
+			continue;
+		}
+		if ((fc->flags & ZCLK_FROZEN_OUTPUT_OPTION) && name != NULL
+			&& strcmp(name, ZCLK_OPTION_OUTPUT_LONG) == 0)
+		{
+			zclk_res res = zclk_command_enable_output_option(cmd);
+			if (res != ZCLK_RES_SUCCESS)
+			{
+				return res;
+			}
+			continue;
+		}
+		cache_add_value(cmd, frozen, &opts[i], 0);
+	}
+	for (uint32_t i = 0; i < fc->num_args; i++)
+	{
+		cache_add_value(cmd, frozen, &args[i], 1);
+	}
+
+	for (uint32_t i = 0; i < fc->num_children; i++)
+	{
+		// dispatch may have built the sub-command already
+		zclk_command *sub = cache_command_at(cache, fc->first_child + i);
+		if (sub == NULL)
+		{
+			return ZCLK_RES_ERR_ALLOC_FAILED;
+		}
+		zclk_res res = zclk_command_subcommand_add(cmd, sub);
+		if (res != ZCLK_RES_SUCCESS)
+		{
+			return res;
+		}
+	}
+	return ZCLK_RES_SUCCESS;
+}
+
+static zclk_res cache_command_loader(zclk_command *cmd, void *loader_args)
+{
+	cache_node *node = (cache_node *)loader_args;
+	return cache_fill(node->cache, cmd, node->id);
+}
+
+/**
+ * Get the command at an index of the block, building it (and the
+ * commands above it) as a lazy command if it is not built yet. Called
+ * with the load lock held.
+ */
+static zclk_command *cache_command_at(zclk_cache *cache, uint32_t id)
+{
+	zclk_frozen *frozen = &cache->frozen;
+	if (frozen->commands[id] != NULL)
+	{
+		return frozen->commands[id];
+	}
+	const zclk_frozen_command *fc = zclk_frozen_get_command(frozen, id);
+	zclk_command *parent = NULL;
+	if (fc->parent != ZCLK_FROZEN_NULL
+		&& (parent = cache_command_at(cache, fc->parent)) == NULL)
+	{
+		return NULL;
+	}
+	cache_node *node = (cache_node *)zclk_arena_alloc(cache->arena,
+		sizeof(cache_node));
+	if (node == NULL)
+	{
+		return NULL;
+	}
+	node->cache = cache;
+	node->id = id;
+	zclk_command *cmd = new_zclk_lazy_command_in(cache->arena,
+		frozen_str(frozen, fc->name), frozen_str(frozen, fc->short_name),
+		frozen_str(frozen, fc->description), NULL, &cache_command_loader,
+		node);
+	if (cmd == NULL)
+	{
+		return NULL;
+	}
+	cmd->allow_abbrev = (int)fc->allow_abbrev;
+	cmd->allow_extra_args = (fc->flags & ZCLK_FROZEN_ALLOW_EXTRA_ARGS) != 0;
+	cmd->frozen = frozen;
+	cmd->frozen_id = id;
+	frozen->commands[id] = cmd;
+	if (cache->bind != NULL)
+	{
+		cache->bind(cmd, parent, cache->bind_args);
+	}
+	return cmd;
+}
+
+zclk_command *zclk_frozen_get_live_command(const zclk_frozen *frozen,
+	uint32_t cmd_id)
+{
+	if (frozen->cache == NULL)
+	{
+		return frozen->commands[cmd_id];
+	}
+	zclk_command_load_lock();
+	zclk_command *cmd = cache_command_at(frozen->cache, cmd_id);
+	zclk_command_load_unlock();
+	return cmd;
+}
+
+zclk_res zclk_cache_open(zclk_cache **cache, const char *path,
+	uint64_t source_hash, zclk_cache_bind_fn bind, void *bind_args)
+{
+	(*cache) = NULL;
+	if (path == NULL)
+	{
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+	zclk_cache *c = (zclk_cache *)calloc(1, sizeof(zclk_cache));
+	if (c == NULL)
+	{
+		return ZCLK_RES_ERR_ALLOC_FAILED;
+	}
+	if (cache_map(c, path) != 0)
+	{
+		free(c);
+		return ZCLK_RES_ERR_UNKNOWN;
+	}
+
+	zclk_cache_header h;
+	if (c->map_size < sizeof(h))
+	{
+		free_zclk_cache(c);
+		return ZCLK_RES_ERR_INVALID_VALUE;
+	}
+	memcpy(&h, c->map, sizeof(h));
+	c->frozen.block = c->map + sizeof(h);
+	c->frozen.size = c->map_size - sizeof(h);
+	if (h.magic != ZCLK_CACHE_MAGIC || h.version != ZCLK_CACHE_VERSION
+		|| h.frozen_version != ZCLK_FROZEN_VERSION
+		|| h.source_hash != source_hash || h.block_size != c->frozen.size
+		|| cache_check_block(&c->frozen) != 0)
+	{
+		free_zclk_cache(c);
+		return ZCLK_RES_ERR_INVALID_VALUE;
+	}
+
+	c->bind = bind;
+	c->bind_args = bind_args;
+	c->frozen.cache = c;
+	zclk_res res = frozen_decode_values(&c->frozen);
+	if (res == ZCLK_RES_SUCCESS)
+	{
+		size_t num_commands = frozen_header(&c->frozen)->num_commands;
+		res = ZCLK_RES_ERR_ALLOC_FAILED;
+		if (create_zclk_arena(&(c->arena), 0) == 0
+			&& (c->frozen.commands = (zclk_command **)zclk_arena_alloc(
+				c->arena, num_commands * sizeof(zclk_command *))) != NULL)
+		{
+			memset(c->frozen.commands, 0,
+				num_commands * sizeof(zclk_command *));
+			// the other commands are built when they are reached
+			c->root = zclk_frozen_get_live_command(&c->frozen, 0);
+		}
+		if (c->root != NULL)
+		{
+			res = ZCLK_RES_SUCCESS;
+		}
+	}
+	if (res != ZCLK_RES_SUCCESS)
+	{
+		free_zclk_cache(c);
+		return res;
+	}
+	(*cache) = c;
+	return ZCLK_RES_SUCCESS;
+}
+
+zclk_command *zclk_cache_get_command(zclk_cache *cache)
+{
+	return cache == NULL ? NULL : cache->root;
+}
+
+void free_zclk_cache(zclk_cache *cache)
+{
+	if (cache != NULL)
+	{
+		free_zclk_arena(cache->arena);
+		free(cache->frozen.values);
+		if (cache->map != NULL)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile((LPCVOID)cache->map);
+#else
+			munmap((void *)cache->map, cache->map_size);
+#endif
+		}
+		free(cache);
+	}
+}
@@ -92,10 +92,45 @@ static zclk_res lua_cmd_handler(zclk_command* cmd, void* handler_args)
     return res;
 }
 
+/**
+ * Clear the userdata of the sub-commands owned by the command (created
+ * from lua), as free_command of the command frees them.
+ */
+static void zclk_command_detach_subcommands(lua_State *L, zclk_command *cmd)
+{
+    size_t sub_cmd_len = arraylist_length(cmd->sub_commands);
+    for (size_t i = 0; i < sub_cmd_len; i++)
+    {
+        zclk_command *sub = arraylist_get(cmd->sub_commands, i);
+        if (sub->parent != cmd)
+        {
+            continue;
+        }
+        if (sub->handler == &lua_cmd_handler)
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, sub->lua_udata_ref);
+            zclk_command **subptr = (zclk_command **)lua_touserdata(L, -1);
+            if (subptr != NULL)
+            {
+                (*subptr) = NULL;
+            }
+            lua_pop(L, 1);
+        }
+        zclk_command_detach_subcommands(L, sub);
+    }
+}
+
 static int zclk_command_free(lua_State *L)
 {
-    zclk_command *cmd = *((zclk_command**)luaL_checkudata(L, 1, LUA_ZCLK_COMMAND_OBJECT));
-    free_command(cmd);
+    zclk_command **cmdptr = (zclk_command**)luaL_checkudata(L, 1, LUA_ZCLK_COMMAND_OBJECT);
+    zclk_command *cmd = *cmdptr;
+    // a sub-command is freed along with the command it was added to
+    if (cmd != NULL && cmd->parent == NULL)
+    {
+        zclk_command_detach_subcommands(L, cmd);
+        free_command(cmd);
+    }
+    (*cmdptr) = NULL;
     return 0;
 }
 
@@ -134,6 +169,22 @@ static int zclk_command_lua_desc_get(lua_State *L)
 //     return 0;
 // }
 
+/**
+ * Create the userdata of a command, and push it.
+ */
+static void zclk_command_push_new(lua_State *L, zclk_command *cmd)
+{
+    zclk_command** cmdptr = lua_newuserdata(L, sizeof(zclk_command*));
+    (*cmdptr) = cmd;
+    cmd->lua_udata_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, cmd->lua_udata_ref);
+
+    // set metatable of zclk_command object
+    luaL_getmetatable(L, LUA_ZCLK_COMMAND_OBJECT);
+    lua_setmetatable(L, -2);
+}
+
 static int zclk_command_new(lua_State *L)
 {
     int handler_ref = luaL_ref(L, LUA_REGISTRYINDEX);
@@ -151,16 +202,140 @@ static int zclk_command_new(lua_State *L)
     zclk_command *cmd = new_zclk_command(name, short_name, desc, &lua_cmd_handler);
     cmd->lua_handler_ref = handler_ref;
     
-    zclk_command** cmdptr = lua_newuserdata(L, sizeof(zclk_command*));
-    (*cmdptr) = cmd;
-    cmd->lua_udata_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    zclk_command_push_new(L, cmd);
+    
+    return 1;
+}
+
+/**
+ * A command tree cache opened from lua, and the lua function which binds
+ * the commands built from it.
+ */
+typedef struct zclk_lua_cache_t
+{
+    zclk_cache *cache;
+    lua_State *L;
+    int bind_ref;
+} zclk_lua_cache;
 
+/**
+ * Create the userdata of a command built from a cache, and set its
+ * handler to the function returned by the bind function, called with
+ * the command and its parent (nil for the top-level command).
+ */
+static void zclk_cache_lua_bind(zclk_command *cmd, zclk_command *parent,
+    void *bind_args)
+{
+    zclk_lua_cache *lc = (zclk_lua_cache *)bind_args;
+    lua_State *L = lc->L;
+
+    zclk_command_push_new(L, cmd);
+    lua_pop(L, 1);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lc->bind_ref);
     lua_rawgeti(L, LUA_REGISTRYINDEX, cmd->lua_udata_ref);
+    if (parent != NULL)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, parent->lua_udata_ref);
+    }
+    else
+    {
+        lua_pushnil(L);
+    }
+    // the commands are built during dispatch, an error cannot unwind it
+    if (lua_pcall(L, 2, 1, 0) == LUA_OK && lua_isfunction(L, -1))
+    {
+        cmd->lua_handler_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        cmd->handler = &lua_cmd_handler;
+    }
+    else
+    {
+        lua_pop(L, 1);
+    }
+}
 
-    // set metatable of zclk_command object
-    luaL_getmetatable(L, LUA_ZCLK_COMMAND_OBJECT);
+static int zclk_cache_lua_free(lua_State *L)
+{
+    zclk_lua_cache *lc = (zclk_lua_cache *)luaL_checkudata(L, 1, LUA_ZCLK_CACHE_OBJECT);
+    free_zclk_cache(lc->cache);
+    lc->cache = NULL;
+    luaL_unref(L, LUA_REGISTRYINDEX, lc->bind_ref);
+    lc->bind_ref = LUA_NOREF;
+    return 0;
+}
+
+/**
+ * zclk.open_cache(path, hash, bind): map a cache file written by
+ * save_cache, and return its top-level command, or nil and the error code
+ * if the file is missing, corrupt or stale. bind is called with each
+ * command built from the cache and its parent, and returns the handler
+ * of the command (or nil).
+ */
+static int zclk_cache_lua_open(lua_State *L)
+{
+    luaL_checktype(L, lua_gettop(L), LUA_TFUNCTION);
+    int bind_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    uint64_t hash = (uint64_t)luaL_checkinteger(L, lua_gettop(L));
+    lua_pop(L, 1);
+    const char* path = luaL_checkstring(L, lua_gettop(L));
+
+    // created first, so that it is finalized after the commands in it
+    zclk_lua_cache *lc = lua_newuserdata(L, sizeof(zclk_lua_cache));
+    lc->cache = NULL;
+    lc->L = L;
+    lc->bind_ref = bind_ref;
+    luaL_getmetatable(L, LUA_ZCLK_CACHE_OBJECT);
     lua_setmetatable(L, -2);
-    
+
+    zclk_res err = zclk_cache_open(&(lc->cache), path, hash,
+        &zclk_cache_lua_bind, lc);
+    if (err != ZCLK_RES_SUCCESS)
+    {
+        lua_pushnil(L);
+        lua_pushinteger(L, err);
+        return 2;
+    }
+    // the commands of the cache are never collected, neither is the cache
+    luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX,
+        zclk_cache_get_command(lc->cache)->lua_udata_ref);
+    return 1;
+}
+
+/**
+ * zclk.cache_hash_file(path): the hash of a file (e.g. of the script
+ * which defines the tree) to save and open a cache with.
+ */
+static int zclk_cache_lua_hash_file(lua_State *L)
+{
+    const char* path = luaL_checkstring(L, lua_gettop(L));
+    lua_pop(L, 1);
+
+    uint64_t hash;
+    if (zclk_cache_hash_file(&hash, path) != ZCLK_RES_SUCCESS)
+    {
+        return luaL_error(L, "Cannot read %s.\n", path);
+    }
+    lua_pushinteger(L, (lua_Integer)hash);
+    return 1;
+}
+
+/**
+ * cmd:save_cache(path, hash): write the tree of the command to a cache
+ * file, returns the error code.
+ */
+static int zclk_command_lua_save_cache(lua_State *L)
+{
+    uint64_t hash = (uint64_t)luaL_checkinteger(L, lua_gettop(L));
+    lua_pop(L, 1);
+    const char* path = luaL_checkstring(L, lua_gettop(L));
+    lua_pop(L, 1);
+    zclk_command *cmd = zclk_command_getobj(L);
+
+    zclk_res err = zclk_command_save_cache(cmd, path, hash);
+
+    lua_pushinteger(L, err);
     return 1;
 }
 
@@ -521,7 +696,7 @@ static int zclk_command_lua_subcommand_add(lua_State *L)
 static int zclk_option_value(lua_State *L)
 {
     zclk_option *opt = zclk_option_getobj(L);
-    zclk_val *val = opt->val;
+    zclk_val *val = zclk_option_get_val(opt);
     if (zclk_val_is_bool(val))
     {
         lua_pushboolean(L, zclk_val_get_bool(val));
@@ -583,7 +758,7 @@ static int zclk_option_type(lua_State *L)
 static int zclk_argument_value(lua_State *L)
 {
     zclk_argument *arg = zclk_argument_getobj(L);
-    zclk_val *val = arg->val;
+    zclk_val *val = zclk_argument_get_val(arg);
 
     if (zclk_val_is_bool(val))
     {
@@ -646,6 +821,8 @@ static int zclk_argument_type(lua_State *L)
 static const luaL_Reg ZclkCommand_funcs[] =
 {
     {"new", zclk_command_new},
+    {"open_cache", zclk_cache_lua_open},
+    {"cache_hash_file", zclk_cache_lua_hash_file},
     {NULL, NULL}
 };
 
@@ -670,6 +847,13 @@ static const luaL_Reg zclk_command_meths[] =
     {"get_option", zclk_command_lua_get_option},
     {"get_argument", zclk_command_lua_get_argument},
     {"subcommand", zclk_command_lua_subcommand_add},
+    {"save_cache", zclk_command_lua_save_cache},
+    {NULL, NULL}
+};
+
+static const luaL_Reg zclk_cache_meths[] =
+{
+    {"__gc", zclk_cache_lua_free},
     {NULL, NULL}
 };
 
@@ -723,7 +907,13 @@ int luaopen_zclk(lua_State *L)
     // register methods
     luaL_setfuncs(L, zclk_argument_meths, 0);
 
-    // register functions - only zclk.new
+    // create zclk cache metatable
+    luaL_newmetatable(L, LUA_ZCLK_CACHE_OBJECT);
+
+    // register methods
+    luaL_setfuncs(L, zclk_cache_meths, 0);
+
+    // register functions - zclk.new, and opening caches
     luaL_newlib(L, ZclkCommand_funcs);
 
     return 1;
@@ -16,6 +16,9 @@
 /* The Zclk argument lua object */
 #define LUA_ZCLK_ARGUMENT_OBJECT    "zclk_argument"
 
+/* The Zclk command tree cache lua object */
+#define LUA_ZCLK_CACHE_OBJECT       "zclk_cache"
+
 /* The lua module method for 'zclk' */
 MODULE_API int luaopen_zclk(lua_State* L);
 
@@ -0,0 +1,75 @@
+// Copyright (c) 2020 Abhishek Mishra
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+/**
+ * \file zclk_number.h
+ * \brief Strict, locale independent parsing of integers and doubles.
+ *
+ * The whole string must be a number, there is no leading or trailing
+ * whitespace, and the decimal point is always '.'.
+ */
+
+#ifndef SRC_ZCLK_NUMBER_H_
+#define SRC_ZCLK_NUMBER_H_
+
+#include "zclk_common.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Results of the number parsing functions.
+ */
+typedef enum {
+	ZCLK_NUMBER_OK = 0,			///< the string is a number in range
+	ZCLK_NUMBER_INVALID = 1,	///< the string is not a number
+	ZCLK_NUMBER_RANGE = 2		///< the number does not fit the type
+} zclk_number_res;
+
+/**
+ * @brief Parse an integer.
+ *
+ * Accepts an optional sign followed by decimal digits, or by 0x/0X and
+ * hex digits, or by 0b/0B and binary digits. Leading zeros do not make
+ * the number octal.
+ *
+ * @param str string to parse
+ * @param out parsed value (not set on error)
+ * @return ZCLK_NUMBER_OK, ZCLK_NUMBER_INVALID or ZCLK_NUMBER_RANGE
+ */
+MODULE_API zclk_number_res zclk_parse_int64(const char* str, int64_t* out);
+
+/**
+ * @brief Parse an integer which fits an int.
+ * @see zclk_parse_int64
+ *
+ * @param str string to parse
+ * @param out parsed value (not set on error)
+ * @return ZCLK_NUMBER_OK, ZCLK_NUMBER_INVALID or ZCLK_NUMBER_RANGE
+ */
+MODULE_API zclk_number_res zclk_parse_int(const char* str, int* out);
+
+/**
+ * @brief Parse a double, rounded to nearest (ties to even).
+ *
+ * Accepts an optional sign followed by digits with an optional '.' and
+ * exponent, or inf, infinity or nan (in any case). Numbers with up to 19
+ * significant digits are converted with the Eisel-Lemire algorithm, the
+ * rest (and hex floats) with strtod. Values too large for a double are a
+ * range error, values too small round to zero.
+ *
+ * @param str string to parse
+ * @param out parsed value (not set on error)
+ * @return ZCLK_NUMBER_OK, ZCLK_NUMBER_INVALID or ZCLK_NUMBER_RANGE
+ */
+MODULE_API zclk_number_res zclk_parse_double(const char* str, double* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_ZCLK_NUMBER_H_ */
@@ -7,7 +7,57 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <pthread.h>
+#endif
 #include "zclk_progress.h"
+#include "zclk_atomic.h"
+
+static double monotonic_ms() {
+#ifdef _WIN32
+	return (double) GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+#endif
+}
+
+static uint64_t double_bits(double d) {
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+	return bits;
+}
+
+static double bits_double(uint64_t bits) {
+	double d;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+/*
+ * The counter holds the bits of a double, and is updated with atomic
+ * compare and swap.
+ */
+void zclk_progress_add(zclk_progress* progress, double amount) {
+	uint64_t old = zclk_atomic_load_u64(&progress->current_bits);
+	while (!zclk_atomic_cas_u64(&progress->current_bits, &old,
+			double_bits(bits_double(old) + amount))) {
+	}
+}
+
+void zclk_progress_set(zclk_progress* progress, double value) {
+	zclk_atomic_store_u64(&progress->current_bits, double_bits(value));
+}
+
+double zclk_progress_get(zclk_progress* progress) {
+	return bits_double(zclk_atomic_load_u64(&progress->current_bits));
+}
 
 int create_zclk_progress(zclk_progress** progress, char* name, int length,
 		double total) {
@@ -18,7 +68,8 @@ int create_zclk_progress(zclk_progress** progress, char* name, int length,
 	(*progress)->before = ZCLK_PROGRESS_DEFAULT_BEFORE;
 	(*progress)->after = ZCLK_PROGRESS_DEFAULT_AFTER;
 	(*progress)->bar = ZCLK_PROGRESS_DEFAULT_BAR;
-	(*progress)->current = 0;
+	zclk_progress_set(*progress, 0);
+	(*progress)->rate = -1;
 	(*progress)->total = total;
 	(*progress)->name = name;
 	(*progress)->length = length;
@@ -30,22 +81,130 @@ void free_zclk_progress(zclk_progress* progress) {
 	free(progress);
 }
 
-void show_progress(zclk_progress* progress) {
-	printf("\r");
-	printf("%s ", progress->name);
-	printf("%s", progress->before);
+void zclk_progress_set_flags(zclk_progress* progress, int flags) {
+	progress->flags = flags;
+}
+
+/**
+ * Fold the updates since the last sample into the moving average. The
+ * weight of the new sample grows with the time it covers.
+ */
+static void progress_sample(zclk_progress* p) {
+	double now = monotonic_ms();
+	double value = zclk_progress_get(p);
+	if (p->sample_ms <= 0) {
+		p->sample_ms = now;
+		p->sample_value = value;
+		return;
+	}
+	double elapsed = now - p->sample_ms;
+	// too short to be a meaningful sample
+	if (elapsed < 100) {
+		return;
+	}
+	double sample = (value - p->sample_value) * 1000.0 / elapsed;
+	if (p->rate < 0) {
+		p->rate = sample;
+	} else {
+		double alpha = 1 - pow(2, -elapsed / ZCLK_PROGRESS_RATE_HALF_LIFE_MS);
+		p->rate += alpha * (sample - p->rate);
+	}
+	p->sample_ms = now;
+	p->sample_value = value;
+}
+
+double zclk_progress_get_rate(zclk_progress* progress) {
+	return progress->rate < 0 ? 0 : progress->rate;
+}
+
+double zclk_progress_get_eta(zclk_progress* progress) {
+	double remaining = progress->total - zclk_progress_get(progress);
+	if (progress->total <= 0 || progress->rate <= 0) {
+		return remaining <= 0 && progress->total > 0 ? 0 : -1;
+	}
+	return remaining <= 0 ? 0 : remaining / progress->rate;
+}
+
+/**
+ * Write the rate with a unit prefix, e.g. 12.5k/s or 1.5 MiB/s.
+ */
+static void write_rate(zclk_writer* w, double rate, int bytes) {
+	static const char* si[] = { "", "k", "M", "G", "T" };
+	static const char* iec[] = { " B", " KiB", " MiB", " GiB", " TiB" };
+	double base = bytes ? 1024 : 1000;
+	int unit = 0;
+	while (rate >= base && unit < 4) {
+		rate /= base;
+		unit++;
+	}
+	zclk_writer_printf(w, unit == 0 && !bytes ? "%.0f%s/s" : "%.1f%s/s",
+			rate, bytes ? iec[unit] : si[unit]);
+}
 
-	double complete = (progress->current / progress->total) * progress->length;
-	int complete_bars = (int) complete;
-	for (int i = 0; i < complete_bars; i++) {
-		printf("%s", progress->bar);
+static void write_eta(zclk_writer* w, double eta) {
+	if (eta < 0 || eta > 359999) {
+		zclk_writer_write(w, "ETA --:--", 9);
+		return;
 	}
-	for (int i = complete_bars; i < progress->length; i++) {
-		printf("%s", " ");
+	long secs = (long) ceil(eta);
+	if (secs >= 3600) {
+		zclk_writer_printf(w, "ETA %ld:%02ld:%02ld", secs / 3600,
+				(secs / 60) % 60, secs % 60);
+	} else {
+		zclk_writer_printf(w, "ETA %02ld:%02ld", secs / 60, secs % 60);
 	}
+}
 
-	printf("%s", progress->after);
-	fflush(stdout);
+static void progress_write_bar_only(zclk_writer* writer, zclk_progress* p) {
+	int complete_bars = 0;
+	if (p->total > 0) {
+		double complete = (zclk_progress_get(p) / p->total) * p->length;
+		complete_bars = complete < 0 ? 0
+				: (complete > p->length ? p->length : (int) complete);
+	}
+	zclk_writer_puts(writer, p->before);
+	if (p->bar != NULL && p->bar[0] != '\0' && p->bar[1] == '\0') {
+		zclk_writer_fill(writer, p->bar[0], (size_t) complete_bars);
+	} else {
+		for (int i = 0; i < complete_bars; i++) {
+			zclk_writer_puts(writer, p->bar);
+		}
+	}
+	zclk_writer_fill(writer, ' ', (size_t) (p->length - complete_bars));
+	zclk_writer_puts(writer, p->after);
+}
+
+/**
+ * Write the rate and ETA, if shown, each after a space.
+ */
+static void progress_write_stats(zclk_writer* writer, zclk_progress* p) {
+	if (p->flags & (ZCLK_PROGRESS_SHOW_RATE | ZCLK_PROGRESS_SHOW_ETA)) {
+		progress_sample(p);
+	}
+	if (p->flags & ZCLK_PROGRESS_SHOW_RATE) {
+		zclk_writer_putc(writer, ' ');
+		write_rate(writer, zclk_progress_get_rate(p),
+				p->flags & ZCLK_PROGRESS_BYTES);
+	}
+	if (p->flags & ZCLK_PROGRESS_SHOW_ETA) {
+		zclk_writer_putc(writer, ' ');
+		write_eta(writer, zclk_progress_get_eta(p));
+	}
+}
+
+void zclk_progress_write_bar(zclk_writer* writer, zclk_progress* p) {
+	progress_write_bar_only(writer, p);
+	progress_write_stats(writer, p);
+}
+
+void show_progress(zclk_progress* progress) {
+	// composed in the buffer of the stdout writer, and written in one go
+	zclk_writer* out = zclk_stdout_writer();
+	zclk_writer_putc(out, '\r');
+	zclk_writer_puts(out, progress->name);
+	zclk_writer_putc(out, ' ');
+	zclk_progress_write_bar(out, progress);
+	zclk_writer_flush(out);
 }
 
 int create_zclk_multi_progress(zclk_multi_progress** multi_progress) {
@@ -54,13 +213,337 @@ int create_zclk_multi_progress(zclk_multi_progress** multi_progress) {
 	if ((*multi_progress) == NULL) {
 		return -1;
 	}
+	if (create_zclk_writer_memory(&(*multi_progress)->frame) != 0
+			|| create_zclk_writer_memory(&(*multi_progress)->line) != 0) {
+		free_zclk_writer((*multi_progress)->frame);
+		free(*multi_progress);
+		(*multi_progress) = NULL;
+		return -1;
+	}
 	(*multi_progress)->old_count = 0;
+	(*multi_progress)->fps = ZCLK_PROGRESS_DEFAULT_FPS;
 	arraylist_new(&((*multi_progress)->progress_ls), (void (*)(void *))&free_zclk_progress);
 	return 0;
 }
 
 void free_zclk_multi_progress(zclk_multi_progress* multi_progress) {
+	if (multi_progress->render_thread != NULL) {
+		zclk_multi_progress_stop(multi_progress);
+	}
+	for (size_t i = 0; i < multi_progress->lines_cap; i++) {
+		free(multi_progress->lines[i]);
+	}
+	free(multi_progress->lines);
+	free(multi_progress->line_lens);
+	free(multi_progress->line_caps);
+	free_zclk_writer(multi_progress->frame);
+	free_zclk_writer(multi_progress->line);
 	free(multi_progress->progress_ls);
 	free(multi_progress);
 }
 
+void zclk_multi_progress_set_fps(zclk_multi_progress* multi_progress,
+		int fps) {
+	multi_progress->fps = fps < 0 ? 0 : fps;
+}
+
+/**
+ * Make room for the text of n lines.
+ */
+static int lines_reserve(zclk_multi_progress* mp, size_t n) {
+	if (n <= mp->lines_cap) {
+		return 0;
+	}
+	size_t cap = mp->lines_cap == 0 ? 8 : mp->lines_cap;
+	while (cap < n) {
+		cap *= 2;
+	}
+	char** lines = (char**) realloc(mp->lines, cap * sizeof(char*));
+	if (lines == NULL) {
+		return -1;
+	}
+	mp->lines = lines;
+	size_t* lens = (size_t*) realloc(mp->line_lens, cap * sizeof(size_t));
+	if (lens == NULL) {
+		return -1;
+	}
+	mp->line_lens = lens;
+	size_t* caps = (size_t*) realloc(mp->line_caps, cap * sizeof(size_t));
+	if (caps == NULL) {
+		return -1;
+	}
+	mp->line_caps = caps;
+	for (size_t i = mp->lines_cap; i < cap; i++) {
+		mp->lines[i] = NULL;
+		mp->line_lens[i] = 0;
+		mp->line_caps[i] = 0;
+	}
+	mp->lines_cap = cap;
+	return 0;
+}
+
+/**
+ * Remember the text drawn on line i.
+ */
+static int line_store(zclk_multi_progress* mp, size_t i, const char* text,
+		size_t len) {
+	if (len + 1 > mp->line_caps[i]) {
+		size_t cap = len + 1 < 64 ? 64 : len + 1;
+		char* line = (char*) realloc(mp->lines[i], cap);
+		if (line == NULL) {
+			return -1;
+		}
+		mp->lines[i] = line;
+		mp->line_caps[i] = cap;
+	}
+	memcpy(mp->lines[i], text, len);
+	mp->line_lens[i] = len;
+	return 0;
+}
+
+/**
+ * Text of the line of a progress object: name: message extra, followed
+ * by the bar if asked for (and there is a total) and the rate and ETA.
+ */
+static void line_compose(zclk_writer* line, zclk_progress* p) {
+	zclk_writer_clear(line);
+	zclk_writer_puts(line, p->name);
+	zclk_writer_write(line, ": ", 2);
+	zclk_writer_puts(line, p->message);
+	if (p->extra != NULL) {
+		zclk_writer_putc(line, ' ');
+		zclk_writer_puts(line, p->extra);
+	}
+	if ((p->flags & ZCLK_PROGRESS_SHOW_BAR) && p->total > 0 && p->length > 0) {
+		zclk_writer_putc(line, ' ');
+		progress_write_bar_only(line, p);
+	}
+	progress_write_stats(line, p);
+}
+
+/**
+ * Move the cursor from row to row of the block of lines.
+ */
+static void move_rows(zclk_writer* frame, size_t from, size_t to) {
+	if (to < from) {
+		zclk_writer_printf(frame, "\033[%zuA", from - to);
+	} else if (to > from) {
+		zclk_writer_printf(frame, "\033[%zuB", to - from);
+	}
+}
+
+static int multi_progress_draw(zclk_multi_progress* mp, zclk_writer* writer,
+		int force) {
+	double now = monotonic_ms();
+	if (!force && mp->fps > 0 && mp->last_frame_ms > 0
+			&& now - mp->last_frame_ms < 1000.0 / mp->fps) {
+		return 0;
+	}
+	size_t n = arraylist_length(mp->progress_ls);
+	if (lines_reserve(mp, n) != 0) {
+		return -1;
+	}
+
+	// the cursor is at the start of the line below the drawn lines
+	size_t drawn = (size_t) mp->old_count;
+	size_t row = drawn;
+	zclk_writer_clear(mp->frame);
+	for (size_t i = 0; i < n || i < drawn; i++) {
+		const char* text = "";
+		size_t len = 0;
+		if (i < n) {
+			line_compose(mp->line, arraylist_get(mp->progress_ls, i));
+			text = zclk_writer_get_data(mp->line, &len);
+		}
+		if (i < drawn && len == mp->line_lens[i]
+				&& memcmp(text, mp->lines[i], len) == 0) {
+			continue;
+		}
+		if (line_store(mp, i, text, len) != 0) {
+			return -1;
+		}
+		if (i < drawn) {
+			// lines which are no longer there are cleared
+			move_rows(mp->frame, row, i);
+			row = i;
+			zclk_writer_putc(mp->frame, '\r');
+			zclk_writer_write(mp->frame, text, len);
+			zclk_writer_write(mp->frame, "\033[K", 3);
+		} else {
+			move_rows(mp->frame, row, drawn);
+			zclk_writer_putc(mp->frame, '\r');
+			zclk_writer_write(mp->frame, text, len);
+			zclk_writer_write(mp->frame, "\033[K\n", 4);
+			drawn++;
+			row = drawn;
+		}
+	}
+	size_t frame_len;
+	const char* frame = zclk_writer_get_data(mp->frame, &frame_len);
+	if (frame_len == 0) {
+		return 0;
+	}
+	if (row != drawn) {
+		move_rows(mp->frame, row, drawn);
+		zclk_writer_putc(mp->frame, '\r');
+		frame = zclk_writer_get_data(mp->frame, &frame_len);
+	}
+	mp->old_count = (int) drawn;
+	mp->last_frame_ms = now;
+	if (mp->frame->error || zclk_writer_write(writer, frame, frame_len) != 0
+			|| zclk_writer_flush(writer) != 0) {
+		return -1;
+	}
+	return 1;
+}
+
+
+void zclk_multi_progress_finish(zclk_multi_progress* mp) {
+	mp->finished = 1;
+}
+
+/**
+ * Check if every progress object with a total has reached it (and there
+ * is at least one).
+ */
+static int multi_progress_complete(zclk_multi_progress* mp) {
+	size_t n = arraylist_length(mp->progress_ls);
+	int any = 0;
+	for (size_t i = 0; i < n; i++) {
+		zclk_progress* p = (zclk_progress*) arraylist_get(mp->progress_ls, i);
+		if (p->total > 0) {
+			if (zclk_progress_get(p) < p->total) {
+				return 0;
+			}
+			any = 1;
+		}
+	}
+	return any;
+}
+
+int zclk_multi_progress_render(zclk_multi_progress* mp, zclk_writer* writer,
+		int force) {
+	if (mp == NULL || writer == NULL) {
+		return -1;
+	}
+	if (mp->render_thread != NULL) {
+		// the render thread draws the frames
+		return 0;
+	}
+	force = force || mp->finished || multi_progress_complete(mp);
+	return multi_progress_draw(mp, writer, force);
+}
+
+typedef struct progress_thread_t {
+	zclk_multi_progress* mp;
+	zclk_writer* writer;
+	int interval_ms;
+#ifdef _WIN32
+	HANDLE thread;
+	HANDLE stop_event;
+#else
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t stop_cond;
+	int stop;
+#endif
+} progress_thread;
+
+#ifdef _WIN32
+static DWORD WINAPI render_thread_fn(LPVOID data) {
+	progress_thread* t = (progress_thread*) data;
+	do {
+		multi_progress_draw(t->mp, t->writer, 0);
+	} while (WaitForSingleObject(t->stop_event, (DWORD) t->interval_ms)
+			== WAIT_TIMEOUT);
+	return 0;
+}
+#else
+static void* render_thread_fn(void* data) {
+	progress_thread* t = (progress_thread*) data;
+	pthread_mutex_lock(&t->lock);
+	while (!t->stop) {
+		pthread_mutex_unlock(&t->lock);
+		// a spurious wakeup is held back by the frame rate
+		multi_progress_draw(t->mp, t->writer, 0);
+		pthread_mutex_lock(&t->lock);
+		if (t->stop) {
+			break;
+		}
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += (long) t->interval_ms * 1000000L;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+		pthread_cond_timedwait(&t->stop_cond, &t->lock, &deadline);
+	}
+	pthread_mutex_unlock(&t->lock);
+	return NULL;
+}
+#endif
+
+int zclk_multi_progress_start(zclk_multi_progress* mp, zclk_writer* writer) {
+	if (mp == NULL || writer == NULL || mp->render_thread != NULL) {
+		return -1;
+	}
+	progress_thread* t = (progress_thread*) calloc(1, sizeof(progress_thread));
+	if (t == NULL) {
+		return -1;
+	}
+	t->mp = mp;
+	t->writer = writer;
+	t->interval_ms = 1000 / (mp->fps > 0 ? mp->fps : ZCLK_PROGRESS_DEFAULT_FPS);
+	if (t->interval_ms < 1) {
+		t->interval_ms = 1;
+	}
+#ifdef _WIN32
+	t->stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (t->stop_event == NULL) {
+		free(t);
+		return -1;
+	}
+	t->thread = CreateThread(NULL, 0, render_thread_fn, t, 0, NULL);
+	if (t->thread == NULL) {
+		CloseHandle(t->stop_event);
+		free(t);
+		return -1;
+	}
+#else
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->stop_cond, NULL);
+	if (pthread_create(&t->thread, NULL, render_thread_fn, t) != 0) {
+		pthread_cond_destroy(&t->stop_cond);
+		pthread_mutex_destroy(&t->lock);
+		free(t);
+		return -1;
+	}
+#endif
+	mp->render_thread = t;
+	return 0;
+}
+
+int zclk_multi_progress_stop(zclk_multi_progress* mp) {
+	if (mp == NULL || mp->render_thread == NULL) {
+		return -1;
+	}
+	progress_thread* t = (progress_thread*) mp->render_thread;
+#ifdef _WIN32
+	SetEvent(t->stop_event);
+	WaitForSingleObject(t->thread, INFINITE);
+	CloseHandle(t->thread);
+	CloseHandle(t->stop_event);
+#else
+	pthread_mutex_lock(&t->lock);
+	t->stop = 1;
+	pthread_cond_signal(&t->stop_cond);
+	pthread_mutex_unlock(&t->lock);
+	pthread_join(t->thread, NULL);
+	pthread_cond_destroy(&t->stop_cond);
+	pthread_mutex_destroy(&t->lock);
+#endif
+	mp->render_thread = NULL;
+	// the final frame, whatever the frame rate
+	int res = multi_progress_draw(mp, t->writer, 1);
+	free(t);
+	return res < 0 ? -1 : 0;
+}
@@ -7,6 +7,8 @@
 #define SRC_ZCLK_PROGRESS_H_
 
 #include "zclk_common.h"
+#include "zclk_writer.h"
+#include <stdint.h>
 #include <coll_arraylist.h>
 
 #ifdef __cplusplus  
@@ -17,6 +19,29 @@ extern "C" {
 #define ZCLK_PROGRESS_DEFAULT_BEFORE "["
 #define ZCLK_PROGRESS_DEFAULT_AFTER "]"
 
+/** Default maximum number of frames per second drawn by a multi progress */
+#define ZCLK_PROGRESS_DEFAULT_FPS 30
+
+/** Show the rate of the updates after the bar */
+#define ZCLK_PROGRESS_SHOW_RATE 1
+/** Show the estimated time to reach the total after the bar */
+#define ZCLK_PROGRESS_SHOW_ETA 2
+/** The counter is in bytes, the rate is shown in KiB/s, MiB/s, ... */
+#define ZCLK_PROGRESS_BYTES 4
+/** Show the bar on the line of a multi progress as well */
+#define ZCLK_PROGRESS_SHOW_BAR 8
+
+/** Time after which a rate sample has half of its weight in the average */
+#define ZCLK_PROGRESS_RATE_HALF_LIFE_MS 2000.0
+
+/**
+ * @brief A progress bar.
+ *
+ * The counter can be updated from any thread with zclk_progress_add and
+ * zclk_progress_set. The strings are read when the bar is drawn, so while
+ * a render thread is running they should only be pointed to strings
+ * which stay valid.
+ */
 typedef struct zclk_progress_t {
 	char* name;
 	char* message;
@@ -25,8 +50,12 @@ typedef struct zclk_progress_t {
 	char* before;
 	char* after;
 	char* extra;
-	double current;
+	uint64_t current_bits;	///< double bits, use zclk_progress_get/set/add
 	double total;
+	int flags;				///< ZCLK_PROGRESS_SHOW_* and ZCLK_PROGRESS_BYTES
+	double rate;			///< moving average of the updates per second
+	double sample_ms;		///< time of the last rate sample
+	double sample_value;	///< counter at the last rate sample
 } zclk_progress;
 
 MODULE_API int create_zclk_progress(zclk_progress** progress, char* name, int length,
@@ -34,17 +63,163 @@ MODULE_API int create_zclk_progress(zclk_progress** progress, char* name, int le
 
 MODULE_API void free_zclk_progress(zclk_progress* progress);
 
+/**
+ * @brief Add to the counter of a progress object, from any thread,
+ * without locking.
+ *
+ * @param progress progress object
+ * @param amount amount to add
+ */
+MODULE_API void zclk_progress_add(zclk_progress* progress, double amount);
+
+/**
+ * @brief Set the counter of a progress object, from any thread.
+ *
+ * @param progress progress object
+ * @param value new value
+ */
+MODULE_API void zclk_progress_set(zclk_progress* progress, double value);
+
+/**
+ * @brief Get the counter of a progress object.
+ *
+ * @param progress progress object
+ * @return current value
+ */
+MODULE_API double zclk_progress_get(zclk_progress* progress);
+
+/**
+ * @brief Set what is shown after the bar, and the units of the counter.
+ *
+ * @param progress progress object
+ * @param flags ZCLK_PROGRESS_SHOW_RATE, ZCLK_PROGRESS_SHOW_ETA,
+ * 			ZCLK_PROGRESS_BYTES and ZCLK_PROGRESS_SHOW_BAR or'ed together
+ */
+MODULE_API void zclk_progress_set_flags(zclk_progress* progress, int flags);
+
+/**
+ * @brief Get the rate of the updates, an exponentially weighted moving
+ * average sampled whenever the bar is drawn. (Call it from the thread
+ * which draws the bar.)
+ *
+ * @param progress progress object
+ * @return updates per second, 0 before the first sample
+ */
+MODULE_API double zclk_progress_get_rate(zclk_progress* progress);
+
+/**
+ * @brief Get the estimated time to reach the total at the current rate.
+ *
+ * @param progress progress object
+ * @return seconds, or -1 if it cannot be estimated
+ */
+MODULE_API double zclk_progress_get_eta(zclk_progress* progress);
+
+/**
+ * @brief Write the bar, followed by the rate and ETA if shown, e.g.
+ * [#####     ] 1.5 MiB/s ETA 00:42
+ *
+ * @param writer writer
+ * @param progress progress object
+ */
+MODULE_API void zclk_progress_write_bar(zclk_writer* writer,
+		zclk_progress* progress);
+
+/**
+ * @brief Draw the progress object on the current line of stdout, with one
+ * write.
+ *
+ * @param progress progress object
+ */
 MODULE_API void show_progress(zclk_progress* progress);
 
+/**
+ * @brief A group of progress objects drawn one per line.
+ *
+ * Each line is "name: message extra", followed by the bar of progress
+ * objects with ZCLK_PROGRESS_SHOW_BAR and the rate and ETA if shown.
+ *
+ * Each frame redraws only the lines whose text changed since the last
+ * frame, and goes out in one write. Frames are limited to fps per second,
+ * updates in between are drawn by the next frame.
+ */
 typedef struct zclk_multi_progress_t {
-	int old_count;
-	arraylist* progress_ls;
+	int old_count;			///< number of lines drawn
+	arraylist* progress_ls;	///< progress objects, one per line
+	int fps;				///< max frames per second, 0 for no limit
+	double last_frame_ms;	///< time of the last frame (monotonic)
+	char** lines;			///< text of the drawn lines
+	size_t* line_lens;		///< length of the text of each line
+	size_t* line_caps;		///< size of the buffer of each line
+	size_t lines_cap;		///< size of the lines arrays
+	zclk_writer* frame;		///< frame being composed
+	zclk_writer* line;		///< line being composed
+	void* render_thread;	///< the render thread, NULL if not started
+	int finished;			///< every frame is drawn, see zclk_multi_progress_finish
 } zclk_multi_progress;
 
 MODULE_API int create_zclk_multi_progress(zclk_multi_progress** multi_progress);
 
 MODULE_API void free_zclk_multi_progress(zclk_multi_progress* multi_progress);
 
+/**
+ * @brief Set the maximum number of frames drawn per second.
+ *
+ * @param multi_progress multi progress
+ * @param fps frames per second, 0 to draw every frame
+ */
+MODULE_API void zclk_multi_progress_set_fps(
+		zclk_multi_progress* multi_progress, int fps);
+
+/**
+ * @brief Mark the progress as finished: from now on every frame is drawn
+ * whatever the frame rate, so that the final state is not skipped. Call
+ * it before the last update when frames are drawn with print_handler.
+ *
+ * @param multi_progress multi progress
+ */
+MODULE_API void zclk_multi_progress_finish(
+		zclk_multi_progress* multi_progress);
+
+/**
+ * @brief Draw a frame with the lines which changed since the last frame,
+ * unless the last frame was drawn less than 1/fps seconds ago. Call it
+ * with force after the last update, so that the final state is drawn.
+ * The frame is drawn anyway once the progress is finished (see
+ * zclk_multi_progress_finish) or every progress object with a total has
+ * reached it.
+ *
+ * @param multi_progress multi progress
+ * @param writer writer to the terminal (flushed after the frame)
+ * @param force draw even if the last frame was drawn too recently
+ * @return 1 if a frame was written, 0 if it was skipped or nothing
+ * 			changed, -1 on error
+ */
+MODULE_API int zclk_multi_progress_render(zclk_multi_progress* multi_progress,
+		zclk_writer* writer, int force);
+
+/**
+ * @brief Start a thread which draws the progress objects fps times a
+ * second (ZCLK_PROGRESS_DEFAULT_FPS if fps is 0), until stopped. While it
+ * runs, the writer belongs to it, zclk_multi_progress_render does
+ * nothing, and no progress object may be added or removed.
+ *
+ * @param multi_progress multi progress
+ * @param writer writer to the terminal
+ * @return 0 on success, -1 on error or if already started
+ */
+MODULE_API int zclk_multi_progress_start(zclk_multi_progress* multi_progress,
+		zclk_writer* writer);
+
+/**
+ * @brief Stop the render thread, after which the final state of every
+ * progress object is drawn and flushed.
+ *
+ * @param multi_progress multi progress
+ * @return 0 on success, -1 on error or if not started
+ */
+MODULE_API int zclk_multi_progress_stop(zclk_multi_progress* multi_progress);
+
 #ifdef __cplusplus 
 }
 #endif
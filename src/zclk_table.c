@@ -6,7 +6,11 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include "zclk_table.h"
+#include "zclk_number.h"
+#include "zclk_encode.h"
 
 int create_zclk_table(zclk_table** table, size_t num_rows, size_t num_cols) {
 	(*table) = (zclk_table*) calloc(1, sizeof(zclk_table));
@@ -16,36 +20,40 @@ int create_zclk_table(zclk_table** table, size_t num_rows, size_t num_cols) {
 	(*table)->num_cols = num_cols;
 	(*table)->num_rows = num_rows;
 	(*table)->header = (char**) calloc(num_cols, sizeof(char*));
-	for (int i = 0; i < num_cols; i++) {
-		(*table)->header[i] = NULL;
-	}
-	(*table)->values = (char***) calloc(num_rows, sizeof(char**));
-	for (int i = 0; i < num_rows; i++) {
-		(*table)->values[i] = (char**) calloc(num_cols, sizeof(char*));
-		for (int j = 0; j < num_cols; j++) {
-			(*table)->values[i][j] = NULL;
-		}
+	(*table)->columns = (zclk_table_column*) calloc(num_cols,
+			sizeof(zclk_table_column));
+	if (!(*table)->header || !(*table)->columns) {
+		free_zclk_table(*table);
+		(*table) = NULL;
+		return 1;
 	}
 	return 0;
 }
 
 void free_zclk_table(zclk_table* table) {
-	for (size_t i = 0; i < table->num_cols; i++) {
-		free(table->header[i]);
+	if (table == NULL) {
+		return;
+	}
+	if (table->header != NULL) {
+		for (size_t i = 0; i < table->num_cols; i++) {
+			free(table->header[i]);
+		}
 	}
 	free(table->header);
-	for (size_t i = 0; i < table->num_rows; i++) {
-		for (size_t j = 0; j < table->num_cols; j++) {
-			free(table->values[i][j]);
+	if (table->columns != NULL) {
+		for (size_t i = 0; i < table->num_cols; i++) {
+			free(table->columns[i].data);
+			free(table->columns[i].offsets);
+			free(table->columns[i].native);
 		}
-		free(table->values[i]);
 	}
-	free(table->values);
+	free(table->columns);
 	free(table);
 }
 
 int zclk_table_set_header(zclk_table* table, size_t col_id, char* name) {
 	if (col_id >= 0 && col_id < table->num_cols) {
+		free(table->header[col_id]);
 		table->header[col_id] = zclk_str_clone(name);
 		return 0;
 	} else {
@@ -53,11 +61,287 @@ int zclk_table_set_header(zclk_table* table, size_t col_id, char* name) {
 	}
 }
 
+/**
+ * Decode the UTF-8 character at str, returning its length in bytes (1 for
+ * an invalid byte, with cp set to -1).
+ */
+static size_t utf8_decode(const unsigned char* str, size_t len, long* cp) {
+	unsigned char c = str[0];
+	size_t n;
+	long v;
+	if (c < 0x80) {
+		(*cp) = c;
+		return 1;
+	} else if (c >= 0xC2 && c <= 0xDF) {
+		n = 2;
+		v = c & 0x1F;
+	} else if (c >= 0xE0 && c <= 0xEF) {
+		n = 3;
+		v = c & 0x0F;
+	} else if (c >= 0xF0 && c <= 0xF4) {
+		n = 4;
+		v = c & 0x07;
+	} else {
+		(*cp) = -1;
+		return 1;
+	}
+	if (n > len) {
+		(*cp) = -1;
+		return 1;
+	}
+	for (size_t i = 1; i < n; i++) {
+		if ((str[i] & 0xC0) != 0x80) {
+			(*cp) = -1;
+			return 1;
+		}
+		v = (v << 6) | (str[i] & 0x3F);
+	}
+	(*cp) = v;
+	return n;
+}
+
+/**
+ * Terminal columns taken by a code point: 0 for combining marks and
+ * zero width characters, 2 for East Asian wide and fullwidth characters.
+ */
+static int char_width(long cp) {
+	if (cp < 0x300) {
+		return 1;
+	}
+	if ((cp >= 0x0300 && cp <= 0x036F) || (cp >= 0x200B && cp <= 0x200F)
+			|| (cp >= 0x20D0 && cp <= 0x20FF)
+			|| (cp >= 0xFE00 && cp <= 0xFE0F)
+			|| (cp >= 0xFE20 && cp <= 0xFE2F)) {
+		return 0;
+	}
+	if ((cp >= 0x1100 && cp <= 0x115F) || (cp >= 0x2E80 && cp <= 0x303E)
+			|| (cp >= 0x3041 && cp <= 0x33FF)
+			|| (cp >= 0x3400 && cp <= 0x4DBF)
+			|| (cp >= 0x4E00 && cp <= 0x9FFF)
+			|| (cp >= 0xA000 && cp <= 0xA4CF)
+			|| (cp >= 0xAC00 && cp <= 0xD7A3)
+			|| (cp >= 0xF900 && cp <= 0xFAFF)
+			|| (cp >= 0xFE30 && cp <= 0xFE4F)
+			|| (cp >= 0xFF00 && cp <= 0xFF60)
+			|| (cp >= 0xFFE0 && cp <= 0xFFE6)
+			|| (cp >= 0x1F300 && cp <= 0x1F64F)
+			|| (cp >= 0x1F900 && cp <= 0x1F9FF)
+			|| (cp >= 0x20000 && cp <= 0x3FFFD)) {
+		return 2;
+	}
+	return 1;
+}
+
+/**
+ * Length of the leading run of ASCII bytes, 8 bytes at a time.
+ */
+static size_t ascii_prefix(const char* str, size_t len) {
+	size_t i = 0;
+	while (i + 8 <= len) {
+		uint64_t chunk;
+		memcpy(&chunk, str + i, 8);
+		if (chunk & 0x8080808080808080ULL) {
+			break;
+		}
+		i += 8;
+	}
+	while (i < len && !(str[i] & 0x80)) {
+		i++;
+	}
+	return i;
+}
+
+/**
+ * Find the longest prefix of str which fits in width columns.
+ * Returns its length in bytes, and its display width in prefix_width.
+ */
+static size_t display_prefix(const char* str, size_t len, size_t width,
+		size_t* prefix_width) {
+	size_t i = ascii_prefix(str, len);
+	if (i >= width) {
+		(*prefix_width) = width;
+		return width;
+	}
+	size_t w = i;
+	while (i < len) {
+		long cp;
+		size_t n = utf8_decode((const unsigned char*) str + i, len - i, &cp);
+		int cw = cp < 0 ? 1 : char_width(cp);
+		if (w + cw > width) {
+			break;
+		}
+		w += cw;
+		i += n;
+	}
+	(*prefix_width) = w;
+	return i;
+}
+
+size_t zclk_table_display_width(const char* str, size_t len) {
+	if (str == NULL) {
+		return 0;
+	}
+	size_t w;
+	display_prefix(str, len, (size_t) -1, &w);
+	return w;
+}
+
+/**
+ * Format a value of a typed column, returning its length.
+ */
+static size_t column_format_native(zclk_table_column* col, size_t row_id,
+		char* buf, size_t size) {
+	int n;
+	if (col->type == ZCLK_TABLE_COL_INT) {
+		n = snprintf(buf, size, "%lld",
+				(long long) ((int64_t*) col->native)[row_id]);
+	} else {
+		// the shortest of 15 to 17 digits which reads back as the value
+		double value = ((double*) col->native)[row_id];
+		for (int digits = 15; digits <= 17; digits++) {
+			n = snprintf(buf, size, "%.*g", digits, value);
+			if (n < 0 || value != value || strtod(buf, NULL) == value) {
+				break;
+			}
+		}
+	}
+	return n < 0 ? 0 : (size_t) n;
+}
+
+/**
+ * Display width of a cell of the column, 0 if it is not set.
+ */
+static size_t column_cell_width(zclk_table_column* col, size_t row_id) {
+	if (col->type == ZCLK_TABLE_COL_STRING) {
+		if (col->offsets == NULL || col->offsets[row_id] == 0) {
+			return 0;
+		}
+		return zclk_table_display_width(
+				col->data + col->offsets[row_id] - 1, col->lengths[row_id]);
+	}
+	if (col->native == NULL || !col->is_set[row_id]) {
+		return 0;
+	}
+	char buf[ZCLK_TABLE_NUM_STR_SIZE];
+	return column_format_native(col, row_id, buf, sizeof(buf));
+}
+
+/**
+ * Account for a cell being replaced by a value of the given width. The
+ * max is recomputed lazily when the widest cell gets narrower.
+ */
+static void column_update_width(zclk_table_column* col, size_t old_width,
+		size_t new_width) {
+	if (new_width > col->max_width) {
+		col->max_width = new_width;
+	} else if (old_width == col->max_width && new_width < old_width) {
+		col->width_dirty = 1;
+	}
+}
+
+/**
+ * Allocate the offsets and lengths of a string column (in one block).
+ */
+static int column_index_alloc(zclk_table_column* col, size_t num_rows) {
+	if (col->offsets == NULL) {
+		size_t size = num_rows * 2 * sizeof(uint32_t);
+		col->offsets = (uint32_t*) calloc(1, size == 0 ? 1 : size);
+		if (col->offsets == NULL) {
+			return -1;
+		}
+		col->lengths = (uint32_t*) (col->offsets + num_rows);
+	}
+	return 0;
+}
+
+/**
+ * Allocate the native values and set flags of a typed column
+ * (in one block).
+ */
+static int column_native_alloc(zclk_table_column* col, size_t num_rows) {
+	if (col->native == NULL) {
+		size_t size = num_rows * (sizeof(int64_t) + 1);
+		col->native = calloc(1, size == 0 ? 1 : size);
+		if (col->native == NULL) {
+			return -1;
+		}
+		col->is_set = (unsigned char*) ((int64_t*) col->native + num_rows);
+	}
+	return 0;
+}
+
+static int column_set_string(zclk_table_column* col, size_t num_rows,
+		size_t row_id, const char* value) {
+	if (column_index_alloc(col, num_rows) != 0) {
+		return -1;
+	}
+	size_t old_width = column_cell_width(col, row_id);
+	if (value == NULL) {
+		col->offsets[row_id] = 0;
+		col->lengths[row_id] = 0;
+		column_update_width(col, old_width, 0);
+		return 0;
+	}
+	size_t len = strlen(value);
+	if (len + 1 >= UINT32_MAX - col->data_len) {
+		return -1;
+	}
+	if (col->data_cap - col->data_len < len + 1) {
+		// the value can be a string of this column, which moves
+		int in_data = (col->data != NULL && value >= col->data
+				&& value < col->data + col->data_len);
+		size_t value_offset = in_data ? (size_t) (value - col->data) : 0;
+		size_t cap = col->data_cap == 0 ? 256 : col->data_cap;
+		while (cap - col->data_len < len + 1) {
+			cap *= 2;
+		}
+		char* data = (char*) realloc(col->data, cap);
+		if (data == NULL) {
+			return -1;
+		}
+		col->data = data;
+		col->data_cap = cap;
+		if (in_data) {
+			value = col->data + value_offset;
+		}
+	}
+	memcpy(col->data + col->data_len, value, len + 1);
+	col->offsets[row_id] = (uint32_t) (col->data_len + 1);
+	col->lengths[row_id] = (uint32_t) len;
+	col->data_len += len + 1;
+	column_update_width(col, old_width,
+			zclk_table_display_width(value, len));
+	return 0;
+}
+
 int zclk_table_set_row_val(zclk_table* table, size_t row_id, size_t col_id, char* value) {
 	if (col_id >= 0 && col_id < table->num_cols && row_id >= 0
 			&& row_id < table->num_rows) {
-		table->values[row_id][col_id] = zclk_str_clone(value);
-		return 0;
+		zclk_table_column* col = &table->columns[col_id];
+		if (col->type == ZCLK_TABLE_COL_STRING) {
+			return column_set_string(col, table->num_rows, row_id, value);
+		}
+		if (value == NULL) {
+			if (column_native_alloc(col, table->num_rows) != 0) {
+				return -1;
+			}
+			column_update_width(col, column_cell_width(col, row_id), 0);
+			col->is_set[row_id] = 0;
+			return 0;
+		}
+		if (col->type == ZCLK_TABLE_COL_INT) {
+			int64_t v;
+			if (zclk_parse_int64(value, &v) != ZCLK_NUMBER_OK) {
+				return -1;
+			}
+			return zclk_table_set_row_int(table, row_id, col_id, v);
+		} else {
+			double v;
+			if (zclk_parse_double(value, &v) != ZCLK_NUMBER_OK) {
+				return -1;
+			}
+			return zclk_table_set_row_double(table, row_id, col_id, v);
+		}
 	} else {
 		return -1;
 	}
@@ -71,13 +355,384 @@ int zclk_table_get_header(char** name, zclk_table* table, size_t col_id) {
 	return -1;
 }
 
+int zclk_table_format_row_val(const char** value, size_t* len,
+	char* buf, zclk_table* table, size_t row_id, size_t col_id) {
+	if (col_id >= table->num_cols || row_id >= table->num_rows) {
+		return -1;
+	}
+	zclk_table_column* col = &table->columns[col_id];
+	(*value) = NULL;
+	(*len) = 0;
+	if (col->type == ZCLK_TABLE_COL_STRING) {
+		if (col->offsets != NULL && col->offsets[row_id] != 0) {
+			(*value) = col->data + col->offsets[row_id] - 1;
+			(*len) = col->lengths[row_id];
+		}
+	} else if (col->native != NULL && col->is_set[row_id]) {
+		(*len) = column_format_native(col, row_id, buf,
+				ZCLK_TABLE_NUM_STR_SIZE);
+		(*value) = buf;
+	}
+	return 0;
+}
+
+int zclk_table_get_row_val_len(const char** value, size_t* len,
+	zclk_table* table, size_t row_id, size_t col_id) {
+	return zclk_table_format_row_val(value, len, table->num_str, table,
+			row_id, col_id);
+}
+
 int zclk_table_get_row_val(char** value, zclk_table* table, size_t row_id,
 	size_t col_id) {
-	if (col_id >= 0 && col_id < table->num_cols && row_id >= 0
-			&& row_id < table->num_rows) {
-		(*value) = table->values[row_id][col_id];
-		return 0;
+	size_t len;
+	return zclk_table_get_row_val_len((const char**) value, &len, table,
+			row_id, col_id);
+}
+
+int zclk_table_get_col_width(size_t* width, zclk_table* table,
+	size_t col_id) {
+	if (col_id >= table->num_cols) {
+		return -1;
 	}
-	return -1;
+	zclk_table_column* col = &table->columns[col_id];
+	if (col->width_dirty) {
+		col->max_width = 0;
+		for (size_t i = 0; i < table->num_rows; i++) {
+			size_t w = column_cell_width(col, i);
+			if (w > col->max_width) {
+				col->max_width = w;
+			}
+		}
+		col->width_dirty = 0;
+	}
+	size_t header_width = table->header[col_id] == NULL ? 0
+			: zclk_table_display_width(table->header[col_id],
+					strlen(table->header[col_id]));
+	(*width) = header_width > col->max_width ? header_width : col->max_width;
+	return 0;
+}
+
+int zclk_table_get_col_render_width(size_t* width, zclk_table* table,
+	size_t col_id) {
+	if (zclk_table_get_col_width(width, table, col_id) != 0) {
+		return -1;
+	}
+	if ((*width) < ZCLK_TABLE_MIN_COL_WIDTH) {
+		(*width) = ZCLK_TABLE_MIN_COL_WIDTH;
+	}
+	if ((*width) > ZCLK_TABLE_MAX_COL_WIDTH) {
+		(*width) = ZCLK_TABLE_MAX_COL_WIDTH;
+	}
+	return 0;
+}
+
+int zclk_table_set_col_type(zclk_table* table, size_t col_id,
+	zclk_table_col_type type) {
+	if (col_id >= table->num_cols) {
+		return -1;
+	}
+	zclk_table_column* col = &table->columns[col_id];
+	if (col->offsets != NULL || col->native != NULL) {
+		return -1;
+	}
+	col->type = type;
+	return 0;
+}
+
+int zclk_table_set_row_int(zclk_table* table, size_t row_id,
+	size_t col_id, int64_t value) {
+	if (col_id >= table->num_cols || row_id >= table->num_rows
+			|| table->columns[col_id].type != ZCLK_TABLE_COL_INT
+			|| column_native_alloc(&table->columns[col_id],
+					table->num_rows) != 0) {
+		return -1;
+	}
+	zclk_table_column* col = &table->columns[col_id];
+	size_t old_width = column_cell_width(col, row_id);
+	((int64_t*) col->native)[row_id] = value;
+	col->is_set[row_id] = 1;
+	column_update_width(col, old_width, column_cell_width(col, row_id));
+	return 0;
+}
+
+int zclk_table_set_row_double(zclk_table* table, size_t row_id,
+	size_t col_id, double value) {
+	if (col_id >= table->num_cols || row_id >= table->num_rows
+			|| table->columns[col_id].type != ZCLK_TABLE_COL_DOUBLE
+			|| column_native_alloc(&table->columns[col_id],
+					table->num_rows) != 0) {
+		return -1;
+	}
+	zclk_table_column* col = &table->columns[col_id];
+	size_t old_width = column_cell_width(col, row_id);
+	((double*) col->native)[row_id] = value;
+	col->is_set[row_id] = 1;
+	column_update_width(col, old_width, column_cell_width(col, row_id));
+	return 0;
+}
+
+int zclk_table_get_row_int(int64_t* value, zclk_table* table,
+	size_t row_id, size_t col_id) {
+	if (col_id >= table->num_cols || row_id >= table->num_rows) {
+		return -1;
+	}
+	zclk_table_column* col = &table->columns[col_id];
+	if (col->type != ZCLK_TABLE_COL_INT || col->native == NULL
+			|| !col->is_set[row_id]) {
+		return -1;
+	}
+	(*value) = ((int64_t*) col->native)[row_id];
+	return 0;
 }
 
+int zclk_table_get_row_double(double* value, zclk_table* table,
+	size_t row_id, size_t col_id) {
+	if (col_id >= table->num_cols || row_id >= table->num_rows) {
+		return -1;
+	}
+	zclk_table_column* col = &table->columns[col_id];
+	if (col->type != ZCLK_TABLE_COL_DOUBLE || col->native == NULL
+			|| !col->is_set[row_id]) {
+		return -1;
+	}
+	(*value) = ((double*) col->native)[row_id];
+	return 0;
+}
+
+void zclk_table_write_cell(zclk_writer* writer, const char* value,
+		size_t width) {
+	zclk_table_write_cell_len(writer, value,
+			value == NULL ? 0 : strlen(value), width);
+}
+
+void zclk_table_write_cell_len(zclk_writer* writer, const char* value,
+		size_t len, size_t width) {
+	size_t value_width = 0;
+	if (value != NULL) {
+		len = display_prefix(value, len, width, &value_width);
+		zclk_writer_write(writer, value, len);
+	}
+	zclk_writer_fill(writer, ' ', width + 1 - value_width);
+}
+
+int create_zclk_table_stream(zclk_table_stream** stream, zclk_writer* writer,
+		size_t num_cols, size_t sample_rows) {
+	(*stream) = (zclk_table_stream*) calloc(1, sizeof(zclk_table_stream));
+	if (!(*stream)) {
+		return -1;
+	}
+	(*stream)->writer = writer;
+	(*stream)->num_cols = num_cols;
+	(*stream)->sample_rows = sample_rows;
+	(*stream)->header = (char**) calloc(num_cols, sizeof(char*));
+	(*stream)->col_widths = (size_t*) calloc(num_cols, sizeof(size_t));
+	if (sample_rows > 0) {
+		(*stream)->pending = (char***) calloc(sample_rows, sizeof(char**));
+	}
+	if (!(*stream)->header || !(*stream)->col_widths
+			|| (sample_rows > 0 && !(*stream)->pending)) {
+		free_zclk_table_stream(*stream);
+		(*stream) = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+void free_zclk_table_stream(zclk_table_stream* stream) {
+	if (stream != NULL) {
+		if (stream->header != NULL) {
+			for (size_t i = 0; i < stream->num_cols; i++) {
+				free(stream->header[i]);
+			}
+		}
+		if (stream->pending != NULL) {
+			for (size_t i = 0; i < stream->num_pending; i++) {
+				free(stream->pending[i]);
+			}
+		}
+		free(stream->header);
+		free(stream->col_widths);
+		free(stream->pending);
+		free(stream);
+	}
+}
+
+int zclk_table_stream_set_header(zclk_table_stream* stream, size_t col_id,
+		const char* name) {
+	if (stream == NULL || stream->started || stream->num_rows > 0
+			|| col_id >= stream->num_cols) {
+		return -1;
+	}
+	free(stream->header[col_id]);
+	stream->header[col_id] = zclk_str_clone(name);
+	return 0;
+}
+
+int zclk_table_stream_set_col_width(zclk_table_stream* stream, size_t col_id,
+		size_t width) {
+	if (stream == NULL || stream->started || stream->num_rows > 0
+			|| col_id >= stream->num_cols || width == 0) {
+		return -1;
+	}
+	stream->col_widths[col_id] = width;
+	return 0;
+}
+
+int zclk_table_stream_set_format(zclk_table_stream* stream, int format) {
+	if (stream == NULL || stream->started || stream->num_rows > 0
+			|| zclk_output_format_name((zclk_output_format) format) == NULL) {
+		return -1;
+	}
+	stream->format = format;
+	return 0;
+}
+
+static void stream_write_row(zclk_table_stream* stream, const char** values) {
+	for (size_t j = 0; j < stream->num_cols; j++) {
+		zclk_table_write_cell(stream->writer, values[j],
+				stream->col_widths[j]);
+	}
+	zclk_writer_putc(stream->writer, '\n');
+}
+
+/**
+ * Fix the widths of the columns which were not declared, from the header
+ * and the sampled rows, and write the header and the sampled rows.
+ */
+static void stream_start(zclk_table_stream* stream) {
+	for (size_t j = 0; j < stream->num_cols; j++) {
+		if (stream->col_widths[j] > 0) {
+			continue;
+		}
+		size_t width = stream->header[j] == NULL ? 0
+				: zclk_table_display_width(stream->header[j],
+						strlen(stream->header[j]));
+		for (size_t i = 0; i < stream->num_pending; i++) {
+			char* value = stream->pending[i][j];
+			size_t value_width = value == NULL ? 0
+					: zclk_table_display_width(value, strlen(value));
+			if (value_width > width) {
+				width = value_width;
+			}
+		}
+		if (width < ZCLK_TABLE_MIN_COL_WIDTH) {
+			width = ZCLK_TABLE_MIN_COL_WIDTH;
+		}
+		if (width > ZCLK_TABLE_MAX_COL_WIDTH) {
+			width = ZCLK_TABLE_MAX_COL_WIDTH;
+		}
+		stream->col_widths[j] = width;
+	}
+
+	zclk_writer_putc(stream->writer, '\n');
+	size_t line_width = 0;
+	for (size_t j = 0; j < stream->num_cols; j++) {
+		zclk_table_write_cell(stream->writer, stream->header[j],
+				stream->col_widths[j]);
+		line_width += stream->col_widths[j] + 1;
+	}
+	zclk_writer_putc(stream->writer, '\n');
+	zclk_writer_fill(stream->writer, '-', line_width);
+	zclk_writer_putc(stream->writer, '\n');
+
+	for (size_t i = 0; i < stream->num_pending; i++) {
+		stream_write_row(stream, (const char**) stream->pending[i]);
+		free(stream->pending[i]);
+	}
+	stream->num_pending = 0;
+	stream->started = 1;
+}
+
+/**
+ * Copy a row into one block: the cell pointers followed by the strings.
+ */
+static char** stream_copy_row(zclk_table_stream* stream, const char** values) {
+	size_t size = stream->num_cols * sizeof(char*);
+	for (size_t j = 0; j < stream->num_cols; j++) {
+		if (values[j] != NULL) {
+			size += strlen(values[j]) + 1;
+		}
+	}
+	char** row = (char**) malloc(size);
+	if (row == NULL) {
+		return NULL;
+	}
+	char* str = (char*) (row + stream->num_cols);
+	for (size_t j = 0; j < stream->num_cols; j++) {
+		if (values[j] == NULL) {
+			row[j] = NULL;
+		} else {
+			size_t len = strlen(values[j]) + 1;
+			memcpy(str, values[j], len);
+			row[j] = str;
+			str += len;
+		}
+	}
+	return row;
+}
+
+int zclk_table_stream_push_row(zclk_table_stream* stream,
+		const char** values) {
+	if (stream == NULL || values == NULL) {
+		return -1;
+	}
+	if (stream->format != ZCLK_OUTPUT_TABLE) {
+		// encoded rows need no widths
+		zclk_encode_row(stream->writer, (zclk_output_format) stream->format,
+				stream->header, stream->num_cols, values, stream->num_rows);
+		stream->num_rows += 1;
+		return stream->writer->error ? -1 : 0;
+	}
+	if (!stream->started) {
+		int declared = 1;
+		for (size_t j = 0; j < stream->num_cols; j++) {
+			declared = declared && stream->col_widths[j] > 0;
+		}
+		if (declared || stream->sample_rows == 0) {
+			stream_start(stream);
+		}
+	}
+	if (stream->started) {
+		stream_write_row(stream, values);
+	} else {
+		char** row = stream_copy_row(stream, values);
+		if (row == NULL) {
+			return -1;
+		}
+		stream->pending[stream->num_pending++] = row;
+		if (stream->num_pending == stream->sample_rows) {
+			// show the first rows as soon as the widths are known
+			stream_start(stream);
+			zclk_writer_flush(stream->writer);
+		}
+	}
+	stream->num_rows += 1;
+	return stream->writer->error ? -1 : 0;
+}
+
+int zclk_table_stream_flush(zclk_table_stream* stream) {
+	if (stream == NULL) {
+		return -1;
+	}
+	if (!stream->started && stream->format == ZCLK_OUTPUT_TABLE) {
+		stream_start(stream);
+	}
+	return zclk_writer_flush(stream->writer);
+}
+
+int zclk_table_stream_finish(zclk_table_stream* stream) {
+	if (stream == NULL) {
+		return -1;
+	}
+	if (stream->format != ZCLK_OUTPUT_TABLE) {
+		zclk_encode_rows_end(stream->writer,
+				(zclk_output_format) stream->format, stream->header,
+				stream->num_cols, stream->num_rows);
+		return zclk_writer_flush(stream->writer);
+	}
+	if (!stream->started) {
+		stream_start(stream);
+	}
+	zclk_writer_putc(stream->writer, '\n');
+	return zclk_writer_flush(stream->writer);
+}
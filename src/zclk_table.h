@@ -7,17 +7,68 @@
 #define SRC_ZCLK_TABLE_H_
 
 #include "zclk_common.h"
+#include "zclk_writer.h"
 #include <stdlib.h>
+#include <stdint.h>
 
 #ifdef __cplusplus  
 extern "C" {
 #endif
 
+/** Columns are at least this wide when rendered */
+#define ZCLK_TABLE_MIN_COL_WIDTH 4
+
+/** Longer values are truncated to this width when rendered */
+#define ZCLK_TABLE_MAX_COL_WIDTH 25
+
+/** Default number of rows a table stream samples to fix the widths */
+#define ZCLK_TABLE_STREAM_SAMPLE_ROWS 100
+
+/** Rows formatted by a worker at a time when a table is written in parallel */
+#define ZCLK_TABLE_RENDER_CHUNK_ROWS 4096
+
+/** Size of a buffer an int or double value is formatted into */
+#define ZCLK_TABLE_NUM_STR_SIZE 32
+
+/**
+ * @brief Types of the values of a table column.
+ */
+typedef enum {
+	ZCLK_TABLE_COL_STRING = 0,	///< strings, kept in the string arena
+	ZCLK_TABLE_COL_INT = 1,		///< int64_t values, formatted when read
+	ZCLK_TABLE_COL_DOUBLE = 2	///< double values, formatted to round-trip when read
+} zclk_table_col_type;
+
+/**
+ * @brief The values of one column of a table.
+ *
+ * The strings of a column are packed one after the other in a single
+ * arena (of up to 4 GiB), and located by offset, so that a column of n rows
+ * takes a few allocations instead of n. Setting a cell again appends the
+ * new value, the space of the old one is not reused.
+ */
+typedef struct zclk_table_column_t {
+	zclk_table_col_type type;	///< type of the values
+	char* data;				///< string arena (NUL terminated values)
+	size_t data_len;		///< bytes used in the arena
+	size_t data_cap;		///< size of the arena
+	uint32_t* offsets;		///< offset + 1 of each value, 0 if not set
+	uint32_t* lengths;		///< length of each value
+	void* native;			///< int64_t/double of each row (typed columns)
+	unsigned char* is_set;	///< rows of a typed column which have a value
+	size_t max_width;		///< display width of the widest value
+	int width_dirty;		///< the widest value was overwritten
+} zclk_table_column;
+
+/**
+ * @brief A table result, stored column by column.
+ */
 typedef struct zclk_table_t {
-	size_t num_rows;
-	size_t num_cols;
-	char** header;
-	char*** values;
+	size_t num_rows;			///< number of rows
+	size_t num_cols;			///< number of columns
+	char** header;				///< column names
+	zclk_table_column* columns;	///< values of each column
+	char num_str[ZCLK_TABLE_NUM_STR_SIZE];	///< typed value formatted by the last get
 } zclk_table;
 
 MODULE_API int create_zclk_table(zclk_table** table, size_t num_rows, size_t num_cols);
@@ -26,14 +77,262 @@ MODULE_API void free_zclk_table(zclk_table* table);
 
 MODULE_API int zclk_table_set_header(zclk_table* table, size_t col_id, char* name);
 
+/**
+ * @brief Set a value. The value is copied into the column (a string is
+ * parsed for an int or double column).
+ *
+ * @return 0 on success, -1 on error
+ */
 MODULE_API int zclk_table_set_row_val(zclk_table* table, size_t row_id, size_t col_id,
 		char* value);
 
 MODULE_API int zclk_table_get_header(char** name, zclk_table* table, size_t col_id);
 
+/**
+ * @brief Get a value as a string. The string of a string column is valid
+ * until a value of the same column is set, the string of an int or double
+ * column is formatted into the table and valid until the next get.
+ *
+ * @return 0 on success, -1 on error
+ */
 MODULE_API int zclk_table_get_row_val(char** value, zclk_table* table, size_t row_id,
 	size_t col_id);
 
+/**
+ * @brief Get a value as a string, along with its length.
+ * @see zclk_table_get_row_val
+ *
+ * @param value value (NULL if not set)
+ * @param len length of the value (0 if not set)
+ * @param table table
+ * @param row_id row
+ * @param col_id column
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_get_row_val_len(const char** value, size_t* len,
+	zclk_table* table, size_t row_id, size_t col_id);
+
+/**
+ * @brief Get a value as a string, formatting an int or double value into
+ * the given buffer instead of the table. Unlike the other getters, this
+ * can be called from many threads at once (while no value is being set).
+ *
+ * @param value value (NULL if not set)
+ * @param len length of the value (0 if not set)
+ * @param buf buffer of ZCLK_TABLE_NUM_STR_SIZE chars
+ * @param table table
+ * @param row_id row
+ * @param col_id column
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_format_row_val(const char** value, size_t* len,
+	char* buf, zclk_table* table, size_t row_id, size_t col_id);
+
+/**
+ * @brief Get the display width of the widest of the header and the values
+ * of a column (before the min/max column widths are applied). The width
+ * is kept up to date as cells are set.
+ *
+ * @param width display width
+ * @param table table
+ * @param col_id column
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_get_col_width(size_t* width, zclk_table* table,
+	size_t col_id);
+
+/**
+ * @brief Get the width of a column when the table is rendered, i.e. the
+ * display width clamped to ZCLK_TABLE_MIN_COL_WIDTH and
+ * ZCLK_TABLE_MAX_COL_WIDTH.
+ *
+ * @param width rendered width
+ * @param table table
+ * @param col_id column
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_get_col_render_width(size_t* width,
+	zclk_table* table, size_t col_id);
+
+/**
+ * @brief Get the number of terminal columns taken by a UTF-8 string.
+ * East Asian wide characters take 2 columns, combining marks none, and
+ * invalid bytes 1 each.
+ *
+ * @param str string
+ * @param len length of the string in bytes
+ * @return display width
+ */
+MODULE_API size_t zclk_table_display_width(const char* str, size_t len);
+
+/**
+ * @brief Set the type of a column, before any of its values is set.
+ *
+ * @param table table
+ * @param col_id column
+ * @param type type of the values
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_set_col_type(zclk_table* table, size_t col_id,
+	zclk_table_col_type type);
+
+/**
+ * @brief Set a value of an int column.
+ *
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_set_row_int(zclk_table* table, size_t row_id,
+	size_t col_id, int64_t value);
+
+/**
+ * @brief Set a value of a double column.
+ *
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_set_row_double(zclk_table* table, size_t row_id,
+	size_t col_id, double value);
+
+/**
+ * @brief Get a value of an int column.
+ *
+ * @return 0 on success, -1 on error (or if the value is not set)
+ */
+MODULE_API int zclk_table_get_row_int(int64_t* value, zclk_table* table,
+	size_t row_id, size_t col_id);
+
+/**
+ * @brief Get a value of a double column.
+ *
+ * @return 0 on success, -1 on error (or if the value is not set)
+ */
+MODULE_API int zclk_table_get_row_double(double* value, zclk_table* table,
+	size_t row_id, size_t col_id);
+
+/**
+ * @brief Write a cell truncated to width display columns (at a character
+ * boundary), and padded with spaces to width + 1 columns.
+ *
+ * @param writer writer
+ * @param value value of the cell (NULL is written as empty)
+ * @param width width of the column
+ */
+MODULE_API void zclk_table_write_cell(zclk_writer* writer, const char* value,
+		size_t width);
+
+/**
+ * @brief Write a cell of known length.
+ * @see zclk_table_write_cell
+ */
+MODULE_API void zclk_table_write_cell_len(zclk_writer* writer,
+		const char* value, size_t len, size_t width);
+
+/**
+ * @brief A table which is written as its rows are pushed.
+ *
+ * The column widths are fixed from the header and the first sample_rows
+ * rows (which are held until then), or from the widths declared for all
+ * columns. Every row after that is written straight to the writer, so
+ * the memory used does not grow with the number of rows. Values wider
+ * than their column are truncated.
+ *
+ * Rows can be written as JSON, CSV or NDJSON instead, as they are pushed,
+ * see zclk_table_stream_set_format.
+ */
+typedef struct zclk_table_stream_t {
+	zclk_writer* writer;	///< sink of the table
+	size_t num_cols;		///< number of columns
+	char** header;			///< column names
+	size_t* col_widths;		///< declared (or fixed) widths, 0 if not set
+	size_t sample_rows;		///< rows sampled to fix the widths
+	char*** pending;		///< sampled rows, not written yet
+	size_t num_pending;		///< number of sampled rows
+	size_t num_rows;		///< number of rows pushed
+	int started;			///< header is written and widths are fixed
+	int format;				///< zclk_output_format of the rows (table)
+} zclk_table_stream;
+
+/**
+ * @brief Create a table stream.
+ *
+ * @param stream stream to create
+ * @param writer sink of the table
+ * @param num_cols number of columns
+ * @param sample_rows rows to sample before fixing the widths
+ * 			(0 to fix them from the header and declared widths)
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int create_zclk_table_stream(zclk_table_stream** stream,
+		zclk_writer* writer, size_t num_cols, size_t sample_rows);
+
+/**
+ * @brief Free a table stream (rows not written yet are dropped).
+ *
+ * @param stream stream
+ */
+MODULE_API void free_zclk_table_stream(zclk_table_stream* stream);
+
+/**
+ * @brief Set the name of a column, before the first row is pushed.
+ *
+ * @param stream stream
+ * @param col_id column
+ * @param name name (cloned)
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_stream_set_header(zclk_table_stream* stream,
+		size_t col_id, const char* name);
+
+/**
+ * @brief Declare the width of a column, before the first row is pushed.
+ * Once all columns have a width rows are written without sampling.
+ *
+ * @param stream stream
+ * @param col_id column
+ * @param width width of the column
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_stream_set_col_width(zclk_table_stream* stream,
+		size_t col_id, size_t width);
+
+/**
+ * @brief Set the format the rows are written in, before the first row is
+ * pushed. In a command handler, pass zclk_current_output_format() to
+ * follow the --output option.
+ *
+ * @param stream stream
+ * @param format a zclk_output_format (ZCLK_OUTPUT_TABLE by default)
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_stream_set_format(zclk_table_stream* stream,
+		int format);
+
+/**
+ * @brief Push a row.
+ *
+ * @param stream stream
+ * @param values num_cols values (NULL values are empty)
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_stream_push_row(zclk_table_stream* stream,
+		const char** values);
+
+/**
+ * @brief Write the header and any sampled rows if they are not written yet,
+ * and flush the writer.
+ *
+ * @param stream stream
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_stream_flush(zclk_table_stream* stream);
+
+/**
+ * @brief End the table: flush it and write the trailing blank line.
+ *
+ * @param stream stream
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_table_stream_finish(zclk_table_stream* stream);
+
 #ifdef __cplusplus 
 }
 #endif
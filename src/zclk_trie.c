@@ -0,0 +1,351 @@
+/**
+ * Copyright (c) 2020 Abhishek Mishra
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "zclk_trie.h"
+
+/**
+ * Allocate zeroed memory from the arena of the trie, or from the heap.
+ */
+static void* trie_alloc(zclk_trie* trie, size_t size) {
+	if (trie->arena != NULL) {
+		return zclk_arena_alloc(trie->arena, size);
+	}
+	return calloc(1, size);
+}
+
+/**
+ * Free memory from trie_alloc (memory in an arena stays until it is freed).
+ */
+static void trie_release(zclk_trie* trie, void* ptr) {
+	if (trie->arena == NULL) {
+		free(ptr);
+	}
+}
+
+static zclk_trie_node* trie_node_new(zclk_trie* trie, const char* label,
+		size_t label_len) {
+	zclk_trie_node* node = (zclk_trie_node*) trie_alloc(trie,
+			sizeof(zclk_trie_node));
+	if (node != NULL) {
+		node->label = label;
+		node->label_len = label_len;
+	}
+	return node;
+}
+
+static void trie_node_free(zclk_trie_node* node) {
+	if (node != NULL) {
+		for (size_t i = 0; i < node->num_children; i++) {
+			trie_node_free(node->children[i]);
+		}
+		free(node->children);
+		free(node);
+	}
+}
+
+/**
+ * Binary search the children for the one whose label starts with c.
+ * Returns the position of the child, or the position to insert it at.
+ */
+static size_t trie_child_pos(zclk_trie_node* node, unsigned char c,
+		int* found) {
+	size_t lo = 0, hi = node->num_children;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		unsigned char m = (unsigned char) node->children[mid]->label[0];
+		if (m == c) {
+			*found = 1;
+			return mid;
+		} else if (m < c) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	*found = 0;
+	return lo;
+}
+
+static int trie_child_insert(zclk_trie* trie, zclk_trie_node* node,
+		size_t pos, zclk_trie_node* child) {
+	if (node->num_children == node->cap_children) {
+		size_t cap = node->cap_children == 0 ? 2 : node->cap_children * 2;
+		zclk_trie_node** children;
+		if (trie->arena != NULL) {
+			children = (zclk_trie_node**) zclk_arena_alloc(trie->arena,
+					cap * sizeof(zclk_trie_node*));
+			if (children != NULL && node->num_children > 0) {
+				memcpy(children, node->children,
+						node->num_children * sizeof(zclk_trie_node*));
+			}
+		} else {
+			children = (zclk_trie_node**) realloc(node->children,
+					cap * sizeof(zclk_trie_node*));
+		}
+		if (children == NULL) {
+			return -1;
+		}
+		node->children = children;
+		node->cap_children = cap;
+	}
+	memmove(node->children + pos + 1, node->children + pos,
+			(node->num_children - pos) * sizeof(zclk_trie_node*));
+	node->children[pos] = child;
+	node->num_children += 1;
+	return 0;
+}
+
+/**
+ * Record that a key with the given value lives below the node.
+ */
+static void trie_note_value(zclk_trie_node* node, void* value) {
+	if (!node->ambiguous) {
+		if (node->unique == NULL) {
+			node->unique = value;
+		} else if (node->unique != value) {
+			node->unique = NULL;
+			node->ambiguous = 1;
+		}
+	}
+}
+
+int create_zclk_trie(zclk_trie** trie) {
+	return create_zclk_trie_in(NULL, trie);
+}
+
+int create_zclk_trie_in(zclk_arena* arena, zclk_trie** trie) {
+	if (arena != NULL) {
+		(*trie) = (zclk_trie*) zclk_arena_alloc(arena, sizeof(zclk_trie));
+	} else {
+		(*trie) = (zclk_trie*) calloc(1, sizeof(zclk_trie));
+	}
+	if (!(*trie)) {
+		return -1;
+	}
+	(*trie)->arena = arena;
+	(*trie)->root = trie_node_new(*trie, "", 0);
+	if (!(*trie)->root) {
+		trie_release(*trie, *trie);
+		return -1;
+	}
+	return 0;
+}
+
+void free_zclk_trie(zclk_trie* trie) {
+	// the nodes of a trie in an arena are released with the arena
+	if (trie != NULL && trie->arena == NULL) {
+		trie_node_free(trie->root);
+		free(trie);
+	}
+}
+
+int zclk_trie_put(zclk_trie* trie, const char* key, void* value) {
+	if (key == NULL || value == NULL) {
+		return -1;
+	}
+	zclk_trie_node* node = trie->root;
+	const char* p = key;
+	trie_note_value(node, value);
+	while (1) {
+		if (*p == '\0') {
+			if (!node->terminal) {
+				trie->size += 1;
+			}
+			node->terminal = 1;
+			node->value = value;
+			return 0;
+		}
+
+		int found;
+		size_t pos = trie_child_pos(node, (unsigned char) *p, &found);
+		if (!found) {
+			zclk_trie_node* leaf = trie_node_new(trie, p, strlen(p));
+			if (leaf == NULL || trie_child_insert(trie, node, pos, leaf) != 0) {
+				trie_release(trie, leaf);
+				return -1;
+			}
+			leaf->terminal = 1;
+			leaf->value = value;
+			leaf->unique = value;
+			trie->size += 1;
+			return 0;
+		}
+
+		zclk_trie_node* child = node->children[pos];
+		size_t common = 0;
+		while (common < child->label_len && p[common] != '\0'
+				&& p[common] == child->label[common]) {
+			common++;
+		}
+		if (common < child->label_len) {
+			// split the edge at the end of the common part
+			zclk_trie_node* mid = trie_node_new(trie, child->label, common);
+			if (mid == NULL || trie_child_insert(trie, mid, 0, child) != 0) {
+				trie_release(trie, mid);
+				return -1;
+			}
+			mid->unique = child->unique;
+			mid->ambiguous = child->ambiguous;
+			child->label += common;
+			child->label_len -= common;
+			node->children[pos] = mid;
+			child = mid;
+		}
+		node = child;
+		trie_note_value(node, value);
+		p += common;
+	}
+}
+
+/**
+ * Walk down the trie along the given prefix.
+ * Returns the node at or just below the end of the prefix, or NULL if no
+ * key starts with the prefix. *exact is set if the prefix ends exactly at
+ * the end of the label of the returned node, and *base_len is set to the
+ * length of the part of the prefix above the label of the node.
+ */
+static zclk_trie_node* trie_walk(zclk_trie* trie, const char* prefix,
+		size_t* base_len, int* exact) {
+	zclk_trie_node* node = trie->root;
+	const char* p = prefix;
+	*exact = 1;
+	*base_len = 0;
+	while (*p != '\0') {
+		int found;
+		size_t pos = trie_child_pos(node, (unsigned char) *p, &found);
+		if (!found) {
+			return NULL;
+		}
+		zclk_trie_node* child = node->children[pos];
+		size_t i = 0;
+		while (i < child->label_len && p[i] != '\0') {
+			if (p[i] != child->label[i]) {
+				return NULL;
+			}
+			i++;
+		}
+		*base_len = (size_t) (p - prefix);
+		p += i;
+		node = child;
+		if (i < child->label_len) {
+			// the prefix ends inside the label of the child
+			*exact = 0;
+			break;
+		}
+	}
+	return node;
+}
+
+void* zclk_trie_get(zclk_trie* trie, const char* key) {
+	size_t base_len;
+	int exact;
+	if (trie == NULL || key == NULL) {
+		return NULL;
+	}
+	zclk_trie_node* node = trie_walk(trie, key, &base_len, &exact);
+	if (node != NULL && exact && node->terminal) {
+		return node->value;
+	}
+	return NULL;
+}
+
+void* zclk_trie_get_prefix(zclk_trie* trie, const char* prefix,
+		int* ambiguous) {
+	size_t base_len;
+	int exact;
+	if (ambiguous != NULL) {
+		*ambiguous = 0;
+	}
+	if (trie == NULL || prefix == NULL) {
+		return NULL;
+	}
+	zclk_trie_node* node = trie_walk(trie, prefix, &base_len, &exact);
+	if (node == NULL) {
+		return NULL;
+	}
+	if (exact && node->terminal) {
+		return node->value;
+	}
+	if (node->ambiguous) {
+		if (ambiguous != NULL) {
+			*ambiguous = 1;
+		}
+		return NULL;
+	}
+	return node->unique;
+}
+
+typedef struct trie_key_buf_t {
+	char* data;
+	size_t len;
+	size_t cap;
+} trie_key_buf;
+
+static int trie_key_append(trie_key_buf* buf, const char* s, size_t len) {
+	if (buf->len + len + 1 > buf->cap) {
+		size_t cap = buf->cap == 0 ? 64 : buf->cap;
+		while (buf->len + len + 1 > cap) {
+			cap *= 2;
+		}
+		char* data = (char*) realloc(buf->data, cap);
+		if (data == NULL) {
+			return -1;
+		}
+		buf->data = data;
+		buf->cap = cap;
+	}
+	memcpy(buf->data + buf->len, s, len);
+	buf->len += len;
+	buf->data[buf->len] = '\0';
+	return 0;
+}
+
+static size_t trie_visit(zclk_trie_node* node, trie_key_buf* buf,
+		zclk_trie_visit_fn fn, void* ctx) {
+	size_t count = 0;
+	if (node->terminal) {
+		fn(buf->data, buf->len, node->value, ctx);
+		count += 1;
+	}
+	for (size_t i = 0; i < node->num_children; i++) {
+		zclk_trie_node* child = node->children[i];
+		size_t len = buf->len;
+		if (trie_key_append(buf, child->label, child->label_len) != 0) {
+			return count;
+		}
+		count += trie_visit(child, buf, fn, ctx);
+		buf->len = len;
+		buf->data[len] = '\0';
+	}
+	return count;
+}
+
+size_t zclk_trie_foreach_prefix(zclk_trie* trie, const char* prefix,
+		zclk_trie_visit_fn fn, void* ctx) {
+	size_t base_len;
+	int exact;
+	if (trie == NULL || prefix == NULL || fn == NULL) {
+		return 0;
+	}
+	zclk_trie_node* node = trie_walk(trie, prefix, &base_len, &exact);
+	if (node == NULL) {
+		return 0;
+	}
+
+	// the key of the node is the prefix above it plus its whole label
+	trie_key_buf buf = { NULL, 0, 0 };
+	if (trie_key_append(&buf, prefix, base_len) != 0
+			|| trie_key_append(&buf, node->label, node->label_len) != 0) {
+		free(buf.data);
+		return 0;
+	}
+	size_t count = trie_visit(node, &buf, fn, ctx);
+	free(buf.data);
+	return count;
+}
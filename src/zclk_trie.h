@@ -0,0 +1,128 @@
+// Copyright (c) 2020 Abhishek Mishra
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+/**
+ * \file zclk_trie.h
+ * \brief A radix trie mapping names to values, with prefix lookup.
+ *
+ * The trie does not copy its keys, edge labels point into the key
+ * strings passed to zclk_trie_put, which must outlive the trie.
+ *
+ * A trie created in an arena allocates its nodes from the arena, and is
+ * released with it.
+ */
+
+#ifndef SRC_ZCLK_TRIE_H_
+#define SRC_ZCLK_TRIE_H_
+
+#include "zclk_common.h"
+#include "zclk_arena.h"
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief A node of the radix trie.
+ */
+typedef struct zclk_trie_node_t {
+	const char* label;		///< edge label (points into a key)
+	size_t label_len;		///< length of the edge label
+	int terminal;			///< flag indicating a key ends at this node
+	void* value;			///< value of the key ending at this node
+	void* unique;			///< value shared by all keys below, or NULL
+	int ambiguous;			///< flag indicating keys below differ in value
+	size_t num_children;	///< number of children
+	size_t cap_children;	///< capacity of the children array
+	struct zclk_trie_node_t** children;	///< children sorted by first char
+} zclk_trie_node;
+
+/**
+ * @brief A radix trie.
+ */
+typedef struct zclk_trie_t {
+	zclk_trie_node* root;	///< root node (empty label)
+	size_t size;			///< number of keys
+	zclk_arena* arena;		///< arena the nodes are allocated in, or NULL
+} zclk_trie;
+
+/**
+ * @brief Function called for every key visited by zclk_trie_foreach_prefix.
+ *
+ * The key is passed as a buffer which is only valid during the call.
+ */
+typedef void (*zclk_trie_visit_fn)(const char* key, size_t key_len,
+	void* value, void* ctx);
+
+MODULE_API int create_zclk_trie(zclk_trie** trie);
+
+/**
+ * @brief Create a trie in the given arena.
+ *
+ * @param arena arena to allocate from (NULL to use the heap)
+ * @param trie trie to create
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int create_zclk_trie_in(zclk_arena* arena, zclk_trie** trie);
+
+/**
+ * @brief Free a trie (does nothing for a trie in an arena).
+ *
+ * @param trie trie
+ */
+MODULE_API void free_zclk_trie(zclk_trie* trie);
+
+/**
+ * @brief Add a key to the trie, replacing the value if it exists.
+ *
+ * @param trie trie
+ * @param key key (not copied, must outlive the trie)
+ * @param value value (must not be NULL)
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_trie_put(zclk_trie* trie, const char* key, void* value);
+
+/**
+ * @brief Get the value of the given key in O(length of key).
+ *
+ * @param trie trie
+ * @param key key
+ * @return value, or NULL if the key is not in the trie
+ */
+MODULE_API void* zclk_trie_get(zclk_trie* trie, const char* key);
+
+/**
+ * @brief Get the value of the only key which starts with the given prefix.
+ *
+ * An exact match is always returned. Otherwise the prefix resolves if all
+ * keys that start with it map to the same value (for e.g. a name and a
+ * short name of the same command).
+ *
+ * @param trie trie
+ * @param prefix prefix
+ * @param ambiguous set to 1 if more than one value matches (can be NULL)
+ * @return value, or NULL if no value or more than one value matches
+ */
+MODULE_API void* zclk_trie_get_prefix(zclk_trie* trie, const char* prefix,
+	int* ambiguous);
+
+/**
+ * @brief Visit all keys which start with the given prefix in sorted order.
+ *
+ * @param trie trie
+ * @param prefix prefix (empty string to visit all keys)
+ * @param fn function called for every key
+ * @param ctx context passed to fn
+ * @return number of keys visited
+ */
+MODULE_API size_t zclk_trie_foreach_prefix(zclk_trie* trie, const char* prefix,
+	zclk_trie_visit_fn fn, void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_ZCLK_TRIE_H_ */
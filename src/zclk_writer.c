@@ -0,0 +1,337 @@
+/**
+ * Copyright (c) 2020 Abhishek Mishra
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+#include "zclk_writer.h"
+
+static ZCLK_THREAD_LOCAL char stdout_buf[ZCLK_WRITER_STDOUT_BUFFER_SIZE];
+static ZCLK_THREAD_LOCAL zclk_writer stdout_writer;
+
+static int writer_create(zclk_writer** writer, zclk_writer_type type,
+		size_t cap) {
+	(*writer) = (zclk_writer*) calloc(1, sizeof(zclk_writer));
+	if (!(*writer)) {
+		return -1;
+	}
+	(*writer)->buf = (char*) malloc(cap);
+	if (!(*writer)->buf) {
+		free(*writer);
+		(*writer) = NULL;
+		return -1;
+	}
+	(*writer)->type = type;
+	(*writer)->cap = cap;
+	(*writer)->owns_buf = 1;
+	(*writer)->fd = -1;
+	return 0;
+}
+
+int create_zclk_writer_file(zclk_writer** writer, FILE* file) {
+	if (writer_create(writer, ZCLK_WRITER_FILE, ZCLK_WRITER_BUFFER_SIZE)
+			!= 0) {
+		return -1;
+	}
+	(*writer)->file = file;
+	return 0;
+}
+
+int create_zclk_writer_fd(zclk_writer** writer, int fd) {
+	if (writer_create(writer, ZCLK_WRITER_FD, ZCLK_WRITER_BUFFER_SIZE) != 0) {
+		return -1;
+	}
+	(*writer)->fd = fd;
+	return 0;
+}
+
+int create_zclk_writer_memory(zclk_writer** writer) {
+	if (writer_create(writer, ZCLK_WRITER_MEMORY, 256) != 0) {
+		return -1;
+	}
+	(*writer)->buf[0] = '\0';
+	return 0;
+}
+
+void free_zclk_writer(zclk_writer* writer) {
+	if (writer != NULL) {
+		zclk_writer_flush(writer);
+		if (writer->owns_buf) {
+			free(writer->buf);
+		}
+		free(writer);
+	}
+}
+
+zclk_writer* zclk_stdout_writer() {
+	if (stdout_writer.buf == NULL) {
+		stdout_writer.type = ZCLK_WRITER_FILE;
+		stdout_writer.file = stdout;
+		stdout_writer.fd = -1;
+		stdout_writer.buf = stdout_buf;
+		stdout_writer.cap = ZCLK_WRITER_STDOUT_BUFFER_SIZE;
+	}
+	return &stdout_writer;
+}
+
+/**
+ * Write all of a, then all of b to the descriptor, with as few system
+ * calls as the kernel allows.
+ */
+static int fd_write2(int fd, const char* a, size_t alen, const char* b,
+		size_t blen) {
+#ifdef _WIN32
+	const char* parts[2] = { a, b };
+	size_t lens[2] = { alen, blen };
+	for (int p = 0; p < 2; p++) {
+		while (lens[p] > 0) {
+			unsigned int chunk = lens[p] > 0x40000000 ? 0x40000000
+					: (unsigned int) lens[p];
+			int n = _write(fd, parts[p], chunk);
+			if (n < 0) {
+				return -1;
+			}
+			parts[p] += n;
+			lens[p] -= (size_t) n;
+		}
+	}
+	return 0;
+#else
+	struct iovec iov[2];
+	iov[0].iov_base = (void*) a;
+	iov[0].iov_len = alen;
+	iov[1].iov_base = (void*) b;
+	iov[1].iov_len = blen;
+	struct iovec* v = iov;
+	int cnt = 2;
+	while (cnt > 0) {
+		if (v->iov_len == 0) {
+			v++;
+			cnt--;
+			continue;
+		}
+		ssize_t n = writev(fd, v, cnt);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		while (cnt > 0 && (size_t) n >= v->iov_len) {
+			n -= (ssize_t) v->iov_len;
+			v++;
+			cnt--;
+		}
+		if (cnt > 0) {
+			v->iov_base = (char*) v->iov_base + n;
+			v->iov_len -= (size_t) n;
+		}
+	}
+	return 0;
+#endif
+}
+
+/**
+ * Hand the buffer followed by extra bytes to the sink, and empty the
+ * buffer.
+ */
+static int writer_emit(zclk_writer* writer, const char* extra, size_t len) {
+	int res = 0;
+	if (writer->type == ZCLK_WRITER_FILE) {
+		if ((writer->len > 0
+				&& fwrite(writer->buf, 1, writer->len, writer->file)
+						!= writer->len)
+				|| (len > 0 && fwrite(extra, 1, len, writer->file) != len)) {
+			res = -1;
+		}
+	} else {
+		res = fd_write2(writer->fd, writer->buf, writer->len, extra, len);
+	}
+	writer->len = 0;
+	if (res != 0) {
+		writer->error = 1;
+	}
+	return res;
+}
+
+/**
+ * Make room for n more bytes in the buffer (plus a NUL for memory
+ * writers), flushing or growing it. Fails if a flushed buffer is too
+ * small.
+ */
+static int writer_reserve(zclk_writer* writer, size_t n) {
+	if (writer->type == ZCLK_WRITER_MEMORY) {
+		if (writer->cap - writer->len > n) {
+			return 0;
+		}
+		size_t cap = writer->cap;
+		while (cap - writer->len <= n) {
+			cap *= 2;
+		}
+		char* buf = (char*) realloc(writer->buf, cap);
+		if (buf == NULL) {
+			writer->error = 1;
+			return -1;
+		}
+		writer->buf = buf;
+		writer->cap = cap;
+		return 0;
+	}
+	if (writer->cap - writer->len >= n) {
+		return 0;
+	}
+	if (writer_emit(writer, NULL, 0) != 0) {
+		return -1;
+	}
+	return writer->cap >= n ? 0 : -1;
+}
+
+int zclk_writer_write(zclk_writer* writer, const char* data, size_t len) {
+	if (writer == NULL || (data == NULL && len > 0)) {
+		return -1;
+	}
+	if (writer->type != ZCLK_WRITER_MEMORY
+			&& len > writer->cap - writer->len) {
+		if (len >= writer->cap) {
+			// too big to buffer, written along with the buffer in one call
+			return writer_emit(writer, data, len);
+		}
+		if (writer_emit(writer, NULL, 0) != 0) {
+			return -1;
+		}
+	} else if (writer_reserve(writer, len) != 0) {
+		return -1;
+	}
+	memcpy(writer->buf + writer->len, data, len);
+	writer->len += len;
+	if (writer->type == ZCLK_WRITER_MEMORY) {
+		writer->buf[writer->len] = '\0';
+	}
+	return 0;
+}
+
+int zclk_writer_puts(zclk_writer* writer, const char* str) {
+	if (str == NULL) {
+		return 0;
+	}
+	return zclk_writer_write(writer, str, strlen(str));
+}
+
+int zclk_writer_putc(zclk_writer* writer, char c) {
+	if (writer != NULL && writer->type != ZCLK_WRITER_MEMORY
+			&& writer->len < writer->cap) {
+		writer->buf[writer->len++] = c;
+		return 0;
+	}
+	return zclk_writer_write(writer, &c, 1);
+}
+
+int zclk_writer_fill(zclk_writer* writer, char c, size_t n) {
+	if (writer == NULL) {
+		return -1;
+	}
+	while (n > 0) {
+		size_t chunk = n;
+		if (writer->type != ZCLK_WRITER_MEMORY) {
+			if (writer->len == writer->cap
+					&& writer_emit(writer, NULL, 0) != 0) {
+				return -1;
+			}
+			if (chunk > writer->cap - writer->len) {
+				chunk = writer->cap - writer->len;
+			}
+		} else if (writer_reserve(writer, chunk) != 0) {
+			return -1;
+		}
+		memset(writer->buf + writer->len, c, chunk);
+		writer->len += chunk;
+		n -= chunk;
+	}
+	if (writer->type == ZCLK_WRITER_MEMORY) {
+		writer->buf[writer->len] = '\0';
+	}
+	return 0;
+}
+
+int zclk_writer_printf(zclk_writer* writer, const char* fmt, ...) {
+	if (writer == NULL || fmt == NULL) {
+		return -1;
+	}
+	va_list args;
+	va_start(args, fmt);
+	size_t room = writer->cap - writer->len;
+	int n = vsnprintf(writer->buf + writer->len, room, fmt, args);
+	va_end(args);
+	if (n < 0) {
+		return -1;
+	}
+	if ((size_t) n < room) {
+		writer->len += (size_t) n;
+		return 0;
+	}
+
+	if (writer_reserve(writer, (size_t) n + 1) == 0) {
+		va_start(args, fmt);
+		vsnprintf(writer->buf + writer->len, writer->cap - writer->len, fmt,
+				args);
+		va_end(args);
+		writer->len += (size_t) n;
+		return 0;
+	}
+
+	// larger than the buffer of a FILE/fd writer
+	char* tmp = (char*) malloc((size_t) n + 1);
+	if (tmp == NULL) {
+		return -1;
+	}
+	va_start(args, fmt);
+	vsnprintf(tmp, (size_t) n + 1, fmt, args);
+	va_end(args);
+	int res = zclk_writer_write(writer, tmp, (size_t) n);
+	free(tmp);
+	return res;
+}
+
+int zclk_writer_flush(zclk_writer* writer) {
+	if (writer == NULL) {
+		return -1;
+	}
+	if (writer->type == ZCLK_WRITER_MEMORY) {
+		return 0;
+	}
+	int res = writer->len > 0 ? writer_emit(writer, NULL, 0) : 0;
+	if (writer->type == ZCLK_WRITER_FILE && fflush(writer->file) != 0) {
+		res = -1;
+	}
+	return res;
+}
+
+const char* zclk_writer_get_data(zclk_writer* writer, size_t* len) {
+	if (writer == NULL || writer->type != ZCLK_WRITER_MEMORY) {
+		return NULL;
+	}
+	if (len != NULL) {
+		(*len) = writer->len;
+	}
+	return writer->buf;
+}
+
+void zclk_writer_clear(zclk_writer* writer) {
+	if (writer != NULL) {
+		writer->len = 0;
+		if (writer->type == ZCLK_WRITER_MEMORY) {
+			writer->buf[0] = '\0';
+		}
+	}
+}
@@ -0,0 +1,174 @@
+// Copyright (c) 2020 Abhishek Mishra
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+/**
+ * \file zclk_writer.h
+ * \brief Buffered output sinks used to render command results.
+ *
+ * A writer collects output in a large buffer and hands it to its sink
+ * (a FILE*, a file descriptor or memory) in as few calls as possible.
+ * A writer must not be used by more than one thread at a time.
+ */
+
+#ifndef SRC_ZCLK_WRITER_H_
+#define SRC_ZCLK_WRITER_H_
+
+#include "zclk_common.h"
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Size of the buffer of FILE and fd writers */
+#define ZCLK_WRITER_BUFFER_SIZE (64 * 1024)
+
+/** Size of the buffer of the per-thread stdout writer */
+#define ZCLK_WRITER_STDOUT_BUFFER_SIZE (16 * 1024)
+
+/**
+ * @brief Kinds of sinks.
+ */
+typedef enum {
+	ZCLK_WRITER_FILE = 0,		///< stdio stream
+	ZCLK_WRITER_FD = 1,			///< file descriptor, written with writev
+	ZCLK_WRITER_MEMORY = 2		///< growable in-memory buffer
+} zclk_writer_type;
+
+/**
+ * @brief A buffered output sink.
+ */
+typedef struct zclk_writer_t {
+	zclk_writer_type type;	///< kind of sink
+	FILE* file;				///< stream of a FILE writer
+	int fd;					///< descriptor of an fd writer
+	char* buf;				///< buffered output (contents of a memory writer)
+	size_t len;				///< bytes in the buffer
+	size_t cap;				///< size of the buffer
+	int owns_buf;			///< buffer is freed with the writer
+	int error;				///< a write to the sink failed
+} zclk_writer;
+
+/**
+ * @brief Create a writer to a stdio stream (which is not closed on free).
+ *
+ * @param writer writer to create
+ * @param file stream
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int create_zclk_writer_file(zclk_writer** writer, FILE* file);
+
+/**
+ * @brief Create a writer to a file descriptor (which is not closed on
+ * free).
+ *
+ * @param writer writer to create
+ * @param fd file descriptor
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int create_zclk_writer_fd(zclk_writer** writer, int fd);
+
+/**
+ * @brief Create a writer which keeps all output in memory.
+ *
+ * @param writer writer to create
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int create_zclk_writer_memory(zclk_writer** writer);
+
+/**
+ * @brief Flush and free a writer.
+ *
+ * @param writer writer
+ */
+MODULE_API void free_zclk_writer(zclk_writer* writer);
+
+/**
+ * @brief Get the writer to stdout of the calling thread.
+ *
+ * @return stdout writer
+ */
+MODULE_API zclk_writer* zclk_stdout_writer();
+
+/**
+ * @brief Write bytes.
+ *
+ * @param writer writer
+ * @param data bytes to write
+ * @param len number of bytes
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_writer_write(zclk_writer* writer, const char* data,
+	size_t len);
+
+/**
+ * @brief Write a string.
+ *
+ * @param writer writer
+ * @param str string to write (nothing is written for NULL)
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_writer_puts(zclk_writer* writer, const char* str);
+
+/**
+ * @brief Write a character.
+ *
+ * @param writer writer
+ * @param c character
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_writer_putc(zclk_writer* writer, char c);
+
+/**
+ * @brief Write a character n times, for e.g. padding and rules.
+ *
+ * @param writer writer
+ * @param c character
+ * @param n number of times
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_writer_fill(zclk_writer* writer, char c, size_t n);
+
+/**
+ * @brief Write formatted output, formatted straight into the buffer.
+ *
+ * @param writer writer
+ * @param fmt printf format
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_writer_printf(zclk_writer* writer, const char* fmt, ...);
+
+/**
+ * @brief Hand the buffered output to the sink.
+ * (Does nothing for a memory writer.)
+ *
+ * @param writer writer
+ * @return 0 on success, -1 on error
+ */
+MODULE_API int zclk_writer_flush(zclk_writer* writer);
+
+/**
+ * @brief Get the output of a memory writer.
+ *
+ * @param writer memory writer
+ * @param len number of bytes written (can be NULL)
+ * @return NUL terminated output, or NULL if not a memory writer
+ */
+MODULE_API const char* zclk_writer_get_data(zclk_writer* writer, size_t* len);
+
+/**
+ * @brief Discard the output of a memory writer (or the unflushed output of
+ * any other writer).
+ *
+ * @param writer writer
+ */
+MODULE_API void zclk_writer_clear(zclk_writer* writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_ZCLK_WRITER_H_ */